@@ -181,6 +181,21 @@ RemixTempo remix_set_tempo (RemixEnv * env, RemixTempo tempo);
 RemixTempo remix_get_tempo (RemixEnv * env);
 CDSet * remix_set_channels (RemixEnv * env, CDSet * channelset);
 CDSet * remix_get_channels (RemixEnv * env);
+int remix_set_threads (RemixEnv * env, int nr_threads);
+int remix_get_threads (RemixEnv * env);
+RemixCount remix_set_read_ahead (RemixEnv * env, RemixCount frames);
+RemixCount remix_get_read_ahead (RemixEnv * env);
+size_t remix_set_cache_size (RemixEnv * env, size_t size);
+size_t remix_get_cache_size (RemixEnv * env);
+
+/* Live edits */
+typedef void (*RemixCommandFunc) (RemixEnv * env, void * data);
+
+int remix_post (RemixEnv * env, RemixEnv * target, RemixCommandFunc func,
+		void * data);
+int remix_drain (RemixEnv * env);
+int remix_retire (RemixEnv * env, RemixBase * base);
+int remix_reclaim (RemixEnv * env, RemixEnv * target);
 
 #if 0
   /* XXX */
@@ -215,6 +230,9 @@ RemixCount remix_length (RemixEnv * env, RemixBase * base);
 RemixCount remix_seek (RemixEnv * env, RemixBase * base, RemixCount offset, int whence);
 RemixCount remix_tell (RemixEnv * env, RemixBase * base);
 int remix_flush (RemixEnv * env, RemixBase * base);
+RemixBase * remix_cursor_new (RemixEnv * env, RemixBase * source);
+int remix_cursor_destroy (RemixEnv * env, RemixBase * source,
+			  RemixBase * cursor);
 
 RemixCount remix_set_mixlength (RemixEnv * env, RemixCount mixlength);
 RemixCount remix_get_mixlength (RemixEnv * env);
@@ -243,6 +261,44 @@ float remix_squaretone_get_frequency (RemixEnv * env,
 /* Monitor */
 RemixMonitor * remix_monitor_new (RemixEnv * env);
 
+/* Output conversion */
+RemixConverter * remix_converter_new (RemixEnv * env, RemixSampleFormat format,
+				      RemixDither dither, int nr_channels);
+void remix_converter_destroy (RemixEnv * env, RemixConverter * converter);
+RemixCount remix_convert_interleaved (RemixEnv * env,
+				      RemixConverter * converter,
+				      RemixPCM * src, void * dest,
+				      RemixCount count);
+RemixCount remix_convert_planar (RemixEnv * env, RemixConverter * converter,
+				 RemixPCM ** srcs, void * dest,
+				 RemixCount count);
+
+/* Playback */
+RemixPlayback * remix_playback_new (RemixEnv * env, RemixBase * source,
+				    char * device);
+RemixPlayback * remix_playback_new_file (RemixEnv * env, RemixBase * source,
+					 int fd, double speed);
+RemixCount remix_playback_set_buffer_length (RemixEnv * env,
+					     RemixPlayback * playback,
+					     RemixCount length);
+RemixCount remix_playback_get_buffer_length (RemixEnv * env,
+					     RemixPlayback * playback);
+RemixDither remix_playback_set_dither (RemixEnv * env,
+				       RemixPlayback * playback,
+				       RemixDither dither);
+RemixDither remix_playback_get_dither (RemixEnv * env,
+				       RemixPlayback * playback);
+int remix_playback_start (RemixEnv * env, RemixPlayback * playback);
+int remix_playback_stop (RemixEnv * env, RemixPlayback * playback);
+int remix_playback_is_playing (RemixEnv * env, RemixPlayback * playback);
+RemixEnv * remix_playback_get_env (RemixEnv * env, RemixPlayback * playback);
+RemixCount remix_playback_get_xruns (RemixEnv * env, RemixPlayback * playback);
+RemixCount remix_playback_get_fill (RemixEnv * env, RemixPlayback * playback);
+RemixCount remix_playback_get_latency (RemixEnv * env,
+				       RemixPlayback * playback);
+RemixCount remix_playback_get_played (RemixEnv * env,
+				      RemixPlayback * playback);
+
 /* Scrubby */
 RemixBase * remix_scrubby_new (RemixEnv * env);
 RemixBase * remix_scrubby_set_source (RemixEnv * env, RemixBase * scrubby,
@@ -90,6 +90,9 @@ RemixDeck * remix_layer_get_deck (RemixEnv * env, RemixLayer * layer);
 RemixTimeType remix_layer_set_timetype (RemixEnv * env, RemixLayer * layer,
 				  RemixTimeType new_type);
 RemixTimeType remix_layer_get_timetype (RemixEnv * env, RemixLayer * layer);
+int remix_layer_add_sounds (RemixEnv * env, RemixLayer * layer,
+			    RemixBase ** sources, RemixTime * start_times,
+			    RemixTime * durations, int n);
 RemixSound * remix_layer_get_sound_before (RemixEnv * env, RemixLayer * layer,
 				     RemixTime time);
 RemixSound * remix_layer_get_sound_at (RemixEnv * env, RemixLayer * layer, RemixTime time);
@@ -124,6 +127,11 @@ RemixTime remix_sound_get_duration (RemixEnv * env, RemixSound * sound);
 RemixBase * remix_sound_set_rate_envelope (RemixEnv * env, RemixSound * sound,
 					   RemixBase * rate_envelope);
 RemixBase * remix_sound_get_rate_envelope (RemixEnv * env, RemixSound * sound);
+RemixResampleQuality remix_sound_set_rate_quality (RemixEnv * env,
+						   RemixSound * sound,
+						   RemixResampleQuality quality);
+RemixResampleQuality remix_sound_get_rate_quality (RemixEnv * env,
+						   RemixSound * sound);
 RemixBase * remix_sound_set_gain_envelope (RemixEnv * env, RemixSound * sound,
 					   RemixBase * gain_envelope);
 RemixBase * remix_sound_get_gain_envelope (RemixEnv * env, RemixSound * sound);
@@ -38,6 +38,9 @@
  * The information describing how a parameter changes over time appears
  * as a generic data source. In order to create this mix automation information
  * Remix provides linear and spline envelopes.
+ * Linear envelopes continue their first and last segments beyond their
+ * points. Spline envelopes are monotone cubic (Hermite) splines, which
+ * never overshoot their points, and hold their end values beyond them.
  * However, parameters could alternatively be controlled by other means such
  * as from a recording of physical slider values, from a sine wave
  * generator, or from a deck constructed solely to generate interesting
@@ -77,6 +80,13 @@ RemixEnvelope * remix_envelope_scale (RemixEnv * env, RemixEnvelope * envelope,
 				      RemixPCM gain);
 RemixEnvelope * remix_envelope_shift (RemixEnv * env, RemixEnvelope * envelope,
 				      RemixTime delta);
+RemixCount remix_envelope_mult (RemixEnv * env, RemixBase * envelope,
+				RemixStream * dest, RemixCount count);
+RemixCount remix_envelope_fade (RemixEnv * env, RemixBase * envelope,
+				RemixStream * dest, RemixCount count);
+RemixCount remix_envelope_blend (RemixEnv * env, RemixBase * envelope,
+				 RemixStream * src, RemixStream * dest,
+				 RemixCount count);
 
 #if defined(__cplusplus)
 }
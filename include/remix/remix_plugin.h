@@ -38,7 +38,7 @@
 #include "ctxdata.h"
 
 #define REMIX_PLUGIN_API_MAJOR 1
-#define REMIX_PLUGIN_API_MINOR 0
+#define REMIX_PLUGIN_API_MINOR 1
 #define REMIX_PLUGIN_API_REVISION 0
 
 typedef struct _RemixMetaAuthor RemixMetaAuthor;
@@ -51,7 +51,7 @@ typedef struct _RemixNamedParameter RemixNamedParameter;
 
 typedef union _RemixConstraint RemixConstraint;
 
-typedef struct _RemixMethods RemixMethods;;
+typedef struct _RemixMethods RemixMethods;
 
 #define REMIX_PLUGIN_WRITEABLE 1<<0
 #define REMIX_PLUGIN_SEEKABLE  1<<1
@@ -63,6 +63,8 @@ typedef struct _RemixPlugin RemixPlugin;
 /*typedef struct _RemixBase * RemixBase;*/
 
 typedef struct _RemixChunk RemixChunk;
+typedef struct _RemixStreamExpr RemixStreamExpr;
+typedef struct _RemixStreamExprOp RemixStreamExprOp;
 
 #if defined (__REMIX__)
 #include "remix_private.h"
@@ -78,6 +80,8 @@ typedef RemixOpaque RemixLayer;
 typedef RemixOpaque RemixSound;
 typedef RemixOpaque RemixSquareTone;
 typedef RemixOpaque RemixMonitor;
+typedef RemixOpaque RemixPlayback;
+typedef RemixOpaque RemixConverter;
 #endif
 
 
@@ -103,6 +107,7 @@ typedef RemixCount (*RemixProcessFunc) (RemixEnv * env, RemixBase * base,
 					RemixStream * input,
 					RemixStream * output);
 typedef int (*RemixFlushFunc) (RemixEnv * env, RemixBase * base);
+typedef RemixBase * (*RemixCursorFunc) (RemixEnv * env, RemixBase * base);
 
 #define REMIX_FLAGS_NONE (0)
 
@@ -200,6 +205,7 @@ struct _RemixMethods {
   RemixLengthFunc length;
   RemixSeekFunc seek;
   RemixFlushFunc flush;
+  RemixCursorFunc cursor; /* optional; see remix_cursor_new() */
 };
 
 
@@ -207,6 +213,45 @@ struct _RemixChunk {
   RemixCount start_index;
   RemixCount length;
   RemixPCM * data;
+  int * _refcount; /* shared with clones, or NULL if data is unshared */
+  int _silent; /* all zero, whatever data holds; cleared before funcs */
+  int _pooled; /* data is from the world's chunk pool */
+};
+
+/*
+ * The data of chunks made by remix_chunk_new() starts on a multiple of
+ * REMIX_CHUNK_ALIGNMENT bytes, so a chunk's samples from index i are
+ * aligned wherever i * sizeof (RemixPCM) is a multiple of it.
+ */
+#define REMIX_CHUNK_ALIGNMENT 64
+
+/*
+ * A stream expression records operations on a destination stream, each
+ * reading the expression's 'src' stream or an envelope, and applies them
+ * all in one pass when evaluated. It lives on the caller's stack; build
+ * it with remix_stream_expr_init() and the remix_stream_expr_*()
+ * operations rather than by hand.
+ */
+#define REMIX_STREAM_EXPR_MAX_OPS 4
+
+typedef enum {
+  REMIX_STREAM_EXPR_COPY = 0, /* dest = src */
+  REMIX_STREAM_EXPR_MULT,     /* dest = dest * envelope */
+  REMIX_STREAM_EXPR_FADE,     /* dest = dest * (1 - envelope) */
+  REMIX_STREAM_EXPR_BLEND     /* dest = dest * envelope + src * (1 - envelope) */
+} RemixStreamExprOpType;
+
+struct _RemixStreamExprOp {
+  RemixStreamExprOpType type;
+  RemixEnvelope * envelope; /* RemixNone for REMIX_STREAM_EXPR_COPY */
+};
+
+struct _RemixStreamExpr {
+  RemixStream * src;
+  int nr_ops;
+  RemixStreamExprOp ops[REMIX_STREAM_EXPR_MAX_OPS];
+  RemixCount _dest_offset; /* of dest when evaluation began */
+  int _fused; /* index of the fused kernel for the ops, or -1 */
 };
 
 
@@ -276,6 +321,19 @@ RemixCount remix_stream_chunkchunkchunkfuncify (RemixEnv * env,
 						RemixChunkChunkChunkFunc func,
 						void * data);
 
+/* remix_expr */
+void remix_stream_expr_init (RemixEnv * env, RemixStreamExpr * expr,
+			     RemixStream * src);
+int remix_stream_expr_copy (RemixEnv * env, RemixStreamExpr * expr);
+int remix_stream_expr_mult (RemixEnv * env, RemixStreamExpr * expr,
+			    RemixBase * envelope);
+int remix_stream_expr_fade (RemixEnv * env, RemixStreamExpr * expr,
+			    RemixBase * envelope);
+int remix_stream_expr_blend (RemixEnv * env, RemixStreamExpr * expr,
+			     RemixBase * envelope);
+RemixCount remix_stream_expr_evaluate (RemixEnv * env, RemixStreamExpr * expr,
+				       RemixStream * dest, RemixCount count);
+
 /* RemixChannel */
 RemixChunk * remix_channel_get_chunk_at (RemixEnv * env,
 					 RemixChannel * channel,
@@ -297,11 +355,33 @@ RemixCount remix_channel_chunkchunkchunkfuncify (RemixEnv * env,
 						 RemixCount count,
 						 RemixChunkChunkChunkFunc func,
 						 int channelname, void * data);
+/* RemixDeck */
+
+unsigned int _remix_deck_nr_shared_walks (RemixEnv * env, RemixDeck * deck);
+
 /* RemixPCM */
 
+int _remix_pcm_set_kernels (const char * name);
 RemixCount _remix_pcm_clear_region (RemixPCM * data, RemixCount count,
 				    void * unused);
 RemixCount _remix_pcm_set (RemixPCM * data, RemixPCM value, RemixCount count);
+RemixCount _remix_pcm_ramp (RemixPCM * data, RemixPCM value,
+			    RemixPCM gradient, RemixCount count);
+RemixCount _remix_pcm_cubic (RemixPCM * data, RemixPCM * coeffs, RemixPCM s,
+			     RemixPCM ds, RemixCount count);
+RemixCount _remix_pcm_mult_cubic (RemixPCM * data, RemixPCM * coeffs,
+				  RemixPCM s, RemixPCM ds, RemixCount count);
+RemixCount _remix_pcm_blend_cubic (RemixPCM * src, RemixPCM * dest,
+				   RemixPCM * coeffs, RemixPCM s, RemixPCM ds,
+				   RemixCount count);
+RemixCount _remix_pcm_copy_mult_cubic (RemixPCM * src, RemixPCM * dest,
+				       RemixPCM * coeffs, RemixPCM s,
+				       RemixPCM ds, RemixCount count);
+RemixCount _remix_pcm_mult_blend_cubic (RemixPCM * src, RemixPCM * dest,
+					RemixPCM * gain, RemixPCM gs,
+					RemixPCM gds, RemixPCM * blend,
+					RemixPCM bs, RemixPCM bds,
+					RemixCount count);
 RemixCount _remix_pcm_gain (RemixPCM * data, RemixCount count,
 			    /* (RemixPCM *) */ void * gain);
 RemixCount _remix_pcm_copy (RemixPCM * src, RemixPCM * dest, RemixCount count,
@@ -316,8 +396,27 @@ RemixCount _remix_pcm_interleave_2 (RemixPCM * src1, RemixPCM * src2,
 				    RemixCount count, void * data);
 RemixCount _remix_pcm_deinterleave_2 (RemixPCM * dest1, RemixPCM * dest2,
 				      RemixCount count, void * data);
+RemixCount _remix_pcm_interleave (RemixPCM ** srcs, int nr_channels,
+				  RemixCount count, RemixPCM * dest);
+RemixCount _remix_pcm_deinterleave (RemixPCM ** dests, int nr_channels,
+				    RemixCount count, RemixPCM * src);
 RemixCount _remix_pcm_blend (RemixPCM * src, RemixPCM * blend, RemixPCM * dest,
 			     RemixCount count, void * unused);
+RemixCount _remix_pcm_mix_gains (RemixPCM ** srcs, RemixPCM * gains,
+				 int nr_srcs, RemixPCM * dest,
+				 RemixCount count, int accumulate);
+RemixCount _remix_pcm_resample_linear (RemixPCM * src, int * index,
+				       RemixPCM * frac, RemixPCM * dest,
+				       RemixCount count);
+RemixCount _remix_pcm_resample_cubic (RemixPCM * src, int * index,
+				      RemixPCM * frac, RemixPCM * dest,
+				      RemixCount count);
+RemixCount _remix_pcm_resample_sinc (RemixPCM * src, int * index,
+				     RemixPCM * frac, RemixPCM * dest,
+				     RemixCount count);
+RemixCount _remix_pcm_quantise (RemixPCM * src, RemixPCM * dither,
+				int * dest, RemixCount count,
+				RemixPCM scale, RemixPCM max);
 RemixCount _remix_pcm_write_linear (RemixPCM * data, RemixCount x1,
 				    RemixPCM y1, RemixCount x2, RemixPCM y2,
 				    RemixCount offset, RemixCount count);
@@ -80,6 +80,9 @@ RemixCount remix_stream_mult (RemixEnv * env, RemixStream * src,
 			      RemixStream * dest, RemixCount count);
 RemixCount remix_streams_mix (RemixEnv * env, CDList * streams,
 			      RemixStream * dest, RemixCount count);
+RemixCount remix_streams_mix_gains (RemixEnv * env, CDList * streams,
+				    RemixPCM * gains, RemixStream * dest,
+				    RemixCount count);
 RemixCount remix_stream_fade (RemixEnv * env, RemixStream * src,
 			      RemixStream * dest, RemixCount count);
 RemixCount remix_stream_blend (RemixEnv * env, RemixStream * src,
@@ -92,10 +95,13 @@ RemixCount remix_stream_interleave_2 (RemixEnv * env, RemixStream * stream,
 RemixCount remix_stream_deinterleave_2 (RemixEnv * env, RemixStream * stream,
 					int name1, int name2,
 					RemixPCM * src, RemixCount count);
+RemixCount remix_stream_interleave (RemixEnv * env, RemixStream * stream,
+				    RemixPCM * dest, RemixCount count);
 
 /* Chunks */
 int remix_chunk_later (RemixEnv * env, RemixChunk * u1, RemixChunk * u2);
 RemixCount remix_chunk_clear (RemixEnv * env, RemixChunk * chunk);
+RemixChunk * remix_chunk_unshare (RemixEnv * env, RemixChunk * chunk);
 
 #if defined(__cplusplus)
 }
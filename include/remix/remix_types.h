@@ -72,6 +72,7 @@ typedef union _RemixTime RemixTime;
 #define REMIX_ERROR_SILENCE         4
 #define REMIX_ERROR_NOOP            5
 #define REMIX_ERROR_SYSTEM          6
+#define REMIX_ERROR_FULL            7
 
 typedef enum {
   REMIX_CHANNEL_LEFT,
@@ -97,6 +98,28 @@ typedef enum {
   REMIX_ENVELOPE_SPLINE
 } RemixEnvelopeType;
 
+/* Integer sample formats, for output conversion */
+typedef enum {
+  REMIX_FORMAT_S16,     /* 16 bit, in a short */
+  REMIX_FORMAT_S24,     /* 24 bit, packed into 3 bytes */
+  REMIX_FORMAT_S24_32,  /* 24 bit, in the high bits of a 32 bit int */
+  REMIX_FORMAT_S32      /* 32 bit, in a 32 bit int */
+} RemixSampleFormat;
+
+/* Dither applied by output conversion */
+typedef enum {
+  REMIX_DITHER_NONE,
+  REMIX_DITHER_TPDF,    /* triangular, +/- 1 LSB */
+  REMIX_DITHER_SHAPED   /* triangular, with noise shaping */
+} RemixDither;
+
+/* Resampling qualities, for sounds with a rate envelope */
+typedef enum {
+  REMIX_RESAMPLE_LINEAR,
+  REMIX_RESAMPLE_CUBIC,
+  REMIX_RESAMPLE_SINC
+} RemixResampleQuality;
+
 union _RemixTime {
   long TIME;
   RemixCount samples;
@@ -156,6 +179,8 @@ typedef RemixOpaque RemixMetaText;
 typedef RemixOpaque RemixPlugin;
 typedef RemixOpaque RemixSquareTone;
 typedef RemixOpaque RemixMonitor;
+typedef RemixOpaque RemixPlayback;
+typedef RemixOpaque RemixConverter;
 #endif
 
 #if defined(__cplusplus)
@@ -0,0 +1,573 @@
+/*
+ * remixbench.c
+ *
+ * Copyright (C) 2006 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ *
+ */
+
+/*
+ * Synthetic, reproducible workloads for the mixing engine.
+ *
+ * Usage: remixbench [-s seconds] [workload ...]
+ *
+ * Runs the named workloads, or all of them, each rendering 'seconds'
+ * (default 10) of stereo audio at the default samplerate. Each workload
+ * runs in its own process, so that the peak RSS reported is its own.
+ *
+ * Results are written to stdout one per line, as JSON objects with the
+ * fields:
+ *
+ *   bench          workload name
+ *   frames         sample frames rendered
+ *   channels       channels per frame
+ *   seconds        wall clock time spent rendering (not building)
+ *   realtime       rendered audio duration / seconds
+ *   ns_per_sample  seconds / (frames * channels), in nanoseconds
+ *   peak_rss_kb    peak resident set size of the workload process
+ *   checksum       sum of the absolute values of the samples rendered,
+ *                  for checking that the output is unchanged
+ *
+ * A workload which cannot run here, eg. for want of libsndfile, reports
+ * only "bench" and "skipped".
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <remix/remix.h>
+
+#ifndef SAMPLEDIR
+#define SAMPLEDIR "."
+#endif
+
+#define NR_CHANNELS 2
+
+/* Graph workload dimensions */
+#define NR_TRACKS 8
+#define NR_LAYERS 2
+#define NR_SOUNDS 32
+#define NR_GAIN_POINTS 64
+#define NR_BLEND_POINTS 8
+#define NESTING_DEPTH 8
+
+/* Length of the streams used by the PCM kernel microbenchmarks */
+#define PCM_LENGTH 16384
+
+/* Multiple of the workload length processed by each PCM microbenchmark */
+#define PCM_PASSES 100
+
+typedef RemixBase * (*BenchBuildFunc) (RemixEnv * env, RemixCount frames);
+
+typedef struct _Bench Bench;
+
+struct _Bench {
+  char * name;
+  BenchBuildFunc build;  /* returns the base to render, NULL to skip */
+  char * pcm_kernels;    /* PCM kernel set to microbenchmark instead */
+};
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static long
+peak_rss_kb (void)
+{
+  struct rusage ru;
+
+  getrusage (RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+static void
+report (char * name, RemixSamplerate samplerate, RemixCount frames,
+	double seconds, double checksum)
+{
+  double samples = (double)frames * NR_CHANNELS;
+
+  if (seconds <= 0.0) seconds = 1e-9;
+
+  printf ("{\"bench\": \"%s\", \"frames\": %ld, \"channels\": %d, "
+	  "\"seconds\": %.6f, \"realtime\": %.3f, \"ns_per_sample\": %.3f, "
+	  "\"peak_rss_kb\": %ld, \"checksum\": %.6g}\n",
+	  name, frames, NR_CHANNELS, seconds,
+	  frames / (double)samplerate / seconds, seconds * 1e9 / samples,
+	  peak_rss_kb (), checksum);
+  fflush (stdout);
+}
+
+static void
+report_skipped (char * name, char * reason)
+{
+  printf ("{\"bench\": \"%s\", \"skipped\": \"%s\"}\n", name, reason);
+  fflush (stdout);
+}
+
+/*
+ * Sources
+ */
+
+static RemixBase *
+new_noise (RemixEnv * env)
+{
+  RemixPlugin * noise_plugin = remix_find_plugin (env, "envstd::noise");
+
+  if (noise_plugin == NULL) return NULL;
+  return remix_new (env, noise_plugin, NULL);
+}
+
+static RemixEnvelope *
+new_gain_envelope (RemixEnv * env, RemixCount length, int nr_points)
+{
+  RemixEnvelope * envelope = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  int i;
+
+  remix_envelope_set_timetype (env, envelope, REMIX_TIME_SAMPLES);
+  for (i = 0; i < nr_points; i++) {
+    remix_envelope_add_point (env, envelope,
+			      REMIX_SAMPLES(i * length / (nr_points - 1)),
+			      (i % 2) ? 0.9 : 0.2);
+  }
+
+  return envelope;
+}
+
+/*
+ * fill_layer (env, layer, sources, nr_sources, frames, nr_sounds, phase,
+ *             automate)
+ *
+ * Places 'nr_sounds' sounds evenly over 'frames' samples of 'layer',
+ * cycling through 'sources'. Each sound fills three quarters of its slot,
+ * and starts 'phase' samples into it. If 'automate' is set, each sound
+ * is given its own gain and blend envelopes.
+ */
+static void
+fill_layer (RemixEnv * env, RemixLayer * layer, RemixBase ** sources,
+	    int nr_sources, RemixCount frames, int nr_sounds, RemixCount phase,
+	    int automate)
+{
+  RemixCount slot = frames / nr_sounds;
+  RemixSound * sound;
+  int i;
+
+  for (i = 0; i < nr_sounds; i++) {
+    sound = remix_sound_new (env, sources[i % nr_sources], layer,
+			     REMIX_SAMPLES(i * slot + phase),
+			     REMIX_SAMPLES(slot * 3 / 4));
+    if (automate) {
+      remix_sound_set_gain_envelope
+	(env, sound, new_gain_envelope (env, slot, NR_GAIN_POINTS));
+      remix_sound_set_blend_envelope
+	(env, sound, new_gain_envelope (env, slot, NR_BLEND_POINTS));
+    }
+  }
+}
+
+/*
+ * Graph workloads
+ */
+
+/*
+ * build_deck (env, frames, automate)
+ *
+ * Builds a deck of NR_TRACKS tracks, each of NR_LAYERS layers of
+ * NR_SOUNDS squaretone and noise sounds.
+ */
+static RemixBase *
+build_deck (RemixEnv * env, RemixCount frames, int automate)
+{
+  RemixDeck * deck = remix_deck_new (env);
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixBase * sources[4];
+  int nr_sources = 0, t, l, first;
+
+  sources[nr_sources++] = remix_squaretone_new (env, 220.0);
+  sources[nr_sources++] = remix_squaretone_new (env, 330.0);
+  sources[nr_sources++] = remix_squaretone_new (env, 495.0);
+  if ((sources[nr_sources] = new_noise (env)) != NULL) nr_sources++;
+
+  for (t = 0; t < NR_TRACKS; t++) {
+    track = remix_track_new (env, deck);
+    remix_track_set_gain (env, track, 1.0 / NR_TRACKS);
+    for (l = 0; l < NR_LAYERS; l++) {
+      layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+      first = (t + l) % nr_sources;
+      fill_layer (env, layer, &sources[first], nr_sources - first, frames,
+		  NR_SOUNDS, l * frames / NR_SOUNDS / 2, automate);
+    }
+  }
+
+  return (RemixBase *)deck;
+}
+
+static RemixBase *
+build_tracks (RemixEnv * env, RemixCount frames)
+{
+  return build_deck (env, frames, FALSE);
+}
+
+/* As for "tracks", but every sound has gain and blend automation */
+static RemixBase *
+build_envelopes (RemixEnv * env, RemixCount frames)
+{
+  return build_deck (env, frames, TRUE);
+}
+
+/* Tracks of sounds read with the sndfile reader */
+static RemixBase *
+build_sndfile (RemixEnv * env, RemixCount frames)
+{
+  RemixPlugin * sf_plugin;
+  CDSet * sf_parms;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixBase * sources[2];
+  int sf_path_key, t;
+
+  sf_plugin = remix_find_plugin (env, "builtin::sndfile_reader");
+  if (sf_plugin == NULL) return NULL;
+
+  sf_path_key = remix_get_init_parameter_key (env, sf_plugin, "path");
+
+  sf_parms = cd_set_new (env);
+  sf_parms = cd_set_insert (env, sf_parms, sf_path_key,
+			    CD_STRING(SAMPLEDIR "/1052.wav"));
+  sources[0] = remix_new (env, sf_plugin, sf_parms);
+  sf_parms = cd_set_replace (env, sf_parms, sf_path_key,
+			     CD_STRING(SAMPLEDIR "/909_cl.wav"));
+  sources[1] = remix_new (env, sf_plugin, sf_parms);
+
+  if (sources[0] == RemixNone || sources[1] == RemixNone) return NULL;
+
+  deck = remix_deck_new (env);
+
+  for (t = 0; t < NR_TRACKS; t++) {
+    track = remix_track_new (env, deck);
+    remix_track_set_gain (env, track, 1.0 / NR_TRACKS);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    fill_layer (env, layer, &sources[t % 2], 2 - t % 2, frames,
+		NR_SOUNDS * 4, t * 37, FALSE);
+  }
+
+  return (RemixBase *)deck;
+}
+
+/* Decks NESTING_DEPTH deep, each playing the one inside it as a sound */
+static RemixBase *
+build_nesting (RemixEnv * env, RemixCount frames)
+{
+  RemixBase * inner;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixSound * sound;
+  int i;
+
+  inner = remix_squaretone_new (env, 220.0);
+
+  for (i = 0; i < NESTING_DEPTH; i++) {
+    deck = remix_deck_new (env);
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    sound = remix_sound_new (env, inner, layer, REMIX_SAMPLES(0),
+			     REMIX_SAMPLES(frames));
+    remix_sound_set_gain_envelope (env, sound,
+				   new_gain_envelope (env, frames, 4));
+
+    /* A second, sparser track at each level */
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    fill_layer (env, layer, &inner, 1, frames, NR_SOUNDS, 0, FALSE);
+
+    inner = (RemixBase *)deck;
+  }
+
+  return inner;
+}
+
+/*
+ * checksum (env, stream, count)
+ *
+ * Returns the sum of the absolute values of the first 'count' frames of
+ * 'stream'.
+ */
+static double
+checksum (RemixEnv * env, RemixStream * stream, RemixCount count)
+{
+  static RemixPCM buf[NR_CHANNELS * PCM_LENGTH];
+  double sum = 0.0;
+  RemixCount n;
+  int i;
+
+  remix_seek (env, (RemixBase *)stream, 0, SEEK_SET);
+
+  while (count > 0) {
+    n = remix_stream_interleave_2 (env, stream, REMIX_CHANNEL_LEFT,
+				   REMIX_CHANNEL_RIGHT, buf,
+				   MIN (count, PCM_LENGTH));
+    if (n <= 0) break;
+    for (i = 0; i < NR_CHANNELS * n; i++)
+      sum += fabs (buf[i]);
+    count -= n;
+  }
+
+  return sum;
+}
+
+static void
+run_graph (RemixEnv * env, Bench * bench, RemixCount frames)
+{
+  RemixCount mixlength = remix_get_mixlength (env);
+  RemixCount n, rendered = 0;
+  RemixStream * output;
+  RemixBase * base;
+  double t, elapsed = 0.0, sum = 0.0;
+
+  base = bench->build (env, frames);
+  if (base == NULL) {
+    report_skipped (bench->name, "source not available");
+    return;
+  }
+
+  output = remix_stream_new_contiguous (env, mixlength);
+  remix_prepare (env, base);
+
+  while (rendered < frames) {
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    t = now ();
+    n = remix_process (env, base, MIN (mixlength, frames - rendered),
+		       RemixNone, output);
+    elapsed += now () - t;
+    if (n <= 0) break;
+    sum += checksum (env, output, n);
+    rendered += n;
+  }
+
+  report (bench->name, remix_get_samplerate (env), rendered, elapsed, sum);
+}
+
+/*
+ * PCM kernel microbenchmarks
+ */
+
+/*
+ * pcm_stream (env, buf, base, range)
+ *
+ * Returns a stream of PCM_LENGTH frames of values spread over 'range'
+ * from 'base'.
+ */
+static RemixStream *
+pcm_stream (RemixEnv * env, RemixPCM * buf, RemixPCM base, RemixPCM range)
+{
+  RemixStream * stream = remix_stream_new_contiguous (env, PCM_LENGTH);
+  int i;
+
+  for (i = 0; i < NR_CHANNELS * PCM_LENGTH; i++)
+    buf[i] = base + range * ((i * 37) % 101) / 101.0;
+
+  remix_stream_deinterleave_2 (env, stream, REMIX_CHANNEL_LEFT,
+			       REMIX_CHANNEL_RIGHT, buf, PCM_LENGTH);
+
+  return stream;
+}
+
+/*
+ * run_pcm (env, bench, frames)
+ *
+ * Times each stream operation over PCM_PASSES times 'frames' samples,
+ * repeatedly applied to the same stream. The operands keep its values
+ * in range and clear of denormals.
+ */
+static void
+run_pcm (RemixEnv * env, Bench * bench, RemixCount frames)
+{
+  static char * ops[] = { "copy", "gain", "mix", "mult", "fade", "blend" };
+  RemixPCM * buf;
+  RemixStream * a, * b, * c, * m, * f;
+  RemixCount done;
+  char name[64];
+  double t;
+  int op;
+
+  buf = (RemixPCM *) malloc (NR_CHANNELS * PCM_LENGTH * sizeof (RemixPCM));
+  a = pcm_stream (env, buf, 0.25, 0.5);
+  b = pcm_stream (env, buf, -0.5, 1.0);
+  c = pcm_stream (env, buf, 0.0, 0.9);
+  m = pcm_stream (env, buf, 0.999, 0.002);
+  f = pcm_stream (env, buf, 0.0, 0.001);
+
+  frames *= PCM_PASSES;
+
+  for (op = 0; op < sizeof (ops) / sizeof (ops[0]); op++) {
+    t = now ();
+    for (done = 0; done < frames; done += PCM_LENGTH) {
+      remix_seek (env, (RemixBase *)a, 0, SEEK_SET);
+      remix_seek (env, (RemixBase *)b, 0, SEEK_SET);
+      remix_seek (env, (RemixBase *)c, 0, SEEK_SET);
+      remix_seek (env, (RemixBase *)m, 0, SEEK_SET);
+      remix_seek (env, (RemixBase *)f, 0, SEEK_SET);
+      switch (op) {
+      case 0: remix_stream_copy (env, b, a, PCM_LENGTH); break;
+      case 1: remix_stream_gain (env, a, PCM_LENGTH, 1.0); break;
+      case 2: remix_stream_mix (env, b, a, PCM_LENGTH); break;
+      case 3: remix_stream_mult (env, m, a, PCM_LENGTH); break;
+      case 4: remix_stream_fade (env, f, a, PCM_LENGTH); break;
+      case 5: remix_stream_blend (env, b, c, a, PCM_LENGTH); break;
+      }
+    }
+    t = now () - t;
+
+    snprintf (name, sizeof (name), "%s-%s", bench->name, ops[op]);
+    report (name, remix_get_samplerate (env), done, t,
+	    checksum (env, a, PCM_LENGTH));
+  }
+
+  free (buf);
+}
+
+static Bench benches[] = {
+  { "tracks", build_tracks, NULL },
+  { "envelopes", build_envelopes, NULL },
+  { "sndfile", build_sndfile, NULL },
+  { "nesting", build_nesting, NULL },
+  { "pcm-scalar", NULL, "scalar" },
+  { "pcm-sse2", NULL, "sse2" },
+  { "pcm-avx2", NULL, "avx2" },
+  { "pcm-avx512", NULL, "avx512" },
+};
+
+#define NR_BENCHES (sizeof (benches) / sizeof (benches[0]))
+
+static void
+run_bench (Bench * bench, double seconds)
+{
+  RemixEnv * env;
+  RemixCount frames;
+
+  if (bench->pcm_kernels != NULL)
+    setenv ("REMIX_PCM_KERNELS", bench->pcm_kernels, 1);
+
+  /* Noise sources draw from rand () */
+  srand (1);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  frames = (RemixCount)(seconds * remix_get_samplerate (env));
+
+  if (bench->build != NULL)
+    run_graph (env, bench, frames);
+  else
+    run_pcm (env, bench, frames);
+
+  remix_purge (env);
+}
+
+/*
+ * fork_bench (bench, seconds)
+ *
+ * Runs 'bench' in a child process, so that its peak RSS is its own.
+ * Returns 0 on success, -1 if the child failed.
+ */
+static int
+fork_bench (Bench * bench, double seconds)
+{
+  pid_t pid;
+  int status;
+
+  pid = fork ();
+  if (pid == -1) {
+    perror ("fork");
+    return -1;
+  } else if (pid == 0) {
+    run_bench (bench, seconds);
+    exit (0);
+  }
+
+  if (waitpid (pid, &status, 0) == -1 ||
+      !WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+    fprintf (stderr, "remixbench: %s failed\n", bench->name);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void
+usage (char * progname)
+{
+  int i;
+
+  fprintf (stderr, "Usage: %s [-s seconds] [workload ...]\n", progname);
+  fprintf (stderr, "Workloads:");
+  for (i = 0; i < NR_BENCHES; i++)
+    fprintf (stderr, " %s", benches[i].name);
+  fprintf (stderr, "\n");
+  exit (1);
+}
+
+int
+main (int argc, char ** argv)
+{
+  double seconds = 10.0;
+  int i, j, ret = 0, nr_named = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "-s")) {
+      if (++i >= argc || (seconds = atof (argv[i])) <= 0.0)
+	usage (argv[0]);
+    } else if (argv[i][0] == '-') {
+      usage (argv[0]);
+    } else {
+      for (j = 0; j < NR_BENCHES; j++) {
+	if (!strcmp (argv[i], benches[j].name)) break;
+      }
+      if (j == NR_BENCHES) usage (argv[0]);
+      nr_named++;
+    }
+  }
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "-s")) {
+      i++;
+      continue;
+    }
+    for (j = 0; j < NR_BENCHES; j++) {
+      if (!strcmp (argv[i], benches[j].name) &&
+	  fork_bench (&benches[j], seconds) == -1)
+	ret = 1;
+    }
+  }
+
+  if (nr_named == 0) {
+    for (j = 0; j < NR_BENCHES; j++) {
+      if (fork_bench (&benches[j], seconds) == -1)
+	ret = 1;
+    }
+  }
+
+  exit (ret);
+}
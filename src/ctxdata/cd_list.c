@@ -383,6 +383,26 @@ cd_list_remove (void * ctx, CDList * list, CDScalarType type, CDScalar data)
   else return list;
 }
 
+/*
+ * cd_list_remove_item (ctx, list, item)
+ *
+ * Unlink list item 'item' from 'list' and free it, without searching.
+ */
+CDList *
+cd_list_remove_item (void * ctx, CDList * list, CDList * item)
+{
+  if (item == NULL) return list;
+
+  if (item->prev) item->prev->next = item->next;
+  if (item->next) item->next->prev = item->prev;
+
+  if (item == list) list = list->next;
+
+  cd_free (item);
+
+  return list;
+}
+
 CDList *
 cd_list_join (void * ctx, CDList * l1, CDList * l2)
 {
@@ -442,6 +462,14 @@ cd_list_destroy_with (void * ctx, CDList * list, CDDestroyFunc destroy)
   return NULL;
 }
 
+/* A CDDestroyFunc freeing 'data' with cd_free() */
+static int
+cd_list_free_data (void * ctx, void * data)
+{
+  cd_free (data);
+  return 0;
+}
+
 /*
  * cd_list_free_all (ctx, list)
  *
@@ -451,7 +479,7 @@ cd_list_destroy_with (void * ctx, CDList * list, CDDestroyFunc destroy)
 CDList *
 cd_list_free_all (void * ctx, CDList * list)
 {
-  return cd_list_destroy_with (ctx, list, (CDDestroyFunc)cd_free);
+  return cd_list_destroy_with (ctx, list, cd_list_free_data);
 }
 
 /*
@@ -216,6 +216,14 @@ cd_set_destroy_with (void * ctx, CDSet * set, CDDestroyFunc destroy)
   return NULL;
 }
 
+/* A CDDestroyFunc freeing 'data' with cd_free() */
+static int
+cd_set_free_data (void * ctx, void * data)
+{
+  cd_free (data);
+  return 0;
+}
+
 /*
  * cd_set_free_all (ctx, set)
  *
@@ -225,7 +233,7 @@ cd_set_destroy_with (void * ctx, CDSet * set, CDDestroyFunc destroy)
 CDSet *
 cd_set_free_all (void * ctx, CDSet * set)
 {
-  return cd_set_destroy_with (ctx, set, (CDDestroyFunc)cd_free);
+  return cd_set_destroy_with (ctx, set, cd_set_free_data);
 }
 
 /*
@@ -183,6 +183,7 @@ CDList * cd_list_insert (void * ctx, CDList * list, CDScalarType type,
 			 CDScalar data, CDCmpFunc f);
 CDList * cd_list_remove (void * ctx, CDList * list, CDScalarType type,
 			 CDScalar data);
+CDList * cd_list_remove_item (void * ctx, CDList * list, CDList * item);
 CDList * cd_list_join (void * ctx, CDList * l1, CDList * l2);
 int cd_list_length (void * ctx, CDList * list);
 int cd_list_is_empty (void * ctx, CDList * list);
@@ -300,7 +300,7 @@ remix_base_encompasses_mixlength (RemixEnv * env, RemixBase * base)
   aml = remix_get_mixlength (env);
   bml = _remix_base_get_mixlength (env, base);
 
-  return (aml < bml);
+  return (aml <= bml);
 }
 
 int
@@ -379,6 +379,40 @@ remix_destroy (RemixEnv * env, RemixBase * base)
   return _remix_destroy (env, base);
 }
 
+/*
+ * remix_cursor_new (env, source)
+ *
+ * Returns a cursor of 'source': a base which reads the same data as
+ * 'source' from a position of its own, with its own decoding state, so
+ * that many cursors can read one source at different positions, and
+ * from different threads, without seeking it. Sources whose methods
+ * have no cursor function are returned themselves, and must then only
+ * be read by one user at a time.
+ */
+RemixBase *
+remix_cursor_new (RemixEnv * env, RemixBase * source)
+{
+  if (!source) {
+    remix_set_error (env, REMIX_ERROR_NOENTITY);
+    return NULL;
+  }
+  if (!source->methods || !source->methods->cursor)
+    return source;
+  return source->methods->cursor (env, source);
+}
+
+/*
+ * remix_cursor_destroy (env, source, cursor)
+ *
+ * Destroys a cursor returned by remix_cursor_new() for 'source'.
+ */
+int
+remix_cursor_destroy (RemixEnv * env, RemixBase * source, RemixBase * cursor)
+{
+  if (cursor == RemixNone || cursor == source) return 0;
+  return remix_destroy (env, cursor);
+}
+
 int
 remix_destroy_list (RemixEnv * env, CDList * list)
 {
@@ -390,10 +424,18 @@ remix_destroy_list (RemixEnv * env, CDList * list)
  * Prepare the methods for process, seek and length calls.
  *
  * "Prepare" means to make sure the base has enough internal buffers
- * to deal with the current context (sample rate, mixlength).
+ * to deal with the current context (sample rate, mixlength, channels).
+ * Containers such as decks prepare their contents too, and buffers are
+ * only reallocated if they no longer fit.
  *
- * If the methods has a ready() function, that is checked first. If it
- * does not have a ready() function, it is assumed to always be ready.
+ * If the methods has a ready() function, that is checked first, and the
+ * prepare() function is only called if the base is not ready. If it does
+ * not have a ready() function, it is always prepared.
+ *
+ * Once a base is prepared, remix_process() on it does not allocate or
+ * free memory until the context changes; see remix_debug.c for a trap
+ * which checks this. Processing only takes locks if the world has
+ * worker threads.
  */
 RemixBase *
 remix_prepare (RemixEnv * env, RemixBase * base)
@@ -431,7 +473,14 @@ remix_process_fast (RemixEnv * env, RemixBase * base, RemixCount count,
     remix_set_error (env, REMIX_ERROR_INVALID);
     return -1;
   }
+  /* Apply live edits at block boundaries only */
+  if (env->_process_depth == 0) remix_drain (env);
+
+  env->_process_depth++;
+  _remix_process_enter ();
   n = _remix_process (env, base, count, input, output);
+  _remix_process_leave ();
+  env->_process_depth--;
   if (n > 0) base->offset += n;
   return n;
 }
@@ -47,6 +47,8 @@
  * A channel must be contained within a stream.
  */
 
+#include <string.h>
+
 #define __REMIX__
 #include "remix.h"
 
@@ -59,19 +61,63 @@ remix_channel_new (RemixEnv * env)
 
   c = (RemixChannel *) remix_malloc (sizeof (struct _RemixChannel));
 
-  c->chunks = cd_list_new (env);
+  c->chunks = NULL;
+  c->_valid_lengths = NULL;
+  c->nr_chunks = 0;
+  c->_max_chunks = 0;
   c->_current_offset = 0;
-  c->_current_chunk = RemixNone;
+  c->_current_chunk = -1;
 
   return c;
 }
 
+/*
+ * remix_channel_grow (env, channel, nr_chunks)
+ *
+ * Ensures there is room in the chunk index of 'channel' for at least
+ * 'nr_chunks' chunks.
+ */
+static void
+remix_channel_grow (RemixEnv * env, RemixChannel * channel, int nr_chunks)
+{
+  RemixChunk ** chunks;
+  RemixCount * valid_lengths;
+  int max_chunks;
+
+  if (nr_chunks <= channel->_max_chunks) return;
+
+  max_chunks = MAX (nr_chunks, MAX (4, channel->_max_chunks * 2));
+
+  chunks = (RemixChunk **) remix_malloc (max_chunks * sizeof (RemixChunk *));
+  valid_lengths = (RemixCount *) remix_malloc (max_chunks * sizeof (RemixCount));
+
+  if (channel->nr_chunks > 0) {
+    memcpy (chunks, channel->chunks, channel->nr_chunks * sizeof (RemixChunk *));
+    memcpy (valid_lengths, channel->_valid_lengths,
+	    channel->nr_chunks * sizeof (RemixCount));
+  }
+
+  if (channel->chunks != NULL) remix_free (channel->chunks);
+  if (channel->_valid_lengths != NULL) remix_free (channel->_valid_lengths);
+
+  channel->chunks = chunks;
+  channel->_valid_lengths = valid_lengths;
+  channel->_max_chunks = max_chunks;
+}
+
 RemixChannel *
 remix_channel_clone (RemixEnv * env, RemixChannel * channel)
 {
   RemixChannel * new_channel = remix_channel_new (env);
-  new_channel->chunks = cd_list_clone (env, channel->chunks,
-				       (CDCloneFunc)remix_chunk_clone);
+  int i;
+
+  remix_channel_grow (env, new_channel, channel->nr_chunks);
+  for (i = 0; i < channel->nr_chunks; i++) {
+    new_channel->chunks[i] = remix_chunk_clone (env, channel->chunks[i]);
+    new_channel->_valid_lengths[i] = channel->_valid_lengths[i];
+  }
+  new_channel->nr_chunks = channel->nr_chunks;
+
   return new_channel;
 }
 
@@ -79,24 +125,93 @@ int
 remix_channel_destroy (RemixEnv * env, RemixBase * base)
 {
   RemixChannel * channel = (RemixChannel *)base;
-  CDList * l;
+  int i;
 
-  for (l = channel->chunks; l; l = l->next) {
-    remix_chunk_free (env, (RemixChunk *)l->data.s_pointer);
+  for (i = 0; i < channel->nr_chunks; i++) {
+    remix_chunk_free (env, channel->chunks[i]);
   }
 
-  cd_list_free (env, channel->chunks);
+  if (channel->chunks != NULL) remix_free (channel->chunks);
+  if (channel->_valid_lengths != NULL) remix_free (channel->_valid_lengths);
   remix_free (channel);
   return 0;
 }
 
+/*
+ * remix_channel_update_valid_length (channel, i)
+ *
+ * Recalculates the valid length of the chunk at index 'i'. The valid
+ * length of a chunk in a channel is defined as the minimum of (the
+ * chunk's actual length) and (the difference between the offset of the
+ * chunk and the offset of the following chunk). ie. if the chunk is
+ * followed by another chunk that cuts it off early, the valid length is
+ * the difference between the two chunk offsets. Crikey, email me if
+ * you're confused.
+ */
+static void
+remix_channel_update_valid_length (RemixChannel * channel, int i)
+{
+  RemixChunk * u, * un;
+
+  if (i < 0 || i >= channel->nr_chunks) return;
+
+  u = channel->chunks[i];
+
+  if (i == channel->nr_chunks - 1) {
+    channel->_valid_lengths[i] = u->length;
+  } else {
+    un = channel->chunks[i+1];
+    channel->_valid_lengths[i] = MIN (u->length,
+				      un->start_index - u->start_index);
+  }
+}
+
+/*
+ * remix_channel_index_upto (channel, offset)
+ *
+ * Returns the number of chunks of 'channel' which start at or before
+ * 'offset', by binary search.
+ */
+static int
+remix_channel_index_upto (RemixChannel * channel, RemixCount offset)
+{
+  int lo = 0, hi = channel->nr_chunks, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (channel->chunks[mid]->start_index <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
 RemixChunk *
 remix_channel_add_chunk (RemixEnv * env, RemixChannel * channel,
 			 RemixChunk * chunk)
 {
-  channel->chunks = cd_list_insert (env, channel->chunks, CD_TYPE_POINTER,
-                                    CD_POINTER(chunk),
-				    (CDCmpFunc)remix_chunk_later);
+  int i;
+
+  remix_channel_grow (env, channel, channel->nr_chunks + 1);
+
+  /* Insert after any chunks starting at the same index, so it wins */
+  i = remix_channel_index_upto (channel, chunk->start_index);
+
+  memmove (&channel->chunks[i+1], &channel->chunks[i],
+	   (channel->nr_chunks - i) * sizeof (RemixChunk *));
+  memmove (&channel->_valid_lengths[i+1], &channel->_valid_lengths[i],
+	   (channel->nr_chunks - i) * sizeof (RemixCount));
+
+  channel->chunks[i] = chunk;
+  channel->nr_chunks++;
+
+  remix_channel_update_valid_length (channel, i-1);
+  remix_channel_update_valid_length (channel, i);
+
+  channel->_current_chunk = -1;
+
   return chunk;
 }
 
@@ -112,118 +227,128 @@ void
 remix_channel_remove_chunk (RemixEnv * env, RemixChannel * channel,
 			    RemixChunk * chunk)
 {
-  channel->chunks = cd_list_remove (env, channel->chunks, CD_TYPE_POINTER,
-				    CD_POINTER(chunk));
+  int i = remix_channel_index_upto (channel, chunk->start_index) - 1;
+
+  /* Step back over other chunks with the same start index */
+  while (i >= 0 && channel->chunks[i] != chunk) {
+    if (channel->chunks[i]->start_index != chunk->start_index) return;
+    i--;
+  }
+  if (i < 0) return;
+
+  channel->nr_chunks--;
+  memmove (&channel->chunks[i], &channel->chunks[i+1],
+	   (channel->nr_chunks - i) * sizeof (RemixChunk *));
+  memmove (&channel->_valid_lengths[i], &channel->_valid_lengths[i+1],
+	   (channel->nr_chunks - i) * sizeof (RemixCount));
+
+  remix_channel_update_valid_length (channel, i-1);
+
+  channel->_current_chunk = -1;
 }
 
 RemixChunk *
 remix_channel_find_chunk_before (RemixEnv * env, RemixChannel * channel,
 				 RemixCount index)
 {
-  CDList * l;
-  RemixChunk * u, * up = RemixNone;
-
-  for (l = channel->chunks; l; l = l->next) {
-    u = (RemixChunk *)l->data.s_pointer;
-    if (u->start_index > index) return up;
-    up = u;
-  }
+  int i = remix_channel_index_upto (channel, index);
 
-  return up;
+  if (i == 0) return RemixNone;
+  return channel->chunks[i-1];
 }
 
 /*
- * remix_chunk_item_valid_length (l)
+ * remix_channel_index_spans (channel, i, offset)
+ *
+ * Returns true if the chunk at index 'i' validly spans 'offset'.
+ */
+#define remix_channel_index_spans(c,i,offset) \
+  ((i) >= 0 && (i) < (c)->nr_chunks && \
+   (c)->chunks[(i)]->start_index <= (offset) && \
+   (c)->chunks[(i)]->start_index + (c)->_valid_lengths[(i)] > (offset))
+
+/*
+ * remix_channel_get_chunk_index_at (channel, offset)
+ *
+ * Returns the index of the chunk which validly spans 'offset', or -1 if
+ * there is none. As valid regions do not overlap, this is the last chunk
+ * starting at or before 'offset', if it reaches that far.
  *
- * Returns the length for which the chunk item 'l' is valid. The valid
- * length of a chunk item in a channel is defined as the minimum of
- * (the chunk's actual length) and (the difference between the offset
- * of the chunk and the offset of the following chunk). ie. if the
- * chunk is followed by another chunk that cuts it off early, the valid
- * length is the difference between the two chunk offsets. Crikey, email
- * me if you're confused.
+ * Sequential access is usually satisfied by the chunk at the cursor
+ * channel->_current_chunk or the one after it; otherwise the index is
+ * binary searched.
  */
-static RemixCount
-remix_chunk_item_valid_length (CDList * l)
+static int
+remix_channel_get_chunk_index_at (RemixChannel * channel, RemixCount offset)
 {
-  CDList * ln = l->next;
-  RemixChunk * u = (RemixChunk *)l->data.s_pointer, * un;
+  int i = channel->_current_chunk;
 
-  if (ln == RemixNone) {
-    return u->length;
-  } else {
-    un = (RemixChunk *)ln->data.s_pointer;
-    return MIN (u->length, un->start_index - u->start_index);
-  }
-}
+  if (remix_channel_index_spans (channel, i, offset)) return i;
+  if (remix_channel_index_spans (channel, i+1, offset)) return i+1;
 
-RemixChunk *
-remix_channel_get_chunk_at (RemixEnv * env, RemixChannel * channel,
-			    RemixCount offset)
-{
-  CDList * l;
-  RemixChunk * u;
-  RemixCount vl; /* valid length */
-
-  for (l = channel->chunks; l; l = l->next) {
-    u = (RemixChunk *)l->data.s_pointer;
-    vl = remix_chunk_item_valid_length (l);
-    if (u->start_index <= offset && u->start_index + vl > offset) {
-      /* chunk validly spans offset: return it */
-      return u;
-    }
-  }
+  i = remix_channel_index_upto (channel, offset) - 1;
+
+  if (remix_channel_index_spans (channel, i, offset)) return i;
 
   /* No chunks found spanning offset */
-  return RemixNone;
+  return -1;
 }
 
-CDList *
-remix_channel_get_chunk_item_at (RemixChannel * channel, RemixCount offset)
+/*
+ * remix_channel_get_chunk_index_after (channel, offset)
+ *
+ * Returns the index of the first chunk starting at or after 'offset', or
+ * -1 if there is none.
+ */
+static int
+remix_channel_get_chunk_index_after (RemixChannel * channel, RemixCount offset)
 {
-  CDList * l;
-  RemixChunk * u;
-  RemixCount vl; /* valid length */
-
-  for (l = channel->chunks; l; l = l->next) {
-    u = (RemixChunk *)l->data.s_pointer;
-    vl = remix_chunk_item_valid_length (l);
-    if (u->start_index <= offset && u->start_index + vl > offset) {
-      /* chunk validly spans offset: return its item */
-      return l;
-    }
-  }
+  int i;
 
-  /* No chunks found spanning offset */
-  return RemixNone;
+  if (offset <= 0) return (channel->nr_chunks > 0 ? 0 : -1);
+
+  i = remix_channel_index_upto (channel, offset - 1);
+
+  return (i < channel->nr_chunks ? i : -1);
 }
 
-CDList *
-remix_channel_get_chunk_item_after (RemixChannel * channel, RemixCount offset)
+/*
+ * remix_channel_valid_length_at (channel, offset)
+ *
+ * Returns the number of samples from 'offset' to the end of the valid
+ * region of the chunk at the cursor channel->_current_chunk.
+ */
+#define remix_channel_valid_length_at(c,offset) \
+  ((c)->chunks[(c)->_current_chunk]->start_index + \
+   (c)->_valid_lengths[(c)->_current_chunk] - (offset))
+
+RemixChunk *
+remix_channel_get_chunk_at (RemixEnv * env, RemixChannel * channel,
+			    RemixCount offset)
 {
-  CDList * l;
-  RemixChunk * u;
+  int i = remix_channel_get_chunk_index_at (channel, offset);
 
-  for (l = channel->chunks; l; l = l->next) {
-    u = (RemixChunk *)l->data.s_pointer;
-    if (u->start_index >= offset) return l;
-  }
+  if (i == -1) return RemixNone;
 
-  return RemixNone;
+  channel->_current_chunk = i;
+  return channel->chunks[i];
 }
 
 RemixCount
 remix_channel_write0 (RemixEnv * env, RemixChannel * channel, RemixCount length)
 {
-  CDList * l = channel->_current_chunk;
   RemixChunk * u;
   RemixCount remaining = length, n, vl;
   RemixCount offset = channel->_current_offset;
+  int i;
+
+  i = remix_channel_get_chunk_index_at (channel, offset);
+  if (i == -1) i = remix_channel_get_chunk_index_after (channel, offset);
 
   while (remaining > 0) {
-    if (l == RemixNone) break; /* No more chunks */
+    if (i == -1 || i >= channel->nr_chunks) break; /* No more chunks */
 
-    u = (RemixChunk *)l->data.s_pointer;
+    u = channel->chunks[i];
 
     if (u->start_index > offset) { /* skip ahead to start of next chunk */
       n = MIN (remaining, u->start_index - offset);
@@ -232,27 +357,55 @@ remix_channel_write0 (RemixEnv * env, RemixChannel * channel, RemixCount length)
     }
 
     if (remaining > 0) {
-      vl = remix_chunk_item_valid_length (l);
+      vl = u->start_index + channel->_valid_lengths[i] - offset;
       n = _remix_chunk_clear_region (env, u, offset, MIN(remaining, vl),
 				  0, NULL);
       offset += n;
       remaining -= n;
     }
 
-    l = l->next;
+    i++;
   }
 
-  channel->_current_chunk = l;
+  channel->_current_chunk = (i < channel->nr_chunks ? i : -1);
   channel->_current_offset += length;
 
   return length;
 }
 
+/*
+ * The library's own chunk functions take silent chunks into account;
+ * chunks are realised before being passed to any other function, which
+ * may access their data directly.
+ */
+static int
+remix_chunk_func_handles_silence (RemixChunkFunc func)
+{
+  return (func == _remix_chunk_clear_region || func == _remix_chunk_gain);
+}
+
+static int
+remix_chunkchunk_func_handles_silence (RemixChunkChunkFunc func)
+{
+  return (func == _remix_chunk_copy || func == _remix_chunk_add_inplace ||
+	  func == _remix_chunk_mult_inplace ||
+	  func == _remix_chunk_fade_inplace ||
+	  func == _remix_chunk_interleave_2 ||
+	  func == _remix_chunk_deinterleave_2);
+}
+
+static int
+remix_chunkchunkchunk_func_handles_silence (RemixChunkChunkChunkFunc func)
+{
+  return (func == _remix_chunk_blend_inplace);
+}
+
 /*
  * remix_channel_chunkfuncify (env, channel, count, func, data)
  *
  * Apply the RemixChunkFunc func to 'count' samples from consecutive chunks
- * of 'channel'.
+ * of 'channel', realising and unsharing each chunk first so that func may
+ * read and write its data.
  * Stops early if the channel runs out of chunks.
  * Returns the number of samples func'ed.
  */
@@ -270,16 +423,20 @@ remix_channel_chunkfuncify (RemixEnv * env, RemixChannel * channel,
 
   while (remaining > 0) {
     channel->_current_chunk =
-      remix_channel_get_chunk_item_at (channel, channel->_current_offset);
-    if (channel->_current_chunk == RemixNone) {
+      remix_channel_get_chunk_index_at (channel, channel->_current_offset);
+    if (channel->_current_chunk == -1) {
       remix_dprintf ("[remix_channel_chunkfuncify] channel incomplete, funced %ld\n",
 		     funced);
       return funced; /* Channel incomplete */
     }
 
-    u = (RemixChunk *)channel->_current_chunk->data.s_pointer;
-    vl = remix_chunk_item_valid_length (channel->_current_chunk);
+    u = channel->chunks[channel->_current_chunk];
+    vl = remix_channel_valid_length_at (channel, channel->_current_offset);
 
+    if (!remix_chunk_func_handles_silence (func)) {
+      _remix_chunk_realise (env, u);
+      remix_chunk_unshare (env, u);
+    }
     n = func (env, u, channel->_current_offset, MIN(remaining, vl),
 	      channelname, data);
 
@@ -307,7 +464,8 @@ remix_channel_chunkfuncify (RemixEnv * env, RemixChannel * channel,
  * remix_channel_chunkchunkfuncify (env, src, dest, count, func, data)
  *
  * Apply the RemixChunkChunkFunc func to corresponding chunks of 'src' and
- * 'dest' to 'count' samples.
+ * 'dest' to 'count' samples. Silent chunks are realised and chunks of
+ * 'dest' are unshared first.
  * Stops early if 'dest' cannot contain part of the region for which
  * 'src' is defined. Copies zeroes to 'dest' wherever 'src' is empty.
  * Returns the number of samples func'ed.
@@ -328,19 +486,19 @@ remix_channel_chunkchunkfuncify (RemixEnv * env, RemixChannel * src, RemixChanne
     n = 0; /* watch for early changes to n */
 
     dest->_current_chunk =
-	remix_channel_get_chunk_item_at (dest, dest->_current_offset);
-    if (dest->_current_chunk == RemixNone) {
+	remix_channel_get_chunk_index_at (dest, dest->_current_offset);
+    if (dest->_current_chunk == -1) {
       remix_dprintf ("[remix_channel_ccf...] channel incomplete after %ld\n", funced);
       return funced; /* Destination channel incomplete */
     }
 
     src->_current_chunk =
-	remix_channel_get_chunk_item_at (src, src->_current_offset);
-    if (src->_current_chunk == RemixNone) { /* No source data at offset */
+	remix_channel_get_chunk_index_at (src, src->_current_offset);
+    if (src->_current_chunk == -1) { /* No source data at offset */
       src->_current_chunk =
-	remix_channel_get_chunk_item_after (src, src->_current_offset);
+	remix_channel_get_chunk_index_after (src, src->_current_offset);
 
-      if (src->_current_chunk == RemixNone) {
+      if (src->_current_chunk == -1) {
         /* No following source data at all */
 	remix_dprintf ("[remix_channel_ccf...] no source data after %ld\n",
 		    src->_current_offset);
@@ -354,9 +512,9 @@ remix_channel_chunkchunkfuncify (RemixEnv * env, RemixChannel * src, RemixChanne
       }
     }
 
-    /* *** Now, sl is the current or following source chunk item *** */
+    /* *** Now, src->_current_chunk indexes the current or following source chunk *** */
 
-    su = (RemixChunk *)src->_current_chunk->data.s_pointer;
+    su = src->chunks[src->_current_chunk];
 
     if (su->start_index > src->_current_offset) { /* No source data at offset */
       remix_dprintf ("[remix_channel_ccf...] no source data at %ld (warn 2)\n",
@@ -370,17 +528,23 @@ remix_channel_chunkchunkfuncify (RemixEnv * env, RemixChannel * src, RemixChanne
     if (remaining > 0) {
       if (n > 0) {
 	dest->_current_chunk =
-	  remix_channel_get_chunk_item_at (dest, dest->_current_offset);
-	if (dest->_current_chunk == RemixNone) {
+	  remix_channel_get_chunk_index_at (dest, dest->_current_offset);
+	if (dest->_current_chunk == -1) {
 	  remix_dprintf ("[remix_channel_ccf...] dest incomplete after %ld\n",
-		      dest->_current_chunk);
+		      funced);
 	  return funced; /* Destination channel incomplete */
 	}
       }
  
-      du = (RemixChunk *)dest->_current_chunk->data.s_pointer;
-
-      vl = remix_chunk_item_valid_length (dest->_current_chunk);
+      du = dest->chunks[dest->_current_chunk];
+
+      vl = remix_channel_valid_length_at (dest, dest->_current_offset);
+      vl = MIN (vl, remix_channel_valid_length_at (src, src->_current_offset));
+      if (!remix_chunkchunk_func_handles_silence (func)) {
+	_remix_chunk_realise (env, su);
+	_remix_chunk_realise (env, du);
+	remix_chunk_unshare (env, du);
+      }
       n = func (env, su, src->_current_offset, du, dest->_current_offset,
                 MIN(remaining, vl), channelname, data);
 
@@ -413,7 +577,8 @@ remix_channel_chunkchunkfuncify (RemixEnv * env, RemixChannel * src, RemixChanne
  *                                    data)
  *
  * Apply the RemixChunkChunkChunkFunc func to corresponding chunks of 'src1',
- * 'src2' and 'dest' to 'count' samples.
+ * 'src2' and 'dest' to 'count' samples. Silent chunks are realised and
+ * chunks of 'dest' are unshared first.
  * Stops early if 'dest' cannot contain part of the region for which
  * both 'src1' and 'src2' is defined. Copies zeroes to 'dest' wherever
  * either 'src1' or 'src2' are empty.
@@ -434,33 +599,33 @@ remix_channel_chunkchunkchunkfuncify (RemixEnv * env,
     n = 0; /* watch for early changes to n */
 
     dest->_current_chunk =
-      remix_channel_get_chunk_item_at (dest, dest->_current_offset);
-    if (dest->_current_chunk == RemixNone)
+      remix_channel_get_chunk_index_at (dest, dest->_current_offset);
+    if (dest->_current_chunk == -1)
       return funced; /* Destination channel incomplete */
 
     src1->_current_chunk =
-      remix_channel_get_chunk_item_at (src1, src1->_current_offset);
-    if (src1->_current_chunk == RemixNone) {
+      remix_channel_get_chunk_index_at (src1, src1->_current_offset);
+    if (src1->_current_chunk == -1) {
       src1->_current_chunk =
-	remix_channel_get_chunk_item_after (src1, src1->_current_offset);
+	remix_channel_get_chunk_index_after (src1, src1->_current_offset);
     }
 
     src2->_current_chunk =
-      remix_channel_get_chunk_item_at (src2, src2->_current_offset);
-    if (src2->_current_chunk == RemixNone) {
+      remix_channel_get_chunk_index_at (src2, src2->_current_offset);
+    if (src2->_current_chunk == -1) {
       src2->_current_chunk =
-	remix_channel_get_chunk_item_after (src2, src2->_current_offset);
+	remix_channel_get_chunk_index_after (src2, src2->_current_offset);
     }
 
-    if (src1->_current_chunk == RemixNone || src2->_current_chunk == RemixNone) {
+    if (src1->_current_chunk == -1 || src2->_current_chunk == -1) {
       n = remix_channel_write0 (env, dest, remaining);
       funced += n;
       remaining -= n;
       return funced;
     }
 
-    s1u = (RemixChunk *)src1->_current_chunk->data.s_pointer;
-    s2u = (RemixChunk *)src2->_current_chunk->data.s_pointer;
+    s1u = src1->chunks[src1->_current_chunk];
+    s2u = src2->chunks[src2->_current_chunk];
 
     if (s1u->start_index > src1->_current_offset ||
 	s2u->start_index > src2->_current_offset) {
@@ -471,19 +636,21 @@ remix_channel_chunkchunkchunkfuncify (RemixEnv * env,
       remaining -= n;
       src1->_current_offset += n;
       src2->_current_offset += n;
+      continue; /* Look up the chunks at the new offsets */
     }
     
     if (remaining > 0) {
-      if (n > 0) {
-	dest->_current_chunk =
-          remix_channel_get_chunk_item_at (dest, dest->_current_offset);
-	if (dest->_current_chunk == RemixNone)
-          return funced; /* Destination channel incomplete */
-      }
-      
-      du = (RemixChunk *)dest->_current_chunk->data.s_pointer;
+      du = dest->chunks[dest->_current_chunk];
       
-      vl = remix_chunk_item_valid_length (dest->_current_chunk);
+      vl = remix_channel_valid_length_at (dest, dest->_current_offset);
+      vl = MIN (vl, remix_channel_valid_length_at (src1, src1->_current_offset));
+      vl = MIN (vl, remix_channel_valid_length_at (src2, src2->_current_offset));
+      if (!remix_chunkchunkchunk_func_handles_silence (func)) {
+	_remix_chunk_realise (env, s1u);
+	_remix_chunk_realise (env, s2u);
+	_remix_chunk_realise (env, du);
+	remix_chunk_unshare (env, du);
+      }
       n = func (env, s1u, src1->_current_offset, s2u, src2->_current_offset,
 		du, dest->_current_offset, MIN(remaining, vl), channelname,
 		data);
@@ -536,6 +703,177 @@ remix_channel_mix (RemixEnv * env, RemixChannel * src, RemixChannel * dest, Remi
 				       0, NULL);
 }
 
+/*
+ * _remix_channel_is_silent (env, channel, offset, count)
+ *
+ * Returns TRUE if the 'count' samples of 'channel' from 'offset' all lie
+ * in silent chunks or in gaps between chunks.
+ */
+int
+_remix_channel_is_silent (RemixEnv * env, RemixChannel * channel,
+			  RemixCount offset, RemixCount count)
+{
+  RemixCount end = offset + count;
+  int i;
+
+  while (offset < end) {
+    i = remix_channel_get_chunk_index_at (channel, offset);
+    if (i == -1) {
+      i = remix_channel_get_chunk_index_after (channel, offset);
+      if (i == -1) break;
+      offset = channel->chunks[i]->start_index;
+    } else {
+      if (!channel->chunks[i]->_silent) return FALSE;
+      offset = channel->chunks[i]->start_index + channel->_valid_lengths[i];
+    }
+  }
+
+  return TRUE;
+}
+
+/* Samples of 'dest' summed at a time by remix_channel_mix_gains() */
+#define REMIX_MIX_TILE 256
+
+/*
+ * remix_channel_mix_gains (env, srcs, gains, nr_srcs, dest, count, accumulate)
+ *
+ * Sum 'count' samples from each of the 'nr_srcs' (at most REMIX_MIX_GROUP)
+ * channels in 'srcs', scaled by the corresponding values in 'gains', into
+ * 'dest'. Entries of 'srcs' may be RemixNone, and regions where a source
+ * has no chunks are treated as silence. If 'accumulate' is zero the
+ * previous contents of 'dest' are replaced.
+ *
+ * Regions where every source is silent are skipped, or marked silent in
+ * 'dest' if not accumulating. Elsewhere, silent source chunks are left
+ * out and the region is worked through one tile of 'dest' at a time.
+ * Wherever every source has a single chunk spanning the tile, all
+ * sources are summed in a single pass over the tile.
+ * Stops early if 'dest' runs out of chunks.
+ * Returns the number of samples mixed.
+ */
+RemixCount
+remix_channel_mix_gains (RemixEnv * env, RemixChannel ** srcs,
+			 RemixPCM * gains, int nr_srcs, RemixChannel * dest,
+			 RemixCount count, int accumulate)
+{
+  RemixPCM * full_ptrs[REMIX_MIX_GROUP], full_gains[REMIX_MIX_GROUP];
+  RemixChannel * partial[REMIX_MIX_GROUP];
+  RemixPCM partial_gains[REMIX_MIX_GROUP];
+  int nr_full, nr_partial, k, written;
+  RemixChunk * du, * su;
+  RemixPCM * d;
+  int si;
+  RemixCount remaining = count, mixed = 0, n, vl, so, sn, start;
+
+  if (nr_srcs > REMIX_MIX_GROUP) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+
+  while (remaining > 0) {
+    dest->_current_chunk =
+      remix_channel_get_chunk_index_at (dest, dest->_current_offset);
+    if (dest->_current_chunk == -1)
+      return mixed; /* Destination channel incomplete */
+
+    du = dest->chunks[dest->_current_chunk];
+    vl = remix_channel_valid_length_at (dest, dest->_current_offset);
+    start = dest->_current_offset - du->start_index;
+    n = MIN (remaining, vl);
+
+    /* Skip straight over regions where all the sources are silent */
+    for (k = 0; k < nr_srcs; k++) {
+      if (srcs[k] != RemixNone &&
+	  !_remix_channel_is_silent (env, srcs[k], srcs[k]->_current_offset,
+				     n))
+	break;
+    }
+    if (k == nr_srcs) {
+      if (!accumulate)
+	n = _remix_chunk_clear_region (env, du, dest->_current_offset, n,
+				       0, NULL);
+      goto advance;
+    }
+
+    n = MIN (n, REMIX_MIX_TILE);
+    _remix_chunk_realise (env, du);
+    remix_chunk_unshare (env, du);
+    d = &du->data[start];
+
+    nr_full = nr_partial = 0;
+    for (k = 0; k < nr_srcs; k++) {
+      if (srcs[k] == RemixNone) continue;
+      si = remix_channel_get_chunk_index_at (srcs[k], srcs[k]->_current_offset);
+      if (si != -1) {
+	srcs[k]->_current_chunk = si;
+	su = srcs[k]->chunks[si];
+	so = srcs[k]->_current_offset - su->start_index;
+	if (so + n <= srcs[k]->_valid_lengths[si]) {
+	  if (su->_silent) continue;
+	  full_ptrs[nr_full] = &su->data[so];
+	  full_gains[nr_full] = gains[k];
+	  nr_full++;
+	  continue;
+	}
+      }
+      partial[nr_partial] = srcs[k];
+      partial_gains[nr_partial] = gains[k];
+      nr_partial++;
+    }
+
+    written = accumulate;
+
+    if (nr_full > 0) {
+      _remix_pcm_mix_gains (full_ptrs, full_gains, nr_full, d, n, written);
+      written = 1;
+    }
+
+    if (nr_partial > 0 && !written) {
+      _remix_pcm_clear_region (d, n, NULL);
+      written = 1;
+    }
+
+    /* Sources with gaps or chunk boundaries in this tile: add piecewise */
+    for (k = 0; k < nr_partial; k++) {
+      so = partial[k]->_current_offset;
+      while (so < partial[k]->_current_offset + n) {
+	si = remix_channel_get_chunk_index_at (partial[k], so);
+	if (si == -1) {
+	  si = remix_channel_get_chunk_index_after (partial[k], so);
+	  if (si == -1) break;
+	  so = partial[k]->chunks[si]->start_index;
+	  continue;
+	}
+	partial[k]->_current_chunk = si;
+	su = partial[k]->chunks[si];
+	sn = MIN (su->start_index + partial[k]->_valid_lengths[si],
+		  partial[k]->_current_offset + n) - so;
+	if (su->_silent) {
+	  so += sn;
+	  continue;
+	}
+	full_ptrs[0] = &su->data[so - su->start_index];
+	_remix_pcm_mix_gains (full_ptrs, &partial_gains[k], 1,
+			      &d[so - partial[k]->_current_offset], sn, 1);
+	so += sn;
+      }
+    }
+
+    if (!written)
+      _remix_pcm_clear_region (d, n, NULL);
+
+  advance:
+    for (k = 0; k < nr_srcs; k++) {
+      if (srcs[k] != RemixNone) srcs[k]->_current_offset += n;
+    }
+    dest->_current_offset += n;
+    mixed += n;
+    remaining -= n;
+  }
+
+  return mixed;
+}
+
 RemixCount
 remix_channel_interleave_2 (RemixEnv * env, RemixChannel * src1, RemixChannel * src2,
 			 RemixPCM * dest, RemixCount count)
@@ -556,6 +894,74 @@ remix_channel_deinterleave_2 (RemixEnv * env, RemixChannel * dest1, RemixChannel
 				  0, src);
 }
 
+/*
+ * remix_channels_interleave (env, srcs, nr_channels, dest, count)
+ *
+ * Interleave 'count' frames of the 'nr_channels' (at most
+ * REMIX_INTERLEAVE_MAX) channels in 'srcs' into 'dest', a span of
+ * chunks common to all of them at a time. Entries of 'srcs' may be
+ * RemixNone; regions where a channel is silent or has no chunks are
+ * interleaved as silence.
+ * Stops early once every channel has run out of chunks.
+ * Returns the number of frames interleaved.
+ */
+RemixCount
+remix_channels_interleave (RemixEnv * env, RemixChannel ** srcs,
+			   int nr_channels, RemixPCM * dest, RemixCount count)
+{
+  RemixPCM * ptrs[REMIX_INTERLEAVE_MAX];
+  RemixChannel * channel;
+  RemixChunk * u;
+  RemixCount remaining = count, interleaved = 0, n, offset;
+  int k, si, more;
+
+  if (nr_channels > REMIX_INTERLEAVE_MAX) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+
+  while (remaining > 0) {
+    n = remaining;
+    more = 0;
+
+    for (k = 0; k < nr_channels; k++) {
+      ptrs[k] = NULL;
+      channel = srcs[k];
+      if (channel == RemixNone) continue;
+
+      offset = channel->_current_offset;
+      si = remix_channel_get_chunk_index_at (channel, offset);
+      if (si == -1) { /* Silence up to the next chunk, if any */
+	si = remix_channel_get_chunk_index_after (channel, offset);
+	if (si == -1) continue;
+	n = MIN (n, channel->chunks[si]->start_index - offset);
+	more = 1;
+	continue;
+      }
+
+      channel->_current_chunk = si;
+      u = channel->chunks[si];
+      n = MIN (n, remix_channel_valid_length_at (channel, offset));
+      if (!u->_silent)
+	ptrs[k] = &u->data[offset - u->start_index];
+      more = 1;
+    }
+
+    if (!more || n <= 0) break;
+
+    _remix_pcm_interleave (ptrs, nr_channels, n,
+			   &dest[interleaved * nr_channels]);
+
+    for (k = 0; k < nr_channels; k++) {
+      if (srcs[k] != RemixNone) srcs[k]->_current_offset += n;
+    }
+    interleaved += n;
+    remaining -= n;
+  }
+
+  return interleaved;
+}
+
 RemixCount
 _remix_channel_write (RemixEnv * env, RemixChannel * channel, RemixCount count,
 		   RemixChannel * data)
@@ -563,29 +969,49 @@ _remix_channel_write (RemixEnv * env, RemixChannel * channel, RemixCount count,
   RemixCount n = remix_channel_copy (env, data, channel, count);
   data->_current_offset += n;
   data->_current_chunk =
-    remix_channel_get_chunk_item_after (data, data->_current_offset);
+    remix_channel_get_chunk_index_at (data, data->_current_offset);
   channel->_current_offset += n;
   channel->_current_chunk =
-    remix_channel_get_chunk_item_after (channel, channel->_current_offset);
+    remix_channel_get_chunk_index_at (channel, channel->_current_offset);
   return n;
 }
 
 RemixCount
 _remix_channel_length (RemixEnv * env, RemixChannel * channel)
 {
-  RemixChunk * last = (RemixChunk *)
-    (cd_list_last (env, channel->chunks, CD_TYPE_POINTER)).s_pointer;
-  if (last == RemixNone) return 0;
+  RemixChunk * last;
+
+  if (channel->nr_chunks == 0) return 0;
+  last = channel->chunks[channel->nr_chunks - 1];
   return (last->start_index + last->length);
 }
 
+/*
+ * _remix_channel_view (env, view, channel)
+ *
+ * Makes 'view' read the chunks of 'channel' as they are now, from its
+ * own position. The chunks still belong to 'channel', so 'view' must
+ * only be read from, and is freed with remix_free() rather than
+ * destroyed.
+ */
+void
+_remix_channel_view (RemixEnv * env, RemixChannel * view,
+		     RemixChannel * channel)
+{
+  view->chunks = channel->chunks;
+  view->_valid_lengths = channel->_valid_lengths;
+  view->nr_chunks = channel->nr_chunks;
+  view->_max_chunks = channel->_max_chunks;
+  view->_current_chunk =
+    remix_channel_get_chunk_index_at (view, view->_current_offset);
+}
+
 RemixCount
 _remix_channel_seek (RemixEnv * env, RemixChannel * channel, RemixCount offset)
 {
   if (offset == channel->_current_offset) return offset;
   channel->_current_offset = offset;
   /* Cache the current chunk */
-  channel->_current_chunk =
-    remix_channel_get_chunk_item_after (channel, offset);
+  channel->_current_chunk = remix_channel_get_chunk_index_at (channel, offset);
   return offset;
 }
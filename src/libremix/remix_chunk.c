@@ -37,6 +37,24 @@
  * a chunk is only valid where it is not overlapped by a later chunk
  * in the same channel; elsewhere, the chunk's data is not used.
  *
+ * Cloned chunks share their data, copy-on-write: anything writing to a
+ * chunk's data must first call remix_chunk_unshare(). The _remix_chunk_*
+ * mutators and the channel chunkfuncify iterators do so for their
+ * destination chunks.
+ *
+ * A chunk may be marked silent, in which case it reads as all zero
+ * whatever its data holds; clearing a whole region of a chunk with
+ * _remix_chunk_clear_region() just sets the mark.
+ * The _remix_chunk_* functions take silence into account, eg. adding a
+ * silent chunk does nothing, and otherwise clear silent chunks with
+ * _remix_chunk_realise() before touching their data. The channel
+ * chunkfuncify iterators realise silent chunks before passing them to
+ * any other function.
+ *
+ * The data of chunks made here comes from the world's RemixChunkPool,
+ * and is REMIX_CHUNK_ALIGNMENT aligned; chunks made from a caller's
+ * buffer use it as is, and free it with remix_free().
+ *
  */
 
 #include <string.h>
@@ -44,6 +62,15 @@
 #define __REMIX__
 #include "remix.h"
 
+/* Clones may be written, and hence unshared, from parallel deck tracks */
+#if defined (__GNUC__)
+#define remix_refcount_inc(p) __sync_add_and_fetch ((p), 1)
+#define remix_refcount_dec(p) __sync_sub_and_fetch ((p), 1)
+#else
+#define remix_refcount_inc(p) (++*(p))
+#define remix_refcount_dec(p) (--*(p))
+#endif
+
 typedef RemixCount
   (*RemixPFunc) (RemixPCM * src, RemixCount count, void * data);
 
@@ -64,7 +91,9 @@ remix_chunk_new (RemixEnv * env, RemixCount start_index, RemixCount length)
   u->start_index = start_index;
   u->length = length;
 
-  u->data = (RemixPCM *) remix_malloc (length * sizeof (RemixPCM));
+  u->data = _remix_chunk_pool_alloc (env, length);
+  u->_pooled = TRUE;
+  memset (u->data, 0, length * sizeof (RemixPCM));
 
   return u;
 }
@@ -84,18 +113,97 @@ remix_chunk_new_from_buffer (RemixEnv * env, RemixCount start_index,
   return u;
 }
 
+/*
+ * remix_chunk_clone (env, chunk)
+ *
+ * Returns a new chunk sharing the data of 'chunk' until either is
+ * unshared.
+ */
 RemixChunk *
 remix_chunk_clone (RemixEnv * env, RemixChunk * chunk)
 {
-  RemixChunk * u = remix_chunk_new (env, chunk->start_index, chunk->length);
-  memcpy (u->data, chunk->data, (chunk->length * sizeof (RemixPCM)));
+  RemixChunk * u;
+
+  u = (RemixChunk *) remix_malloc (sizeof (struct _RemixChunk));
+  u->start_index = chunk->start_index;
+  u->length = chunk->length;
+  u->data = chunk->data;
+  u->_silent = chunk->_silent;
+  u->_pooled = chunk->_pooled;
+
+  if (chunk->_refcount == NULL) {
+    chunk->_refcount = (int *) remix_malloc (sizeof (int));
+    *chunk->_refcount = 1;
+  }
+  remix_refcount_inc (chunk->_refcount);
+  u->_refcount = chunk->_refcount;
+
   return u;
 }
 
+static void
+remix_chunk_free_data (RemixEnv * env, RemixChunk * chunk)
+{
+  if (chunk->_pooled)
+    _remix_chunk_pool_free (env, chunk->data, chunk->length);
+  else
+    remix_free (chunk->data);
+}
+
+/*
+ * remix_chunk_release_data (env, chunk)
+ *
+ * Drops the reference of 'chunk' to its data, freeing the data if no
+ * other chunk shares it.
+ */
+static void
+remix_chunk_release_data (RemixEnv * env, RemixChunk * chunk)
+{
+  if (chunk->_refcount == NULL) {
+    remix_chunk_free_data (env, chunk);
+  } else if (remix_refcount_dec (chunk->_refcount) == 0) {
+    remix_free (chunk->_refcount);
+    remix_chunk_free_data (env, chunk);
+  }
+
+  chunk->data = NULL;
+  chunk->_refcount = NULL;
+}
+
+/*
+ * remix_chunk_unshare (env, chunk)
+ *
+ * Gives 'chunk' its own copy of its data, if it is shared with any
+ * clones, so that it can be written.
+ */
+RemixChunk *
+remix_chunk_unshare (RemixEnv * env, RemixChunk * chunk)
+{
+  RemixPCM * data;
+
+  if (chunk->_refcount == NULL) return chunk;
+
+  if (*chunk->_refcount == 1) {
+    /* All clones are gone */
+    remix_free (chunk->_refcount);
+    chunk->_refcount = NULL;
+    return chunk;
+  }
+
+  data = _remix_chunk_pool_alloc (env, chunk->length);
+  memcpy (data, chunk->data, chunk->length * sizeof (RemixPCM));
+
+  remix_chunk_release_data (env, chunk);
+  chunk->data = data;
+  chunk->_pooled = TRUE;
+
+  return chunk;
+}
+
 void
 remix_chunk_free (RemixEnv * env, RemixChunk * chunk)
 {
-  remix_free (chunk->data);
+  remix_chunk_release_data (env, chunk);
   remix_free (chunk);
 }
 
@@ -109,10 +217,65 @@ RemixCount
 remix_chunk_clear (RemixEnv * env, RemixChunk * chunk)
 {
   RemixCount len = chunk->length;
+  remix_chunk_unshare (env, chunk);
   memset (chunk->data, (RemixPCM)0, len * sizeof (RemixPCM));
+  chunk->_silent = FALSE;
   return len;
 }
 
+/*
+ * _remix_chunk_realise (env, chunk)
+ *
+ * Fills a silent chunk's data with zeroes and removes its silent mark,
+ * so that the data can be accessed directly.
+ */
+RemixChunk *
+_remix_chunk_realise (RemixEnv * env, RemixChunk * chunk)
+{
+  if (!chunk->_silent) return chunk;
+
+  if (chunk->_refcount != NULL && *chunk->_refcount > 1) {
+    /* Don't bother copying the shared data just to clear it */
+    remix_chunk_release_data (env, chunk);
+    chunk->data = _remix_chunk_pool_alloc (env, chunk->length);
+    chunk->_pooled = TRUE;
+  } else {
+    remix_chunk_unshare (env, chunk);
+  }
+  memset (chunk->data, (RemixPCM)0, chunk->length * sizeof (RemixPCM));
+
+  chunk->_silent = FALSE;
+
+  return chunk;
+}
+
+/*
+ * remix_chunk_span (chunk, offset, count)
+ *
+ * Returns how many of 'count' samples from stream index 'offset' lie
+ * within 'chunk'.
+ */
+static RemixCount
+remix_chunk_span (RemixChunk * chunk, RemixCount offset, RemixCount count)
+{
+  RemixCount end = MIN (offset + count, chunk->start_index + chunk->length);
+  offset = MAX (offset, chunk->start_index);
+  return MAX (end - offset, 0);
+}
+
+/*
+ * remix_chunk_covers (chunk, offset, count)
+ *
+ * Returns TRUE if the 'count' samples from stream index 'offset' cover
+ * all of 'chunk'.
+ */
+static int
+remix_chunk_covers (RemixChunk * chunk, RemixCount offset, RemixCount count)
+{
+  return (offset <= chunk->start_index &&
+	  offset + count >= chunk->start_index + chunk->length);
+}
+
 
 /*
  * FUNCTION APPLIERS
@@ -134,6 +297,8 @@ _remix_pfunc_apply (RemixEnv * env, RemixPFunc func, RemixChunk * chunk,
     count = chunk->length - chunk_start;
   }
 
+  _remix_chunk_realise (env, chunk);
+  remix_chunk_unshare (env, chunk);
   func (&chunk->data[chunk_start], count, data);
 
   return (count);
@@ -171,6 +336,9 @@ _remix_ppfunc_apply (RemixEnv * env, RemixPPFunc func,
   if (dest_start + count > dest->length)
     count = dest->length - dest_start;
 
+  _remix_chunk_realise (env, src);
+  _remix_chunk_realise (env, dest);
+  remix_chunk_unshare (env, dest);
   s = &src->data[src_start];
   d = &dest->data[dest_start];
 
@@ -218,6 +386,10 @@ _remix_pppfunc_apply (RemixEnv * env, RemixPPPFunc func,
   if (dest_start + count > dest->length)
     count = dest->length - dest_start;
 
+  _remix_chunk_realise (env, src1);
+  _remix_chunk_realise (env, src2);
+  _remix_chunk_realise (env, dest);
+  remix_chunk_unshare (env, dest);
   s1 = &src1->data[src1_start];
   s2 = &src2->data[src2_start];
   d = &dest->data[dest_start];
@@ -240,6 +412,13 @@ _remix_chunk_clear_region (RemixEnv * env, RemixChunk * chunk,
                            RemixCount start, RemixCount length,
                            int channelname, void * unused)
 {
+  if (chunk->_silent) return remix_chunk_span (chunk, start, length);
+
+  if (remix_chunk_covers (chunk, start, length)) {
+    chunk->_silent = TRUE;
+    return remix_chunk_span (chunk, start, length);
+  }
+
   return _remix_pfunc_apply (env,_remix_pcm_clear_region,
                              chunk, start, length, NULL);
 }
@@ -256,6 +435,8 @@ _remix_chunk_gain (RemixEnv * env, RemixChunk * chunk,
                    RemixCount start, RemixCount count,
                    int channelname, /* (RemixPCM *) */ void * gain)
 {
+  if (chunk->_silent) return remix_chunk_span (chunk, start, count);
+
   return _remix_pfunc_apply (env, _remix_pcm_gain, chunk, start, count, gain);
 }
 
@@ -273,6 +454,15 @@ _remix_chunk_copy (RemixEnv * env, RemixChunk * src, RemixCount src_offset,
                    RemixChunk * dest, RemixCount dest_offset, RemixCount count,
                    int channelname, void * unused)
 {
+  count = MIN (count, remix_chunk_span (src, src_offset, count));
+
+  if (src->_silent)
+    return _remix_chunk_clear_region (env, dest, dest_offset, count, 0, NULL);
+
+  /* Overwriting all of a silent chunk, so no need to clear it first */
+  if (remix_chunk_covers (dest, dest_offset, count))
+    dest->_silent = FALSE;
+
   return _remix_ppfunc_apply (env, _remix_pcm_copy, src, src_offset,
                               dest, dest_offset, count, NULL);
 }
@@ -289,6 +479,14 @@ _remix_chunk_add_inplace (RemixEnv * env,
                           RemixChunk * dest, RemixCount dest_offset,
                           RemixCount count, int channelname, void * unused)
 {
+  if (src->_silent)
+    return MIN (remix_chunk_span (src, src_offset, count),
+		remix_chunk_span (dest, dest_offset, count));
+
+  if (dest->_silent)
+    return _remix_chunk_copy (env, src, src_offset, dest, dest_offset, count,
+			      channelname, NULL);
+
   return _remix_ppfunc_apply (env, _remix_pcm_add, src, src_offset,
 			   dest, dest_offset, count, NULL);
 			   
@@ -306,6 +504,14 @@ _remix_chunk_mult_inplace (RemixEnv * env,
                            RemixChunk * dest, RemixCount dest_offset,
                            RemixCount count, int channelname, void * unused)
 {
+  count = MIN (count, remix_chunk_span (src, src_offset, count));
+
+  if (dest->_silent)
+    return remix_chunk_span (dest, dest_offset, count);
+
+  if (src->_silent)
+    return _remix_chunk_clear_region (env, dest, dest_offset, count, 0, NULL);
+
   return _remix_ppfunc_apply (env, _remix_pcm_mult, src, src_offset,
 			   dest, dest_offset, count, NULL);
 }
@@ -322,6 +528,10 @@ _remix_chunk_fade_inplace (RemixEnv * env,
                            RemixChunk * dest, RemixCount dest_offset,
                            RemixCount count, int channelname, void * unused)
 {
+  if (src->_silent || dest->_silent)
+    return MIN (remix_chunk_span (src, src_offset, count),
+		remix_chunk_span (dest, dest_offset, count));
+
   return _remix_ppfunc_apply (env, _remix_pcm_fade, src, src_offset,
 			   dest, dest_offset, count, NULL);
 }
@@ -360,6 +570,13 @@ _remix_chunk_deinterleave_2 (RemixEnv * env,
                              RemixChunk * dest2, RemixCount dest2_offset,
                              RemixCount count, int unused, void * src)
 {
+  /* Overwriting all of a silent chunk, so no need to clear it first */
+  if (remix_chunk_covers (dest1, dest1_offset, count))
+    dest1->_silent = FALSE;
+  if (remix_chunk_covers (dest2, dest2_offset, count))
+    dest2->_silent = FALSE;
+
+  remix_chunk_unshare (env, dest1);
   return _remix_ppfunc_apply (env, _remix_pcm_deinterleave_2,
                               dest1, dest1_offset, dest2, dest2_offset,
                               count, src);
@@ -381,6 +598,17 @@ _remix_chunk_blend_inplace (RemixEnv * env,
                             RemixChunk * dest, RemixCount dest_offset,
                             RemixCount count, int channelname, void * unused)
 {
+  count = MIN (count, remix_chunk_span (blend, blend_offset, count));
+
+  /* With no blend, dest is replaced by src */
+  if (blend->_silent)
+    return _remix_chunk_copy (env, src, src_offset, dest, dest_offset, count,
+			      channelname, NULL);
+
+  if (src->_silent && dest->_silent)
+    return MIN (remix_chunk_span (src, src_offset, count),
+		remix_chunk_span (dest, dest_offset, count));
+
   return _remix_pppfunc_apply (env, _remix_pcm_blend, src, src_offset,
                                blend, blend_offset, dest, dest_offset,
                                count, NULL);
@@ -0,0 +1,233 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixCommandQueue: live edits during playback.
+ *
+ * Description
+ * -----------
+ *
+ * Each RemixEnv made by remix_init() or remix_init_clone() owns two
+ * fixed-size rings. Commands posted to an env with remix_post() are run
+ * by that env's thread at the start of its next top-level remix_process()
+ * call, or when it calls remix_drain(); an edit made by a command thus
+ * never overlaps processing, and takes effect at a block boundary.
+ *
+ * Commands which unlink bases from the graph hand them to remix_retire()
+ * rather than destroying them on the processing thread. Another thread
+ * destroys them later with remix_reclaim().
+ *
+ * Invariants
+ * ----------
+ *
+ * Each ring has a single producer and a single consumer thread: one
+ * thread may post to an env while the env's own thread drains it, and
+ * one thread may reclaim from an env while the env's thread retires.
+ *
+ * Posting, draining, retiring and reclaiming take no locks and do not
+ * allocate memory.
+ */
+
+#include <config.h>
+
+#define __REMIX__
+#include "remix.h"
+
+/* Number of commands in each ring; a power of two */
+#define REMIX_COMMAND_QUEUE_LENGTH 256
+
+typedef struct _RemixCommand RemixCommand;
+
+struct _RemixCommand {
+  RemixCommandFunc func;
+  void * data;
+};
+
+struct _RemixCommandQueue {
+  unsigned int head; /* next to take; written by the consumer */
+  unsigned int tail; /* next to fill; written by the producer */
+  RemixCommand commands[REMIX_COMMAND_QUEUE_LENGTH];
+};
+
+static RemixCommandQueue *
+remix_command_queue_new (void)
+{
+  return (RemixCommandQueue *)
+    remix_malloc (sizeof (struct _RemixCommandQueue));
+}
+
+static int
+remix_command_queue_push (RemixCommandQueue * queue, RemixCommandFunc func,
+			  void * data)
+{
+  unsigned int tail = queue->tail;
+  RemixCommand * command;
+
+  if (tail - _remix_load_acquire (&queue->head) == REMIX_COMMAND_QUEUE_LENGTH)
+    return -1;
+
+  command = &queue->commands[tail % REMIX_COMMAND_QUEUE_LENGTH];
+  command->func = func;
+  command->data = data;
+
+  _remix_store_release (&queue->tail, tail + 1);
+
+  return 0;
+}
+
+static int
+remix_command_queue_pop (RemixCommandQueue * queue, RemixCommand * command)
+{
+  unsigned int head = queue->head;
+
+  if (head == _remix_load_acquire (&queue->tail))
+    return -1;
+
+  *command = queue->commands[head % REMIX_COMMAND_QUEUE_LENGTH];
+
+  _remix_store_release (&queue->head, head + 1);
+
+  return 0;
+}
+
+void
+_remix_commands_init (RemixEnv * env)
+{
+  env->_commands = remix_command_queue_new ();
+  env->_retired = remix_command_queue_new ();
+}
+
+/*
+ * _remix_commands_destroy (env)
+ *
+ * Runs any commands still pending on 'env', destroys any bases it has
+ * retired, and frees its rings.
+ */
+void
+_remix_commands_destroy (RemixEnv * env)
+{
+  if (env->_commands == RemixNone) return;
+
+  remix_drain (env);
+  remix_reclaim (env, env);
+
+  remix_free (env->_commands);
+  remix_free (env->_retired);
+
+  env->_commands = RemixNone;
+  env->_retired = RemixNone;
+}
+
+/*
+ * remix_post (env, target, func, data)
+ *
+ * Queues a call of func (target, data) to be made by the thread of
+ * 'target' at its next block boundary. Only one thread may post to
+ * any given 'target'. Returns 0 on success, or -1 if the queue of
+ * 'target' is full.
+ */
+int
+remix_post (RemixEnv * env, RemixEnv * target, RemixCommandFunc func,
+	    void * data)
+{
+  if (target == RemixNone || target->_commands == RemixNone ||
+      func == NULL) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+
+  if (remix_command_queue_push (target->_commands, func, data) == -1) {
+    remix_set_error (env, REMIX_ERROR_FULL);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * remix_drain (env)
+ *
+ * Runs all commands posted to 'env', in the order they were posted.
+ * This is done automatically at the start of each top-level
+ * remix_process() on 'env'. Returns the number of commands run.
+ */
+int
+remix_drain (RemixEnv * env)
+{
+  RemixCommand command;
+  int n = 0;
+
+  if (env->_commands == RemixNone) return 0;
+
+  while (remix_command_queue_pop (env->_commands, &command) == 0) {
+    command.func (env, command.data);
+    n++;
+  }
+
+  return n;
+}
+
+/*
+ * remix_retire (env, base)
+ *
+ * Hands 'base', which must no longer be reachable from anything 'env'
+ * processes, to be destroyed by a later remix_reclaim(). Returns 0 on
+ * success, or -1 if too many bases are awaiting reclamation.
+ */
+int
+remix_retire (RemixEnv * env, RemixBase * base)
+{
+  if (base == RemixNone || env->_retired == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+
+  if (remix_command_queue_push (env->_retired, NULL, base) == -1) {
+    remix_set_error (env, REMIX_ERROR_FULL);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * remix_reclaim (env, target)
+ *
+ * Destroys, in 'env', the bases retired on 'target'. Only one thread
+ * may reclaim from any given 'target'. Returns the number of bases
+ * destroyed.
+ */
+int
+remix_reclaim (RemixEnv * env, RemixEnv * target)
+{
+  RemixCommand command;
+  int n = 0;
+
+  if (target == RemixNone || target->_retired == RemixNone) return 0;
+
+  while (remix_command_queue_pop (target->_retired, &command) == 0) {
+    remix_destroy (env, (RemixBase *)command.data);
+    n++;
+  }
+
+  return n;
+}
@@ -47,12 +47,17 @@ remix_context_destroy (RemixEnv * env)
 
   world->purging = 1;
 
+  _remix_thread_pool_destroy (env);
+  _remix_io_thread_destroy (env);
+
   world->plugins = cd_list_destroy_with (env, world->plugins, remix_plugin_destroy);
   remix_plugin_defaults_unload (env);
 
   //world->bases = cd_list_destroy_with (env, world->bases, remix_destroy);
 
   remix_channelset_defaults_destroy (env);
+  _remix_chunk_pool_destroy (env);
+  _remix_page_cache_destroy (env);
   remix_free (ctx);
   remix_free (world);
 }
@@ -64,6 +69,7 @@ remix_add_thread_context (RemixContext * ctx, RemixWorld * world)
   env->context = ctx;
   env->world = world;
   world->refcount++;
+  _remix_commands_init (env);
   return env;
 }
 
@@ -136,12 +142,21 @@ remix_init (void)
   world->plugins = cd_list_new (ctx);
   world->bases = cd_list_new (ctx);
   world->purging = FALSE;
+  world->_pool = NULL;
+  world->_read_ahead = 0;
+  world->_io = NULL;
+  world->_graph_serial = 0;
+
+  remix_debug_init ();
+  remix_pcm_init_kernels ();
 
   ctx->mixlength = REMIX_DEFAULT_MIXLENGTH;
   ctx->samplerate = REMIX_DEFAULT_SAMPLERATE;
   ctx->tempo = REMIX_DEFAULT_TEMPO;
 
   env = remix_add_thread_context (ctx, world);
+  _remix_chunk_pool_init (env);
+  _remix_page_cache_init (env);
   remix_channelset_defaults_initialise (env);
   ctx->channels = REMIX_MONO;
 
@@ -164,6 +179,7 @@ void
 remix_purge (RemixEnv * env)
 {
   RemixWorld * world = env->world;
+  _remix_commands_destroy (env);
   world->refcount--;
   if (world->refcount <= 0) {
     remix_context_destroy (env);
@@ -274,7 +290,10 @@ RemixEnv *
 _remix_register_base (RemixEnv * env, RemixBase * base)
 {
   RemixWorld * world = env->world;
-  world->bases = cd_list_append (env, world->bases, CD_POINTER(base));
+  _remix_world_lock (env);
+  world->bases = cd_list_prepend (env, world->bases, CD_POINTER(base));
+  base->_world_item = world->bases;
+  _remix_world_unlock (env);
   return env;
 }
 
@@ -282,10 +301,12 @@ RemixEnv *
 _remix_unregister_base (RemixEnv * env, RemixBase * base)
 {
   RemixWorld * world = env->world;
-  if (world->purging) return env;
+  if (world->purging || base->_world_item == RemixNone) return env;
 
-  world->bases = cd_list_remove (env, world->bases, CD_TYPE_POINTER,
-				 CD_POINTER(base));
+  _remix_world_lock (env);
+  world->bases = cd_list_remove_item (env, world->bases, base->_world_item);
+  base->_world_item = RemixNone;
+  _remix_world_unlock (env);
   return env;
 }
 
@@ -0,0 +1,317 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixConverter: conversion of RemixPCM to integer output formats.
+ *
+ * Description
+ * -----------
+ *
+ * A converter turns planar or interleaved RemixPCM data into interleaved
+ * S16, S24 or S32 samples, as used by output devices and sound files.
+ * Full scale is [-1.0, 1.0); samples beyond it saturate.
+ *
+ * Scaling, dithering, saturation and rounding are done by the
+ * _remix_pcm_quantise() kernel, in vectors where the CPU allows.
+ * Triangular (TPDF) dither of +/- 1 LSB decorrelates the quantisation
+ * error from the signal. With noise shaping, the error is also fed back
+ * through a three tap filter which moves its power towards high
+ * frequencies; this depends on the previous output of each channel, so
+ * is done one sample at a time.
+ *
+ * Invariants
+ * ----------
+ *
+ * Planar channels given as NULL are converted to digital silence,
+ * without dither.
+ *
+ * Conversion does not allocate memory.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <math.h>
+
+#define __REMIX__
+#include "remix.h"
+
+/* Samples converted at a time */
+#define REMIX_CONVERT_BLOCK 256
+
+/* Noise shaping error filter (Wannamaker's 3 tap E-weighted filter) */
+#define REMIX_SHAPING_TAPS 3
+static const RemixPCM shaping[REMIX_SHAPING_TAPS] = { 1.623, -0.982, 0.109 };
+
+struct _RemixConverter {
+  RemixSampleFormat format;
+  RemixDither dither;
+  int nr_channels;
+  RemixPCM scale; /* full scale, in output LSBs */
+  RemixPCM max; /* largest output value representable as a RemixPCM */
+  unsigned int seed;
+  RemixPCM * error; /* past errors of each channel, latest first */
+};
+
+/*
+ * remix_converter_new (env, format, dither, nr_channels)
+ *
+ * Creates a converter producing 'nr_channels' interleaved channels of
+ * 'format' samples, with 'dither'.
+ */
+RemixConverter *
+remix_converter_new (RemixEnv * env, RemixSampleFormat format,
+		     RemixDither dither, int nr_channels)
+{
+  RemixConverter * converter;
+
+  if (nr_channels < 1) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return RemixNone;
+  }
+
+  converter = remix_malloc (sizeof (struct _RemixConverter));
+  converter->format = format;
+  converter->dither = dither;
+  converter->nr_channels = nr_channels;
+  converter->seed = 0x2545f491;
+  converter->error = remix_malloc (nr_channels * REMIX_SHAPING_TAPS *
+				   sizeof (RemixPCM));
+
+  switch (format) {
+  case REMIX_FORMAT_S16:
+    converter->scale = 32768.0;
+    converter->max = 32767.0;
+    break;
+  case REMIX_FORMAT_S24:
+  case REMIX_FORMAT_S24_32:
+    converter->scale = 8388608.0;
+    converter->max = 8388607.0;
+    break;
+  case REMIX_FORMAT_S32:
+  default:
+    /* 2^31 - 1 is not a float; this is the largest float below 2^31 */
+    converter->scale = 2147483648.0;
+    converter->max = 2147483520.0;
+    break;
+  }
+
+  return converter;
+}
+
+void
+remix_converter_destroy (RemixEnv * env, RemixConverter * converter)
+{
+  if (converter == RemixNone) return;
+
+  remix_free (converter->error);
+  remix_free (converter);
+}
+
+/* A uniform random value in [0, 1), by xorshift */
+static RemixPCM
+remix_converter_random (RemixConverter * converter)
+{
+  unsigned int x = converter->seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  converter->seed = x;
+
+  return (RemixPCM)((x >> 8) & 0xffffff) * (1.0 / 16777216.0);
+}
+
+static RemixPCM
+remix_converter_tpdf (RemixConverter * converter)
+{
+  return remix_converter_random (converter) -
+    remix_converter_random (converter);
+}
+
+/*
+ * remix_converter_pack (converter, q, dest, index, stride, count)
+ *
+ * Stores the 'count' quantised samples 'q' as output samples 'index',
+ * 'index' + 'stride', ... of 'dest'.
+ */
+static void
+remix_converter_pack (RemixConverter * converter, int * q, void * dest,
+		      RemixCount index, int stride, RemixCount count)
+{
+  short * s16;
+  unsigned char * s24;
+  int * s32;
+  RemixCount i;
+
+  switch (converter->format) {
+  case REMIX_FORMAT_S16:
+    s16 = (short *)dest + index;
+    for (i = 0; i < count; i++)
+      s16[i * stride] = q[i];
+    break;
+  case REMIX_FORMAT_S24:
+    s24 = (unsigned char *)dest + 3 * index;
+    for (i = 0; i < count; i++, s24 += 3 * stride) {
+#ifdef WORDS_BIGENDIAN
+      s24[0] = q[i] >> 16; s24[1] = q[i] >> 8; s24[2] = q[i];
+#else
+      s24[0] = q[i]; s24[1] = q[i] >> 8; s24[2] = q[i] >> 16;
+#endif
+    }
+    break;
+  case REMIX_FORMAT_S24_32:
+    s32 = (int *)dest + index;
+    for (i = 0; i < count; i++)
+      s32[i * stride] = (int)((unsigned int)q[i] << 8);
+    break;
+  case REMIX_FORMAT_S32:
+  default:
+    s32 = (int *)dest + index;
+    for (i = 0; i < count; i++)
+      s32[i * stride] = q[i];
+    break;
+  }
+}
+
+/*
+ * remix_converter_shape (converter, channel, src, src_stride, q, count)
+ *
+ * Quantises 'count' samples of 'src', taken 'src_stride' apart, with
+ * dither and noise shaping of the error in 'channel'.
+ */
+static void
+remix_converter_shape (RemixConverter * converter, int channel,
+		       RemixPCM * src, int src_stride, int * q,
+		       RemixCount count)
+{
+  RemixPCM * e = &converter->error[channel * REMIX_SHAPING_TAPS];
+  RemixPCM scale = converter->scale, max = converter->max, v, x;
+  RemixCount i;
+  long r;
+
+  for (i = 0; i < count; i++) {
+    v = src[i * src_stride] * scale -
+      (shaping[0] * e[0] + shaping[1] * e[1] + shaping[2] * e[2]);
+    r = lrintf (v + remix_converter_tpdf (converter));
+
+    /* The error is taken before saturation, which keeps it bounded */
+    e[2] = e[1];
+    e[1] = e[0];
+    e[0] = (RemixPCM)r - v;
+
+    x = (RemixPCM)r;
+    if (x > max) x = max;
+    else if (x < -scale) x = -scale;
+    q[i] = (int) lrintf (x);
+  }
+}
+
+/*
+ * remix_converter_run (converter, channel, src, src_stride, dest, index,
+ *                      dest_stride, count)
+ *
+ * Converts 'count' samples of 'src', taken 'src_stride' apart, to output
+ * samples 'index', 'index' + 'dest_stride', ... of 'dest'. The samples
+ * must all belong to 'channel' if noise shaping, and 'src_stride' must
+ * be 1 otherwise.
+ */
+static void
+remix_converter_run (RemixConverter * converter, int channel,
+		     RemixPCM * src, int src_stride,
+		     void * dest, RemixCount index, int dest_stride,
+		     RemixCount count)
+{
+  int q[REMIX_CONVERT_BLOCK];
+  RemixPCM dither[REMIX_CONVERT_BLOCK];
+  RemixCount n, i;
+
+  while (count > 0) {
+    n = MIN (count, REMIX_CONVERT_BLOCK);
+
+    if (src == NULL) {
+      memset (q, 0, n * sizeof (int));
+    } else if (converter->dither == REMIX_DITHER_SHAPED) {
+      remix_converter_shape (converter, channel, src, src_stride, q, n);
+      src += n * src_stride;
+    } else if (converter->dither == REMIX_DITHER_TPDF) {
+      for (i = 0; i < n; i++)
+	dither[i] = remix_converter_tpdf (converter);
+      _remix_pcm_quantise (src, dither, q, n, converter->scale,
+			   converter->max);
+      src += n;
+    } else {
+      _remix_pcm_quantise (src, NULL, q, n, converter->scale,
+			   converter->max);
+      src += n;
+    }
+
+    remix_converter_pack (converter, q, dest, index, dest_stride, n);
+
+    index += n * dest_stride;
+    count -= n;
+  }
+}
+
+/*
+ * remix_convert_interleaved (env, converter, src, dest, count)
+ *
+ * Converts 'count' frames of interleaved data from 'src' into 'dest'.
+ * Returns 'count'.
+ */
+RemixCount
+remix_convert_interleaved (RemixEnv * env, RemixConverter * converter,
+			   RemixPCM * src, void * dest, RemixCount count)
+{
+  int c, nr_channels = converter->nr_channels;
+
+  if (converter->dither == REMIX_DITHER_SHAPED) {
+    for (c = 0; c < nr_channels; c++)
+      remix_converter_run (converter, c, src + c, nr_channels,
+			   dest, c, nr_channels, count);
+  } else {
+    remix_converter_run (converter, 0, src, 1, dest, 0, 1,
+			 count * nr_channels);
+  }
+
+  return count;
+}
+
+/*
+ * remix_convert_planar (env, converter, srcs, dest, count)
+ *
+ * Converts 'count' frames from the channel buffers 'srcs', one for each
+ * of the converter's channels, into interleaved frames in 'dest'.
+ * Returns 'count'.
+ */
+RemixCount
+remix_convert_planar (RemixEnv * env, RemixConverter * converter,
+		      RemixPCM ** srcs, void * dest, RemixCount count)
+{
+  int c, nr_channels = converter->nr_channels;
+
+  for (c = 0; c < nr_channels; c++)
+    remix_converter_run (converter, c, srcs[c], 1, dest, c, nr_channels,
+			 count);
+
+  return count;
+}
@@ -28,17 +28,100 @@
  * Description
  * -----------
  *
- * This file contains printing routines for formatted debugging.
+ * This file contains printing routines for formatted debugging, and
+ * the allocation trap.
+ *
+ * Once prepared with remix_prepare(), remix_process() must not allocate
+ * or free memory, so that it can run in a real-time audio thread. If the
+ * environment variable REMIX_DEBUG_ALLOC is set when remix_init() is
+ * first called, any remix_malloc() or remix_free() made while a thread
+ * is inside remix_process() prints a message and aborts, to be caught in
+ * a debugger. The trap needs thread-local storage, and is only available
+ * when built with GCC.
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 
 #define __REMIX__
 #include "remix.h"
 
+#if defined (__GNUC__)
+#define REMIX_ALLOC_TRAP
+static __thread int process_depth = 0;
+#endif
+
+static int alloc_trap = -1; /* not yet read from the environment */
+
+/*
+ * remix_debug_init (void)
+ *
+ * Reads the debugging options from the environment.
+ */
+void
+remix_debug_init (void)
+{
+  if (alloc_trap == -1)
+    alloc_trap = (getenv ("REMIX_DEBUG_ALLOC") != NULL);
+}
+
+/*
+ * _remix_process_enter (void), _remix_process_leave (void)
+ *
+ * Mark the calling thread as entering and leaving remix_process().
+ */
+void
+_remix_process_enter (void)
+{
+#ifdef REMIX_ALLOC_TRAP
+  process_depth++;
+#endif
+}
+
+void
+_remix_process_leave (void)
+{
+#ifdef REMIX_ALLOC_TRAP
+  process_depth--;
+#endif
+}
+
+/*
+ * _remix_alloc_check (void)
+ *
+ * Aborts if the allocation trap is set and the calling thread is
+ * processing.
+ */
+void
+_remix_alloc_check (void)
+{
+#ifdef REMIX_ALLOC_TRAP
+  if (process_depth > 0 && alloc_trap > 0) {
+    fprintf (stderr, "libremix: memory allocated or freed in remix_process\n");
+    abort ();
+  }
+#endif
+}
+
+void *
+_remix_malloc (size_t size)
+{
+  _remix_alloc_check ();
+  return calloc (1, size);
+}
+
+void
+_remix_free (void * ptr)
+{
+  _remix_alloc_check ();
+  free (ptr);
+}
+
+#ifdef DEBUG
 static int indent = 0;
+#endif
 
 /*
  * remix_debug_down (void)
@@ -46,7 +129,9 @@ static int indent = 0;
 void
 remix_debug_down (void)
 {
+#ifdef DEBUG
   indent ++;
+#endif
 }
 
 /*
@@ -55,7 +140,9 @@ remix_debug_down (void)
 void
 remix_debug_up (void)
 {
+#ifdef DEBUG
   indent --;
+#endif
 }
 
 /*
@@ -46,15 +46,65 @@
 /* Optimisation dependencies: optimise on change of nr. tracks */
 static RemixDeck * remix_deck_optimise (RemixEnv * env, RemixDeck * deck);
 
+/*
+ * remix_deck_ensure_mixstreams (env, deck, resize)
+ *
+ * Makes sure the deck has one scratch stream per track, each of the
+ * deck's mixlength, and room for the per-track render job. Existing
+ * streams are kept unless 'resize' is set and they no longer fit the
+ * mixlength and channels.
+ */
 static RemixDeck *
-remix_deck_replace_mixstream (RemixEnv * env, RemixDeck * deck)
+remix_deck_ensure_mixstreams (RemixEnv * env, RemixDeck * deck, int resize)
 {
   RemixCount mixlength = _remix_base_get_mixlength (env, deck);
+  int nr_tracks = cd_list_length (env, deck->tracks);
+  RemixStream * mixstream;
+  CDList * l;
+
+  if (resize) {
+    for (l = deck->_mixstreams; l; l = l->next) {
+      l->data.s_pointer =
+	_remix_stream_ensure_contiguous (env, (RemixStream *)l->data.s_pointer,
+					 mixlength);
+    }
+  }
+
+  if (deck->_nr_mixstreams == nr_tracks && deck->_gains != NULL)
+    return deck;
 
-  if (deck->_mixstream != RemixNone)
-    remix_destroy (env, (RemixBase *)deck->_mixstream);
+  while (deck->_nr_mixstreams < nr_tracks) {
+    mixstream = remix_stream_new_contiguous (env, mixlength);
+    deck->_mixstreams = cd_list_prepend (env, deck->_mixstreams,
+                                         CD_POINTER(mixstream));
+    deck->_nr_mixstreams++;
+  }
+
+  while (deck->_nr_mixstreams > nr_tracks) {
+    mixstream = (RemixStream *)deck->_mixstreams->data.s_pointer;
+    deck->_mixstreams = cd_list_remove (env, deck->_mixstreams,
+                                        CD_TYPE_POINTER,
+                                        CD_POINTER(mixstream));
+    remix_destroy (env, (RemixBase *)mixstream);
+    deck->_nr_mixstreams--;
+  }
 
-  deck->_mixstream = remix_stream_new_contiguous (env, mixlength);
+  if (deck->_gains != NULL) remix_free (deck->_gains);
+  if (deck->_trackv != NULL) remix_free (deck->_trackv);
+  if (deck->_mixstreamv != NULL) remix_free (deck->_mixstreamv);
+  if (deck->_counts != NULL) remix_free (deck->_counts);
+  if (deck->_errors != NULL) remix_free (deck->_errors);
+
+  nr_tracks = MAX (nr_tracks, 1);
+  deck->_gains = (RemixPCM *) remix_malloc (nr_tracks * sizeof (RemixPCM));
+  deck->_trackv = (RemixTrack **) remix_malloc (nr_tracks *
+                                                sizeof (RemixTrack *));
+  deck->_mixstreamv = (RemixStream **) remix_malloc (nr_tracks *
+                                                     sizeof (RemixStream *));
+  deck->_counts = (RemixCount *) remix_malloc (nr_tracks *
+                                               sizeof (RemixCount));
+  deck->_errors = (RemixError *) remix_malloc (nr_tracks *
+                                               sizeof (RemixError));
 
   return deck;
 }
@@ -64,8 +114,16 @@ remix_deck_init (RemixEnv * env, RemixBase * base)
 {
   RemixDeck * deck = (RemixDeck *)base;
   deck->tracks = cd_list_new (env);
-  deck->_mixstream = RemixNone;
-  remix_deck_replace_mixstream (env, deck);
+  deck->_mixstreams = cd_list_new (env);
+  deck->_gains = NULL;
+  deck->_nr_mixstreams = 0;
+  deck->_trackv = NULL;
+  deck->_mixstreamv = NULL;
+  deck->_counts = NULL;
+  deck->_errors = NULL;
+  deck->_reach_serial = 0;
+  deck->_shared = -1;
+  deck->_shared_serial = 0;
   remix_deck_optimise (env, deck);
   return (RemixBase *)deck;
 }
@@ -83,8 +141,11 @@ remix_deck_clone (RemixEnv * env, RemixBase * base)
 {
   RemixDeck * deck = (RemixDeck *)base;
   RemixDeck * new_deck = remix_deck_new (env);
-  new_deck->tracks = cd_list_clone (env, deck->tracks,
-				    (CDCloneFunc)remix_track_clone);
+  new_deck->tracks =
+    cd_list_clone_with (env, deck->tracks,
+			(CDCloneWithFunc)remix_track_clone_with_deck,
+			new_deck);
+  remix_deck_optimise (env, new_deck);
   return (RemixBase *)new_deck;
 }
 
@@ -93,30 +154,57 @@ remix_deck_destroy (RemixEnv * env, RemixBase * base)
 {
   RemixDeck * deck = (RemixDeck *)base;
   remix_destroy_list (env, deck->tracks);
-  remix_destroy (env, (RemixBase *)deck->_mixstream);
+  remix_destroy_list (env, deck->_mixstreams);
+  if (deck->_gains != NULL) remix_free (deck->_gains);
+  if (deck->_trackv != NULL) remix_free (deck->_trackv);
+  if (deck->_mixstreamv != NULL) remix_free (deck->_mixstreamv);
+  if (deck->_counts != NULL) remix_free (deck->_counts);
+  if (deck->_errors != NULL) remix_free (deck->_errors);
   remix_free (deck);
   return 0;
 }
 
-static int
-remix_deck_ready (RemixEnv * env, RemixBase * base)
-{
-  return (remix_base_encompasses_mixlength (env, base) &&
-	  remix_base_encompasses_channels (env, base));
-}
-
+/*
+ * remix_deck_prepare (env, base)
+ *
+ * Resizes the deck's scratch streams if need be, and prepares its
+ * tracks. Decks have no ready() method, so that they are always
+ * prepared and pass the preparation on to their tracks.
+ */
 static RemixBase *
 remix_deck_prepare (RemixEnv * env, RemixBase * base)
 {
   RemixDeck * deck = (RemixDeck *)base;
-  remix_deck_replace_mixstream (env, deck);
+  CDList * l;
+
+  remix_deck_ensure_mixstreams (env, deck, TRUE);
+
+  for (l = deck->tracks; l; l = l->next)
+    remix_prepare (env, (RemixBase *)l->data.s_pointer);
+
   return base;
 }
 
+/*
+ * _remix_deck_graph_changed (env)
+ *
+ * Notes that a track, layer, sound, envelope or source has been added,
+ * removed or replaced somewhere in the world, so that every deck finds
+ * again which of its bases are shared between tracks. A world-wide
+ * serial is used as decks nested in sources of other decks do not know
+ * which decks read them.
+ */
+void
+_remix_deck_graph_changed (RemixEnv * env)
+{
+  env->world->_graph_serial++;
+}
+
 RemixTrack *
 _remix_deck_add_track (RemixEnv * env, RemixDeck * deck, RemixTrack * track)
 {
   deck->tracks = cd_list_prepend (env, deck->tracks, CD_POINTER(track));
+  _remix_deck_graph_changed (env);
   remix_deck_optimise (env, deck);
   return track;
 }
@@ -126,6 +214,7 @@ _remix_deck_remove_track (RemixEnv * env, RemixDeck * deck, RemixTrack * track)
 {
   deck->tracks = cd_list_remove (env, deck->tracks, CD_TYPE_POINTER,
 				 CD_POINTER(track));
+  _remix_deck_graph_changed (env);
   remix_deck_optimise (env, deck);
   return track;
 }
@@ -161,97 +250,229 @@ remix_deck_get_tracks (RemixEnv * env, RemixDeck * deck)
   return cd_list_copy (env, deck->tracks);
 }
 
-#if 0
-static RemixCount
-remix_deck_process (RemixEnv * env, RemixBase base, RemixCount count, RemixStream input,
-		 RemixStream output)
+/* Results of remix_deck_reach() */
+#define REMIX_REACH_NEW 0
+#define REMIX_REACH_SAME_TRACK 1
+#define REMIX_REACH_OTHER_TRACK 2
+
+/*
+ * remix_deck_reach (deck, base, i)
+ *
+ * Records that 'base' is read by the i'th track of 'deck' in the current
+ * remix_deck_shared() pass. Returns whether it was new to the pass, or
+ * already read by this or another track.
+ */
+static int
+remix_deck_reach (RemixDeck * deck, RemixBase * base, int i)
 {
-  RemixDeck deck = (RemixDeck)base;
-  CDList tl, ml;
-  RemixTrack track;
-  RemixStream mixstream;
-  RemixCount processed = 0, remaining = count, n, minn;
-  RemixCount input_offset;
+  if (base->_reach_deck == deck && base->_reach_serial == deck->_reach_serial)
+    return (base->_reach_track == i) ?
+      REMIX_REACH_SAME_TRACK : REMIX_REACH_OTHER_TRACK;
 
-  remix_dprintf ("PROCESS DECK (%p, +%ld, %p -> %p) @ %ld\n",
-	      deck, count, input, output, remix_tell (env, base));
+  base->_reach_deck = deck;
+  base->_reach_serial = deck->_reach_serial;
+  base->_reach_track = i;
 
-  while (remaining > 0) {
-    /* Get mixlength from each track */
-    minn = deck->mixlength;
-    input_offset = remix_tell (env, (RemixBase)input);
-    for (tl = deck->tracks, ml = deck->mixstreams; tl && ml;
-         tl = tl->next, ml = ml->next) {
-      track = (RemixTrack)tl->data;
-      mixstream = (RemixStream)ml->data;
-      remix_seek (env, (RemixBase)input, input_offset);
-      n = remix_process (env, (RemixBase)track, MIN (remaining, deck->mixlength),
-		      input, mixstream);
-      minn = MIN (minn, n);
+  return REMIX_REACH_NEW;
+}
+
+/*
+ * remix_deck_reach_track (deck, track, i)
+ *
+ * Records the bases read by the sounds of 'track', on behalf of the i'th
+ * track of 'deck', that have no cursor of their own: sound sources
+ * without a cursor method, and envelopes. The tracks of such sources
+ * that are decks are followed too. Returns TRUE if any of them is also
+ * read by another track of 'deck'.
+ */
+static int
+remix_deck_reach_track (RemixDeck * deck, RemixTrack * track, int i)
+{
+  CDList * l, * tl;
+  RemixLayer * layer;
+  RemixSound * sound;
+  RemixBase * bases[4];
+  int j, k, reach;
+
+  for (l = track->layers; l; l = l->next) {
+    layer = (RemixLayer *)l->data.s_pointer;
+    for (j = 0; j < layer->nr_sounds; j++) {
+      sound = layer->sounds[j];
+      bases[0] = sound->rate_envelope;
+      bases[1] = sound->gain_envelope;
+      bases[2] = sound->blend_envelope;
+      bases[3] = (sound->_cursor == sound->source) ? sound->source : RemixNone;
+
+      for (k = 0; k < 4; k++) {
+        if (bases[k] == RemixNone) continue;
+
+        reach = remix_deck_reach (deck, bases[k], i);
+        if (reach == REMIX_REACH_OTHER_TRACK) return TRUE;
+        if (reach == REMIX_REACH_SAME_TRACK) continue;
+
+        /* A nested deck reads its own sources on this track's behalf */
+        if (bases[k]->methods && bases[k]->methods->clone == remix_deck_clone) {
+          for (tl = ((RemixDeck *)bases[k])->tracks; tl; tl = tl->next) {
+            if (remix_deck_reach_track (deck, (RemixTrack *)tl->data.s_pointer,
+                                        i))
+              return TRUE;
+          }
+        }
+      }
     }
+  }
 
+  return FALSE;
+}
 
-    if (output != RemixNone) {
-      /* mix tracks together to the output */
-      n = remix_streams_mix (env, deck->mixstreams, output, minn);
-    } else {
-      /* don't need to create output */
-      n = minn;
-    }
+/*
+ * remix_deck_shared (deck, nr_tracks)
+ *
+ * Returns TRUE if any base without a cursor of its own, such as a
+ * squaretone, a plugin or a nested deck, is read by more than one of
+ * the first 'nr_tracks' tracks of 'deck'. Their tracks cannot then be
+ * rendered concurrently. Takes time linear in the number of sounds and
+ * allocates nothing, so the result is kept until the next edit (see
+ * _remix_deck_graph_changed()).
+ */
+static int
+remix_deck_shared (RemixEnv * env, RemixDeck * deck, int nr_tracks)
+{
+  RemixWorld * world = env->world;
+  int i;
 
-    processed += n;
-    remaining -= n;
+  if (deck->_shared != -1 && deck->_shared_serial == world->_graph_serial)
+    return deck->_shared;
+
+  deck->_shared = FALSE;
+  deck->_shared_serial = world->_graph_serial;
+  deck->_reach_serial++;
+
+  for (i = 0; i < nr_tracks; i++) {
+    if (remix_deck_reach_track (deck, deck->_trackv[i], i)) {
+      deck->_shared = TRUE;
+      break;
+    }
   }
 
-  remix_dprintf ("[remix_deck_process] processed %ld\n", processed);
+  return deck->_shared;
+}
 
-  return processed;
+/*
+ * _remix_deck_nr_shared_walks (env, deck)
+ *
+ * Returns the number of times 'deck' has walked its tracks to find the
+ * bases they share. For tests.
+ */
+unsigned int
+_remix_deck_nr_shared_walks (RemixEnv * env, RemixDeck * deck)
+{
+  return deck->_reach_serial;
 }
-#endif
 
+/*
+ * remix_deck_render_track (env, i, deck)
+ *
+ * Renders the current block of the i'th track of 'deck' into its scratch
+ * stream. Run as a task of the world's thread pool, so 'env' may belong
+ * to a worker thread; any error the track sets is kept for the deck to
+ * pass on to its caller.
+ */
+static void
+remix_deck_render_track (RemixEnv * env, int i, void * data)
+{
+  RemixDeck * deck = (RemixDeck *)data;
+  RemixStream * mixstream = deck->_mixstreamv[i];
+
+  if (deck->_input != RemixNone)
+    remix_seek (env, (RemixBase *)deck->_input, deck->_input_offset, SEEK_SET);
+
+  remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
+  remix_set_error (env, REMIX_ERROR_OK);
+  deck->_counts[i] = remix_process (env, (RemixBase *)deck->_trackv[i],
+                                    deck->_block, deck->_input, mixstream);
+  deck->_errors[i] = remix_last_error (env);
+  remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
+}
+
+/*
+ * remix_deck_process (env, base, count, input, output)
+ *
+ * Each track renders into its own scratch stream, then all tracks are
+ * scaled by their gains and summed into the output in a single
+ * remix_streams_mix_gains() pass, one mixlength at a time.
+ *
+ * If the world has worker threads (see remix_set_threads()) the tracks
+ * are rendered concurrently. This is only done when there is no input
+ * stream, as every track would read from it, and when no source without
+ * a cursor is read by more than one track (see remix_deck_shared()).
+ * Without worker threads the tracks are not walked at all.
+ */
 static RemixCount
 remix_deck_process (RemixEnv * env, RemixBase * base, RemixCount count,
                     RemixStream * input, RemixStream * output)
 {
   RemixDeck * deck = (RemixDeck *)base;
-  CDList * l;
-  RemixTrack * track;
+  CDList * l, * ml;
   RemixCount remaining = count, processed = 0, n;
   RemixCount current_offset = remix_tell (env, base);
   RemixCount input_offset = remix_tell (env, (RemixBase *)input);
   RemixCount output_offset = remix_tell (env, (RemixBase *)output);
   RemixCount mixlength = _remix_base_get_mixlength (env, deck);
-  RemixStream * mixstream = deck->_mixstream;
+  int i, nr_tracks, serial;
 
   remix_dprintf ("PROCESS DECK (%p, +%ld, %p -> %p) @ %ld\n",
                  deck, count, input, output, current_offset);
 
-  while (remaining > 0) {
+  for (l = deck->tracks, ml = deck->_mixstreams, i = 0; l && ml;
+       l = l->next, ml = ml->next, i++) {
+    deck->_trackv[i] = (RemixTrack *)l->data.s_pointer;
+    deck->_mixstreamv[i] = (RemixStream *)ml->data.s_pointer;
+  }
+  nr_tracks = i;
 
-    l = deck->tracks;
-    track = (RemixTrack *)l->data.s_pointer;
+  deck->_input = input;
+
+  serial = (env->world->_pool == RemixNone) || (nr_tracks < 2) ||
+    (input != RemixNone) || remix_deck_shared (env, deck, nr_tracks);
 
+  while (remaining > 0) {
     n = MIN (remaining, mixlength);
 
-    n = remix_process (env, (RemixBase *)track, n, input, output);
-    remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
-    n = remix_stream_gain (env, output, n, track->gain);
+    deck->_block = n;
+    deck->_input_offset = input_offset;
 
-    for (l = l->next; l; l = l->next) {
-      track = (RemixTrack *)l->data.s_pointer;
-      
-      remix_seek (env, (RemixBase *)input, input_offset, SEEK_SET);
-      remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
-      n = remix_process (env, (RemixBase *)track, n, input, mixstream);
-      
-      remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
-      n = remix_stream_gain (env, mixstream, n, track->gain);
-      
-      remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
+    if (!serial) {
+      _remix_thread_pool_run (env, remix_deck_render_track, deck, nr_tracks);
+    } else {
+      for (i = 0; i < nr_tracks; i++)
+        remix_deck_render_track (env, i, deck);
+    }
+
+    for (i = 0; i < nr_tracks; i++) {
+      deck->_gains[i] = deck->_trackv[i]->gain;
+      n = MIN (n, deck->_counts[i]);
+    }
+
+    /* Report the first track's error, wherever it was rendered */
+    for (i = 0; i < nr_tracks; i++) {
+      if (deck->_errors[i] != REMIX_ERROR_OK) {
+        remix_set_error (env, deck->_errors[i]);
+        break;
+      }
+    }
+
+    if (n <= 0) break;
+
+    if (output != RemixNone) {
       remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
-      n = remix_stream_mix (env, mixstream, output, n);
+      n = remix_streams_mix_gains (env, deck->_mixstreams, deck->_gains,
+                                   output, n);
+      if (n <= 0) break;
     }
 
+    input_offset += n;
+    output_offset += n;
     processed += n;
     remaining -= n;
   }
@@ -261,62 +482,26 @@ remix_deck_process (RemixEnv * env, RemixBase * base, RemixCount count,
   return processed;
 }
 
-static RemixCount
-remix_deck_twotrack_process (RemixEnv * env, RemixBase * base, RemixCount count,
-                             RemixStream * input, RemixStream * output)
-{
-  RemixDeck * deck = (RemixDeck *)base;
-  CDList * l;
-  RemixTrack * track1, * track2;
-  RemixCount n;
-  RemixCount current_offset = remix_tell (env, base);
-  RemixCount input_offset = remix_tell (env, (RemixBase *)input);
-  RemixCount output_offset = remix_tell (env, (RemixBase *)output);
-  RemixStream * mixstream = deck->_mixstream;
-
-  remix_dprintf ("PROCESS DECK [twotrack] (%p, +%ld, %p -> %p) @ %ld\n",
-                 deck, count, input, output, current_offset);
-
-  l = deck->tracks;
-  track1 = (RemixTrack *)l->data.s_pointer;
-
-  l = l->next;
-  track2 = (RemixTrack *)l->data.s_pointer;
-
-  n = remix_process (env, (RemixBase *)track1, count, input, output);
-
-  remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
-  n = remix_stream_gain (env, output, n, track1->gain);
-
-  remix_seek (env, (RemixBase *)input, input_offset, SEEK_SET);
-  remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
-  n = remix_process (env, (RemixBase *)track2, n, input, mixstream);
-
-  remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
-  n = remix_stream_gain (env, mixstream, n, track2->gain);
-
-  remix_seek (env, (RemixBase *)mixstream, 0, SEEK_SET);
-  remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
-  n = remix_stream_mix (env, mixstream, output, n);
-
-  remix_dprintf ("[remix_deck_twotrack_process] processed %ld\n", n);
-
-  return n;
-}
-
 static RemixCount
 remix_deck_onetrack_process (RemixEnv * env, RemixBase * base, RemixCount count,
                              RemixStream * input, RemixStream * output)
 {
   RemixDeck * deck = (RemixDeck *)base;
   RemixTrack * track = (RemixTrack *)deck->tracks->data.s_pointer;
-  RemixCount n;
+  RemixCount n, output_offset;
 
   remix_dprintf ("PROCESS DECK [onetrack] (%p, +%ld, %p -> %p) @ %ld\n",
                  deck, count, input, output, remix_tell (env, base));
 
+  output_offset = remix_tell (env, (RemixBase *)output);
+
   n = remix_process (env, (RemixBase *)track, count, input, output);
 
+  if (n > 0 && output != RemixNone && track->gain != 1.0) {
+    remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
+    n = remix_stream_gain (env, output, n, track->gain);
+  }
+
   remix_dprintf ("*** deck @ %ld\ttrack @ %ld\n", remix_tell (env, base),
                  remix_tell (env, (RemixBase *)track));
 
@@ -358,7 +543,7 @@ remix_deck_flush (RemixEnv * env, RemixBase * base)
 static struct _RemixMethods _remix_deck_empty_methods = {
   remix_deck_clone,   /* clone */
   remix_deck_destroy, /* destroy */
-  remix_deck_ready,   /* ready */
+  NULL,               /* ready */
   remix_deck_prepare, /* preapre */
   remix_null_process, /* process */
   remix_null_length,  /* length */
@@ -369,7 +554,7 @@ static struct _RemixMethods _remix_deck_empty_methods = {
 static struct _RemixMethods _remix_deck_methods = {
   remix_deck_clone,   /* clone */
   remix_deck_destroy, /* destroy */
-  remix_deck_ready,   /* ready */
+  NULL,               /* ready */
   remix_deck_prepare, /* preapre */
   remix_deck_process, /* process */
   remix_deck_length,  /* length */
@@ -380,7 +565,7 @@ static struct _RemixMethods _remix_deck_methods = {
 static struct _RemixMethods _remix_deck_onetrack_methods = {
   remix_deck_clone,            /* clone */
   remix_deck_destroy,          /* destroy */
-  remix_deck_ready,            /* ready */
+  NULL,                        /* ready */
   remix_deck_prepare,          /* preapre */
   remix_deck_onetrack_process, /* process */
   remix_deck_length,           /* length */
@@ -388,26 +573,16 @@ static struct _RemixMethods _remix_deck_onetrack_methods = {
   remix_deck_flush,   /* flush */
 };
 
-static struct _RemixMethods _remix_deck_twotrack_methods = {
-  remix_deck_clone,            /* clone */
-  remix_deck_destroy,          /* destroy */
-  remix_deck_ready,            /* ready */
-  remix_deck_prepare,          /* preapre */
-  remix_deck_twotrack_process, /* process */
-  remix_deck_length,           /* length */
-  remix_deck_seek,             /* seek */
-  remix_deck_flush,   /* flush */
-};
-
 static RemixDeck *
 remix_deck_optimise (RemixEnv * env, RemixDeck * deck)
 {
   int nr_tracks = cd_list_length (env, deck->tracks);
 
+  remix_deck_ensure_mixstreams (env, deck, FALSE);
+
   switch (nr_tracks) {
   case 0: _remix_set_methods (env, deck, &_remix_deck_empty_methods); break;
   case 1: _remix_set_methods (env, deck, &_remix_deck_onetrack_methods); break;
-  case 2: _remix_set_methods (env, deck, &_remix_deck_twotrack_methods); break;
   default: _remix_set_methods (env, deck, &_remix_deck_methods); break;
   }
 
@@ -26,6 +26,8 @@
  * Conrad Parker <conrad@metadecks.org>, August 2001
  */
 
+#include <string.h>
+
 #define __REMIX__
 #include "remix.h"
 
@@ -38,15 +40,15 @@ static void
 remix_envelope_debug (RemixEnv * env, RemixEnvelope * envelope)
 {
 #ifdef DEBUG
-  CDList * l;
   RemixPoint * point;
+  int i;
 
   printf ("envelope %p\n", envelope);
   printf ("envelope->points: %p\n", envelope->points);
 
-  /*  printf (" has %d points\n", cd_list_length (env, envelope->points));*/
-  for (l = envelope->points; l; l = l->next) {
-    point = (RemixPoint *)l->data.s_pointer;
+  printf (" has %d points\n", envelope->nr_points);
+  for (i = 0; i < envelope->nr_points; i++) {
+    point = envelope->points[i];
     switch (envelope->timetype) {
     case REMIX_TIME_SAMPLES:
       printf ("%ld samples, %f\n", point->time.samples, point->value);
@@ -74,28 +76,195 @@ remix_point_new (RemixTime time, RemixPCM value)
   return point;
 }
 
-static RemixPoint *
-remix_point_clone (RemixEnv * env, RemixPoint * point)
+/*
+ * remix_envelope_grow (env, envelope, nr_points)
+ *
+ * Ensures there is room in 'envelope' for at least 'nr_points' points
+ * and their sample positions.
+ */
+static void
+remix_envelope_grow (RemixEnv * env, RemixEnvelope * envelope, int nr_points)
 {
-  return remix_point_new (point->time, point->value);
+  RemixPoint ** points;
+  RemixCount * samples;
+  RemixPCM * coeffs;
+  int max_points;
+
+  if (nr_points <= envelope->_max_points) return;
+
+  max_points = MAX (nr_points, MAX (4, envelope->_max_points * 2));
+
+  points = (RemixPoint **) remix_malloc (max_points * sizeof (RemixPoint *));
+  samples = (RemixCount *) remix_malloc (max_points * sizeof (RemixCount));
+  coeffs = (RemixPCM *) remix_malloc (4 * max_points * sizeof (RemixPCM));
+
+  if (envelope->nr_points > 0) {
+    memcpy (points, envelope->points,
+	    envelope->nr_points * sizeof (RemixPoint *));
+    memcpy (samples, envelope->_samples,
+	    envelope->nr_points * sizeof (RemixCount));
+  }
+
+  if (envelope->points != NULL) remix_free (envelope->points);
+  if (envelope->_samples != NULL) remix_free (envelope->_samples);
+  if (envelope->_coeffs != NULL) remix_free (envelope->_coeffs);
+
+  envelope->points = points;
+  envelope->_samples = samples;
+  envelope->_coeffs = coeffs;
+  envelope->_coeffs_valid = FALSE;
+  envelope->_max_points = max_points;
 }
 
-static int
-remix_point_later_X (RemixEnv * env, RemixPoint * p1, RemixPoint * p2)
+/*
+ * remix_envelope_point_samples (env, envelope, point)
+ *
+ * Converts the time of 'point' to samples at the current samplerate
+ * and tempo of 'env'.
+ */
+static RemixCount
+remix_envelope_point_samples (RemixEnv * env, RemixEnvelope * envelope,
+                              RemixPoint * point)
+{
+  RemixTime t = remix_time_convert (env, point->time, envelope->timetype,
+                                    REMIX_TIME_SAMPLES);
+  return t.samples;
+}
+
+/*
+ * remix_envelope_update_samples (env, envelope)
+ *
+ * Recalculates the cached sample positions of the points of 'envelope'
+ * if they were made at a different samplerate or tempo, or have been
+ * invalidated by a change to the point times.
+ */
+static void
+remix_envelope_update_samples (RemixEnv * env, RemixEnvelope * envelope)
 {
-  return _remix_time_gt(REMIX_TIME_SAMPLES, p1->time, p2->time);
+  RemixSamplerate samplerate = remix_get_samplerate (env);
+  RemixTempo tempo = remix_get_tempo (env);
+  int i;
+
+  if (envelope->_samples_valid &&
+      (envelope->timetype == REMIX_TIME_SAMPLES ||
+       (envelope->_samples_samplerate == samplerate &&
+	envelope->_samples_tempo == tempo)))
+    return;
+
+  for (i = 0; i < envelope->nr_points; i++)
+    envelope->_samples[i] =
+      remix_envelope_point_samples (env, envelope, envelope->points[i]);
+
+  envelope->_samples_valid = TRUE;
+  envelope->_samples_samplerate = samplerate;
+  envelope->_samples_tempo = tempo;
+  envelope->_coeffs_valid = FALSE;
 }
 
+/*
+ * remix_envelope_update_coeffs (env, envelope)
+ *
+ * Recalculates the spline coefficients of 'envelope' if its points have
+ * changed. Segment k from point k to k+1, of h samples, is the cubic
+ * c[0] + c[1] s + c[2] s^2 + c[3] s^3 in s = (x - x_k) / h, with
+ * c = &_coeffs[4*k]. The cached sample positions must be up to date.
+ *
+ * The tangents at interior points are the Fritsch-Butland weighted
+ * harmonic mean of the neighbouring gradients, or zero at a local
+ * extremum, so that the spline is monotone wherever the points are and
+ * never overshoots them. The end tangents are the gradients of the end
+ * segments.
+ */
+static void
+remix_envelope_update_coeffs (RemixEnv * env, RemixEnvelope * envelope)
+{
+  RemixCount * x = envelope->_samples;
+  RemixPCM * c;
+  double y0, y1, y2, h, h1, d, d1, m0 = 0.0, m1, w, w1;
+  int k, last = envelope->nr_points - 1;
+
+  if (envelope->_coeffs_valid) return;
+
+  for (k = 0; k < last; k++) {
+    y0 = envelope->points[k]->value;
+    y1 = envelope->points[k+1]->value;
+    h = x[k+1] - x[k];
+    d = (h > 0) ? (y1 - y0) / h : 0.0;
+
+    if (k == 0) m0 = d;
+
+    if (k + 1 == last) {
+      m1 = d;
+    } else {
+      y2 = envelope->points[k+2]->value;
+      h1 = x[k+2] - x[k+1];
+      d1 = (h1 > 0) ? (y2 - y1) / h1 : 0.0;
+      if (d * d1 <= 0.0) {
+	m1 = 0.0;
+      } else {
+	w = 2 * h1 + h;
+	w1 = h1 + 2 * h;
+	m1 = (w + w1) / (w / d + w1 / d1);
+      }
+    }
+
+    c = &envelope->_coeffs[4*k];
+    c[0] = y0;
+    c[1] = h * m0;
+    c[2] = 3 * (y1 - y0) - h * (2 * m0 + m1);
+    c[3] = 2 * (y0 - y1) + h * (m0 + m1);
+
+    m0 = m1;
+  }
+
+  envelope->_coeffs_valid = TRUE;
+}
+
+/*
+ * remix_envelope_index_upto (env, envelope, time)
+ *
+ * Returns the number of points of 'envelope' at or before 'time', ie.
+ * the index of the first point after it.
+ */
 static int
-remix_point_later_S (RemixEnv * env, RemixPoint * p1, RemixPoint * p2)
+remix_envelope_index_upto (RemixEnv * env, RemixEnvelope * envelope,
+			   RemixTime time)
 {
-  return _remix_time_gt(REMIX_TIME_SECONDS, p1->time, p2->time);
+  int lo = 0, hi = envelope->nr_points, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (_remix_time_gt (envelope->timetype, envelope->points[mid]->time, time))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return lo;
 }
 
+/*
+ * remix_envelope_index_before (env, envelope, offset)
+ *
+ * Returns the index of the last point of 'envelope' at or before sample
+ * 'offset', or -1 if there is none. The cached sample positions must be
+ * up to date.
+ */
 static int
-remix_point_later_B (RemixEnv * env, RemixPoint * p1, RemixPoint * p2)
+remix_envelope_index_before (RemixEnv * env, RemixEnvelope * envelope,
+			     RemixCount offset)
 {
-  return _remix_time_gt(REMIX_TIME_BEAT24S, p1->time, p2->time);
+  int lo = 0, hi = envelope->nr_points, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (envelope->_samples[mid] > offset)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return lo - 1;
 }
 
 RemixBase *
@@ -103,7 +272,15 @@ remix_envelope_init (RemixEnv * env, RemixBase * base)
 {
   RemixEnvelope * envelope = (RemixEnvelope *)base;
   envelope->type = REMIX_ENVELOPE_LINEAR;
-  envelope->points = cd_list_new (env);
+  envelope->timetype = REMIX_TIME_SAMPLES;
+  envelope->points = NULL;
+  envelope->nr_points = 0;
+  envelope->_max_points = 0;
+  envelope->_samples = NULL;
+  envelope->_samples_valid = FALSE;
+  envelope->_coeffs = NULL;
+  envelope->_coeffs_valid = FALSE;
+  envelope->_current_point = -1;
   remix_envelope_optimise (env, envelope);
   return (RemixBase *)envelope;
 }
@@ -124,8 +301,16 @@ remix_envelope_clone (RemixEnv * env, RemixBase * base)
 {
   RemixEnvelope * envelope = (RemixEnvelope *)base;
   RemixEnvelope * new_envelope = remix_envelope_new (env, envelope->type);
-  new_envelope->points = cd_list_clone (env, envelope->points,
-					(CDCloneFunc)remix_point_clone);
+  RemixPoint * point;
+  int i;
+
+  new_envelope->timetype = envelope->timetype;
+  remix_envelope_grow (env, new_envelope, envelope->nr_points);
+  for (i = 0; i < envelope->nr_points; i++) {
+    point = envelope->points[i];
+    new_envelope->points[i] = remix_point_new (point->time, point->value);
+  }
+  new_envelope->nr_points = envelope->nr_points;
   remix_envelope_optimise (env, new_envelope);
   return (RemixBase *)new_envelope;
 }
@@ -134,7 +319,13 @@ static int
 remix_envelope_destroy (RemixEnv * env, RemixBase * base)
 {
   RemixEnvelope * envelope = (RemixEnvelope *)base;
-  cd_list_free_all (env, envelope->points);
+  int i;
+
+  for (i = 0; i < envelope->nr_points; i++)
+    remix_free (envelope->points[i]);
+  if (envelope->points != NULL) remix_free (envelope->points);
+  if (envelope->_samples != NULL) remix_free (envelope->_samples);
+  if (envelope->_coeffs != NULL) remix_free (envelope->_coeffs);
   remix_free (envelope);
   return 0;
 }
@@ -160,6 +351,7 @@ remix_envelope_set_timetype (RemixEnv * env, RemixEnvelope * envelope,
 {
   RemixTimeType old = envelope->timetype;
   envelope->timetype = timetype;
+  envelope->_samples_valid = FALSE;
   return old;
 }
 
@@ -172,42 +364,49 @@ remix_envelope_get_timetype (RemixEnv * env, RemixEnvelope * envelope)
 RemixTime
 remix_envelope_get_duration (RemixEnv * env, RemixEnvelope * envelope)
 {
-  CDList * l = cd_list_last_item (env, envelope->points);
-  RemixPoint * p;
+  if (envelope->nr_points == 0) return _remix_time_zero (envelope->timetype);
 
-  if (l == RemixNone) return _remix_time_zero (envelope->timetype);
-
-  p = (RemixPoint *)l->data.s_pointer;
-  if (p == RemixNone) return _remix_time_zero (envelope->timetype);
-
-  return p->time;
+  return envelope->points[envelope->nr_points - 1]->time;
 }
 
 RemixPoint *
 remix_envelope_add_point (RemixEnv * env, RemixEnvelope * envelope,
                           RemixTime time, RemixPCM value)
 {
-  RemixPoint * point = remix_point_new (time, value);
+  RemixPoint * point;
+  int i, n = envelope->nr_points;
+
   switch (envelope->timetype) {
   case REMIX_TIME_SAMPLES:
-    envelope->points = cd_list_insert (env, envelope->points,
-				       CD_TYPE_POINTER, CD_POINTER(point),
-				       (CDCmpFunc)remix_point_later_X);
-    break;
   case REMIX_TIME_SECONDS:
-    envelope->points = cd_list_insert (env, envelope->points,
-				       CD_TYPE_POINTER, CD_POINTER(point),
-				       (CDCmpFunc)remix_point_later_S);
-    break;
   case REMIX_TIME_BEAT24S:
-    envelope->points = cd_list_insert (env, envelope->points,
-				       CD_TYPE_POINTER, CD_POINTER(point),
-				       (CDCmpFunc)remix_point_later_B);
     break;
   default: /* uncommon, we should hope */
-    remix_free (point); point = RemixNone;
-    break;
+    return RemixNone;
   }
+
+  point = remix_point_new (time, value);
+
+  /* Insert after any points at the same time; appending needs no search */
+  if (n == 0 ||
+      !_remix_time_gt (envelope->timetype, envelope->points[n-1]->time, time))
+    i = n;
+  else
+    i = remix_envelope_index_upto (env, envelope, time);
+
+  remix_envelope_grow (env, envelope, n + 1);
+  memmove (&envelope->points[i+1], &envelope->points[i],
+	   (n - i) * sizeof (RemixPoint *));
+  memmove (&envelope->_samples[i+1], &envelope->_samples[i],
+	   (n - i) * sizeof (RemixCount));
+  envelope->points[i] = point;
+  envelope->_samples[i] = remix_envelope_point_samples (env, envelope, point);
+  envelope->nr_points++;
+  envelope->_coeffs_valid = FALSE;
+
+  /* Keep the current point where it was */
+  if (i <= envelope->_current_point) envelope->_current_point++;
+
   remix_envelope_debug (env, envelope);
   remix_envelope_optimise (env, envelope);
   return point;
@@ -217,8 +416,25 @@ RemixEnvelope *
 remix_envelope_remove_point (RemixEnv * env, RemixEnvelope * envelope,
                              RemixPoint * point)
 {
-  envelope->points = cd_list_remove (env, envelope->points,
-				     CD_TYPE_POINTER, CD_POINTER(point));
+  int i;
+
+  if (point == RemixNone) return envelope;
+
+  /* Search back through the points at the same time as 'point' */
+  for (i = remix_envelope_index_upto (env, envelope, point->time) - 1;
+       i >= 0 && envelope->points[i] != point; i--);
+  if (i < 0) return envelope;
+
+  memmove (&envelope->points[i], &envelope->points[i+1],
+	   (envelope->nr_points - i - 1) * sizeof (RemixPoint *));
+  memmove (&envelope->_samples[i], &envelope->_samples[i+1],
+	   (envelope->nr_points - i - 1) * sizeof (RemixCount));
+  envelope->nr_points--;
+  envelope->_coeffs_valid = FALSE;
+
+  /* Step back to the previous point if the current one was removed */
+  if (i <= envelope->_current_point) envelope->_current_point--;
+
   remix_free (point);
   remix_envelope_debug (env, envelope);
   remix_envelope_optimise (env, envelope);
@@ -228,13 +444,11 @@ remix_envelope_remove_point (RemixEnv * env, RemixEnvelope * envelope,
 RemixEnvelope *
 remix_envelope_scale (RemixEnv * env, RemixEnvelope * envelope, RemixPCM gain)
 {
-  CDList * l;
-  RemixPoint * p;
+  int i;
 
-  for (l = envelope->points; l; l = l->next) {
-    p = (RemixPoint *)l->data.s_pointer;
-    p->value *= gain;
-  }
+  for (i = 0; i < envelope->nr_points; i++)
+    envelope->points[i]->value *= gain;
+  envelope->_coeffs_valid = FALSE;
 
   return envelope;
 }
@@ -242,33 +456,157 @@ remix_envelope_scale (RemixEnv * env, RemixEnvelope * envelope, RemixPCM gain)
 RemixEnvelope *
 remix_envelope_shift (RemixEnv * env, RemixEnvelope * envelope, RemixTime delta)
 {
-  CDList * l;
   RemixPoint * p;
+  int i;
 
-  for (l = envelope->points; l; l = l->next) {
-    p = (RemixPoint *)l->data.s_pointer;
+  for (i = 0; i < envelope->nr_points; i++) {
+    p = envelope->points[i];
     p->time = _remix_time_add (envelope->timetype, p->time, delta);
   }
+  envelope->_samples_valid = FALSE;
 
   return envelope;
 }
 
-static CDList *
-remix_envelope_point_item_before (RemixEnv * env, RemixEnvelope * envelope,
-                                  RemixCount offset)
+/*
+ * remix_cubic_sum (c, h, t1, t2)
+ *
+ * Returns the sum of the spline segment cubic 'c' of 'h' samples at
+ * each sample 't' from 't1' up to (but not including) 't2', from the
+ * sums of the powers of t.
+ */
+static double
+remix_cubic_sum (RemixPCM * c, RemixCount h, RemixCount t1, RemixCount t2)
 {
-  CDList * l, * lp = RemixNone;
-  RemixPoint * point;
-  RemixTime ptime;
-
-  for (l = envelope->points; l; l = l->next) {
-    point = (RemixPoint *)l->data.s_pointer;
-    ptime = remix_time_convert (env, point->time, envelope->timetype,
-                                REMIX_TIME_SAMPLES);
-    if (ptime.samples > offset) break;
-    lp = l;
+  double n, f[4];
+  int k;
+
+  for (k = 0; k < 4; k++) f[k] = 0.0;
+
+  /* f[k] = sum of t^k for t1 <= t < t2 */
+  for (n = t2, k = 1; k >= -1; n = t1, k -= 2) {
+    f[0] += k * n;
+    f[1] += k * n * (n - 1) / 2.0;
+    f[2] += k * n * (n - 1) * (2 * n - 1) / 6.0;
+    f[3] += k * (n * (n - 1) / 2.0) * (n * (n - 1) / 2.0);
+  }
+
+  return c[0] * f[0] + (c[1] * f[1] + (c[2] * f[2] + c[3] * f[3] / h) / h) / h;
+}
+
+/*
+ * remix_envelope_spline_sum (env, envelope, x1, x2)
+ *
+ * _remix_envelope_sum() for spline envelopes with at least two points,
+ * which hold their end values outside of their points.
+ */
+static double
+remix_envelope_spline_sum (RemixEnv * env, RemixEnvelope * envelope,
+			   RemixCount x1, RemixCount x2)
+{
+  RemixCount px, npx, a, b;
+  double sum = 0.0;
+  int i, last = envelope->nr_points - 1;
+
+  remix_envelope_update_samples (env, envelope);
+  remix_envelope_update_coeffs (env, envelope);
+
+  b = MIN (x2, envelope->_samples[0]);
+  if (b > x1) sum += (double)envelope->points[0]->value * (b - x1);
+
+  for (i = MAX (0, remix_envelope_index_before (env, envelope, x1));
+       i < last && envelope->_samples[i] < x2; i++) {
+    px = envelope->_samples[i];
+    npx = envelope->_samples[i+1];
+    a = MAX (x1, px);
+    b = MIN (x2, npx);
+    if (b <= a) continue;
+    sum += remix_cubic_sum (&envelope->_coeffs[4*i], npx - px, a - px, b - px);
+  }
+
+  a = MAX (x1, envelope->_samples[last]);
+  if (x2 > a) sum += (double)envelope->points[last]->value * (x2 - a);
+
+  return sum;
+}
+
+/*
+ * _remix_envelope_sum (env, envelope, x1, x2)
+ *
+ * Returns the sum of the values of 'envelope' at each sample from 'x1'
+ * up to (but not including) 'x2', as written by processing it. Each
+ * segment contributes an arithmetic series, or for splines a sum of
+ * powers, so this takes time proportional to the number of points, not
+ * samples.
+ */
+double
+_remix_envelope_sum (RemixEnv * env, RemixEnvelope * envelope,
+                     RemixCount x1, RemixCount x2)
+{
+  RemixPoint * point, * next_point;
+  RemixCount px, npx, a, b, n;
+  double gradient, sum = 0.0;
+  int i, last = envelope->nr_points - 1;
+
+  if (x2 <= x1) return 0.0;
+
+  if (last < 0) return 0.0;
+
+  if (last == 0) {
+    point = envelope->points[0];
+    return (double)point->value * (x2 - x1);
   }
-  return lp;
+
+  if (envelope->type == REMIX_ENVELOPE_SPLINE)
+    return remix_envelope_spline_sum (env, envelope, x1, x2);
+
+  remix_envelope_update_samples (env, envelope);
+
+  /* Segments ending before x1 contribute nothing */
+  i = MAX (0, MIN (last - 1, remix_envelope_index_before (env, envelope, x1)));
+
+  /* The first segment extends back, and the last forward, indefinitely */
+  for (; i < last; i++) {
+    point = envelope->points[i];
+    next_point = envelope->points[i+1];
+    px = envelope->_samples[i];
+    npx = envelope->_samples[i+1];
+
+    if (i > 0 && px >= x2) break;
+
+    a = (i == 0) ? x1 : MAX (x1, px);
+    b = (i + 1 == last) ? x2 : MIN (x2, npx);
+    if (b <= a || npx == px) continue;
+
+    n = b - a;
+    gradient = (double)(next_point->value - point->value) / (npx - px);
+    sum += n * (double)point->value +
+      gradient * ((double)(a + b - 1) * n / 2.0 - (double)n * px);
+  }
+
+  return sum;
+}
+
+RemixPCM
+remix_envelope_get_value (RemixEnv * env, RemixEnvelope * envelope,
+                          RemixTime time)
+{
+  RemixTime t = remix_time_convert (env, time, envelope->timetype,
+                                    REMIX_TIME_SAMPLES);
+  return (RemixPCM)_remix_envelope_sum (env, envelope, t.samples,
+                                        t.samples + 1);
+}
+
+RemixPCM
+remix_envelope_get_integral (RemixEnv * env, RemixEnvelope * envelope,
+                             RemixTime t1, RemixTime t2)
+{
+  RemixTime x1 = remix_time_convert (env, t1, envelope->timetype,
+                                     REMIX_TIME_SAMPLES);
+  RemixTime x2 = remix_time_convert (env, t2, envelope->timetype,
+                                     REMIX_TIME_SAMPLES);
+  return (RemixPCM)_remix_envelope_sum (env, envelope, x1.samples,
+                                        x2.samples);
 }
 
 static RemixCount
@@ -282,146 +620,252 @@ remix_envelope_constant_write_chunk (RemixEnv * env, RemixChunk * chunk,
   RemixPCM * d;
   RemixCount n;
 
-  point = (RemixPoint *)envelope->points->data.s_pointer;
+  point = envelope->points[0];
   value = point->value;
-  d = &chunk->data[offset];
+  d = &chunk->data[offset - chunk->start_index];
 
   n = _remix_pcm_set (d, value, count);
-  envelope->_current_offset += n;
   return n;
 }
 
-#if 0
-static RemixCount
-remix_envelope_spline_write_chunk (RemixEnv * env, RemixChunk * chunk,
-                                   RemixCount offset, RemixCount count,
-                                   int channelname, void * data)
+/*
+ * _remix_envelope_segment (env, envelope, pos, remaining, current, c, s, ds)
+ *
+ * Describes 'envelope' from sample 'pos' up to its next point, or at
+ * most 'remaining' samples, as the cubic c[0] + c[1] x + c[2] x^2 +
+ * c[3] x^3 at x = 's' and every 'ds' after. '*current' is the index of
+ * the point at or before 'pos' (or -1), and is updated as 'pos' passes
+ * later points. Returns the number of samples described. The envelope
+ * must have been readied with _remix_envelope_prepare().
+ */
+RemixCount
+_remix_envelope_segment (RemixEnv * env, RemixEnvelope * envelope,
+                         RemixCount pos, RemixCount remaining, int * current,
+                         RemixPCM * c, RemixPCM * s, RemixPCM * ds)
 {
-  RemixEnvelope * envelope = (RemixEnvelope *)data;
-  /* XXX: Implement ;) */
-  return -1;
+  RemixCount * x = envelope->_samples;
+  int l = *current, k, last = envelope->nr_points - 1;
+  RemixPCM y0, y1, gradient;
+  RemixCount h;
+
+  while (l < last && x[l+1] <= pos)
+    l++;
+  *current = l;
+
+  c[1] = c[2] = c[3] = 0.0;
+  *s = 0.0;
+  *ds = 1.0;
+
+  if (last < 0) {/* Empty envelope, applied as silence */
+    c[0] = 0.0;
+    return remaining;
+  } else if (last == 0) {/* Constant envelope (one point) */
+    c[0] = envelope->points[0]->value;
+    return remaining;
+  }
+
+  if (envelope->type == REMIX_ENVELOPE_SPLINE) {
+    /* Splines hold their end values beyond their points */
+    if (l < 0) {
+      c[0] = envelope->points[0]->value;
+      return MIN (remaining, x[0] - pos);
+    } else if (l == last) {
+      c[0] = envelope->points[last]->value;
+      return remaining;
+    }
+
+    h = x[l+1] - x[l];
+    memcpy (c, &envelope->_coeffs[4*l], 4 * sizeof (RemixPCM));
+    *s = (RemixPCM)((double)(pos - x[l]) / h);
+    *ds = (RemixPCM)(1.0 / h);
+    return MIN (remaining, x[l+1] - pos);
+  }
+
+  /* The first linear segment extends back, and the last forward,
+   * indefinitely */
+  k = MAX (0, MIN (l, last - 1));
+  y0 = envelope->points[k]->value;
+  y1 = envelope->points[k+1]->value;
+  h = x[k+1] - x[k];
+  gradient = (h > 0) ? (y1 - y0) / (RemixPCM)h : 0.0;
+
+  c[0] = y0 + (RemixPCM)(pos - x[k]) * gradient;
+  c[1] = gradient;
+
+  if (k + 1 == last) return remaining;
+  return MIN (remaining, x[k+1] - pos);
 }
-#endif
 
 /* A RemixChunkFunc for creating envelope data */
 static RemixCount
-remix_envelope_linear_write_chunk (RemixEnv * env, RemixChunk * chunk,
-                                   RemixCount offset, RemixCount count,
-                                   int channelname, void * data)
+remix_envelope_write_chunk (RemixEnv * env, RemixChunk * chunk,
+                            RemixCount offset, RemixCount count,
+                            int channelname, void * data)
 {
   RemixEnvelope * envelope = (RemixEnvelope *)data;
   RemixCount remaining = count, written = 0;
-  RemixCount pos = envelope->_current_offset;
-  CDList * l, * nl;
-  RemixPoint * point, * next_point;
-  RemixCount px, npx, n;
-  RemixTime t;
-  RemixPCM py, npy, gradient;
+  RemixCount pos = envelope->_current_offset +
+    (offset - envelope->_output_offset);
+  int l = envelope->_current_point;
+  RemixPCM c[4], s, ds;
+  RemixCount n;
   RemixPCM * d;
 
-  remix_dprintf ("[remix_envelope_linear_write_chunk] (%ld, +%ld) @ %ld\n",
+  remix_dprintf ("[remix_envelope_write_chunk] (%ld, +%ld) @ %ld\n",
 	  offset, count, pos);
 
+  while (remaining > 0) {
+    n = _remix_envelope_segment (env, envelope, pos, remaining, &l, c, &s,
+				 &ds);
 
-  l = envelope->_current_point_item;
-
-  if (l == RemixNone) {/* No points before start */
-    l = envelope->points;
-    if (l == RemixNone) {/* No points at all */
-      n = _remix_chunk_clear_region (env, chunk, offset, count, 0, NULL);
-      envelope->_current_offset += n;
-      return n;
-    }
-  }
-
-  nl = l->next;
-  if (nl == RemixNone) {
-    /* if the last point was before offset, and there were
-     * more points, set l to the second last and nl to the last */
-    nl = l; l = l->prev;
-    if (l == RemixNone) {/* Constant envelope (one point) */
-      return remix_envelope_constant_write_chunk (env, chunk, offset, count,
-					       channelname, envelope);
-    }
-  }
-
-  point = (RemixPoint *)l->data.s_pointer;
-  t = remix_time_convert (env, point->time, envelope->timetype,
-                          REMIX_TIME_SAMPLES);
-  px = t.samples;
-  py = point->value;
-  
-  next_point = (RemixPoint *)nl->data.s_pointer;
-  t = remix_time_convert (env, next_point->time, envelope->timetype,
-                          REMIX_TIME_SAMPLES);
-  npx = t.samples;
-  npy = next_point->value;
+    d = &chunk->data[offset - chunk->start_index];
+    if (envelope->type == REMIX_ENVELOPE_SPLINE)
+      n = _remix_pcm_cubic (d, c, s, ds, n);
+    else
+      n = _remix_pcm_ramp (d, c[0], c[1], n);
 
-  while (remaining > 0) {
-    if (nl->next == RemixNone) {
-      /* These are the last two points, so fill out with this gradient */
-      n = remaining;
-    } else {
-      n = MIN (remaining, npx - pos);
-    }
-    gradient = (npy - py) / (RemixPCM)(npx - px);
-    
-    d = &chunk->data[offset];
-    /*  _remix_pcm_write_linear (d, px - chunk->start_index, py, gradient, n);*/
-    n = _remix_pcm_write_linear (d, px, py, npx, npy, pos, n);
-    
     remaining -= n;
     written += n;
     pos += n;
     offset += n;
-    
-    if (remaining > 0) {
-      l = nl; point = next_point; px = npx; py = npy;
-      
-      nl = nl->next;
-      next_point = (RemixPoint *)nl->data.s_pointer;
-      t = remix_time_convert (env, next_point->time, envelope->timetype,
-                              REMIX_TIME_SAMPLES);
-      npx = t.samples;
-      npy = next_point->value;
-    }
   }
 
-  envelope->_current_point_item = l;
-  envelope->_current_offset = pos;
-
   return written;
 }
 
+/*
+ * _remix_envelope_prepare (env, envelope)
+ *
+ * Brings the cached sample positions (and spline coefficients) of
+ * 'envelope' up to date for the env's samplerate and tempo, before its
+ * segments are written or applied.
+ */
+void
+_remix_envelope_prepare (RemixEnv * env, RemixEnvelope * envelope)
+{
+  remix_envelope_update_samples (env, envelope);
+  if (envelope->type == REMIX_ENVELOPE_SPLINE)
+    remix_envelope_update_coeffs (env, envelope);
+}
+
+/*
+ * _remix_envelope_advance (env, envelope, count)
+ *
+ * Moves the current position of 'envelope' on by 'count' samples, once
+ * every channel has been written from it.
+ */
+void
+_remix_envelope_advance (RemixEnv * env, RemixEnvelope * envelope,
+                         RemixCount count)
+{
+  int l = envelope->_current_point, last = envelope->nr_points - 1;
+
+  envelope->_current_offset += count;
+
+  if (l < 0) l = 0;
+  if (last < 0 || envelope->_samples[l] > envelope->_current_offset)
+    return;
+
+  while (l < last && envelope->_samples[l+1] <= envelope->_current_offset)
+    l++;
+
+  envelope->_current_point = l;
+}
+
+/*
+ * remix_envelope_write (env, envelope, count, output, func)
+ *
+ * Writes 'count' samples of 'envelope' to each channel of 'output' with
+ * the RemixChunkFunc 'func', which finds the envelope position of each
+ * chunk relative to the output offset at the start of the write.
+ */
 static RemixCount
-remix_envelope_constant_process (RemixEnv * env, RemixBase * base,
-                                 RemixCount count, RemixStream * input,
-                                 RemixStream * output)
+remix_envelope_write (RemixEnv * env, RemixEnvelope * envelope,
+                      RemixCount count, RemixStream * output,
+                      RemixChunkFunc func)
 {
-  RemixEnvelope * envelope = (RemixEnvelope *)base;
-  return remix_stream_chunkfuncify (env, output, count,
-                                    remix_envelope_constant_write_chunk,
-                                    envelope);
+  RemixCount n;
+
+  _remix_envelope_prepare (env, envelope);
+  envelope->_output_offset = remix_tell (env, (RemixBase *)output);
+  n = remix_stream_chunkfuncify (env, output, count, func, envelope);
+  if (n > 0) _remix_envelope_advance (env, envelope, n);
+
+  return n;
+}
+
+/*
+ * remix_envelope_mult (env, envelope, dest, count)
+ *
+ * Multiplies 'count' samples of 'dest' by 'envelope' in place; like
+ * processing 'envelope' and then remix_stream_mult(), but without the
+ * intermediate stream. An envelope with no points applies as silence.
+ * Returns -1 with REMIX_ERROR_INVALID if 'envelope' is not a
+ * RemixEnvelope, so that callers can render it to a stream instead.
+ */
+RemixCount
+remix_envelope_mult (RemixEnv * env, RemixBase * envelope,
+                     RemixStream * dest, RemixCount count)
+{
+  RemixStreamExpr expr;
+
+  remix_stream_expr_init (env, &expr, RemixNone);
+  if (remix_stream_expr_mult (env, &expr, envelope) == -1) return -1;
+  return remix_stream_expr_evaluate (env, &expr, dest, count);
+}
+
+/*
+ * remix_envelope_fade (env, envelope, dest, count)
+ *
+ * Fades 'count' samples of 'dest' by 'envelope' in place, as
+ * remix_stream_fade() would by the processed envelope.
+ */
+RemixCount
+remix_envelope_fade (RemixEnv * env, RemixBase * envelope,
+                     RemixStream * dest, RemixCount count)
+{
+  RemixStreamExpr expr;
+
+  remix_stream_expr_init (env, &expr, RemixNone);
+  if (remix_stream_expr_fade (env, &expr, envelope) == -1) return -1;
+  return remix_stream_expr_evaluate (env, &expr, dest, count);
+}
+
+/*
+ * remix_envelope_blend (env, envelope, src, dest, count)
+ *
+ * Blends 'count' samples of 'src' into 'dest' by 'envelope' in place,
+ * as remix_stream_blend() would by the processed envelope.
+ */
+RemixCount
+remix_envelope_blend (RemixEnv * env, RemixBase * envelope,
+                      RemixStream * src, RemixStream * dest, RemixCount count)
+{
+  RemixStreamExpr expr;
+
+  remix_stream_expr_init (env, &expr, src);
+  if (remix_stream_expr_blend (env, &expr, envelope) == -1) return -1;
+  return remix_stream_expr_evaluate (env, &expr, dest, count);
 }
 
 static RemixCount
-remix_envelope_spline_process (RemixEnv * env, RemixBase * base,
-                               RemixCount count, RemixStream * input,
-                               RemixStream * output)
+remix_envelope_constant_process (RemixEnv * env, RemixBase * base,
+                                 RemixCount count, RemixStream * input,
+                                 RemixStream * output)
 {
-  /* XXX: Implement */
-  return -1;
+  RemixEnvelope * envelope = (RemixEnvelope *)base;
+  return remix_envelope_write (env, envelope, count, output,
+                               remix_envelope_constant_write_chunk);
 }
 
 static RemixCount
-remix_envelope_linear_process (RemixEnv * env, RemixBase * base,
-                               RemixCount count, RemixStream * input,
-                               RemixStream * output)
+remix_envelope_curve_process (RemixEnv * env, RemixBase * base,
+                              RemixCount count, RemixStream * input,
+                              RemixStream * output)
 {
   RemixEnvelope * envelope = (RemixEnvelope *)base;
-  return remix_stream_chunkfuncify (env, output, count,
-                                    remix_envelope_linear_write_chunk,
-                                    envelope);
+  return remix_envelope_write (env, envelope, count, output,
+                               remix_envelope_write_chunk);
 }
 
 static RemixCount
@@ -432,10 +876,8 @@ remix_envelope_process (RemixEnv * env, RemixBase * base, RemixCount count,
 
   switch (envelope->type) {
   case REMIX_ENVELOPE_LINEAR:
-    return remix_envelope_linear_process (env, base, count, input, output);
-    break;
   case REMIX_ENVELOPE_SPLINE:
-    return remix_envelope_spline_process (env, base, count, input, output);
+    return remix_envelope_curve_process (env, base, count, input, output);
     break;
   default:
     break;
@@ -458,8 +900,9 @@ static RemixCount
 remix_envelope_seek (RemixEnv * env, RemixBase * base, RemixCount offset)
 {
   RemixEnvelope * envelope = (RemixEnvelope *)base;
-  envelope->_current_point_item =
-    remix_envelope_point_item_before (env, envelope, offset);
+  remix_envelope_update_samples (env, envelope);
+  envelope->_current_point =
+    remix_envelope_index_before (env, envelope, offset);
   envelope->_current_offset = offset;
   return offset;
 }
@@ -491,7 +934,7 @@ static struct _RemixMethods _remix_envelope_linear_methods = {
   remix_envelope_destroy,
   NULL, /* ready */
   NULL, /* prepare */
-  remix_envelope_linear_process,
+  remix_envelope_curve_process,
   remix_envelope_length,
   remix_envelope_seek,
   NULL, /* flush */
@@ -502,7 +945,7 @@ static struct _RemixMethods _remix_envelope_spline_methods = {
   remix_envelope_destroy,
   NULL, /* ready */
   NULL, /* prepare */
-  remix_envelope_spline_process,
+  remix_envelope_curve_process,
   remix_envelope_length,
   remix_envelope_seek,
   NULL, /* flush */
@@ -522,9 +965,9 @@ static struct _RemixMethods _remix_envelope_methods = {
 static RemixEnvelope *
 remix_envelope_optimise (RemixEnv * env, RemixEnvelope * envelope)
 {
-  if (cd_list_is_empty (env, envelope->points)) {
+  if (envelope->nr_points == 0) {
     _remix_set_methods (env, envelope, &_remix_envelope_empty_methods);
-  } else if (cd_list_is_singleton (env, envelope->points)) {
+  } else if (envelope->nr_points == 1) {
     _remix_set_methods (env, envelope, &_remix_envelope_constant_methods);
   } else {
     switch (envelope->type) {
@@ -539,3 +982,23 @@ remix_envelope_optimise (RemixEnv * env, RemixEnvelope * envelope)
 
   return envelope;
 }
+
+/*
+ * _remix_is_envelope (env, base)
+ *
+ * Returns true if 'base' is a RemixEnvelope.
+ */
+int
+_remix_is_envelope (RemixEnv * env, RemixBase * base)
+{
+  RemixMethods * methods;
+
+  if (base == RemixNone) return FALSE;
+  methods = base->methods;
+
+  return (methods == &_remix_envelope_empty_methods ||
+          methods == &_remix_envelope_constant_methods ||
+          methods == &_remix_envelope_linear_methods ||
+          methods == &_remix_envelope_spline_methods ||
+          methods == &_remix_envelope_methods);
+}
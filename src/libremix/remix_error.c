@@ -44,6 +44,7 @@ remix_error_string (RemixEnv * env, RemixError error)
   case REMIX_ERROR_SILENCE: return "Operation would yield silence"; break;
   case REMIX_ERROR_NOOP: return "Operation would not modify data"; break;
   case REMIX_ERROR_SYSTEM: return "System error"; break;
+  case REMIX_ERROR_FULL: return "Queue is full"; break;
   default: return "Unknown error"; break;
   }
 }
@@ -0,0 +1,413 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixStreamExpr: chains of stream operations, evaluated in one pass.
+ *
+ * Description
+ * -----------
+ *
+ * A stream expression records a sequence of operations on a destination
+ * stream -- copying in a source stream, multiplying or fading by an
+ * envelope, blending the source in by an envelope -- without doing any
+ * of them. remix_stream_expr_evaluate() then walks each channel of the
+ * destination once, in tiles which lie within one chunk and one segment
+ * of every envelope, and applies all the operations to each tile while
+ * it is in cache.
+ *
+ * Where the operations match an entry of the fused table, a single PCM
+ * kernel does them all in one loop over the tile; otherwise they are
+ * applied one after another to the tile.
+ *
+ * Invariants
+ * ----------
+ *
+ * Every operand of an expression other than its source stream is a
+ * RemixEnvelope, and no envelope occurs twice in one expression, as each
+ * is advanced once by the evaluation.
+ *
+ * Evaluation does not allocate, and so may be used within remix_process().
+ */
+
+#define __REMIX__
+#include "remix.h"
+
+/*
+ * RemixStreamExprFunc: applies the ops of an expression to 'count'
+ * samples of 'dest' (and 'src'), given the segment of each op's envelope
+ * as the cubic 'c' at 's' and every 'ds' after.
+ */
+typedef RemixCount (*RemixStreamExprFunc) (RemixPCM * src, RemixPCM * dest,
+					   RemixPCM c[][4], RemixPCM * s,
+					   RemixPCM * ds, RemixCount count);
+
+static RemixCount
+remix_expr_mult (RemixPCM * src, RemixPCM * dest, RemixPCM c[][4],
+		 RemixPCM * s, RemixPCM * ds, RemixCount count)
+{
+  return _remix_pcm_mult_cubic (dest, c[0], s[0], ds[0], count);
+}
+
+static RemixCount
+remix_expr_blend (RemixPCM * src, RemixPCM * dest, RemixPCM c[][4],
+		  RemixPCM * s, RemixPCM * ds, RemixCount count)
+{
+  return _remix_pcm_blend_cubic (src, dest, c[0], s[0], ds[0], count);
+}
+
+static RemixCount
+remix_expr_copy_mult (RemixPCM * src, RemixPCM * dest, RemixPCM c[][4],
+		      RemixPCM * s, RemixPCM * ds, RemixCount count)
+{
+  return _remix_pcm_copy_mult_cubic (src, dest, c[1], s[1], ds[1], count);
+}
+
+static RemixCount
+remix_expr_mult_blend (RemixPCM * src, RemixPCM * dest, RemixPCM c[][4],
+		       RemixPCM * s, RemixPCM * ds, RemixCount count)
+{
+  return _remix_pcm_mult_blend_cubic (src, dest, c[0], s[0], ds[0],
+				      c[1], s[1], ds[1], count);
+}
+
+/* Fades are multiplies by the complemented envelope segment */
+static struct {
+  int nr_ops;
+  RemixStreamExprOpType types[2];
+  RemixStreamExprFunc func;
+} remix_expr_fused[] = {
+  { 1, { REMIX_STREAM_EXPR_MULT }, remix_expr_mult },
+  { 1, { REMIX_STREAM_EXPR_FADE }, remix_expr_mult },
+  { 1, { REMIX_STREAM_EXPR_BLEND }, remix_expr_blend },
+  { 2, { REMIX_STREAM_EXPR_COPY, REMIX_STREAM_EXPR_MULT },
+    remix_expr_copy_mult },
+  { 2, { REMIX_STREAM_EXPR_COPY, REMIX_STREAM_EXPR_FADE },
+    remix_expr_copy_mult },
+  { 2, { REMIX_STREAM_EXPR_MULT, REMIX_STREAM_EXPR_BLEND },
+    remix_expr_mult_blend },
+};
+
+#define REMIX_EXPR_NR_FUSED \
+  ((int)(sizeof (remix_expr_fused) / sizeof (remix_expr_fused[0])))
+
+/*
+ * remix_expr_find_fused (expr)
+ *
+ * Returns the index of the entry of the fused table matching the ops of
+ * 'expr', or -1 if there is none.
+ */
+static int
+remix_expr_find_fused (RemixStreamExpr * expr)
+{
+  int i, k;
+
+  for (i = 0; i < REMIX_EXPR_NR_FUSED; i++) {
+    if (remix_expr_fused[i].nr_ops != expr->nr_ops) continue;
+    for (k = 0; k < expr->nr_ops; k++)
+      if (remix_expr_fused[i].types[k] != expr->ops[k].type) break;
+    if (k == expr->nr_ops) return i;
+  }
+
+  return -1;
+}
+
+/*
+ * remix_expr_needs_src (expr)
+ *
+ * Returns whether any op of 'expr' reads its source stream.
+ */
+static int
+remix_expr_needs_src (RemixStreamExpr * expr)
+{
+  int k;
+
+  for (k = 0; k < expr->nr_ops; k++)
+    if (expr->ops[k].type == REMIX_STREAM_EXPR_COPY ||
+	expr->ops[k].type == REMIX_STREAM_EXPR_BLEND)
+      return TRUE;
+
+  return FALSE;
+}
+
+/*
+ * remix_expr_apply (env, expr, src, dest, dest_offset, count)
+ *
+ * Applies the ops of 'expr' to 'count' samples of chunk data 'dest' (and
+ * 'src', if the ops read it), which lie at stream index 'dest_offset'.
+ */
+static RemixCount
+remix_expr_apply (RemixEnv * env, RemixStreamExpr * expr, RemixPCM * src,
+		  RemixPCM * dest, RemixCount dest_offset, RemixCount count)
+{
+  RemixPCM c[REMIX_STREAM_EXPR_MAX_OPS][4];
+  RemixPCM s[REMIX_STREAM_EXPR_MAX_OPS], ds[REMIX_STREAM_EXPR_MAX_OPS];
+  int l[REMIX_STREAM_EXPR_MAX_OPS];
+  RemixCount pos[REMIX_STREAM_EXPR_MAX_OPS];
+  RemixCount remaining, done = 0, n;
+  RemixEnvelope * envelope;
+  int k, j;
+
+  for (k = 0; k < expr->nr_ops; k++) {
+    envelope = expr->ops[k].envelope;
+    if (envelope == RemixNone) continue;
+    l[k] = envelope->_current_point;
+    pos[k] = envelope->_current_offset + (dest_offset - expr->_dest_offset);
+  }
+
+  for (remaining = count; remaining > 0; remaining -= n) {
+    /* Find the longest tile within one segment of every envelope */
+    n = remaining;
+    for (k = 0; k < expr->nr_ops; k++) {
+      envelope = expr->ops[k].envelope;
+      if (envelope == RemixNone) continue;
+
+      n = _remix_envelope_segment (env, envelope, pos[k] + done, n, &l[k],
+				   c[k], &s[k], &ds[k]);
+
+      if (expr->ops[k].type == REMIX_STREAM_EXPR_FADE) {
+	c[k][0] = 1.0 - c[k][0];
+	for (j = 1; j < 4; j++) c[k][j] = -c[k][j];
+      }
+    }
+
+    if (expr->_fused != -1) {
+      n = remix_expr_fused[expr->_fused].func (src, dest, c, s, ds, n);
+    } else {
+      for (k = 0; k < expr->nr_ops; k++) {
+	switch (expr->ops[k].type) {
+	case REMIX_STREAM_EXPR_COPY:
+	  _remix_pcm_copy (src, dest, n, NULL);
+	  break;
+	case REMIX_STREAM_EXPR_MULT:
+	case REMIX_STREAM_EXPR_FADE:
+	  _remix_pcm_mult_cubic (dest, c[k], s[k], ds[k], n);
+	  break;
+	case REMIX_STREAM_EXPR_BLEND:
+	  _remix_pcm_blend_cubic (src, dest, c[k], s[k], ds[k], n);
+	  break;
+	default:
+	  break;
+	}
+      }
+    }
+
+    done += n;
+    dest += n;
+    if (src != NULL) src += n;
+  }
+
+  return done;
+}
+
+/* A RemixChunkFunc for evaluating expressions which do not read 'src' */
+static RemixCount
+remix_expr_chunk (RemixEnv * env, RemixChunk * chunk, RemixCount offset,
+		  RemixCount count, int channelname, void * data)
+{
+  RemixStreamExpr * expr = (RemixStreamExpr *)data;
+
+  return remix_expr_apply (env, expr, NULL,
+			   &chunk->data[offset - chunk->start_index],
+			   offset, count);
+}
+
+/* A RemixChunkChunkFunc for evaluating expressions which read 'src' */
+static RemixCount
+remix_expr_chunkchunk (RemixEnv * env, RemixChunk * src,
+		       RemixCount src_offset, RemixChunk * dest,
+		       RemixCount dest_offset, RemixCount count,
+		       int channelname, void * data)
+{
+  RemixStreamExpr * expr = (RemixStreamExpr *)data;
+
+  count = MIN (count, src->start_index + src->length - src_offset);
+  count = MIN (count, dest->start_index + dest->length - dest_offset);
+
+  return remix_expr_apply (env, expr,
+			   &src->data[src_offset - src->start_index],
+			   &dest->data[dest_offset - dest->start_index],
+			   dest_offset, count);
+}
+
+/*
+ * remix_stream_expr_init (env, expr, src)
+ *
+ * Starts 'expr' as an empty expression, whose copy and blend operations
+ * will read 'src'.
+ */
+void
+remix_stream_expr_init (RemixEnv * env, RemixStreamExpr * expr,
+			RemixStream * src)
+{
+  expr->src = src;
+  expr->nr_ops = 0;
+  expr->_dest_offset = 0;
+  expr->_fused = -1;
+}
+
+/*
+ * remix_stream_expr_push (env, expr, type, base)
+ *
+ * Appends the operation 'type' on the envelope 'base' to 'expr'. Returns
+ * 0, or -1 with REMIX_ERROR_INVALID if 'base' is not a RemixEnvelope or
+ * is already used by 'expr', or if 'expr' has no room for the operation
+ * or no source for it to copy. A blend without a source blends in
+ * silence, which is a multiplication by the envelope.
+ */
+static int
+remix_stream_expr_push (RemixEnv * env, RemixStreamExpr * expr,
+			RemixStreamExprOpType type, RemixBase * base)
+{
+  int k;
+
+  if (expr->nr_ops >= REMIX_STREAM_EXPR_MAX_OPS) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+
+  if (expr->src == RemixNone) {
+    if (type == REMIX_STREAM_EXPR_COPY) {
+      remix_set_error (env, REMIX_ERROR_INVALID);
+      return -1;
+    } else if (type == REMIX_STREAM_EXPR_BLEND) {
+      type = REMIX_STREAM_EXPR_MULT;
+    }
+  }
+
+  if (type != REMIX_STREAM_EXPR_COPY) {
+    if (!_remix_is_envelope (env, base)) {
+      remix_set_error (env, REMIX_ERROR_INVALID);
+      return -1;
+    }
+    for (k = 0; k < expr->nr_ops; k++) {
+      if (expr->ops[k].envelope == (RemixEnvelope *)base) {
+	remix_set_error (env, REMIX_ERROR_INVALID);
+	return -1;
+      }
+    }
+  }
+
+  expr->ops[expr->nr_ops].type = type;
+  expr->ops[expr->nr_ops].envelope =
+    (type == REMIX_STREAM_EXPR_COPY) ? RemixNone : (RemixEnvelope *)base;
+  expr->nr_ops++;
+
+  return 0;
+}
+
+/*
+ * remix_stream_expr_copy (env, expr)
+ *
+ * Appends to 'expr' a copy of its source stream into the destination.
+ */
+int
+remix_stream_expr_copy (RemixEnv * env, RemixStreamExpr * expr)
+{
+  return remix_stream_expr_push (env, expr, REMIX_STREAM_EXPR_COPY,
+				 RemixNone);
+}
+
+/*
+ * remix_stream_expr_mult (env, expr, envelope)
+ *
+ * Appends to 'expr' a multiplication of the destination by 'envelope'.
+ */
+int
+remix_stream_expr_mult (RemixEnv * env, RemixStreamExpr * expr,
+			RemixBase * envelope)
+{
+  return remix_stream_expr_push (env, expr, REMIX_STREAM_EXPR_MULT, envelope);
+}
+
+/*
+ * remix_stream_expr_fade (env, expr, envelope)
+ *
+ * Appends to 'expr' a multiplication of the destination by one minus
+ * 'envelope', as remix_stream_fade() does.
+ */
+int
+remix_stream_expr_fade (RemixEnv * env, RemixStreamExpr * expr,
+			RemixBase * envelope)
+{
+  return remix_stream_expr_push (env, expr, REMIX_STREAM_EXPR_FADE, envelope);
+}
+
+/*
+ * remix_stream_expr_blend (env, expr, envelope)
+ *
+ * Appends to 'expr' a blend of its source stream into the destination
+ * by 'envelope', as remix_stream_blend() does. If 'expr' has no source,
+ * silence is blended in.
+ */
+int
+remix_stream_expr_blend (RemixEnv * env, RemixStreamExpr * expr,
+			 RemixBase * envelope)
+{
+  return remix_stream_expr_push (env, expr, REMIX_STREAM_EXPR_BLEND,
+				 envelope);
+}
+
+/*
+ * remix_stream_expr_evaluate (env, expr, dest, count)
+ *
+ * Applies the operations of 'expr' to 'count' samples of each channel
+ * of 'dest' from its current position, reading the source stream of
+ * 'expr' from its current position, and each envelope from its own.
+ * All are advanced past the samples evaluated, as if each envelope had
+ * been processed. Returns the count of samples evaluated.
+ */
+RemixCount
+remix_stream_expr_evaluate (RemixEnv * env, RemixStreamExpr * expr,
+			    RemixStream * dest, RemixCount count)
+{
+  RemixEnvelope * envelope;
+  RemixCount n;
+  int k;
+
+  if (expr->nr_ops == 0) return count;
+
+  for (k = 0; k < expr->nr_ops; k++) {
+    envelope = expr->ops[k].envelope;
+    if (envelope != RemixNone) _remix_envelope_prepare (env, envelope);
+  }
+
+  expr->_fused = remix_expr_find_fused (expr);
+  expr->_dest_offset = remix_tell (env, (RemixBase *)dest);
+
+  if (remix_expr_needs_src (expr))
+    n = remix_stream_chunkchunkfuncify (env, expr->src, dest, count,
+					remix_expr_chunkchunk, expr);
+  else
+    n = remix_stream_chunkfuncify (env, dest, count, remix_expr_chunk, expr);
+
+  if (n <= 0) return n;
+
+  /* Advance the envelopes as remix_process() would have */
+  for (k = 0; k < expr->nr_ops; k++) {
+    envelope = expr->ops[k].envelope;
+    if (envelope == RemixNone) continue;
+    _remix_envelope_advance (env, envelope, n);
+    envelope->base.offset += n;
+  }
+
+  return n;
+}
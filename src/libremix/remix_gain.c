@@ -105,6 +105,7 @@ remix_gain_process (RemixEnv * env, RemixBase * base, RemixCount count,
   RemixCount mixlength = remix_base_get_mixlength (env, base);
   RemixBase * gain_envelope;
   RemixGain * gi = remix_base_get_instance_data (env, base);
+  RemixStreamExpr expr;
 
   remix_dprintf ("PROCESS GAIN (%p, +%ld) @ %ld\n", base, count,
 	      remix_tell (env, base));
@@ -117,6 +118,16 @@ remix_gain_process (RemixEnv * env, RemixBase * base, RemixCount count,
     return -1;
   }
 
+  /* Envelopes are applied while copying, in one pass; anything else is
+   * rendered into the gain stream first */
+  remix_stream_expr_init (env, &expr, input);
+  if (remix_stream_expr_copy (env, &expr) != -1 &&
+      remix_stream_expr_mult (env, &expr, gain_envelope) != -1) {
+    processed = remix_stream_expr_evaluate (env, &expr, output, count);
+    remix_dprintf ("[remix_gain_process] evaluated %ld\n", processed);
+    return processed;
+  }
+
   while (remaining > 0) {
     n = MIN (remaining, mixlength);
 
@@ -182,7 +193,7 @@ remix_gain_optimise (RemixEnv * env, RemixBase * gain)
 static int
 remix_gain_plugin_destroy (RemixEnv * env, RemixPlugin * plugin)
 {
-  cd_set_free (env, plugin->process_scheme);
+  plugin->process_scheme = cd_set_free (env, plugin->process_scheme);
   return 0;
 }
 
@@ -40,6 +40,8 @@
  *
  */
 
+#include <string.h>
+
 #define __REMIX__
 #include "remix.h"
 
@@ -49,18 +51,20 @@ static RemixLayer * remix_layer_optimise (RemixEnv * env, RemixLayer * layer);
 /* Coherency dependencies: ensure coherency on addition+removal of sounds */
 static RemixLayer * remix_layer_ensure_coherency (RemixEnv * env, RemixLayer * layer);
 
+static void remix_layer_grow (RemixEnv * env, RemixLayer * layer, int nr_sounds);
+
 void
 remix_layer_debug (RemixEnv * env, RemixLayer * layer)
 {
 #ifdef DEBUG
-  CDList * l;
   RemixSound * s;
+  int i;
 
   remix_dprintf ("Layer (0x%p): ", layer);
   if (layer == RemixNone) return;
 
-  for (l = layer->sounds; l; l = l->next) {
-    s = (RemixSound *)l->data.s_pointer;
+  for (i = 0; i < layer->nr_sounds; i++) {
+    s = layer->sounds[i];
     /* XXX: assumes samples */
     remix_dprintf ("[0x%p: %ld, +%ld] ", s, s->start_time.samples,
 		s->duration.samples);
@@ -74,9 +78,11 @@ remix_layer_init (RemixEnv * env, RemixBase * base)
 {
   RemixLayer * layer = (RemixLayer *)base;
   layer->timetype = REMIX_TIME_SAMPLES;
-  layer->sounds = cd_list_new (env);
+  layer->sounds = NULL;
+  layer->nr_sounds = 0;
+  layer->_max_sounds = 0;
   /*  layer->_current_time = _remix_time_zero (layer->timetype);*/
-  layer->_current_sound_item = RemixNone;
+  layer->_current_sound = -1;
   layer->_current_tempo = remix_get_tempo (env);
   layer->_current_offset = 0;
   remix_layer_optimise (env, layer);
@@ -90,22 +96,42 @@ _remix_layer_new (RemixEnv * env)
     remix_base_new_subclass (env, sizeof (struct _RemixLayer));
 }
 
+/*
+ * remix_layer_clone_with_track (env, base, new_track)
+ *
+ * Clones the layer 'base' and its sounds for 'new_track'. The new layer
+ * is not added to the track's list of layers.
+ */
 RemixBase *
-remix_layer_clone (RemixEnv * env, RemixBase * base)
+remix_layer_clone_with_track (RemixEnv * env, RemixBase * base,
+			      RemixTrack * new_track)
 {
   RemixLayer * layer = (RemixLayer *)base;
   RemixLayer * new_layer = (RemixLayer *)_remix_layer_new (env);
   RemixCount offset = remix_tell (env, base);
+  int i;
 
+  new_layer->track = new_track;
+  remix_layer_init (env, (RemixBase *)new_layer);
   new_layer->timetype = layer->timetype;
-  new_layer->sounds =
-    cd_list_clone_with (env, layer->sounds,
-			(CDCloneWithFunc)remix_sound_clone_with_layer,
-			new_layer);
+  remix_layer_grow (env, new_layer, layer->nr_sounds);
+  for (i = 0; i < layer->nr_sounds; i++)
+    remix_sound_clone_with_layer (env, (RemixBase *)layer->sounds[i],
+				  new_layer);
   remix_seek (env, (RemixBase *)new_layer, offset, SEEK_SET);
 
-  new_layer->track = layer->track;
-  _remix_track_add_layer_above (env, layer->track, new_layer, layer);
+  return (RemixBase *)new_layer;
+}
+
+RemixBase *
+remix_layer_clone (RemixEnv * env, RemixBase * base)
+{
+  RemixLayer * layer = (RemixLayer *)base;
+  RemixLayer * new_layer = (RemixLayer *)
+    remix_layer_clone_with_track (env, base, layer->track);
+
+  if (layer->track)
+    _remix_track_add_layer_above (env, layer->track, new_layer, layer);
 
   return (RemixBase *)new_layer;
 }
@@ -116,7 +142,10 @@ remix_layer_destroy (RemixEnv * env, RemixBase * base)
   RemixLayer * layer = (RemixLayer *)base;
   if (layer->track)
     _remix_track_remove_layer (env, layer->track, layer);
-  remix_destroy_list (env, layer->sounds);
+  /* Each sound removes itself from the layer when destroyed */
+  while (layer->nr_sounds > 0)
+    remix_destroy (env, (RemixBase *)layer->sounds[layer->nr_sounds - 1]);
+  if (layer->sounds != NULL) remix_free (layer->sounds);
   remix_free (layer);
   return 0;
 }
@@ -232,16 +261,16 @@ RemixTimeType
 remix_layer_set_timetype (RemixEnv * env, RemixLayer * layer, RemixTimeType new_type)
 {
   RemixTimeType old_type = layer->timetype;
-  CDList * l;
   RemixDeck * deck;
   RemixSound * sound;
+  int i;
 
   if (old_type == new_type) return old_type;
 
   deck = remix_layer_get_deck (env, layer);
 
-  for (l = layer->sounds; l; l = l->next) {
-    sound = (RemixSound *)l->data.s_pointer;
+  for (i = 0; i < layer->nr_sounds; i++) {
+    sound = layer->sounds[i];
     sound->start_time = remix_time_convert (env, sound->start_time, old_type,
 					   new_type);
     sound->duration = remix_time_convert (env, sound->duration, old_type,
@@ -259,87 +288,275 @@ remix_layer_get_timetype (RemixEnv * env, RemixLayer * layer)
   return layer->timetype;
 }
 
+/*
+ * remix_layer_grow (env, layer, nr_sounds)
+ *
+ * Ensures there is room in the timeline of 'layer' for at least
+ * 'nr_sounds' sounds.
+ */
+static void
+remix_layer_grow (RemixEnv * env, RemixLayer * layer, int nr_sounds)
+{
+  RemixSound ** sounds;
+  int max_sounds;
+
+  if (nr_sounds <= layer->_max_sounds) return;
+
+  max_sounds = MAX (nr_sounds, MAX (4, layer->_max_sounds * 2));
+
+  sounds = (RemixSound **) remix_malloc (max_sounds * sizeof (RemixSound *));
+
+  if (layer->nr_sounds > 0)
+    memcpy (sounds, layer->sounds, layer->nr_sounds * sizeof (RemixSound *));
+
+  if (layer->sounds != NULL) remix_free (layer->sounds);
+
+  layer->sounds = sounds;
+  layer->_max_sounds = max_sounds;
+}
+
+/*
+ * remix_layer_renumber (layer, from)
+ *
+ * Updates the timeline index of each sound of 'layer' from 'from' on.
+ */
+static void
+remix_layer_renumber (RemixLayer * layer, int from)
+{
+  int i;
+
+  for (i = from; i < layer->nr_sounds; i++)
+    layer->sounds[i]->_layer_index = i;
+}
+
+/*
+ * remix_layer_index_upto (env, layer, time)
+ *
+ * Returns the number of sounds of 'layer' with a start_time at or
+ * before 'time', ie. the index of the first sound starting after it.
+ */
+static int
+remix_layer_index_upto (RemixEnv * env, RemixLayer * layer, RemixTime time)
+{
+  int lo = 0, hi = layer->nr_sounds, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (_remix_time_gt (layer->timetype, layer->sounds[mid]->start_time, time))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return lo;
+}
+
+/*
+ * remix_layer_index_from (env, layer, time)
+ *
+ * Returns the index of the first sound of 'layer' with a start_time at
+ * or after 'time', or nr_sounds if there is none.
+ */
+static int
+remix_layer_index_from (RemixEnv * env, RemixLayer * layer, RemixTime time)
+{
+  int lo = 0, hi = layer->nr_sounds, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (_remix_time_ge (layer->timetype, layer->sounds[mid]->start_time, time))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return lo;
+}
+
 RemixSound *
 _remix_layer_add_sound (RemixEnv * env, RemixLayer * layer, RemixSound * sound,
 		     RemixTime start_time)
 {
+  int i;
+
   sound->start_time = start_time;
-  layer->sounds = cd_list_insert (env, layer->sounds, CD_TYPE_POINTER,
-				  CD_POINTER(sound),
-				  (CDCmpFunc)remix_sound_later);
+
+  /* Insert after any sounds starting at the same time */
+  i = remix_layer_index_upto (env, layer, start_time);
+
+  remix_layer_grow (env, layer, layer->nr_sounds + 1);
+  memmove (&layer->sounds[i+1], &layer->sounds[i],
+	   (layer->nr_sounds - i) * sizeof (RemixSound *));
+  layer->sounds[i] = sound;
+  layer->nr_sounds++;
+  remix_layer_renumber (layer, i);
+  _remix_deck_graph_changed (env);
+
   remix_layer_ensure_coherency (env, layer);
   return sound;
 }
 
-RemixSound *
-_remix_layer_remove_sound (RemixEnv * env, RemixLayer * layer, RemixSound * sound)
-{
-  layer->sounds = cd_list_remove (env, layer->sounds, CD_TYPE_POINTER,
-				  CD_POINTER(sound));
-  remix_layer_ensure_coherency (env, layer);
-  return sound;
+/*
+ * remix_layer_sort_sounds (env, layer, sounds, tmp, n)
+ *
+ * Sorts the 'n' sounds in 'sounds' by start_time, keeping sounds with
+ * equal start_times in order. 'tmp' is scratch space for 'n' sounds.
+ */
+static void
+remix_layer_sort_sounds (RemixEnv * env, RemixLayer * layer,
+			 RemixSound ** sounds, RemixSound ** tmp, int n)
+{
+  RemixSound ** src = sounds, ** dest = tmp, ** t;
+  int width, lo, mid, hi, i, j, k;
+
+  /* Bottom-up merge sort */
+  for (width = 1; width < n; width *= 2) {
+    for (lo = 0; lo < n; lo += 2 * width) {
+      mid = MIN (lo + width, n);
+      hi = MIN (lo + 2 * width, n);
+      i = lo; j = mid; k = lo;
+      while (i < mid && j < hi) {
+	if (_remix_time_gt (layer->timetype, src[i]->start_time,
+			    src[j]->start_time))
+	  dest[k++] = src[j++];
+	else
+	  dest[k++] = src[i++];
+      }
+      while (i < mid) dest[k++] = src[i++];
+      while (j < hi) dest[k++] = src[j++];
+    }
+    t = src; src = dest; dest = t;
+  }
+
+  if (src != sounds)
+    memcpy (sounds, src, n * sizeof (RemixSound *));
 }
 
 /*
- * remix_layer_get_sound_item_before (layer, time)
+ * remix_layer_add_sounds (env, layer, sources, start_times, durations, n)
  *
- * Finds the last sound with a start_time before 'time'.
+ * Creates 'n' sounds in 'layer', the i'th playing sources[i] from
+ * start_times[i] for durations[i]. This is equivalent to calling
+ * remix_sound_new() for each in turn, but sorts the new sounds once and
+ * merges them into the layer in a single pass. Returns the number of
+ * sounds added, or -1 on error.
  */
-static CDList *
-remix_layer_get_sound_item_before (RemixEnv * env, RemixLayer * layer, RemixTime time)
+int
+remix_layer_add_sounds (RemixEnv * env, RemixLayer * layer,
+			RemixBase ** sources, RemixTime * start_times,
+			RemixTime * durations, int n)
 {
-  RemixSound * s;
-  CDList * l, * lp = RemixNone;
+  RemixSound ** new_sounds, ** sounds;
+  int i, j, k;
 
-  for (l = layer->sounds; l; l = l->next) {
-    s = (RemixSound *)l->data.s_pointer;
-    if (_remix_time_gt (layer->timetype, s->start_time, time)) return lp;
-    lp = l;
+  if (layer == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_NOENTITY);
+    return -1;
   }
-  
-  return lp;
+
+  if (n < 0 || (n > 0 && (sources == NULL || start_times == NULL ||
+			  durations == NULL))) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+
+  if (n == 0) return 0;
+
+  new_sounds = (RemixSound **) remix_malloc (n * sizeof (RemixSound *));
+  sounds = (RemixSound **)
+    remix_malloc ((layer->nr_sounds + n) * sizeof (RemixSound *));
+
+  for (i = 0; i < n; i++) {
+    new_sounds[i] = _remix_sound_new_unplaced (env, sources[i], layer,
+					       start_times[i], durations[i]);
+  }
+
+  /* The merged array doubles as scratch space for the sort */
+  remix_layer_sort_sounds (env, layer, new_sounds, sounds, n);
+
+  /* Merge, placing new sounds after existing ones with equal start_times */
+  i = j = k = 0;
+  while (i < layer->nr_sounds && j < n) {
+    if (_remix_time_gt (layer->timetype, layer->sounds[i]->start_time,
+			new_sounds[j]->start_time))
+      sounds[k++] = new_sounds[j++];
+    else
+      sounds[k++] = layer->sounds[i++];
+  }
+  while (i < layer->nr_sounds) sounds[k++] = layer->sounds[i++];
+  while (j < n) sounds[k++] = new_sounds[j++];
+
+  if (layer->sounds != NULL) remix_free (layer->sounds);
+  remix_free (new_sounds);
+
+  layer->sounds = sounds;
+  layer->nr_sounds = layer->_max_sounds = k;
+  remix_layer_renumber (layer, 0);
+  _remix_deck_graph_changed (env);
+
+  remix_layer_ensure_coherency (env, layer);
+
+  return n;
+}
+
+RemixSound *
+_remix_layer_remove_sound (RemixEnv * env, RemixLayer * layer, RemixSound * sound)
+{
+  int i = sound->_layer_index;
+
+  if (i < 0 || i >= layer->nr_sounds || layer->sounds[i] != sound)
+    return sound;
+
+  memmove (&layer->sounds[i], &layer->sounds[i+1],
+	   (layer->nr_sounds - i - 1) * sizeof (RemixSound *));
+  layer->nr_sounds--;
+  remix_layer_renumber (layer, i);
+  sound->_layer_index = -1;
+  _remix_deck_graph_changed (env);
+
+  remix_layer_ensure_coherency (env, layer);
+  return sound;
 }
 
 /*
- * remix_layer_get_sound_item_at (layer, time)
+ * remix_layer_get_sound_index_at (layer, time)
  *
  * Finds the sound occurring at 'time'. If no sound is playing at 'time',
- * returns RemixNone.
+ * returns -1.
  */
-CDList *
-remix_layer_get_sound_item_at (RemixEnv * env, RemixLayer * layer, RemixTime time)
+static int
+remix_layer_get_sound_index_at (RemixEnv * env, RemixLayer * layer,
+				RemixTime time)
 {
   RemixTime t;
-  CDList * l = remix_layer_get_sound_item_before (env, layer, time);
   RemixSound * s;
+  int i;
 
-  if (l == RemixNone) return RemixNone;
+  /* The last sound with a start_time before 'time' */
+  i = remix_layer_index_upto (env, layer, time) - 1;
+  if (i < 0) return -1;
 
-  s = (RemixSound *)l->data.s_pointer;
+  s = layer->sounds[i];
 
   t = _remix_time_add (layer->timetype, s->start_time, s->duration);
-  if (_remix_time_le (layer->timetype, t, time)) l = RemixNone;
+  if (_remix_time_le (layer->timetype, t, time)) return -1;
 
-  return l;
+  return i;
 }
 
 /*
- * remix_layer_get_sound_item_after (layer, time)
+ * remix_layer_get_sound_at (layer, time)
  *
- * Finds the first sound at or after 'time' and returns its list item.
+ * Finds the sound occurring at 'time', or RemixNone if no sound is
+ * playing at 'time'.
  */
-static CDList *
-remix_layer_get_sound_item_after (RemixEnv * env, RemixLayer * layer, RemixTime time)
+RemixSound *
+remix_layer_get_sound_at (RemixEnv * env, RemixLayer * layer, RemixTime time)
 {
-  RemixSound * s;
-  CDList * l;
+  int i = remix_layer_get_sound_index_at (env, layer, time);
 
-  for (l = layer->sounds; l; l = l->next) {
-    s = (RemixSound *)l->data.s_pointer;
-    if (_remix_time_ge (layer->timetype, s->start_time, time)) return l;
-  }
-
-  return RemixNone;
+  if (i == -1) return RemixNone;
+  else return layer->sounds[i];
 }
 
 /*
@@ -350,55 +567,44 @@ remix_layer_get_sound_item_after (RemixEnv * env, RemixLayer * layer, RemixTime
 RemixSound *
 remix_layer_get_sound_after (RemixEnv * env, RemixLayer * layer, RemixTime time)
 {
-  CDList * l = remix_layer_get_sound_item_after (env, layer, time);
+  int i = remix_layer_index_from (env, layer, time);
 
-  if (l == RemixNone) return RemixNone;
-  else return (RemixSound *)l->data.s_pointer;
+  if (i == layer->nr_sounds) return RemixNone;
+  else return layer->sounds[i];
 }
 
 RemixSound *
 _remix_layer_get_sound_prev (RemixEnv * env, RemixLayer * layer, RemixSound * sound)
 {
-  CDList * sound_item;
-  RemixSound * sn;
+  int i;
 
-  if (layer->sounds == NULL) return RemixNone;
+  if (layer->nr_sounds == 0) return RemixNone;
 
-  if (sound == RemixNone) {
-    sn = (RemixSound *) layer->sounds->data.s_pointer;
-  } else {
-    sound_item = cd_list_find (env, layer->sounds, CD_TYPE_POINTER,
-			       CD_POINTER(sound));
-    if (sound_item == NULL) return RemixNone;
-    sound_item = sound_item->prev;
-    if (sound_item == NULL) return RemixNone;
-    sn = (RemixSound *) sound_item->data.s_pointer;
-  }
+  if (sound == RemixNone) return layer->sounds[0];
+
+  i = sound->_layer_index;
+  if (i < 0 || i >= layer->nr_sounds || layer->sounds[i] != sound)
+    return RemixNone;
+  if (i == 0) return RemixNone;
 
-  return sn;
+  return layer->sounds[i-1];
 }
 
 RemixSound *
 _remix_layer_get_sound_next (RemixEnv * env, RemixLayer * layer, RemixSound * sound)
 {
-  CDList * sound_item;
-  RemixSound * sn;
-
-  if (layer->sounds == NULL) return RemixNone;
-
-  if (sound == NULL) {
-    sn = (RemixSound *)
-      (cd_list_last (env, layer->sounds, CD_TYPE_POINTER)).s_pointer;
-  } else {
-    sound_item = cd_list_find (env, layer->sounds, CD_TYPE_POINTER,
-			       CD_POINTER(sound));
-    if (sound_item == NULL) return RemixNone;
-    sound_item = sound_item->next;
-    if (sound_item == NULL) return RemixNone;
-    sn = (RemixSound *) sound_item->data.s_pointer;
-  }
+  int i;
+
+  if (layer->nr_sounds == 0) return RemixNone;
 
-  return sn;
+  if (sound == RemixNone) return layer->sounds[layer->nr_sounds - 1];
+
+  i = sound->_layer_index;
+  if (i < 0 || i >= layer->nr_sounds || layer->sounds[i] != sound)
+    return RemixNone;
+  if (i == layer->nr_sounds - 1) return RemixNone;
+
+  return layer->sounds[i+1];
 }
 
 RemixLayer *
@@ -423,15 +629,16 @@ static RemixCount
 remix_layer_length (RemixEnv * env, RemixBase * base)
 {
   RemixLayer * layer = (RemixLayer *)base;
-  RemixSound * sound = (RemixSound *)
-    (cd_list_last (env, layer->sounds, CD_TYPE_POINTER)).s_pointer;
+  RemixSound * sound;
   RemixTime end, t;
 
-  if (sound == RemixNone) {
+  if (layer->nr_sounds == 0) {
     remix_dprintf ("[remix_layer_length] layer %p has no sounds\n", layer);
     return 0;
   }
 
+  sound = layer->sounds[layer->nr_sounds - 1];
+
   /* Convert sound's end time to offset and return that */
   end = _remix_time_add (layer->timetype, sound->start_time, sound->duration);
   t = remix_time_convert (env, end, layer->timetype, REMIX_TIME_SAMPLES);
@@ -453,13 +660,15 @@ remix_layer_seek (RemixEnv * env, RemixBase * base, RemixCount offset)
   current_time = remix_time_convert (env, (RemixTime)offset, REMIX_TIME_SAMPLES,
 				    layer->timetype);
 
-  /* Cache the current sound item */
-  layer->_current_sound_item =
-    remix_layer_get_sound_item_at (env, layer, current_time);
+  /* Cache the current sound */
+  layer->_current_sound =
+    remix_layer_get_sound_index_at (env, layer, current_time);
 
-  if (layer->_current_sound_item == RemixNone)
-    layer->_current_sound_item =
-      remix_layer_get_sound_item_after (env, layer, current_time);
+  if (layer->_current_sound == -1) {
+    layer->_current_sound = remix_layer_index_from (env, layer, current_time);
+    if (layer->_current_sound == layer->nr_sounds)
+      layer->_current_sound = -1;
+  }
 
   layer->_current_offset = offset;
 
@@ -496,8 +705,10 @@ remix_layer_process_sound (RemixEnv * env, RemixLayer * layer,
     remix_seek (env, (RemixBase *)sound, current_offset - sound_offset,
 	       SEEK_SET);
     n = remix_process (env, (RemixBase *)sound, n, input, output);
-    processed += n;
-    remaining -= n;
+    if (n > 0) {
+      processed += n;
+      remaining -= n;
+    }
   }
 
   return processed;
@@ -524,7 +735,7 @@ remix_layer_process (RemixEnv * env, RemixBase * base, RemixCount count,
     RemixCount new_offset;
 
 #if 0
-    if (layer->_current_sound_item == RemixNone) {
+    if (layer->_current_sound == -1) {
       RemixSamplerate samplerate = remix_get_samplerate (env);
       int beat24s;
 
@@ -532,7 +743,7 @@ remix_layer_process (RemixEnv * env, RemixBase * base, RemixCount count,
 		       layer->_current_tempo * 24.0 / (samplerate * 60.0)));
       new_offset = (RemixCount)(beat24s * samplerate * 60.0 / (tempo * 24.0));
     } else {
-      sound = (RemixSound *)layer->_current_sound_item->data.s_pointer;
+      sound = layer->sounds[layer->_current_sound];
       t = remix_time_convert (env, sound->start_time, layer->timetype,
 			     REMIX_TIME_SAMPLES);
       
@@ -545,14 +756,14 @@ remix_layer_process (RemixEnv * env, RemixBase * base, RemixCount count,
     remix_layer_seek (env, (RemixBase *)layer, new_offset);
     layer->_current_tempo = tempo;
 #else
-    if (layer->_current_sound_item != RemixNone)
+    if (layer->_current_sound != -1)
       remix_layer_ensure_coherency (env, layer);
 #endif
   }
 
   while (remaining > 0) {
 
-    if (layer->_current_sound_item == RemixNone) {
+    if (layer->_current_sound == -1) {
       /* No more sounds */
       remix_dprintf ("[remix_layer_process] ## no more sounds!\n");
 
@@ -564,7 +775,7 @@ remix_layer_process (RemixEnv * env, RemixBase * base, RemixCount count,
       break;
     }
 
-    sound = (RemixSound *)layer->_current_sound_item->data.s_pointer;
+    sound = layer->sounds[layer->_current_sound];
     t = remix_time_convert (env, sound->start_time, layer->timetype,
 			   REMIX_TIME_SAMPLES);
     sound_offset = t.samples;
@@ -573,8 +784,8 @@ remix_layer_process (RemixEnv * env, RemixBase * base, RemixCount count,
 			   REMIX_TIME_SAMPLES);
     sound_length = t.samples;
 
-    if (layer->_current_sound_item->next) {
-      sn = (RemixSound *)(layer->_current_sound_item->next->data.s_pointer);
+    if (layer->_current_sound + 1 < layer->nr_sounds) {
+      sn = layer->sounds[layer->_current_sound + 1];
       t = remix_time_convert (env, sn->start_time, layer->timetype,
 			     REMIX_TIME_SAMPLES);
       next_offset = t.samples;
@@ -589,12 +800,22 @@ remix_layer_process (RemixEnv * env, RemixBase * base, RemixCount count,
     n = remix_layer_process_sound (env, layer, current_offset,
 				  sound, sound_offset, sound_length,
 				  remaining, input, output);
+
+    /* Stop at a sound that fails, leaving its error if it gave nothing */
+    if (n <= 0 && current_offset < sound_offset + sound_length) {
+      if (processed == 0) return -1;
+      break;
+    }
+
     current_offset += n;
     processed += n;
     remaining -= n;
 
-    if (current_offset >= sound_offset + sound_length)
-      layer->_current_sound_item = layer->_current_sound_item->next;
+    if (current_offset >= sound_offset + sound_length) {
+      layer->_current_sound++;
+      if (layer->_current_sound == layer->nr_sounds)
+	layer->_current_sound = -1;
+    }
   }
 
   remix_dprintf ("[remix_layer_process] processed %ld\n", processed);
@@ -615,9 +836,9 @@ remix_layer_flush (RemixEnv * env, RemixBase * base)
   RemixLayer * layer = (RemixLayer *)base;
   RemixBase * sound;
 
-  if (layer->_current_sound_item == RemixNone) return 0;
+  if (layer->_current_sound == -1) return 0;
 
-  sound = (RemixBase *)layer->_current_sound_item->data.s_pointer;
+  sound = (RemixBase *)layer->sounds[layer->_current_sound];
 
   return remix_flush (env, sound);
 }
@@ -633,11 +854,29 @@ remix_layer_ensure_coherency (RemixEnv * env, RemixLayer * layer)
   return layer;
 }
 
+/*
+ * remix_layer_prepare (env, base)
+ *
+ * Prepares each sound of the layer. Layers have no scratch streams of
+ * their own.
+ */
+static RemixBase *
+remix_layer_prepare (RemixEnv * env, RemixBase * base)
+{
+  RemixLayer * layer = (RemixLayer *)base;
+  int i;
+
+  for (i = 0; i < layer->nr_sounds; i++)
+    remix_prepare (env, (RemixBase *)layer->sounds[i]);
+
+  return base;
+}
+
 static struct _RemixMethods _remix_layer_methods = {
   remix_layer_clone,   /* clone */
   remix_layer_destroy, /* destroy */
   NULL,             /* ready */
-  NULL,             /* prepare */
+  remix_layer_prepare, /* prepare */
   remix_layer_process, /* process */
   remix_layer_length,  /* length */
   remix_layer_seek,    /* seek */
@@ -84,6 +84,11 @@ remix_monitor_reset_device (RemixEnv * env, RemixBase * base)
   monitor->numfrags = DEFAULT_NUMFRAGS;
   monitor->fragsize = DEFAULT_FRAGSIZE;
 
+  remix_converter_destroy (env, monitor->converter);
+  monitor->converter = remix_converter_new (env, REMIX_FORMAT_S16,
+					    REMIX_DITHER_TPDF,
+					    monitor->stereo ? 2 : 1);
+
   if (DEBUG_FILE == 1) {
     monitor->format = AFMT_S16_LE;
     return base;
@@ -187,6 +192,7 @@ remix_monitor_destroy (RemixEnv * env, RemixBase * base)
   if (monitor->dev_dsp_fd != -1) {
     close (monitor->dev_dsp_fd);
   }
+  remix_converter_destroy (env, monitor->converter);
   remix_free (monitor);
   return 0;
 }
@@ -254,15 +260,15 @@ static RemixCount
 remix_monitor_playbuffer (RemixEnv * env, RemixMonitor * monitor, RemixPCM * data,
 			 RemixCount count)
 {
-  RemixCount i;
-  RemixPCM value;
-  const RemixPCM max_value = (RemixPCM)SHRT_MAX / 2;
-
-  for (i = 0; i < count; i++) {
-    value = *data++ * max_value;
-    monitor->playbuffer[i] = (short)value;
+  if (monitor->converter == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_NOENTITY);
+    return -1;
   }
 
+  remix_convert_interleaved (env, monitor->converter, data,
+			     monitor->playbuffer,
+			     count / (monitor->stereo ? 2 : 1));
+
   count = remix_monitor_write_short (env, monitor, count);
   
   return count;
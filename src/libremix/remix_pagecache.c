@@ -0,0 +1,594 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixPageCache: decoded audio shared between file readers.
+ *
+ * Description
+ * -----------
+ *
+ * Each world owns a cache of decoded audio, in pages of REMIX_PAGE_SAMPLES
+ * planar samples keyed by file and page number. File readers open their
+ * file with _remix_page_file_open() and decode through the cache, so
+ * that a file read by many readers, or by clones of one, is decoded only
+ * once while it stays in the cache.
+ *
+ * The pages are allocated up front, outside of processing: enough for the
+ * world's cache size, set with remix_set_cache_size(), plus one for each
+ * open reader. They are kept in order of use, and a page missing from the
+ * cache is decoded into the least recently used page not in use, so that
+ * reading never allocates or frees memory. A cache size of 0 disables
+ * caching.
+ *
+ * Invariants
+ * ----------
+ *
+ * A page is only ever shorter than its file's page_frames at the end of
+ * the file.
+ *
+ * Pages in use by a reader are pinned, and are not reused until released.
+ * Each reader pins at most one page at a time, so there is always a page
+ * that is not pinned for a reader to decode into. A reader reading pages
+ * in place with _remix_page_cache_map() keeps its page pinned between
+ * reads, and pins no other.
+ *
+ * The cache may be used from several threads at once. Its lock is only
+ * held to look pages up and reorder them, never while decoding or copying
+ * data; readers decoding ahead only use the cache from the I/O thread.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define __REMIX__
+#include "remix.h"
+
+/* Samples in a page, across all channels */
+#define REMIX_PAGE_SAMPLES 16384
+
+/* Number of hash chains; a power of two */
+#define REMIX_PAGE_CACHE_BUCKETS 1024
+
+/* Default cache size, in bytes */
+#define REMIX_PAGE_CACHE_DEFAULT (32 * 1024 * 1024)
+
+#define REMIX_PAGE_BYTES (REMIX_PAGE_SAMPLES * sizeof (RemixPCM))
+
+struct _RemixPageFile {
+  RemixPageFile * next; /* in the cache's list of files */
+  char * path;
+  int nr_channels;
+  RemixCount page_frames; /* frames of each channel in a page */
+};
+
+struct _RemixPage {
+  RemixPage * hash_next;
+  RemixPage * prev, * next; /* in order of use, most recent first */
+  RemixPageFile * file; /* NULL if the page holds nothing */
+  RemixCount index; /* first frame / file->page_frames */
+  RemixCount length; /* frames decoded */
+  int users; /* readers holding the page pinned */
+  RemixPCM * data; /* frame f of channel c is data[c*page_frames+f] */
+};
+
+struct _RemixPageCache {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif
+  size_t max_size;
+  int nr_pages; /* allocated */
+  int nr_readers; /* open readers, each owed a page */
+  RemixPageFile * files;
+  RemixPage * buckets[REMIX_PAGE_CACHE_BUCKETS];
+  RemixPage * first, * last;
+  long hits, misses;
+};
+
+static void
+remix_page_cache_lock (RemixPageCache * cache)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock (&cache->lock);
+#endif
+}
+
+static void
+remix_page_cache_unlock (RemixPageCache * cache)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock (&cache->lock);
+#endif
+}
+
+static unsigned int
+remix_page_hash (RemixPageFile * file, RemixCount index)
+{
+  unsigned long f = (unsigned long)file;
+
+  return (unsigned int)(f >> 4) * 16777619u ^
+    (unsigned int)index * 2654435761u;
+}
+
+static RemixPage **
+remix_page_cache_bucket (RemixPageCache * cache, RemixPageFile * file,
+			 RemixCount index)
+{
+  return &cache->buckets[remix_page_hash (file, index) &
+			 (REMIX_PAGE_CACHE_BUCKETS - 1)];
+}
+
+static RemixPage *
+remix_page_cache_find (RemixPageCache * cache, RemixPageFile * file,
+		       RemixCount index)
+{
+  RemixPage * page;
+
+  page = *remix_page_cache_bucket (cache, file, index);
+  for (; page; page = page->hash_next) {
+    if (page->file == file && page->index == index)
+      return page;
+  }
+
+  return NULL;
+}
+
+static void
+remix_page_cache_unlink (RemixPageCache * cache, RemixPage * page)
+{
+  if (page->prev) page->prev->next = page->next;
+  else cache->first = page->next;
+  if (page->next) page->next->prev = page->prev;
+  else cache->last = page->prev;
+  page->prev = page->next = NULL;
+}
+
+static void
+remix_page_cache_link_first (RemixPageCache * cache, RemixPage * page)
+{
+  page->next = cache->first;
+  if (cache->first) cache->first->prev = page;
+  else cache->last = page;
+  cache->first = page;
+}
+
+static void
+remix_page_cache_link_last (RemixPageCache * cache, RemixPage * page)
+{
+  page->prev = cache->last;
+  if (cache->last) cache->last->next = page;
+  else cache->first = page;
+  cache->last = page;
+}
+
+/*
+ * remix_page_cache_clear (cache, page)
+ *
+ * Takes whatever 'page' holds out of the cache, leaving it empty.
+ * Called with the cache locked.
+ */
+static void
+remix_page_cache_clear (RemixPageCache * cache, RemixPage * page)
+{
+  RemixPage ** pp;
+
+  if (page->file == NULL) return;
+
+  pp = remix_page_cache_bucket (cache, page->file, page->index);
+  for (; *pp; pp = &(*pp)->hash_next) {
+    if (*pp == page) {
+      *pp = page->hash_next;
+      break;
+    }
+  }
+
+  page->hash_next = NULL;
+  page->file = NULL;
+  page->length = 0;
+}
+
+/*
+ * remix_page_cache_resize (cache)
+ *
+ * Allocates or frees pages so that there are enough for the cache size
+ * and one for each open reader. Pages in use are not freed; the pool is
+ * trimmed again on the next resize. Called with the cache locked, and
+ * never while processing.
+ */
+static void
+remix_page_cache_resize (RemixPageCache * cache)
+{
+  int nr_pages = (int)(cache->max_size / REMIX_PAGE_BYTES) +
+    cache->nr_readers;
+  RemixPage * page, * prev;
+
+  while (cache->nr_pages < nr_pages) {
+    page = (RemixPage *) remix_malloc (sizeof (struct _RemixPage));
+    page->data = (RemixPCM *) remix_malloc (REMIX_PAGE_BYTES);
+    remix_page_cache_link_last (cache, page);
+    cache->nr_pages++;
+  }
+
+  for (page = cache->last; page && cache->nr_pages > nr_pages; page = prev) {
+    prev = page->prev;
+    if (page->users > 0) continue;
+    remix_page_cache_clear (cache, page);
+    remix_page_cache_unlink (cache, page);
+    remix_free (page->data);
+    remix_free (page);
+    cache->nr_pages--;
+  }
+}
+
+/*
+ * remix_page_cache_get (cache, file, index, func, data)
+ *
+ * Returns page 'index' of 'file' pinned, decoding it through 'func' into
+ * the least recently used page that is not pinned if it is not cached,
+ * or NULL if no frames could be decoded. With a cache size of 0 the page
+ * is decoded every time, and is not added to the cache.
+ */
+static RemixPage *
+remix_page_cache_get (RemixPageCache * cache, RemixPageFile * file,
+		      RemixCount index, RemixReadAheadFunc func, void * data)
+{
+  RemixPage * page, * other;
+  RemixPage ** bucket;
+
+  remix_page_cache_lock (cache);
+
+  page = remix_page_cache_find (cache, file, index);
+  if (page != NULL) {
+    page->users++;
+    remix_page_cache_unlink (cache, page);
+    remix_page_cache_link_first (cache, page);
+    cache->hits++;
+    remix_page_cache_unlock (cache);
+    return page;
+  }
+
+  for (page = cache->last; page && page->users > 0; page = page->prev);
+  if (page == NULL) {
+    /* Only if a reader pins more than the one page it is owed */
+    remix_page_cache_unlock (cache);
+    return NULL;
+  }
+
+  /* Take the page out of the cache while decoding into it */
+  remix_page_cache_clear (cache, page);
+  page->users = 1;
+
+  remix_page_cache_unlock (cache);
+
+  page->length = func (data, index * file->page_frames, page->data,
+		       file->page_frames, file->page_frames);
+
+  remix_page_cache_lock (cache);
+
+  page->users = 0;
+  page->index = index;
+
+  if (page->length > 0 && cache->max_size == 0) {
+    page->users++;
+    remix_page_cache_unlock (cache);
+    return page;
+  }
+
+  if (page->length <= 0) {
+    page->length = 0;
+    remix_page_cache_unlink (cache, page);
+    remix_page_cache_link_last (cache, page);
+    remix_page_cache_unlock (cache);
+    return NULL;
+  }
+
+  /* Another reader may have decoded the page meanwhile */
+  other = remix_page_cache_find (cache, file, index);
+  if (other != NULL) {
+    page->length = 0;
+    remix_page_cache_unlink (cache, page);
+    remix_page_cache_link_last (cache, page);
+    page = other;
+  } else {
+    page->file = file;
+    bucket = remix_page_cache_bucket (cache, file, index);
+    page->hash_next = *bucket;
+    *bucket = page;
+    cache->misses++;
+  }
+
+  page->users++;
+  remix_page_cache_unlink (cache, page);
+  remix_page_cache_link_first (cache, page);
+
+  remix_page_cache_unlock (cache);
+
+  return page;
+}
+
+static void
+remix_page_cache_release (RemixPageCache * cache, RemixPage * page)
+{
+  remix_page_cache_lock (cache);
+  page->users--;
+  remix_page_cache_unlock (cache);
+}
+
+void
+_remix_page_cache_init (RemixEnv * env)
+{
+  RemixPageCache * cache;
+
+  cache = (RemixPageCache *) remix_malloc (sizeof (struct _RemixPageCache));
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init (&cache->lock, NULL);
+#endif
+  cache->max_size = REMIX_PAGE_CACHE_DEFAULT;
+
+  env->world->_page_cache = cache;
+}
+
+void
+_remix_page_cache_destroy (RemixEnv * env)
+{
+  RemixPageCache * cache = env->world->_page_cache;
+  RemixPageFile * file, * next_file;
+  RemixPage * page, * next;
+
+  if (cache == RemixNone) return;
+
+  remix_dprintf ("[_remix_page_cache_destroy] %ld hits, %ld misses\n",
+		 cache->hits, cache->misses);
+
+  for (page = cache->first; page; page = next) {
+    next = page->next;
+    remix_free (page->data);
+    remix_free (page);
+  }
+
+  for (file = cache->files; file; file = next_file) {
+    next_file = file->next;
+    remix_free (file->path);
+    remix_free (file);
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy (&cache->lock);
+#endif
+  remix_free (cache);
+
+  env->world->_page_cache = RemixNone;
+}
+
+/*
+ * _remix_page_file_open (env, path, nr_channels)
+ *
+ * Called when a reader of the 'nr_channels' channel file 'path' is
+ * created, and not while processing. Makes sure the world's cache has a
+ * page for the reader, and returns the file to read it through, which
+ * all readers of the same path share.
+ */
+RemixPageFile *
+_remix_page_file_open (RemixEnv * env, const char * path, int nr_channels)
+{
+  RemixPageCache * cache = env->world->_page_cache;
+  RemixPageFile * file;
+
+  remix_page_cache_lock (cache);
+
+  for (file = cache->files; file; file = file->next) {
+    if (file->nr_channels == nr_channels && !strcmp (file->path, path))
+      break;
+  }
+
+  if (file == NULL) {
+    file = (RemixPageFile *) remix_malloc (sizeof (struct _RemixPageFile));
+    file->path = remix_malloc (strlen (path) + 1);
+    strcpy (file->path, path);
+    file->nr_channels = nr_channels;
+    file->page_frames = REMIX_PAGE_SAMPLES / nr_channels;
+    file->next = cache->files;
+    cache->files = file;
+  }
+
+  cache->nr_readers++;
+  remix_page_cache_resize (cache);
+
+  remix_page_cache_unlock (cache);
+
+  return file;
+}
+
+/*
+ * _remix_page_file_close (env, file)
+ *
+ * Called when a reader of 'file' is destroyed. Its pages stay cached for
+ * later readers of the same path.
+ */
+void
+_remix_page_file_close (RemixEnv * env, RemixPageFile * file)
+{
+  RemixPageCache * cache = env->world->_page_cache;
+
+  if (file == RemixNone) return;
+
+  remix_page_cache_lock (cache);
+  cache->nr_readers--;
+  remix_page_cache_resize (cache);
+  remix_page_cache_unlock (cache);
+}
+
+/*
+ * _remix_page_cache_read (cache, file, frame, dest, stride, count, func,
+ *                         data)
+ *
+ * Copies up to 'count' frames of 'file' from 'frame' into 'dest', frame
+ * i of channel c at dest[c*stride + i]. Pages not in the cache are
+ * decoded through 'func', as for _remix_read_ahead_new(), and added to
+ * it. Returns the number of frames copied, which is less than 'count'
+ * only at the end of the file. This may be called from any thread, and
+ * does not allocate memory.
+ */
+RemixCount
+_remix_page_cache_read (RemixPageCache * cache, RemixPageFile * file,
+			RemixCount frame, RemixPCM * dest, RemixCount stride,
+			RemixCount count, RemixReadAheadFunc func, void * data)
+{
+  RemixPage * page;
+  RemixCount index, offset, n, copied = 0;
+  int c, last;
+
+  if (_remix_load_acquire (&cache->max_size) == 0)
+    return func (data, frame, dest, stride, count);
+
+  while (copied < count) {
+    index = frame / file->page_frames;
+    page = remix_page_cache_get (cache, file, index, func, data);
+    if (page == NULL) break;
+
+    offset = frame - index * file->page_frames;
+    n = MIN (count - copied, page->length - offset);
+    last = (page->length < file->page_frames);
+
+    for (c = 0; c < file->nr_channels && n > 0; c++)
+      _remix_pcm_copy (&page->data[c * file->page_frames + offset],
+		       &dest[c * stride + copied], n, NULL);
+
+    remix_page_cache_release (cache, page);
+
+    if (n <= 0) break;
+
+    copied += n;
+    frame += n;
+
+    if (last) break;
+  }
+
+  return copied;
+}
+
+/*
+ * _remix_page_cache_map (cache, file, frame, page, channels, func, data)
+ *
+ * Points 'channels' at 'frame' of each channel of 'file' in a page held
+ * pinned in '*page', which is kept if it already holds 'frame' and is
+ * otherwise released for the page that does, decoded through 'func' if
+ * need be. Returns the number of frames the page holds from 'frame', or
+ * 0 with '*page' NULL at the end of the file. This lets a reader that
+ * pins no other page read in place, without copying each page out of
+ * the cache; it may be called from any thread, and does not allocate
+ * memory.
+ */
+RemixCount
+_remix_page_cache_map (RemixPageCache * cache, RemixPageFile * file,
+		       RemixCount frame, RemixPage ** page,
+		       RemixPCM ** channels, RemixReadAheadFunc func,
+		       void * data)
+{
+  RemixCount index = frame / file->page_frames, offset;
+  int c;
+
+  if (*page != NULL && (*page)->index != index) {
+    remix_page_cache_release (cache, *page);
+    *page = NULL;
+  }
+
+  if (*page == NULL)
+    *page = remix_page_cache_get (cache, file, index, func, data);
+
+  if (*page == NULL) return 0;
+
+  offset = frame - index * file->page_frames;
+  if (offset >= (*page)->length) {
+    remix_page_cache_release (cache, *page);
+    *page = NULL;
+    return 0;
+  }
+
+  for (c = 0; c < file->nr_channels; c++)
+    channels[c] = &(*page)->data[c * file->page_frames + offset];
+
+  return (*page)->length - offset;
+}
+
+/*
+ * _remix_page_cache_unmap (cache, page)
+ *
+ * Releases a page pinned by _remix_page_cache_map(), if any.
+ */
+void
+_remix_page_cache_unmap (RemixPageCache * cache, RemixPage * page)
+{
+  if (page != NULL) remix_page_cache_release (cache, page);
+}
+
+/*
+ * _remix_page_cache_forget (cache, path)
+ *
+ * Drops all cached pages of 'path', as when the file is rewritten.
+ */
+void
+_remix_page_cache_forget (RemixPageCache * cache, const char * path)
+{
+  RemixPage * page;
+
+  remix_page_cache_lock (cache);
+  for (page = cache->first; page; page = page->next) {
+    if (page->file != NULL && !strcmp (page->file->path, path))
+      remix_page_cache_clear (cache, page);
+  }
+  remix_page_cache_unlock (cache);
+}
+
+/*
+ * remix_set_cache_size (env, size)
+ *
+ * Sets the number of bytes of decoded audio that env's world keeps for
+ * its file readers to share, allocating or freeing pages to match once
+ * any reader is open. A size of 0 disables the cache. Returns the
+ * previous size. This must not be called while processing.
+ */
+size_t
+remix_set_cache_size (RemixEnv * env, size_t size)
+{
+  RemixPageCache * cache = env->world->_page_cache;
+  size_t old;
+
+  remix_page_cache_lock (cache);
+  old = cache->max_size;
+  _remix_store_release (&cache->max_size, size);
+  if (cache->nr_readers > 0) remix_page_cache_resize (cache);
+  remix_page_cache_unlock (cache);
+
+  return old;
+}
+
+size_t
+remix_get_cache_size (RemixEnv * env)
+{
+  return _remix_load_acquire (&env->world->_page_cache->max_size);
+}
@@ -32,8 +32,13 @@
  * RemixPCM data. The RemixPCM type is defined in <remix_types.h>,  usually as
  * a floating point value (float).
  *
- * The functions in this file are an excellent target for short vector
- * machine optimisations.
+ * The hot per-sample loops are implemented once per instruction set.
+ * The scalar versions in this file are the reference implementations;
+ * SSE2, AVX2 and AVX-512 versions are built from remix_pcm_simd.h.
+ * remix_pcm_init_kernels() picks the widest set the CPU supports, once,
+ * from remix_init(). Setting REMIX_PCM_KERNELS in the environment to
+ * "scalar", "sse2", "avx2" or "avx512" overrides the choice, and tests
+ * may switch sets later with _remix_pcm_set_kernels().
  *
  * Invariants
  * ----------
@@ -42,11 +47,537 @@
  *
  */
 
+#include <config.h>
+
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #define __REMIX__
 #include "remix.h"
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+/* Scalar reference kernels */
+
+static RemixCount
+remix_pcm_set_scalar (RemixPCM * data, RemixPCM value, RemixCount count)
+{
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *data++ = value;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_ramp_scalar (RemixPCM * data, RemixPCM value, RemixPCM gradient,
+                       RemixCount count)
+{
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *data++ = value + (RemixPCM)i * gradient;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_cubic_scalar (RemixPCM * data, RemixPCM * coeffs, RemixPCM s,
+                        RemixPCM ds, RemixCount count)
+{
+  RemixPCM c0 = coeffs[0], c1 = coeffs[1], c2 = coeffs[2], c3 = coeffs[3], x;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    x = s + (RemixPCM)i * ds;
+    *data++ = c0 + x * (c1 + x * (c2 + x * c3));
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_mult_cubic_scalar (RemixPCM * data, RemixPCM * coeffs, RemixPCM s,
+                             RemixPCM ds, RemixCount count)
+{
+  RemixPCM c0 = coeffs[0], c1 = coeffs[1], c2 = coeffs[2], c3 = coeffs[3], x;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    x = s + (RemixPCM)i * ds;
+    *data++ *= c0 + x * (c1 + x * (c2 + x * c3));
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_blend_cubic_scalar (RemixPCM * src, RemixPCM * dest,
+                              RemixPCM * coeffs, RemixPCM s, RemixPCM ds,
+                              RemixCount count)
+{
+  RemixPCM c0 = coeffs[0], c1 = coeffs[1], c2 = coeffs[2], c3 = coeffs[3], x, b;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    x = s + (RemixPCM)i * ds;
+    b = c0 + x * (c1 + x * (c2 + x * c3));
+    dest[i] = (dest[i] * b) + (src[i] * (1.0 - b));
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_copy_mult_cubic_scalar (RemixPCM * src, RemixPCM * dest,
+                                  RemixPCM * coeffs, RemixPCM s, RemixPCM ds,
+                                  RemixCount count)
+{
+  RemixPCM c0 = coeffs[0], c1 = coeffs[1], c2 = coeffs[2], c3 = coeffs[3], x;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    x = s + (RemixPCM)i * ds;
+    dest[i] = src[i] * (c0 + x * (c1 + x * (c2 + x * c3)));
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_mult_blend_cubic_scalar (RemixPCM * src, RemixPCM * dest,
+                                   RemixPCM * gain, RemixPCM gs, RemixPCM gds,
+                                   RemixPCM * blend, RemixPCM bs, RemixPCM bds,
+                                   RemixCount count)
+{
+  RemixPCM x, g, b;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    x = gs + (RemixPCM)i * gds;
+    g = gain[0] + x * (gain[1] + x * (gain[2] + x * gain[3]));
+    x = bs + (RemixPCM)i * bds;
+    b = blend[0] + x * (blend[1] + x * (blend[2] + x * blend[3]));
+    dest[i] = (dest[i] * g * b) + (src[i] * (1.0 - b));
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_gain_scalar (RemixPCM * data, RemixCount count, void * gain)
+{
+  RemixPCM _gain = *(RemixPCM *)gain;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *data++ *= _gain;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_add_scalar (RemixPCM * src, RemixPCM * dest, RemixCount count,
+                      void * unused)
+{
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *dest++ += *src++;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_mult_scalar (RemixPCM * src, RemixPCM * dest, RemixCount count,
+                       void * unused)
+{
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *dest++ *= *src++;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_fade_scalar (RemixPCM * src, RemixPCM * dest, RemixCount count,
+                       void * unused)
+{
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *dest++ *= (1.0 - *src++);
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_interleave_2_scalar (RemixPCM * src1, RemixPCM * src2,
+                               RemixCount count, void * data)
+{
+  RemixPCM * dest = (RemixPCM *)data;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *dest++ = *src1++;
+    *dest++ = *src2++;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_deinterleave_2_scalar (RemixPCM * dest1, RemixPCM * dest2,
+                                 RemixCount count, void * data)
+{
+  RemixPCM * src = (RemixPCM *)data;
+  RemixCount i;
+
+  for (i = 0; i < count; i++) {
+    *dest1++ = *src++;
+    *dest2++ = *src++;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_interleave_scalar (RemixPCM ** srcs, int nr_channels,
+                             RemixCount count, RemixPCM * dest)
+{
+  RemixCount i;
+  int c;
+
+  for (i = 0; i < count; i++) {
+    for (c = 0; c < nr_channels; c++) {
+      *dest++ = srcs[c] ? srcs[c][i] : 0.0;
+    }
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_deinterleave_scalar (RemixPCM ** dests, int nr_channels,
+                               RemixCount count, RemixPCM * src)
+{
+  RemixCount i;
+  int c;
+
+  for (i = 0; i < count; i++) {
+    for (c = 0; c < nr_channels; c++) {
+      dests[c][i] = *src++;
+    }
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_blend_scalar (RemixPCM * src, RemixPCM * blend, RemixPCM * dest,
+                        RemixCount count, void * unused)
+{
+  RemixCount i;
+  RemixPCM b, d;
+
+  for (i = 0; i < count; i++) {
+    b = *blend++;
+    d = (*dest * b) + (*src++ * (1.0 - b));
+    *dest++ = d;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_mix_gains_scalar (RemixPCM ** srcs, RemixPCM * gains, int nr_srcs,
+                            RemixPCM * dest, RemixCount count, int accumulate)
+{
+  RemixCount i;
+  RemixPCM d;
+  int k;
+
+  for (i = 0; i < count; i++) {
+    d = accumulate ? dest[i] : 0.0;
+    for (k = 0; k < nr_srcs; k++)
+      d += srcs[k][i] * gains[k];
+    dest[i] = d;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_resample_linear_scalar (RemixPCM * src, int * index, RemixPCM * frac,
+                                  RemixPCM * dest, RemixCount count)
+{
+  RemixCount i;
+  RemixPCM a, b;
+
+  for (i = 0; i < count; i++) {
+    a = src[index[i]];
+    b = src[index[i] + 1];
+    dest[i] = a + (b - a) * frac[i];
+  }
+
+  return count;
+}
+
+/* Catmull-Rom spline through the two samples either side */
+static RemixCount
+remix_pcm_resample_cubic_scalar (RemixPCM * src, int * index, RemixPCM * frac,
+                                 RemixPCM * dest, RemixCount count)
+{
+  RemixCount i;
+  RemixPCM p0, p1, p2, p3, f;
+
+  for (i = 0; i < count; i++) {
+    p0 = src[index[i] - 1];
+    p1 = src[index[i]];
+    p2 = src[index[i] + 1];
+    p3 = src[index[i] + 2];
+    f = frac[i];
+    dest[i] = p1 + 0.5 * f * (p2 - p0 +
+                              f * (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3 +
+                                   f * (3.0 * (p1 - p2) + p3 - p0)));
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_resample_sinc_scalar (RemixPCM * src, int * index, RemixPCM * frac,
+                                RemixPCM * dest, RemixCount count)
+{
+  RemixCount i;
+  RemixPCM * s, * c, x, pf, acc;
+  int t, phase;
+
+  for (i = 0; i < count; i++) {
+    s = &src[index[i] - (REMIX_SINC_TAPS/2 - 1)];
+    x = frac[i] * REMIX_SINC_PHASES;
+    phase = (int)x;
+    pf = x - phase;
+    acc = 0.0;
+    for (t = 0; t < REMIX_SINC_TAPS; t++) {
+      c = &_remix_pcm_sinc_table[t * (REMIX_SINC_PHASES + 1) + phase];
+      acc += s[t] * (c[0] + (c[1] - c[0]) * pf);
+    }
+    dest[i] = acc;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_pcm_quantise_scalar (RemixPCM * src, RemixPCM * dither, int * dest,
+                           RemixCount count, RemixPCM scale, RemixPCM max)
+{
+  RemixCount i;
+  RemixPCM v;
+
+  for (i = 0; i < count; i++) {
+    v = src[i] * scale;
+    if (dither) v += dither[i];
+    if (v > max) v = max;
+    else if (v < -scale) v = -scale;
+    dest[i] = (int) lrintf (v);
+  }
+
+  return count;
+}
+
+static RemixPCMKernels remix_pcm_scalar_kernels = {
+  "scalar",
+  remix_pcm_set_scalar,
+  remix_pcm_ramp_scalar,
+  remix_pcm_cubic_scalar,
+  remix_pcm_mult_cubic_scalar,
+  remix_pcm_blend_cubic_scalar,
+  remix_pcm_copy_mult_cubic_scalar,
+  remix_pcm_mult_blend_cubic_scalar,
+  remix_pcm_gain_scalar,
+  remix_pcm_add_scalar,
+  remix_pcm_mult_scalar,
+  remix_pcm_fade_scalar,
+  remix_pcm_interleave_2_scalar,
+  remix_pcm_deinterleave_2_scalar,
+  remix_pcm_interleave_scalar,
+  remix_pcm_deinterleave_scalar,
+  remix_pcm_blend_scalar,
+  remix_pcm_mix_gains_scalar,
+  remix_pcm_resample_linear_scalar,
+  remix_pcm_resample_cubic_scalar,
+  remix_pcm_resample_sinc_scalar,
+  remix_pcm_quantise_scalar,
+};
+
+static RemixPCMKernels * kernels = &remix_pcm_scalar_kernels;
+
+RemixPCM _remix_pcm_sinc_table[REMIX_SINC_TAPS * (REMIX_SINC_PHASES + 1)];
+
+/*
+ * remix_pcm_init_sinc_table ()
+ *
+ * Tabulate a Blackman windowed sinc, normalised to unity gain at each
+ * phase.
+ */
+static void
+remix_pcm_init_sinc_table (void)
+{
+  double x, u, w, sum, c[REMIX_SINC_TAPS];
+  int p, t;
+
+  for (p = 0; p <= REMIX_SINC_PHASES; p++) {
+    sum = 0.0;
+    for (t = 0; t < REMIX_SINC_TAPS; t++) {
+      x = (t - (REMIX_SINC_TAPS/2 - 1)) - (double)p / REMIX_SINC_PHASES;
+      u = x / (REMIX_SINC_TAPS/2);
+      w = (fabs (u) >= 1.0) ? 0.0 :
+        0.42 + 0.5 * cos (M_PI * u) + 0.08 * cos (2.0 * M_PI * u);
+      c[t] = (x == 0.0) ? 1.0 : w * sin (M_PI * x) / (M_PI * x);
+      sum += c[t];
+    }
+    for (t = 0; t < REMIX_SINC_TAPS; t++)
+      _remix_pcm_sinc_table[t * (REMIX_SINC_PHASES + 1) + p] = c[t] / sum;
+  }
+}
+
+
+/* Kernel selection */
+
+/*
+ * remix_pcm_find_kernels (name)
+ *
+ * Returns the widest kernel table the CPU supports, or if 'name' is
+ * given, the table of that name if the CPU supports it, else NULL.
+ */
+static RemixPCMKernels *
+remix_pcm_find_kernels (const char * name)
+{
+  RemixPCMKernels * best = NULL;
+#ifdef REMIX_PCM_X86
+  RemixPCMKernels * candidates[] = {
+    &_remix_pcm_avx512_kernels,
+    &_remix_pcm_avx2_kernels,
+    &_remix_pcm_sse2_kernels,
+    &remix_pcm_scalar_kernels,
+  };
+  int i, supported[4];
+
+  __builtin_cpu_init ();
+  supported[0] = __builtin_cpu_supports ("avx512f");
+  supported[1] = __builtin_cpu_supports ("avx2");
+  supported[2] = __builtin_cpu_supports ("sse2");
+  supported[3] = 1;
+
+  for (i = 3; i >= 0; i--) {
+    if (!supported[i]) continue;
+    if (name == NULL || !strcmp (name, candidates[i]->name))
+      best = candidates[i];
+  }
+#else
+  if (name == NULL || !strcmp (name, remix_pcm_scalar_kernels.name))
+    best = &remix_pcm_scalar_kernels;
+#endif
+
+  return best;
+}
+
+/*
+ * remix_pcm_select_kernels ()
+ *
+ * Choose the kernel table for this process and tabulate the sinc filter.
+ * Run exactly once, by remix_pcm_init_kernels().
+ */
+static void
+remix_pcm_select_kernels (void)
+{
+  char * override = getenv ("REMIX_PCM_KERNELS");
+
+  /* An unsupported override leaves the scalar kernels */
+  kernels = &remix_pcm_scalar_kernels;
+  if (override == NULL)
+    kernels = remix_pcm_find_kernels (NULL);
+  else if (remix_pcm_find_kernels (override) != NULL)
+    kernels = remix_pcm_find_kernels (override);
+
+  remix_pcm_init_sinc_table ();
+
+  remix_dprintf ("[remix_pcm_init_kernels] using %s kernels\n", kernels->name);
+}
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+#else
+static int kernels_selected = 0;
+#endif
+
+/*
+ * remix_pcm_init_kernels ()
+ *
+ * Called from every remix_init(). The CPU does not change under us, so
+ * only the first call does any work; later calls, possibly from other
+ * threads creating their own environments, leave the kernel table and
+ * the sinc table alone while they may be in use.
+ */
+void
+remix_pcm_init_kernels (void)
+{
+#ifdef HAVE_PTHREAD
+  pthread_once (&kernels_once, remix_pcm_select_kernels);
+#else
+  if (!kernels_selected) {
+    remix_pcm_select_kernels ();
+    kernels_selected = 1;
+  }
+#endif
+}
+
+RemixPCMKernels *
+remix_pcm_get_kernels (void)
+{
+  return kernels;
+}
+
+/*
+ * _remix_pcm_set_kernels (name)
+ *
+ * Switch to the kernel set 'name' ("scalar", "sse2", "avx2" or "avx512")
+ * for the rest of the process, as REMIX_PCM_KERNELS would have chosen it
+ * at the first remix_init(). Returns 0, or -1 leaving the kernels as
+ * they were if the set is unknown or the CPU does not support it. For
+ * tests only: nothing may be processing while the kernels change.
+ */
+int
+_remix_pcm_set_kernels (const char * name)
+{
+  RemixPCMKernels * k;
+
+  remix_pcm_init_kernels ();
+
+  if ((k = remix_pcm_find_kernels (name)) == NULL) return -1;
+
+  kernels = k;
+  return 0;
+}
+
 
 /* PFunc */
 
@@ -66,26 +597,96 @@ _remix_pcm_clear_region (RemixPCM * data, RemixCount count, void * unused)
 RemixCount
 _remix_pcm_set (RemixPCM * data, RemixPCM value, RemixCount count)
 {
-  RemixCount i;
+  return kernels->set (data, value, count);
+}
 
-  for (i = 0; i < count; i++) {
-    *data++ = value;
-  }
+/*
+ * _remix_pcm_ramp (data, value, gradient, count)
+ *
+ * Write 'count' samples at 'data' starting at 'value' and rising by
+ * 'gradient' per sample.
+ */
+RemixCount
+_remix_pcm_ramp (RemixPCM * data, RemixPCM value, RemixPCM gradient,
+                 RemixCount count)
+{
+  return kernels->ramp (data, value, gradient, count);
+}
 
-  return count;
+/*
+ * _remix_pcm_cubic (data, coeffs, s, ds, count)
+ *
+ * Write 'count' samples at 'data' of the cubic with coefficients
+ * coeffs[0] + coeffs[1] x + coeffs[2] x^2 + coeffs[3] x^3, at x = 's'
+ * and every 'ds' after.
+ */
+RemixCount
+_remix_pcm_cubic (RemixPCM * data, RemixPCM * coeffs, RemixPCM s,
+                  RemixPCM ds, RemixCount count)
+{
+  return kernels->cubic (data, coeffs, s, ds, count);
 }
 
+/*
+ * _remix_pcm_mult_cubic (data, coeffs, s, ds, count)
+ *
+ * Multiply 'count' samples at 'data' by the cubic of _remix_pcm_cubic().
+ */
 RemixCount
-_remix_pcm_gain (RemixPCM * data, RemixCount count, void * gain)
+_remix_pcm_mult_cubic (RemixPCM * data, RemixPCM * coeffs, RemixPCM s,
+                       RemixPCM ds, RemixCount count)
 {
-  RemixPCM _gain = *(RemixPCM *)gain;
-  RemixCount i;
+  return kernels->mult_cubic (data, coeffs, s, ds, count);
+}
 
-  for (i = 0; i < count; i++) {
-    *data++ *= _gain;
-  }
+/*
+ * _remix_pcm_blend_cubic (src, dest, coeffs, s, ds, count)
+ *
+ * Blend 'count' samples of 'src' into 'dest' as _remix_pcm_blend() does,
+ * by the cubic of _remix_pcm_cubic() rather than by blend data.
+ */
+RemixCount
+_remix_pcm_blend_cubic (RemixPCM * src, RemixPCM * dest, RemixPCM * coeffs,
+                        RemixPCM s, RemixPCM ds, RemixCount count)
+{
+  return kernels->blend_cubic (src, dest, coeffs, s, ds, count);
+}
 
-  return count;
+/*
+ * _remix_pcm_copy_mult_cubic (src, dest, coeffs, s, ds, count)
+ *
+ * Write 'count' samples of 'src' multiplied by the cubic of
+ * _remix_pcm_cubic() to 'dest'.
+ */
+RemixCount
+_remix_pcm_copy_mult_cubic (RemixPCM * src, RemixPCM * dest, RemixPCM * coeffs,
+                            RemixPCM s, RemixPCM ds, RemixCount count)
+{
+  return kernels->copy_mult_cubic (src, dest, coeffs, s, ds, count);
+}
+
+/*
+ * _remix_pcm_mult_blend_cubic (src, dest, gain, gs, gds, blend, bs, bds,
+ *                              count)
+ *
+ * Multiply 'count' samples of 'dest' by the cubic 'gain' and then blend
+ * 'src' into them by the cubic 'blend', as _remix_pcm_mult_cubic() and
+ * _remix_pcm_blend_cubic() would in turn.
+ */
+RemixCount
+_remix_pcm_mult_blend_cubic (RemixPCM * src, RemixPCM * dest,
+                             RemixPCM * gain, RemixPCM gs, RemixPCM gds,
+                             RemixPCM * blend, RemixPCM bs, RemixPCM bds,
+                             RemixCount count)
+{
+  return kernels->mult_blend_cubic (src, dest, gain, gs, gds, blend, bs, bds,
+                                    count);
+}
+
+RemixCount
+_remix_pcm_gain (RemixPCM * data, RemixCount count, void * gain)
+{
+  return kernels->gain (data, count, gain);
 }
 
 
@@ -113,13 +714,7 @@ RemixCount
 _remix_pcm_add (RemixPCM * src, RemixPCM * dest, RemixCount count,
                 void * unused)
 {
-  RemixCount i;
-
-  for (i = 0; i < count; i++) {
-    *dest++ += *src++;
-  }
-
-  return count;
+  return kernels->add (src, dest, count, unused);
 }
 
 /*
@@ -131,13 +726,7 @@ RemixCount
 _remix_pcm_mult (RemixPCM * src, RemixPCM * dest, RemixCount count,
                  void * unused)
 {
-  RemixCount i;
-
-  for (i = 0; i < count; i++) {
-    *dest++ *= *src++;
-  }
-
-  return count;
+  return kernels->mult (src, dest, count, unused);
 }
 
 /*
@@ -149,13 +738,7 @@ RemixCount
 _remix_pcm_fade (RemixPCM * src, RemixPCM * dest, RemixCount count,
                  void * unused)
 {
-  RemixCount i;
-
-  for (i = 0; i < count; i++) {
-    *dest++ *= (1.0 - *src++);
-  }
-
-  return count;
+  return kernels->fade (src, dest, count, unused);
 }
 
 /*
@@ -167,15 +750,7 @@ RemixCount
 _remix_pcm_interleave_2 (RemixPCM * src1, RemixPCM * src2, RemixCount count,
                          void * data)
 {
-  RemixPCM * dest = (RemixPCM *)data;
-  RemixCount i;
-
-  for (i = 0; i < count; i++) {
-    *dest++ = *src1++;
-    *dest++ = *src2++;
-  }
-
-  return count;
+  return kernels->interleave_2 (src1, src2, count, data);
 }
 
 /*
@@ -187,15 +762,33 @@ RemixCount
 _remix_pcm_deinterleave_2 (RemixPCM * dest1, RemixPCM * dest2,
                            RemixCount count, void * data)
 {
-  RemixPCM * src = (RemixPCM *)data;
-  RemixCount i;
+  return kernels->deinterleave_2 (dest1, dest2, count, data);
+}
 
-  for (i = 0; i < count; i++) {
-    *dest1++ = *src++;
-    *dest2++ = *src++;
-  }
+/*
+ * _remix_pcm_interleave (srcs, nr_channels, count, dest)
+ *
+ * Interleave 'count' frames of the 'nr_channels' buffers in 'srcs' into
+ * dest. Entries of 'srcs' may be NULL, for channels of silence.
+ */
+RemixCount
+_remix_pcm_interleave (RemixPCM ** srcs, int nr_channels, RemixCount count,
+                       RemixPCM * dest)
+{
+  return kernels->interleave (srcs, nr_channels, count, dest);
+}
 
-  return count;
+/*
+ * _remix_pcm_deinterleave (dests, nr_channels, count, src)
+ *
+ * Deinterleave 'count' frames of 'nr_channels' channels from src into
+ * the buffers in 'dests'.
+ */
+RemixCount
+_remix_pcm_deinterleave (RemixPCM ** dests, int nr_channels,
+                         RemixCount count, RemixPCM * src)
+{
+  return kernels->deinterleave (dests, nr_channels, count, src);
 }
 
 /* PPPFunc */
@@ -209,18 +802,82 @@ RemixCount
 _remix_pcm_blend (RemixPCM * src, RemixPCM * blend, RemixPCM * dest,
                   RemixCount count, void * unused)
 {
-  RemixCount i;
-  RemixPCM b, d;
+  return kernels->blend (src, blend, dest, count, unused);
+}
 
-  for (i = 0; i < count; i++) {
-    b = *blend++;
-    d = (*dest * b) + (*src++ * (1.0 - b));
-    *dest++ = d;
-  }
+/* Multi-source */
 
-  return count;
+/*
+ * _remix_pcm_mix_gains (srcs, gains, nr_srcs, dest, count, accumulate)
+ *
+ * Sum 'count' samples of each of the 'nr_srcs' buffers in 'srcs', each
+ * scaled by the corresponding value in 'gains', into 'dest'. If
+ * 'accumulate' is zero the previous contents of 'dest' are replaced,
+ * otherwise the sum is added to them. Each output sample is written
+ * once, however many sources there are.
+ */
+RemixCount
+_remix_pcm_mix_gains (RemixPCM ** srcs, RemixPCM * gains, int nr_srcs,
+                      RemixPCM * dest, RemixCount count, int accumulate)
+{
+  return kernels->mix_gains (srcs, gains, nr_srcs, dest, count, accumulate);
+}
+
+/* Resampling */
+
+/*
+ * _remix_pcm_resample_linear (src, index, frac, dest, count)
+ *
+ * Write 'count' samples to 'dest', the i'th being 'src' interpolated at
+ * position index[i] + frac[i], where 0 <= frac[i] < 1. Linear
+ * interpolation reads src[index[i]] and src[index[i] + 1].
+ */
+RemixCount
+_remix_pcm_resample_linear (RemixPCM * src, int * index, RemixPCM * frac,
+                            RemixPCM * dest, RemixCount count)
+{
+  return kernels->resample_linear (src, index, frac, dest, count);
 }
 
+/*
+ * _remix_pcm_resample_cubic (src, index, frac, dest, count)
+ *
+ * As _remix_pcm_resample_linear(), with cubic interpolation reading
+ * src[index[i] - 1] to src[index[i] + 2].
+ */
+RemixCount
+_remix_pcm_resample_cubic (RemixPCM * src, int * index, RemixPCM * frac,
+                           RemixPCM * dest, RemixCount count)
+{
+  return kernels->resample_cubic (src, index, frac, dest, count);
+}
+
+/*
+ * _remix_pcm_resample_sinc (src, index, frac, dest, count)
+ *
+ * As _remix_pcm_resample_linear(), with windowed sinc interpolation
+ * reading REMIX_SINC_TAPS samples around each position.
+ */
+RemixCount
+_remix_pcm_resample_sinc (RemixPCM * src, int * index, RemixPCM * frac,
+                          RemixPCM * dest, RemixCount count)
+{
+  return kernels->resample_sinc (src, index, frac, dest, count);
+}
+
+/*
+ * _remix_pcm_quantise (src, dither, dest, count, scale, max)
+ *
+ * Scale each of 'count' samples of 'src' by 'scale', add the matching
+ * sample of 'dither' unless it is NULL, saturate to [-scale, max] and
+ * round to the nearest integer in 'dest'.
+ */
+RemixCount
+_remix_pcm_quantise (RemixPCM * src, RemixPCM * dither, int * dest,
+                     RemixCount count, RemixPCM scale, RemixPCM max)
+{
+  return kernels->quantise (src, dither, dest, count, scale, max);
+}
 
 /* Miscellaneous */
 
@@ -235,14 +892,11 @@ _remix_pcm_write_linear (RemixPCM * data, RemixCount x1, RemixPCM y1,
                          RemixCount x2, RemixPCM y2,
                          RemixCount offset, RemixCount count)
 {
-  RemixCount i;
+  RemixPCM gradient = (y2 - y1) / (RemixPCM)(x2 - x1);
 
   remix_dprintf ("[remix_pcm_write_linear] ((%ld, %f) -> (%ld, %f), %ld +%ld)\n",
                  x1, y1, x2, y2, offset, count);
 
-  for (i = 0; i < count; i++) {
-    *data++ = y1 + (RemixPCM)(i + offset - x1) * (y2 - y1) / (x2 - x1);
-  }
-
-  return count;
+  return kernels->ramp (data, y1 + (RemixPCM)(offset - x1) * gradient,
+                        gradient, count);
 }
@@ -0,0 +1,138 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixPCM: AVX2 (8-wide) PCM kernels.
+ *
+ * Description
+ * -----------
+ *
+ * Instantiates the template in remix_pcm_simd.h for this instruction
+ * set. Only the functions in this file are compiled for it, so the
+ * library as a whole still runs on any CPU; remix_pcm_init_kernels()
+ * only selects this table when the CPU supports it.
+ *
+ */
+
+#include <math.h>
+
+#define __REMIX__
+#include "remix.h"
+
+#ifdef REMIX_PCM_X86
+
+#include <immintrin.h>
+
+#define REMIX_SIMD_FUNC __attribute__((target("avx2")))
+#define REMIX_SIMD_NAME "avx2"
+#define REMIX_SIMD_KERNELS _remix_pcm_avx2_kernels
+#define REMIX_SIMD_WIDTH 8
+
+typedef __m256 RemixVector;
+
+#define V_LOAD(p) _mm256_loadu_ps (p)
+#define V_STORE(p,v) _mm256_storeu_ps ((p), (v))
+#define V_LOAD_ALIGNED(p) _mm256_load_ps (p)
+#define V_STORE_ALIGNED(p,v) _mm256_store_ps ((p), (v))
+#define V_SET1(x) _mm256_set1_ps (x)
+#define V_ADD(a,b) _mm256_add_ps ((a), (b))
+#define V_SUB(a,b) _mm256_sub_ps ((a), (b))
+#define V_MUL(a,b) _mm256_mul_ps ((a), (b))
+#define V_MIN(a,b) _mm256_min_ps ((a), (b))
+#define V_MAX(a,b) _mm256_max_ps ((a), (b))
+#define V_STORE_INT(p,v) \
+  _mm256_storeu_si256 ((__m256i *)(p), _mm256_cvtps_epi32 (v))
+#define V_GATHER(p,idx) \
+  _mm256_i32gather_ps ((p), _mm256_loadu_si256 ((__m256i *)(idx)), 4)
+
+/* unpack works within 128 bit lanes, so fix up the lanes afterwards */
+REMIX_SIMD_FUNC static void
+simd_interleave (__m256 a, __m256 b, __m256 * lo, __m256 * hi)
+{
+  __m256 t0 = _mm256_unpacklo_ps (a, b);
+  __m256 t1 = _mm256_unpackhi_ps (a, b);
+
+  *lo = _mm256_permute2f128_ps (t0, t1, 0x20);
+  *hi = _mm256_permute2f128_ps (t0, t1, 0x31);
+}
+
+REMIX_SIMD_FUNC static void
+simd_deinterleave (__m256 lo, __m256 hi, __m256 * a, __m256 * b)
+{
+  __m256 t0 = _mm256_permute2f128_ps (lo, hi, 0x20);
+  __m256 t1 = _mm256_permute2f128_ps (lo, hi, 0x31);
+
+  *a = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (2, 0, 2, 0));
+  *b = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (3, 1, 3, 1));
+}
+
+/* Transposes within each 128 bit lane: frames 0-3, then 4-7 */
+REMIX_SIMD_FUNC static void
+simd_store_frames_4 (__m256 a, __m256 b, __m256 c, __m256 d,
+		     RemixPCM * dest, int stride)
+{
+  __m256 t0 = _mm256_unpacklo_ps (a, b);
+  __m256 t1 = _mm256_unpacklo_ps (c, d);
+  __m256 t2 = _mm256_unpackhi_ps (a, b);
+  __m256 t3 = _mm256_unpackhi_ps (c, d);
+  __m256 f0 = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (1, 0, 1, 0));
+  __m256 f1 = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (3, 2, 3, 2));
+  __m256 f2 = _mm256_shuffle_ps (t2, t3, _MM_SHUFFLE (1, 0, 1, 0));
+  __m256 f3 = _mm256_shuffle_ps (t2, t3, _MM_SHUFFLE (3, 2, 3, 2));
+
+  _mm_storeu_ps (dest, _mm256_castps256_ps128 (f0));
+  _mm_storeu_ps (dest + stride, _mm256_castps256_ps128 (f1));
+  _mm_storeu_ps (dest + 2*stride, _mm256_castps256_ps128 (f2));
+  _mm_storeu_ps (dest + 3*stride, _mm256_castps256_ps128 (f3));
+  _mm_storeu_ps (dest + 4*stride, _mm256_extractf128_ps (f0, 1));
+  _mm_storeu_ps (dest + 5*stride, _mm256_extractf128_ps (f1, 1));
+  _mm_storeu_ps (dest + 6*stride, _mm256_extractf128_ps (f2, 1));
+  _mm_storeu_ps (dest + 7*stride, _mm256_extractf128_ps (f3, 1));
+}
+
+/* Frames 0-3 go in the low lanes, 4-7 in the high lanes */
+REMIX_SIMD_FUNC static void
+simd_load_frames_4 (RemixPCM * src, int stride,
+		    __m256 * a, __m256 * b, __m256 * c, __m256 * d)
+{
+  __m256 r[4], t0, t1, t2, t3;
+  int k;
+
+  for (k = 0; k < 4; k++)
+    r[k] = _mm256_insertf128_ps
+      (_mm256_castps128_ps256 (_mm_loadu_ps (src + k*stride)),
+       _mm_loadu_ps (src + (4+k)*stride), 1);
+
+  t0 = _mm256_unpacklo_ps (r[0], r[1]);
+  t1 = _mm256_unpacklo_ps (r[2], r[3]);
+  t2 = _mm256_unpackhi_ps (r[0], r[1]);
+  t3 = _mm256_unpackhi_ps (r[2], r[3]);
+
+  *a = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (1, 0, 1, 0));
+  *b = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (3, 2, 3, 2));
+  *c = _mm256_shuffle_ps (t2, t3, _MM_SHUFFLE (1, 0, 1, 0));
+  *d = _mm256_shuffle_ps (t2, t3, _MM_SHUFFLE (3, 2, 3, 2));
+}
+
+#include "remix_pcm_simd.h"
+
+#endif /* REMIX_PCM_X86 */
@@ -0,0 +1,144 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixPCM: AVX-512 (16-wide) PCM kernels.
+ *
+ * Description
+ * -----------
+ *
+ * Instantiates the template in remix_pcm_simd.h for this instruction
+ * set. Only the functions in this file are compiled for it, so the
+ * library as a whole still runs on any CPU; remix_pcm_init_kernels()
+ * only selects this table when the CPU supports it.
+ *
+ */
+
+#include <math.h>
+
+#define __REMIX__
+#include "remix.h"
+
+#ifdef REMIX_PCM_X86
+
+#include <immintrin.h>
+
+#define REMIX_SIMD_FUNC __attribute__((target("avx512f")))
+#define REMIX_SIMD_NAME "avx512"
+#define REMIX_SIMD_KERNELS _remix_pcm_avx512_kernels
+#define REMIX_SIMD_WIDTH 16
+
+typedef __m512 RemixVector;
+
+#define V_LOAD(p) _mm512_loadu_ps (p)
+#define V_STORE(p,v) _mm512_storeu_ps ((p), (v))
+#define V_LOAD_ALIGNED(p) _mm512_load_ps (p)
+#define V_STORE_ALIGNED(p,v) _mm512_store_ps ((p), (v))
+#define V_SET1(x) _mm512_set1_ps (x)
+#define V_ADD(a,b) _mm512_add_ps ((a), (b))
+#define V_SUB(a,b) _mm512_sub_ps ((a), (b))
+#define V_MUL(a,b) _mm512_mul_ps ((a), (b))
+#define V_MIN(a,b) _mm512_min_ps ((a), (b))
+#define V_MAX(a,b) _mm512_max_ps ((a), (b))
+#define V_STORE_INT(p,v) \
+  _mm512_storeu_si512 ((p), _mm512_cvtps_epi32 (v))
+#define V_GATHER(p,idx) \
+  _mm512_i32gather_ps (_mm512_loadu_si512 ((idx)), (p), 4)
+
+REMIX_SIMD_FUNC static void
+simd_interleave (__m512 a, __m512 b, __m512 * lo, __m512 * hi)
+{
+  __m512i ilo = _mm512_set_epi32 (23, 7, 22, 6, 21, 5, 20, 4,
+				  19, 3, 18, 2, 17, 1, 16, 0);
+  __m512i ihi = _mm512_set_epi32 (31, 15, 30, 14, 29, 13, 28, 12,
+				  27, 11, 26, 10, 25, 9, 24, 8);
+
+  *lo = _mm512_permutex2var_ps (a, ilo, b);
+  *hi = _mm512_permutex2var_ps (a, ihi, b);
+}
+
+REMIX_SIMD_FUNC static void
+simd_deinterleave (__m512 lo, __m512 hi, __m512 * a, __m512 * b)
+{
+  __m512i ieven = _mm512_set_epi32 (30, 28, 26, 24, 22, 20, 18, 16,
+				    14, 12, 10, 8, 6, 4, 2, 0);
+  __m512i iodd = _mm512_set_epi32 (31, 29, 27, 25, 23, 21, 19, 17,
+				   15, 13, 11, 9, 7, 5, 3, 1);
+
+  *a = _mm512_permutex2var_ps (lo, ieven, hi);
+  *b = _mm512_permutex2var_ps (lo, iodd, hi);
+}
+
+/* Transposes within each 128 bit lane: frames 0-3, 4-7, 8-11, 12-15 */
+REMIX_SIMD_FUNC static void
+simd_store_frames_4 (__m512 a, __m512 b, __m512 c, __m512 d,
+		     RemixPCM * dest, int stride)
+{
+  __m512 t0 = _mm512_unpacklo_ps (a, b);
+  __m512 t1 = _mm512_unpacklo_ps (c, d);
+  __m512 t2 = _mm512_unpackhi_ps (a, b);
+  __m512 t3 = _mm512_unpackhi_ps (c, d);
+  __m512 f[4];
+  int k;
+
+  f[0] = _mm512_shuffle_ps (t0, t1, _MM_SHUFFLE (1, 0, 1, 0));
+  f[1] = _mm512_shuffle_ps (t0, t1, _MM_SHUFFLE (3, 2, 3, 2));
+  f[2] = _mm512_shuffle_ps (t2, t3, _MM_SHUFFLE (1, 0, 1, 0));
+  f[3] = _mm512_shuffle_ps (t2, t3, _MM_SHUFFLE (3, 2, 3, 2));
+
+  for (k = 0; k < 4; k++) {
+    _mm_storeu_ps (dest + k*stride, _mm512_extractf32x4_ps (f[k], 0));
+    _mm_storeu_ps (dest + (4+k)*stride, _mm512_extractf32x4_ps (f[k], 1));
+    _mm_storeu_ps (dest + (8+k)*stride, _mm512_extractf32x4_ps (f[k], 2));
+    _mm_storeu_ps (dest + (12+k)*stride, _mm512_extractf32x4_ps (f[k], 3));
+  }
+}
+
+/* Frames 0-3, 4-7, 8-11 and 12-15 go in successive 128 bit lanes */
+REMIX_SIMD_FUNC static void
+simd_load_frames_4 (RemixPCM * src, int stride,
+		    __m512 * a, __m512 * b, __m512 * c, __m512 * d)
+{
+  __m512 r[4], t0, t1, t2, t3;
+  int k;
+
+  for (k = 0; k < 4; k++) {
+    r[k] = _mm512_castps128_ps512 (_mm_loadu_ps (src + k*stride));
+    r[k] = _mm512_insertf32x4 (r[k], _mm_loadu_ps (src + (4+k)*stride), 1);
+    r[k] = _mm512_insertf32x4 (r[k], _mm_loadu_ps (src + (8+k)*stride), 2);
+    r[k] = _mm512_insertf32x4 (r[k], _mm_loadu_ps (src + (12+k)*stride), 3);
+  }
+
+  t0 = _mm512_unpacklo_ps (r[0], r[1]);
+  t1 = _mm512_unpacklo_ps (r[2], r[3]);
+  t2 = _mm512_unpackhi_ps (r[0], r[1]);
+  t3 = _mm512_unpackhi_ps (r[2], r[3]);
+
+  *a = _mm512_shuffle_ps (t0, t1, _MM_SHUFFLE (1, 0, 1, 0));
+  *b = _mm512_shuffle_ps (t0, t1, _MM_SHUFFLE (3, 2, 3, 2));
+  *c = _mm512_shuffle_ps (t2, t3, _MM_SHUFFLE (1, 0, 1, 0));
+  *d = _mm512_shuffle_ps (t2, t3, _MM_SHUFFLE (3, 2, 3, 2));
+}
+
+#include "remix_pcm_simd.h"
+
+#endif /* REMIX_PCM_X86 */
@@ -0,0 +1,785 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixPCM SIMD template: vector versions of the remix_pcm.c kernels.
+ *
+ * Description
+ * -----------
+ *
+ * This file is included once by each of remix_pcm_sse2.c,
+ * remix_pcm_avx2.c and remix_pcm_avx512.c. Before including it, the
+ * including file defines:
+ *
+ *   REMIX_SIMD_FUNC      function attributes selecting the target ISA
+ *   REMIX_SIMD_NAME      name of the kernel set, eg. "avx2"
+ *   REMIX_SIMD_KERNELS   name of the RemixPCMKernels table to define
+ *   REMIX_SIMD_WIDTH     number of RemixPCM values per vector
+ *   RemixVector          the vector type
+ *   V_LOAD, V_STORE      unaligned load and store
+ *   V_LOAD_ALIGNED, V_STORE_ALIGNED
+ *                        load and store of a sizeof (RemixVector) aligned
+ *                        address
+ *   V_SET1, V_ADD, V_SUB, V_MUL, V_MIN, V_MAX
+ *   V_STORE_INT (p, v)   round each lane to the nearest integer and store
+ *                        them, unaligned, to the int array p
+ *   V_GATHER (p, idx)    load p[idx[k]] into each lane k, for an int array
+ *
+ * and the static functions simd_interleave() and simd_deinterleave(),
+ * which (de)interleave two vectors' worth of stereo samples, and
+ * simd_store_frames_4 (a, b, c, d, dest, stride), which transposes one
+ * vector of each of four channels and stores frame k of the four at
+ * dest + k * stride, and its inverse simd_load_frames_4 (src, stride,
+ * a, b, c, d).
+ *
+ * Each kernel processes whole vectors, then finishes the remaining
+ * (fewer than REMIX_SIMD_WIDTH) samples with scalar code matching the
+ * reference implementation in remix_pcm.c.
+ *
+ * The kernels which write a chunk in place first do the samples before
+ * the first aligned vector of the destination with scalar code, and then
+ * access the destination with aligned loads and stores. Chunk data is
+ * REMIX_CHUNK_ALIGNMENT aligned, so that this covers all but the ends
+ * of most spans.
+ *
+ * Invariants
+ * ----------
+ *
+ * RemixPCM is float.
+ *
+ */
+
+/*
+ * simd_head (dest, count)
+ *
+ * Returns how many of 'count' samples from 'dest' come before the first
+ * vector aligned one.
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_head (RemixPCM * dest, RemixCount count)
+{
+  size_t misalign = (size_t)dest % sizeof (RemixVector);
+  RemixCount head;
+
+  if (misalign == 0) return 0;
+
+  head = (sizeof (RemixVector) - misalign) / sizeof (RemixPCM);
+  return MIN (head, count);
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_set (RemixPCM * data, RemixPCM value, RemixCount count)
+{
+  RemixVector v = V_SET1 (value);
+  RemixCount i, head = simd_head (data, count);
+
+  for (i = 0; i < head; i++)
+    data[i] = value;
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE_ALIGNED (&data[i], v);
+
+  for (; i < count; i++)
+    data[i] = value;
+
+  return count;
+}
+
+/*
+ * simd_ramp (data, value, gradient, count)
+ *
+ * Each lane is computed from its own index rather than by stepping, so
+ * that errors do not accumulate along the ramp. The stores are
+ * unaligned, and a ramp which does not fill its last vector is finished
+ * by a vector overlapping the one before, so only ramps shorter than a
+ * vector are written with scalar code.
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_ramp (RemixPCM * data, RemixPCM value, RemixPCM gradient,
+	   RemixCount count)
+{
+  RemixPCM lanes[REMIX_SIMD_WIDTH];
+  RemixVector v = V_SET1 (value), g = V_SET1 (gradient), l;
+  RemixCount i;
+  int k;
+
+  if (count < REMIX_SIMD_WIDTH) {
+    for (i = 0; i < count; i++)
+      data[i] = value + (RemixPCM)i * gradient;
+    return count;
+  }
+
+  for (k = 0; k < REMIX_SIMD_WIDTH; k++)
+    lanes[k] = (RemixPCM)k;
+  l = V_LOAD (lanes);
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE (&data[i], V_ADD (v, V_MUL (V_ADD (V_SET1 ((RemixPCM)i), l), g)));
+
+  if (i < count) {
+    i = count - REMIX_SIMD_WIDTH;
+    V_STORE (&data[i], V_ADD (v, V_MUL (V_ADD (V_SET1 ((RemixPCM)i), l), g)));
+  }
+
+  return count;
+}
+
+/*
+ * simd_cubic_at (c, s, ds, l, i)
+ *
+ * Returns the cubic with coefficients 'c' at s + (i + l) * ds, where
+ * the lanes 'l' are 0, 1, 2, ...
+ */
+REMIX_SIMD_FUNC static RemixVector
+simd_cubic_at (RemixVector * c, RemixVector s, RemixVector ds, RemixVector l,
+	       RemixCount i)
+{
+  RemixVector x = V_ADD (s, V_MUL (V_ADD (V_SET1 ((RemixPCM)i), l), ds));
+
+  return V_ADD (c[0], V_MUL (x, V_ADD (c[1], V_MUL (x, V_ADD (c[2],
+							     V_MUL (x, c[3]))))));
+}
+
+/*
+ * simd_cubic (data, coeffs, s, ds, count)
+ *
+ * Evaluates the cubic in Horner form, finishing as simd_ramp() does.
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_cubic (RemixPCM * data, RemixPCM * coeffs, RemixPCM s, RemixPCM ds,
+	    RemixCount count)
+{
+  RemixPCM lanes[REMIX_SIMD_WIDTH], x;
+  RemixVector c[4], vs = V_SET1 (s), vds = V_SET1 (ds), l;
+  RemixCount i;
+  int k;
+
+  if (count < REMIX_SIMD_WIDTH) {
+    for (i = 0; i < count; i++) {
+      x = s + (RemixPCM)i * ds;
+      data[i] = coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+    }
+    return count;
+  }
+
+  for (k = 0; k < 4; k++)
+    c[k] = V_SET1 (coeffs[k]);
+  for (k = 0; k < REMIX_SIMD_WIDTH; k++)
+    lanes[k] = (RemixPCM)k;
+  l = V_LOAD (lanes);
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE (&data[i], simd_cubic_at (c, vs, vds, l, i));
+
+  if (i < count) {
+    i = count - REMIX_SIMD_WIDTH;
+    V_STORE (&data[i], simd_cubic_at (c, vs, vds, l, i));
+  }
+
+  return count;
+}
+
+/*
+ * simd_mult_cubic (data, coeffs, s, ds, count)
+ *
+ * Multiplies by the cubic of simd_cubic(). Being in place, this cannot
+ * overlap its last vector, and so finishes with scalar code.
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_mult_cubic (RemixPCM * data, RemixPCM * coeffs, RemixPCM s, RemixPCM ds,
+		 RemixCount count)
+{
+  RemixPCM lanes[REMIX_SIMD_WIDTH], x;
+  RemixVector c[4], vs = V_SET1 (s), vds = V_SET1 (ds), l;
+  RemixCount i, head = simd_head (data, count);
+  int k;
+
+  for (i = 0; i < head; i++) {
+    x = s + (RemixPCM)i * ds;
+    data[i] *= coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+  }
+
+  for (k = 0; k < 4; k++)
+    c[k] = V_SET1 (coeffs[k]);
+  for (k = 0; k < REMIX_SIMD_WIDTH; k++)
+    lanes[k] = (RemixPCM)k;
+  l = V_LOAD (lanes);
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE_ALIGNED (&data[i], V_MUL (V_LOAD_ALIGNED (&data[i]),
+				      simd_cubic_at (c, vs, vds, l, i)));
+
+  for (; i < count; i++) {
+    x = s + (RemixPCM)i * ds;
+    data[i] *= coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+  }
+
+  return count;
+}
+
+/*
+ * simd_blend_cubic (src, dest, coeffs, s, ds, count)
+ *
+ * Blends as simd_blend() does, by the cubic of simd_cubic().
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_blend_cubic (RemixPCM * src, RemixPCM * dest, RemixPCM * coeffs,
+		  RemixPCM s, RemixPCM ds, RemixCount count)
+{
+  RemixPCM lanes[REMIX_SIMD_WIDTH], x, b;
+  RemixVector c[4], vs = V_SET1 (s), vds = V_SET1 (ds), l, vb;
+  RemixVector one = V_SET1 (1.0);
+  RemixCount i, head = simd_head (dest, count);
+  int k;
+
+  for (i = 0; i < head; i++) {
+    x = s + (RemixPCM)i * ds;
+    b = coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+    dest[i] = (dest[i] * b) + (src[i] * (1.0 - b));
+  }
+
+  for (k = 0; k < 4; k++)
+    c[k] = V_SET1 (coeffs[k]);
+  for (k = 0; k < REMIX_SIMD_WIDTH; k++)
+    lanes[k] = (RemixPCM)k;
+  l = V_LOAD (lanes);
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    vb = simd_cubic_at (c, vs, vds, l, i);
+    V_STORE_ALIGNED (&dest[i],
+		     V_ADD (V_MUL (V_LOAD_ALIGNED (&dest[i]), vb),
+			    V_MUL (V_LOAD (&src[i]), V_SUB (one, vb))));
+  }
+
+  for (; i < count; i++) {
+    x = s + (RemixPCM)i * ds;
+    b = coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+    dest[i] = (dest[i] * b) + (src[i] * (1.0 - b));
+  }
+
+  return count;
+}
+
+/*
+ * simd_copy_mult_cubic (src, dest, coeffs, s, ds, count)
+ *
+ * Writes src multiplied by the cubic of simd_cubic() to dest.
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_copy_mult_cubic (RemixPCM * src, RemixPCM * dest, RemixPCM * coeffs,
+		      RemixPCM s, RemixPCM ds, RemixCount count)
+{
+  RemixPCM lanes[REMIX_SIMD_WIDTH], x;
+  RemixVector c[4], vs = V_SET1 (s), vds = V_SET1 (ds), l;
+  RemixCount i, head = simd_head (dest, count);
+  int k;
+
+  for (i = 0; i < head; i++) {
+    x = s + (RemixPCM)i * ds;
+    dest[i] = src[i] *
+      (coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3])));
+  }
+
+  for (k = 0; k < 4; k++)
+    c[k] = V_SET1 (coeffs[k]);
+  for (k = 0; k < REMIX_SIMD_WIDTH; k++)
+    lanes[k] = (RemixPCM)k;
+  l = V_LOAD (lanes);
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE_ALIGNED (&dest[i], V_MUL (V_LOAD (&src[i]),
+				      simd_cubic_at (c, vs, vds, l, i)));
+
+  for (; i < count; i++) {
+    x = s + (RemixPCM)i * ds;
+    dest[i] = src[i] *
+      (coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3])));
+  }
+
+  return count;
+}
+
+/*
+ * simd_mult_blend_cubic (src, dest, gain, gs, gds, blend, bs, bds, count)
+ *
+ * Multiplies dest by the cubic 'gain' and blends src into it by the
+ * cubic 'blend', in one pass.
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_mult_blend_cubic (RemixPCM * src, RemixPCM * dest,
+		       RemixPCM * gain, RemixPCM gs, RemixPCM gds,
+		       RemixPCM * blend, RemixPCM bs, RemixPCM bds,
+		       RemixCount count)
+{
+  RemixPCM lanes[REMIX_SIMD_WIDTH], x, g, b;
+  RemixVector gc[4], bc[4], vgs = V_SET1 (gs), vgds = V_SET1 (gds);
+  RemixVector vbs = V_SET1 (bs), vbds = V_SET1 (bds), l, vg, vb;
+  RemixVector one = V_SET1 (1.0);
+  RemixCount i, head = simd_head (dest, count);
+  int k;
+
+  for (i = 0; i < head; i++) {
+    x = gs + (RemixPCM)i * gds;
+    g = gain[0] + x * (gain[1] + x * (gain[2] + x * gain[3]));
+    x = bs + (RemixPCM)i * bds;
+    b = blend[0] + x * (blend[1] + x * (blend[2] + x * blend[3]));
+    dest[i] = (dest[i] * g * b) + (src[i] * (1.0 - b));
+  }
+
+  for (k = 0; k < 4; k++) {
+    gc[k] = V_SET1 (gain[k]);
+    bc[k] = V_SET1 (blend[k]);
+  }
+  for (k = 0; k < REMIX_SIMD_WIDTH; k++)
+    lanes[k] = (RemixPCM)k;
+  l = V_LOAD (lanes);
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    vg = simd_cubic_at (gc, vgs, vgds, l, i);
+    vb = simd_cubic_at (bc, vbs, vbds, l, i);
+    V_STORE_ALIGNED (&dest[i],
+		     V_ADD (V_MUL (V_MUL (V_LOAD_ALIGNED (&dest[i]), vg), vb),
+			    V_MUL (V_LOAD (&src[i]), V_SUB (one, vb))));
+  }
+
+  for (; i < count; i++) {
+    x = gs + (RemixPCM)i * gds;
+    g = gain[0] + x * (gain[1] + x * (gain[2] + x * gain[3]));
+    x = bs + (RemixPCM)i * bds;
+    b = blend[0] + x * (blend[1] + x * (blend[2] + x * blend[3]));
+    dest[i] = (dest[i] * g * b) + (src[i] * (1.0 - b));
+  }
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_gain (RemixPCM * data, RemixCount count, void * gain)
+{
+  RemixPCM _gain = *(RemixPCM *)gain;
+  RemixVector g = V_SET1 (_gain);
+  RemixCount i, head = simd_head (data, count);
+
+  for (i = 0; i < head; i++)
+    data[i] *= _gain;
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE_ALIGNED (&data[i], V_MUL (V_LOAD_ALIGNED (&data[i]), g));
+
+  for (; i < count; i++)
+    data[i] *= _gain;
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_add (RemixPCM * src, RemixPCM * dest, RemixCount count, void * unused)
+{
+  RemixCount i, head = simd_head (dest, count);
+
+  for (i = 0; i < head; i++)
+    dest[i] += src[i];
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE_ALIGNED (&dest[i],
+		     V_ADD (V_LOAD_ALIGNED (&dest[i]), V_LOAD (&src[i])));
+
+  for (; i < count; i++)
+    dest[i] += src[i];
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_mult (RemixPCM * src, RemixPCM * dest, RemixCount count, void * unused)
+{
+  RemixCount i, head = simd_head (dest, count);
+
+  for (i = 0; i < head; i++)
+    dest[i] *= src[i];
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE_ALIGNED (&dest[i],
+		     V_MUL (V_LOAD_ALIGNED (&dest[i]), V_LOAD (&src[i])));
+
+  for (; i < count; i++)
+    dest[i] *= src[i];
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_fade (RemixPCM * src, RemixPCM * dest, RemixCount count, void * unused)
+{
+  RemixVector one = V_SET1 (1.0);
+  RemixCount i, head = simd_head (dest, count);
+
+  for (i = 0; i < head; i++)
+    dest[i] *= (1.0 - src[i]);
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH)
+    V_STORE_ALIGNED (&dest[i], V_MUL (V_LOAD_ALIGNED (&dest[i]),
+				      V_SUB (one, V_LOAD (&src[i]))));
+
+  for (; i < count; i++)
+    dest[i] *= (1.0 - src[i]);
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_interleave_2 (RemixPCM * src1, RemixPCM * src2, RemixCount count,
+		   void * data)
+{
+  RemixPCM * dest = (RemixPCM *)data;
+  RemixVector lo, hi;
+  RemixCount i;
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    simd_interleave (V_LOAD (&src1[i]), V_LOAD (&src2[i]), &lo, &hi);
+    V_STORE (&dest[2*i], lo);
+    V_STORE (&dest[2*i + REMIX_SIMD_WIDTH], hi);
+  }
+
+  for (; i < count; i++) {
+    dest[2*i] = src1[i];
+    dest[2*i + 1] = src2[i];
+  }
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_deinterleave_2 (RemixPCM * dest1, RemixPCM * dest2, RemixCount count,
+		     void * data)
+{
+  RemixPCM * src = (RemixPCM *)data;
+  RemixVector a, b;
+  RemixCount i;
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    simd_deinterleave (V_LOAD (&src[2*i]),
+		       V_LOAD (&src[2*i + REMIX_SIMD_WIDTH]), &a, &b);
+    V_STORE (&dest1[i], a);
+    V_STORE (&dest2[i], b);
+  }
+
+  for (; i < count; i++) {
+    dest1[i] = src[2*i];
+    dest2[i] = src[2*i + 1];
+  }
+
+  return count;
+}
+
+/*
+ * simd_interleave_n (srcs, nr_channels, count, dest)
+ *
+ * Stereo is interleaved by simd_interleave_2(). Otherwise each group of
+ * four channels is transposed a vector at a time, which stores four
+ * samples of each frame at once, and any remaining channels are stored
+ * one sample at a time.
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_interleave_n (RemixPCM ** srcs, int nr_channels, RemixCount count,
+		   RemixPCM * dest)
+{
+  RemixVector zero = V_SET1 (0.0), v[4];
+  RemixCount i;
+  int c, k;
+
+  if (nr_channels == 2 && srcs[0] && srcs[1])
+    return simd_interleave_2 (srcs[0], srcs[1], count, dest);
+
+  for (c = 0; c + 4 <= nr_channels; c += 4) {
+    for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+      for (k = 0; k < 4; k++)
+	v[k] = srcs[c+k] ? V_LOAD (&srcs[c+k][i]) : zero;
+      simd_store_frames_4 (v[0], v[1], v[2], v[3],
+			   &dest[i * nr_channels + c], nr_channels);
+    }
+    for (; i < count; i++) {
+      for (k = 0; k < 4; k++)
+	dest[i * nr_channels + c + k] = srcs[c+k] ? srcs[c+k][i] : 0.0;
+    }
+  }
+
+  for (; c < nr_channels; c++) {
+    for (i = 0; i < count; i++)
+      dest[i * nr_channels + c] = srcs[c] ? srcs[c][i] : 0.0;
+  }
+
+  return count;
+}
+
+/*
+ * simd_deinterleave_n (dests, nr_channels, count, src)
+ *
+ * The inverse of simd_interleave_n().
+ */
+REMIX_SIMD_FUNC static RemixCount
+simd_deinterleave_n (RemixPCM ** dests, int nr_channels, RemixCount count,
+		     RemixPCM * src)
+{
+  RemixVector v[4];
+  RemixCount i;
+  int c, k;
+
+  if (nr_channels == 2)
+    return simd_deinterleave_2 (dests[0], dests[1], count, src);
+
+  for (c = 0; c + 4 <= nr_channels; c += 4) {
+    for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+      simd_load_frames_4 (&src[i * nr_channels + c], nr_channels,
+			  &v[0], &v[1], &v[2], &v[3]);
+      for (k = 0; k < 4; k++)
+	V_STORE (&dests[c+k][i], v[k]);
+    }
+    for (; i < count; i++) {
+      for (k = 0; k < 4; k++)
+	dests[c+k][i] = src[i * nr_channels + c + k];
+    }
+  }
+
+  for (; c < nr_channels; c++) {
+    for (i = 0; i < count; i++)
+      dests[c][i] = src[i * nr_channels + c];
+  }
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_blend (RemixPCM * src, RemixPCM * blend, RemixPCM * dest,
+	    RemixCount count, void * unused)
+{
+  RemixVector one = V_SET1 (1.0);
+  RemixVector b;
+  RemixCount i, head = simd_head (dest, count);
+
+  for (i = 0; i < head; i++)
+    dest[i] = (dest[i] * blend[i]) + (src[i] * (1.0 - blend[i]));
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    b = V_LOAD (&blend[i]);
+    V_STORE_ALIGNED (&dest[i],
+		     V_ADD (V_MUL (V_LOAD_ALIGNED (&dest[i]), b),
+			    V_MUL (V_LOAD (&src[i]), V_SUB (one, b))));
+  }
+
+  for (; i < count; i++)
+    dest[i] = (dest[i] * blend[i]) + (src[i] * (1.0 - blend[i]));
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_mix_gains (RemixPCM ** srcs, RemixPCM * gains, int nr_srcs,
+		RemixPCM * dest, RemixCount count, int accumulate)
+{
+  RemixVector acc;
+  RemixCount i, head = simd_head (dest, count);
+  RemixPCM d;
+  int k;
+
+  for (i = 0; i < head; i++) {
+    d = accumulate ? dest[i] : 0.0;
+    for (k = 0; k < nr_srcs; k++)
+      d += srcs[k][i] * gains[k];
+    dest[i] = d;
+  }
+
+  for (; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    acc = accumulate ? V_LOAD_ALIGNED (&dest[i]) : V_SET1 (0.0);
+    for (k = 0; k < nr_srcs; k++)
+      acc = V_ADD (acc, V_MUL (V_LOAD (&srcs[k][i]), V_SET1 (gains[k])));
+    V_STORE_ALIGNED (&dest[i], acc);
+  }
+
+  for (; i < count; i++) {
+    d = accumulate ? dest[i] : 0.0;
+    for (k = 0; k < nr_srcs; k++)
+      d += srcs[k][i] * gains[k];
+    dest[i] = d;
+  }
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_resample_linear (RemixPCM * src, int * index, RemixPCM * frac,
+		      RemixPCM * dest, RemixCount count)
+{
+  RemixVector a, b;
+  RemixCount i;
+  RemixPCM sa, sb;
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    a = V_GATHER (src, &index[i]);
+    b = V_GATHER (src + 1, &index[i]);
+    V_STORE (&dest[i], V_ADD (a, V_MUL (V_SUB (b, a), V_LOAD (&frac[i]))));
+  }
+
+  for (; i < count; i++) {
+    sa = src[index[i]];
+    sb = src[index[i] + 1];
+    dest[i] = sa + (sb - sa) * frac[i];
+  }
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_resample_cubic (RemixPCM * src, int * index, RemixPCM * frac,
+		     RemixPCM * dest, RemixCount count)
+{
+  RemixVector p0, p1, p2, p3, f, t;
+  RemixVector half = V_SET1 (0.5), two = V_SET1 (2.0), three = V_SET1 (3.0);
+  RemixVector four = V_SET1 (4.0), five = V_SET1 (5.0);
+  RemixCount i;
+  RemixPCM s0, s1, s2, s3, sf;
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    p0 = V_GATHER (src - 1, &index[i]);
+    p1 = V_GATHER (src, &index[i]);
+    p2 = V_GATHER (src + 1, &index[i]);
+    p3 = V_GATHER (src + 2, &index[i]);
+    f = V_LOAD (&frac[i]);
+
+    /* Horner form of the reference expression */
+    t = V_SUB (V_ADD (V_MUL (three, V_SUB (p1, p2)), p3), p0);
+    t = V_ADD (V_SUB (V_ADD (V_SUB (V_MUL (two, p0), V_MUL (five, p1)),
+			     V_MUL (four, p2)), p3), V_MUL (f, t));
+    t = V_ADD (V_SUB (p2, p0), V_MUL (f, t));
+    V_STORE (&dest[i], V_ADD (p1, V_MUL (V_MUL (half, f), t)));
+  }
+
+  for (; i < count; i++) {
+    s0 = src[index[i] - 1];
+    s1 = src[index[i]];
+    s2 = src[index[i] + 1];
+    s3 = src[index[i] + 2];
+    sf = frac[i];
+    dest[i] = s1 + 0.5 * sf * (s2 - s0 +
+			       sf * (2.0 * s0 - 5.0 * s1 + 4.0 * s2 - s3 +
+				     sf * (3.0 * (s1 - s2) + s3 - s0)));
+  }
+
+  return count;
+}
+
+/* Vectorised across output samples: one gather per tap and lane */
+REMIX_SIMD_FUNC static RemixCount
+simd_resample_sinc (RemixPCM * src, int * index, RemixPCM * frac,
+		    RemixPCM * dest, RemixCount count)
+{
+  RemixPCM * s = src - (REMIX_SINC_TAPS/2 - 1);
+  RemixPCM * c, x, pf, acc;
+  RemixPCM pfrac[REMIX_SIMD_WIDTH];
+  int phase[REMIX_SIMD_WIDTH];
+  RemixVector vacc, vpf, c0, c1;
+  RemixCount i;
+  int k, t, p;
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    for (k = 0; k < REMIX_SIMD_WIDTH; k++) {
+      x = frac[i+k] * REMIX_SINC_PHASES;
+      phase[k] = (int)x;
+      pfrac[k] = x - phase[k];
+    }
+    vpf = V_LOAD (pfrac);
+    vacc = V_SET1 (0.0);
+    for (t = 0; t < REMIX_SINC_TAPS; t++) {
+      c = &_remix_pcm_sinc_table[t * (REMIX_SINC_PHASES + 1)];
+      c0 = V_GATHER (c, phase);
+      c1 = V_GATHER (c + 1, phase);
+      vacc = V_ADD (vacc, V_MUL (V_GATHER (s + t, &index[i]),
+				 V_ADD (c0, V_MUL (V_SUB (c1, c0), vpf))));
+    }
+    V_STORE (&dest[i], vacc);
+  }
+
+  for (; i < count; i++) {
+    x = frac[i] * REMIX_SINC_PHASES;
+    p = (int)x;
+    pf = x - p;
+    acc = 0.0;
+    for (t = 0; t < REMIX_SINC_TAPS; t++) {
+      c = &_remix_pcm_sinc_table[t * (REMIX_SINC_PHASES + 1) + p];
+      acc += s[index[i] + t] * (c[0] + (c[1] - c[0]) * pf);
+    }
+    dest[i] = acc;
+  }
+
+  return count;
+}
+
+REMIX_SIMD_FUNC static RemixCount
+simd_quantise (RemixPCM * src, RemixPCM * dither, int * dest,
+	       RemixCount count, RemixPCM scale, RemixPCM max)
+{
+  RemixVector vscale = V_SET1 (scale), vmin = V_SET1 (-scale);
+  RemixVector vmax = V_SET1 (max), v;
+  RemixCount i;
+  RemixPCM x;
+
+  for (i = 0; i + REMIX_SIMD_WIDTH <= count; i += REMIX_SIMD_WIDTH) {
+    v = V_MUL (V_LOAD (&src[i]), vscale);
+    if (dither) v = V_ADD (v, V_LOAD (&dither[i]));
+    V_STORE_INT (&dest[i], V_MAX (V_MIN (v, vmax), vmin));
+  }
+
+  for (; i < count; i++) {
+    x = src[i] * scale;
+    if (dither) x += dither[i];
+    if (x > max) x = max;
+    else if (x < -scale) x = -scale;
+    dest[i] = (int) lrintf (x);
+  }
+
+  return count;
+}
+
+RemixPCMKernels REMIX_SIMD_KERNELS = {
+  REMIX_SIMD_NAME,
+  simd_set,
+  simd_ramp,
+  simd_cubic,
+  simd_mult_cubic,
+  simd_blend_cubic,
+  simd_copy_mult_cubic,
+  simd_mult_blend_cubic,
+  simd_gain,
+  simd_add,
+  simd_mult,
+  simd_fade,
+  simd_interleave_2,
+  simd_deinterleave_2,
+  simd_interleave_n,
+  simd_deinterleave_n,
+  simd_blend,
+  simd_mix_gains,
+  simd_resample_linear,
+  simd_resample_cubic,
+  simd_resample_sinc,
+  simd_quantise,
+};
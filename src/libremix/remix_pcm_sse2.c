@@ -0,0 +1,109 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixPCM: SSE2 (4-wide) PCM kernels.
+ *
+ * Description
+ * -----------
+ *
+ * Instantiates the template in remix_pcm_simd.h for this instruction
+ * set. Only the functions in this file are compiled for it, so the
+ * library as a whole still runs on any CPU; remix_pcm_init_kernels()
+ * only selects this table when the CPU supports it.
+ *
+ */
+
+#include <math.h>
+
+#define __REMIX__
+#include "remix.h"
+
+#ifdef REMIX_PCM_X86
+
+#include <emmintrin.h>
+
+#define REMIX_SIMD_FUNC __attribute__((target("sse2")))
+#define REMIX_SIMD_NAME "sse2"
+#define REMIX_SIMD_KERNELS _remix_pcm_sse2_kernels
+#define REMIX_SIMD_WIDTH 4
+
+typedef __m128 RemixVector;
+
+#define V_LOAD(p) _mm_loadu_ps (p)
+#define V_STORE(p,v) _mm_storeu_ps ((p), (v))
+#define V_LOAD_ALIGNED(p) _mm_load_ps (p)
+#define V_STORE_ALIGNED(p,v) _mm_store_ps ((p), (v))
+#define V_SET1(x) _mm_set1_ps (x)
+#define V_ADD(a,b) _mm_add_ps ((a), (b))
+#define V_SUB(a,b) _mm_sub_ps ((a), (b))
+#define V_MUL(a,b) _mm_mul_ps ((a), (b))
+#define V_MIN(a,b) _mm_min_ps ((a), (b))
+#define V_MAX(a,b) _mm_max_ps ((a), (b))
+#define V_STORE_INT(p,v) \
+  _mm_storeu_si128 ((__m128i *)(p), _mm_cvtps_epi32 (v))
+#define V_GATHER(p,idx) \
+  _mm_set_ps ((p)[(idx)[3]], (p)[(idx)[2]], (p)[(idx)[1]], (p)[(idx)[0]])
+
+REMIX_SIMD_FUNC static void
+simd_interleave (__m128 a, __m128 b, __m128 * lo, __m128 * hi)
+{
+  *lo = _mm_unpacklo_ps (a, b);
+  *hi = _mm_unpackhi_ps (a, b);
+}
+
+REMIX_SIMD_FUNC static void
+simd_deinterleave (__m128 lo, __m128 hi, __m128 * a, __m128 * b)
+{
+  *a = _mm_shuffle_ps (lo, hi, _MM_SHUFFLE (2, 0, 2, 0));
+  *b = _mm_shuffle_ps (lo, hi, _MM_SHUFFLE (3, 1, 3, 1));
+}
+
+REMIX_SIMD_FUNC static void
+simd_store_frames_4 (__m128 a, __m128 b, __m128 c, __m128 d,
+		     RemixPCM * dest, int stride)
+{
+  _MM_TRANSPOSE4_PS (a, b, c, d);
+
+  _mm_storeu_ps (dest, a);
+  _mm_storeu_ps (dest + stride, b);
+  _mm_storeu_ps (dest + 2*stride, c);
+  _mm_storeu_ps (dest + 3*stride, d);
+}
+
+REMIX_SIMD_FUNC static void
+simd_load_frames_4 (RemixPCM * src, int stride,
+		    __m128 * a, __m128 * b, __m128 * c, __m128 * d)
+{
+  __m128 r0 = _mm_loadu_ps (src);
+  __m128 r1 = _mm_loadu_ps (src + stride);
+  __m128 r2 = _mm_loadu_ps (src + 2*stride);
+  __m128 r3 = _mm_loadu_ps (src + 3*stride);
+
+  _MM_TRANSPOSE4_PS (r0, r1, r2, r3);
+
+  *a = r0; *b = r1; *c = r2; *d = r3;
+}
+
+#include "remix_pcm_simd.h"
+
+#endif /* REMIX_PCM_X86 */
@@ -0,0 +1,753 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixPlayback: real-time playback of a base to a device.
+ *
+ * Description
+ * -----------
+ *
+ * A playback renders its source ahead, one mixlength at a time, on a
+ * render thread of its own, converting each block to dithered,
+ * interleaved 16 bit samples in a ring buffer. A device thread takes one
+ * period at a time from the ring and writes it to the device, so that
+ * neither waits on the other except when the ring is full or empty.
+ *
+ * The device is either an OSS device, or a file descriptor (a file or a
+ * pipe) consumed at a simulated sample clock. The latter makes playback
+ * testable on machines without sound hardware.
+ *
+ * The render thread processes in its own env, which is where live edits
+ * for the source should be posted; see remix_playback_get_env().
+ *
+ * Invariants
+ * ----------
+ *
+ * The ring has a single producer, the render thread, and a single
+ * consumer, the device thread; neither takes a lock.
+ *
+ * An underrun (xrun) is counted each time the device thread needs a
+ * period that has not been fully rendered; the missing part is played as
+ * silence and no rendered audio is dropped.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef HAVE_SYS_SOUNDCARD_H
+#include <sys/ioctl.h>
+#include <sys/soundcard.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define __REMIX__
+#include "remix.h"
+
+#define DEFAULT_DEVICE "/dev/dsp"
+
+/* Default ring length, in mixlengths */
+#define DEFAULT_BLOCKS 4
+
+typedef enum {
+  REMIX_DEVICE_OSS,
+  REMIX_DEVICE_FILE
+} RemixDeviceType;
+
+struct _RemixPlayback {
+  RemixBase base;
+  RemixBase * source;
+  RemixEnv * render_env;
+  RemixStream * stream; /* one rendered block */
+  RemixCount block;
+  int nr_channels;
+  int * channel_names;
+  RemixDither dither;
+  RemixConverter * converter;
+  RemixPCM ** planes; /* channel data of the rendered block */
+
+  /* Device */
+  RemixDeviceType device_type;
+  int fd;
+  double speed; /* file devices: multiple of real time, or 0 */
+  struct timespec clock_start;
+  unsigned long device_frames; /* frames written to the device */
+
+  /* Ring of interleaved frames */
+  short * ring;
+  unsigned long ring_length; /* frames; a power of two */
+  RemixCount buffer_length;
+  unsigned long written; /* frames rendered; written by the render thread */
+  unsigned long played; /* frames taken; written by the device thread */
+  short * period;
+
+  /* State and counters */
+  int running;
+  int ended; /* the source has been rendered to its end */
+  int playing; /* the device thread has not yet finished */
+  long xruns;
+  long latency;
+
+#ifdef HAVE_PTHREAD
+  pthread_t render_thread;
+  pthread_t device_thread;
+#endif
+};
+
+/* Optimisation dependencies: none */
+static RemixPlayback * remix_playback_optimise (RemixEnv * env,
+						RemixPlayback * playback);
+
+static void
+remix_playback_sleep (long nsec)
+{
+  struct timespec ts;
+
+  ts.tv_sec = nsec / 1000000000L;
+  ts.tv_nsec = nsec % 1000000000L;
+  while (nanosleep (&ts, &ts) == -1 && errno == EINTR);
+}
+
+static double
+remix_playback_elapsed (struct timespec * start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) +
+    (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/* Device */
+
+static int
+remix_playback_open_oss (RemixEnv * env, RemixPlayback * playback,
+			 char * path)
+{
+#ifdef HAVE_SYS_SOUNDCARD_H
+  int format = AFMT_S16_NE;
+  int channels = playback->nr_channels;
+  int frequency = (int) remix_get_samplerate (env);
+
+  playback->fd = open (path ? path : DEFAULT_DEVICE, O_WRONLY, 0);
+  if (playback->fd == -1) {
+    remix_set_error (env, REMIX_ERROR_SYSTEM);
+    return -1;
+  }
+
+  if (ioctl (playback->fd, SNDCTL_DSP_SETFMT, &format) == -1 ||
+      format != AFMT_S16_NE ||
+      ioctl (playback->fd, SNDCTL_DSP_CHANNELS, &channels) == -1 ||
+      channels != playback->nr_channels ||
+      ioctl (playback->fd, SNDCTL_DSP_SPEED, &frequency) == -1) {
+    close (playback->fd);
+    playback->fd = -1;
+    remix_set_error (env, REMIX_ERROR_SYSTEM);
+    return -1;
+  }
+
+  return 0;
+#else
+  remix_set_error (env, REMIX_ERROR_SYSTEM);
+  return -1;
+#endif
+}
+
+/*
+ * remix_playback_device_delay (playback)
+ *
+ * Returns the number of frames written to the device but not yet played.
+ */
+static long
+remix_playback_device_delay (RemixPlayback * playback)
+{
+  double played;
+  long delay;
+#ifdef HAVE_SYS_SOUNDCARD_H
+  int bytes;
+#endif
+
+  switch (playback->device_type) {
+  case REMIX_DEVICE_OSS:
+#ifdef HAVE_SYS_SOUNDCARD_H
+    if (ioctl (playback->fd, SNDCTL_DSP_GETODELAY, &bytes) == -1) return 0;
+    return bytes / (playback->nr_channels * sizeof (short));
+#endif
+    break;
+  case REMIX_DEVICE_FILE:
+    if (playback->speed <= 0.0) return 0;
+    played = remix_playback_elapsed (&playback->clock_start) *
+      playback->speed * _remix_base_get_samplerate (NULL, playback);
+    delay = playback->device_frames - (long)played;
+    return MAX (delay, 0);
+  default: break;
+  }
+
+  return 0;
+}
+
+/*
+ * remix_playback_device_write (playback, count)
+ *
+ * Writes 'count' frames from the period buffer to the device. A file
+ * device then waits until its simulated clock has played all frames
+ * written before this period, as a sound card whose buffer holds one
+ * period would. Returns 0 on success, or -1 on error.
+ */
+static int
+remix_playback_device_write (RemixPlayback * playback, RemixCount count)
+{
+  char * p = (char *)playback->period;
+  size_t remaining = count * playback->nr_channels * sizeof (short);
+  ssize_t n;
+  double due;
+
+  while (remaining > 0) {
+    n = write (playback->fd, p, remaining);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += n;
+    remaining -= n;
+  }
+
+  if (playback->device_type == REMIX_DEVICE_FILE && playback->speed > 0.0) {
+    due = playback->device_frames /
+      (playback->speed * _remix_base_get_samplerate (NULL, playback)) -
+      remix_playback_elapsed (&playback->clock_start);
+    if (due > 0.0) remix_playback_sleep ((long)(due * 1e9));
+  }
+
+  playback->device_frames += count;
+
+  return 0;
+}
+
+/* Render thread */
+
+/*
+ * remix_playback_convert (env, playback, count)
+ *
+ * Converts 'count' frames of the rendered block to 16 bit samples and
+ * appends them to the ring.
+ */
+static void
+remix_playback_convert (RemixEnv * env, RemixPlayback * playback,
+			RemixCount count)
+{
+  RemixChannel * channel;
+  RemixChunk * chunk;
+  unsigned long offset = playback->written & (playback->ring_length - 1);
+  RemixCount n;
+  int c;
+
+  for (c = 0; c < playback->nr_channels; c++) {
+    channel = remix_stream_find_channel (env, playback->stream,
+					 playback->channel_names[c]);
+    chunk = channel ? remix_channel_get_chunk_at (env, channel, 0) : NULL;
+    playback->planes[c] =
+      (chunk == RemixNone || chunk->_silent) ? NULL : chunk->data;
+  }
+
+  /* Up to the end of the ring, then wrap around */
+  n = MIN (count, (RemixCount)(playback->ring_length - offset));
+  remix_convert_planar (env, playback->converter, playback->planes,
+			&playback->ring[offset * playback->nr_channels], n);
+
+  if (n < count) {
+    for (c = 0; c < playback->nr_channels; c++)
+      if (playback->planes[c]) playback->planes[c] += n;
+    remix_convert_planar (env, playback->converter, playback->planes,
+			  playback->ring, count - n);
+  }
+}
+
+/*
+ * remix_playback_render (playback)
+ *
+ * Renders one block into the ring. Returns the number of frames
+ * rendered; 0 once the source has ended.
+ */
+static RemixCount
+remix_playback_render (RemixPlayback * playback)
+{
+  RemixEnv * env = playback->render_env;
+  RemixCount count = playback->block, length, n;
+
+  length = remix_length (env, playback->source);
+  if (length != REMIX_COUNT_INFINITE && length >= 0)
+    count = MIN (count, length - remix_tell (env, playback->source));
+  if (count <= 0) return 0;
+
+  remix_seek (env, (RemixBase *)playback->stream, 0, SEEK_SET);
+  n = remix_process (env, playback->source, count, RemixNone,
+		     playback->stream);
+  if (n <= 0) return 0;
+
+  remix_playback_convert (env, playback, n);
+  _remix_store_release (&playback->written, playback->written + n);
+
+  return n;
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+remix_playback_render_thread (void * data)
+{
+  RemixPlayback * playback = (RemixPlayback *)data;
+  unsigned long filled;
+  long period_ns = (long)(1e9 * playback->block /
+			  _remix_base_get_samplerate (NULL, playback));
+
+  while (_remix_load_acquire (&playback->running)) {
+    filled = playback->written - _remix_load_acquire (&playback->played);
+    if (filled + playback->block > (unsigned long)playback->buffer_length) {
+      remix_playback_sleep (period_ns / 4);
+      continue;
+    }
+    if (remix_playback_render (playback) == 0) {
+      _remix_store_release (&playback->ended, TRUE);
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+/* Device thread */
+
+static void *
+remix_playback_device_thread (void * data)
+{
+  RemixPlayback * playback = (RemixPlayback *)data;
+  unsigned long mask = playback->ring_length - 1;
+  unsigned long p, available;
+  RemixCount period = playback->block, n, i;
+  int nr_channels = playback->nr_channels, primed = FALSE;
+  long period_ns = (long)(1e9 * period /
+			  _remix_base_get_samplerate (NULL, playback));
+
+  while (_remix_load_acquire (&playback->running)) {
+    p = playback->played;
+    available = _remix_load_acquire (&playback->written) - p;
+
+    /* Wait for the ring to fill before starting, then never again */
+    if (!primed) {
+      if (available + period <= (unsigned long)playback->buffer_length &&
+	  !_remix_load_acquire (&playback->ended)) {
+	remix_playback_sleep (period_ns / 4);
+	continue;
+      }
+      primed = TRUE;
+      clock_gettime (CLOCK_MONOTONIC, &playback->clock_start);
+      playback->device_frames = 0;
+    }
+
+    if (available == 0 && _remix_load_acquire (&playback->ended)) break;
+
+    n = MIN (available, (unsigned long)period);
+    if (n < period && !_remix_load_acquire (&playback->ended))
+      _remix_store_release (&playback->xruns, playback->xruns + 1);
+
+    for (i = 0; i < n; i++) {
+      memcpy (&playback->period[i * nr_channels],
+	      &playback->ring[((p + i) & mask) * nr_channels],
+	      nr_channels * sizeof (short));
+    }
+    memset (&playback->period[n * nr_channels], 0,
+	    (period - n) * nr_channels * sizeof (short));
+
+    _remix_store_release (&playback->played, p + n);
+    _remix_store_release (&playback->latency,
+			  (long)(available - n) +
+			  remix_playback_device_delay (playback) + period);
+
+    /* Short periods, on underrun or at the end, are padded with silence */
+    if (remix_playback_device_write (playback, period) == -1) break;
+  }
+
+  _remix_store_release (&playback->playing, FALSE);
+
+  return NULL;
+}
+#endif
+
+/* Base methods */
+
+static RemixBase *
+remix_playback_prepare (RemixEnv * env, RemixBase * base)
+{
+  RemixPlayback * playback = (RemixPlayback *)base;
+  CDSet * channels = _remix_base_get_channels (env, base), * s;
+  RemixCount length;
+  int c;
+
+  playback->block = _remix_base_get_mixlength (env, base);
+
+  if (playback->stream != RemixNone)
+    remix_destroy (env, (RemixBase *)playback->stream);
+  playback->stream = remix_stream_new_contiguous (env, playback->block);
+
+  if (playback->buffer_length < 2 * playback->block)
+    playback->buffer_length = DEFAULT_BLOCKS * playback->block;
+
+  for (length = 1; length < playback->buffer_length; length <<= 1);
+
+  if (playback->ring) remix_free (playback->ring);
+  playback->ring = remix_malloc (length * playback->nr_channels *
+				 sizeof (short));
+  playback->ring_length = length;
+
+  if (playback->period) remix_free (playback->period);
+  playback->period = remix_malloc (playback->block * playback->nr_channels *
+				   sizeof (short));
+
+  for (s = channels, c = 0; s && c < playback->nr_channels;
+       s = s->next, c++)
+    playback->channel_names[c] = s->key;
+
+  remix_converter_destroy (env, playback->converter);
+  playback->converter = remix_converter_new (env, REMIX_FORMAT_S16,
+					     playback->dither,
+					     playback->nr_channels);
+
+  playback->written = playback->played = 0;
+
+  return base;
+}
+
+/*
+ * remix_playback_new_device (env, source)
+ *
+ * Creates a playback of 'source' with no device yet, for the current
+ * channels, samplerate and mixlength of 'env'.
+ */
+static RemixPlayback *
+remix_playback_new_device (RemixEnv * env, RemixBase * source)
+{
+  RemixPlayback * playback;
+
+  if (source == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_NOENTITY);
+    return RemixNone;
+  }
+
+  playback = (RemixPlayback *)
+    remix_base_new_subclass (env, sizeof (struct _RemixPlayback));
+  playback->source = source;
+  playback->fd = -1;
+  playback->nr_channels = cd_set_size (env, remix_get_channels (env));
+  playback->channel_names = remix_malloc (playback->nr_channels *
+					  sizeof (int));
+  playback->planes = remix_malloc (playback->nr_channels *
+				   sizeof (RemixPCM *));
+  playback->dither = REMIX_DITHER_TPDF;
+
+  remix_playback_optimise (env, playback);
+
+  return playback;
+}
+
+/*
+ * remix_playback_new (env, source, device)
+ *
+ * Creates a playback of 'source' on the OSS device at path 'device', or
+ * on the default device if 'device' is NULL.
+ */
+RemixPlayback *
+remix_playback_new (RemixEnv * env, RemixBase * source, char * device)
+{
+  RemixPlayback * playback = remix_playback_new_device (env, source);
+
+  if (playback == RemixNone) return RemixNone;
+
+  playback->device_type = REMIX_DEVICE_OSS;
+  if (remix_playback_open_oss (env, playback, device) == -1) {
+    remix_destroy (env, (RemixBase *)playback);
+    return RemixNone;
+  }
+
+  return playback;
+}
+
+/*
+ * remix_playback_new_file (env, source, fd, speed)
+ *
+ * Creates a playback of 'source' which writes interleaved, native endian
+ * 16 bit frames to the file descriptor 'fd'. The descriptor is consumed
+ * at 'speed' times the samplerate by a simulated clock, or as fast as it
+ * can be written if 'speed' is 0. The descriptor is not closed when the
+ * playback is destroyed.
+ */
+RemixPlayback *
+remix_playback_new_file (RemixEnv * env, RemixBase * source, int fd,
+			 double speed)
+{
+  RemixPlayback * playback = remix_playback_new_device (env, source);
+
+  if (playback == RemixNone) return RemixNone;
+
+  playback->device_type = REMIX_DEVICE_FILE;
+  playback->fd = fd;
+  playback->speed = speed;
+
+  return playback;
+}
+
+static int
+remix_playback_destroy (RemixEnv * env, RemixBase * base)
+{
+  RemixPlayback * playback = (RemixPlayback *)base;
+
+  remix_playback_stop (env, playback);
+
+  if (playback->render_env) remix_purge (playback->render_env);
+  if (playback->stream) remix_destroy (env, (RemixBase *)playback->stream);
+  if (playback->device_type == REMIX_DEVICE_OSS && playback->fd != -1)
+    close (playback->fd);
+  if (playback->ring) remix_free (playback->ring);
+  if (playback->period) remix_free (playback->period);
+  remix_converter_destroy (env, playback->converter);
+  remix_free (playback->channel_names);
+  remix_free (playback->planes);
+  remix_free (playback);
+
+  return 0;
+}
+
+static RemixCount
+remix_playback_length (RemixEnv * env, RemixBase * base)
+{
+  RemixPlayback * playback = (RemixPlayback *)base;
+  return remix_length (env, playback->source);
+}
+
+/*
+ * remix_playback_set_buffer_length (env, playback, length)
+ *
+ * Sets the number of frames rendered ahead of the device, which takes
+ * effect when playback next starts. Returns the previous length.
+ */
+RemixCount
+remix_playback_set_buffer_length (RemixEnv * env, RemixPlayback * playback,
+				  RemixCount length)
+{
+  RemixCount old = playback->buffer_length;
+  playback->buffer_length = length;
+  return old;
+}
+
+RemixCount
+remix_playback_get_buffer_length (RemixEnv * env, RemixPlayback * playback)
+{
+  return playback->buffer_length;
+}
+
+/*
+ * remix_playback_set_dither (env, playback, dither)
+ *
+ * Sets the dither used in converting to 16 bit, which takes effect when
+ * playback next starts. The default is REMIX_DITHER_TPDF. Returns the
+ * previous dither.
+ */
+RemixDither
+remix_playback_set_dither (RemixEnv * env, RemixPlayback * playback,
+			   RemixDither dither)
+{
+  RemixDither old = playback->dither;
+  playback->dither = dither;
+  return old;
+}
+
+RemixDither
+remix_playback_get_dither (RemixEnv * env, RemixPlayback * playback)
+{
+  return playback->dither;
+}
+
+/*
+ * remix_playback_start (env, playback)
+ *
+ * Prepares the source, then starts the render and device threads.
+ * Returns 0 on success, or -1 on error.
+ */
+int
+remix_playback_start (RemixEnv * env, RemixPlayback * playback)
+{
+#ifdef HAVE_PTHREAD
+  if (playback->running) return 0;
+
+  if (playback->render_env == RemixNone)
+    playback->render_env = remix_init_clone (env);
+
+  remix_prepare (env, (RemixBase *)playback);
+  remix_prepare (playback->render_env, playback->source);
+
+  playback->written = playback->played = 0;
+  playback->ended = FALSE;
+  playback->running = TRUE;
+  playback->playing = TRUE;
+
+  if (pthread_create (&playback->render_thread, NULL,
+		      remix_playback_render_thread, playback) != 0) {
+    playback->running = playback->playing = FALSE;
+    remix_set_error (env, REMIX_ERROR_SYSTEM);
+    return -1;
+  }
+
+  if (pthread_create (&playback->device_thread, NULL,
+		      remix_playback_device_thread, playback) != 0) {
+    _remix_store_release (&playback->running, FALSE);
+    pthread_join (playback->render_thread, NULL);
+    playback->playing = FALSE;
+    remix_set_error (env, REMIX_ERROR_SYSTEM);
+    return -1;
+  }
+
+  return 0;
+#else
+  remix_set_error (env, REMIX_ERROR_SYSTEM);
+  return -1;
+#endif
+}
+
+/*
+ * remix_playback_stop (env, playback)
+ *
+ * Stops rendering and playing immediately; frames still in the ring are
+ * discarded, and the source remains positioned after the last frame
+ * rendered.
+ */
+int
+remix_playback_stop (RemixEnv * env, RemixPlayback * playback)
+{
+#ifdef HAVE_PTHREAD
+  if (!playback->running) return 0;
+
+  _remix_store_release (&playback->running, FALSE);
+  pthread_join (playback->render_thread, NULL);
+  pthread_join (playback->device_thread, NULL);
+  playback->playing = FALSE;
+#endif
+
+  return 0;
+}
+
+/*
+ * remix_playback_is_playing (env, playback)
+ *
+ * Returns whether the device is still being written; this becomes false
+ * once all of the source has been played.
+ */
+int
+remix_playback_is_playing (RemixEnv * env, RemixPlayback * playback)
+{
+  return _remix_load_acquire (&playback->playing);
+}
+
+/*
+ * remix_playback_get_env (env, playback)
+ *
+ * Returns the env in which the source is rendered, to which live edits
+ * should be posted with remix_post() once playback has started.
+ */
+RemixEnv *
+remix_playback_get_env (RemixEnv * env, RemixPlayback * playback)
+{
+  return playback->render_env;
+}
+
+/*
+ * remix_playback_get_xruns (env, playback)
+ *
+ * Returns the number of periods the device needed before they were
+ * rendered.
+ */
+RemixCount
+remix_playback_get_xruns (RemixEnv * env, RemixPlayback * playback)
+{
+  return _remix_load_acquire (&playback->xruns);
+}
+
+/*
+ * remix_playback_get_fill (env, playback)
+ *
+ * Returns the number of frames rendered but not yet taken by the device.
+ */
+RemixCount
+remix_playback_get_fill (RemixEnv * env, RemixPlayback * playback)
+{
+  return _remix_load_acquire (&playback->written) -
+    _remix_load_acquire (&playback->played);
+}
+
+/*
+ * remix_playback_get_latency (env, playback)
+ *
+ * Returns the latency last measured by the device thread, in frames:
+ * the number of frames rendered but not yet audible when the device
+ * took its latest period.
+ */
+RemixCount
+remix_playback_get_latency (RemixEnv * env, RemixPlayback * playback)
+{
+  return _remix_load_acquire (&playback->latency);
+}
+
+/*
+ * remix_playback_get_played (env, playback)
+ *
+ * Returns the number of frames taken from the ring by the device since
+ * playback last started.
+ */
+RemixCount
+remix_playback_get_played (RemixEnv * env, RemixPlayback * playback)
+{
+  return _remix_load_acquire (&playback->played);
+}
+
+static struct _RemixMethods _remix_playback_methods = {
+  NULL,                      /* clone */
+  remix_playback_destroy,    /* destroy */
+  NULL,                      /* ready */
+  remix_playback_prepare,    /* prepare */
+  NULL,                      /* process */
+  remix_playback_length,     /* length */
+  NULL,                      /* seek */
+  NULL,                      /* flush */
+};
+
+static RemixPlayback *
+remix_playback_optimise (RemixEnv * env, RemixPlayback * playback)
+{
+  _remix_set_methods (env, (RemixBase *)playback, &_remix_playback_methods);
+  return playback;
+}
@@ -43,6 +43,9 @@
 
 static CDList * modules_list = CD_EMPTY_LIST;
 
+/* Worlds sharing the loaded modules, which are unloaded with the last */
+static int modules_users = 0;
+
 static CDList *
 remix_plugin_initialise_static (RemixEnv * env)
 {
@@ -138,6 +141,8 @@ remix_plugin_defaults_initialise (RemixEnv * env)
 {
   CDList * plugins = cd_list_new (env);
 
+  modules_users++;
+
   plugins = cd_list_join (env, plugins, remix_plugin_initialise_static (env));
   plugins = cd_list_join (env, plugins, remix_plugin_initialise_dynamic (env));
 
@@ -163,7 +168,7 @@ remix_plugin_unload (RemixEnv * env, void * module)
 void
 remix_plugin_defaults_unload (RemixEnv * env)
 {
-  CDList * l;
+  if (--modules_users > 0) return;
 
   modules_list = cd_list_destroy_with (env, modules_list, (CDDestroyFunc)remix_plugin_unload);
 }
@@ -0,0 +1,247 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixChunkPool: recycled, aligned buffers for chunk data.
+ *
+ * Description
+ * -----------
+ *
+ * Each world owns a pool from which remix_chunk_new() and copy-on-write
+ * unsharing take chunk data. Buffers are REMIX_CHUNK_ALIGNMENT aligned,
+ * so that vector kernels can use aligned accesses on the body of a chunk.
+ *
+ * Buffer sizes are rounded up to a power of two number of samples, and
+ * freed buffers are kept on a free list per size class to be handed out
+ * again, rather than going back to the system allocator each time a
+ * stream is rebuilt.
+ *
+ * Invariants
+ * ----------
+ *
+ * Buffers from the pool are not zeroed.
+ *
+ * Each size class retains at most REMIX_CHUNK_POOL_RETAIN bytes of free
+ * buffers; beyond that, and for buffers longer than the largest class,
+ * freed buffers go straight back to the system.
+ *
+ * The pool may be used from several threads at once.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define __REMIX__
+#include "remix.h"
+
+/* Smallest class: 2^REMIX_CHUNK_POOL_MIN_SHIFT samples */
+#define REMIX_CHUNK_POOL_MIN_SHIFT 6
+
+/* Largest class: 2^(REMIX_CHUNK_POOL_MIN_SHIFT+REMIX_CHUNK_POOL_CLASSES-1) */
+#define REMIX_CHUNK_POOL_CLASSES 15
+
+/* Maximum bytes of free buffers kept in each class */
+#define REMIX_CHUNK_POOL_RETAIN (4 * 1024 * 1024)
+
+typedef struct _RemixFreeBuffer RemixFreeBuffer;
+
+/* Free buffers are linked through their own data */
+struct _RemixFreeBuffer {
+  RemixFreeBuffer * next;
+};
+
+struct _RemixChunkPool {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif
+  RemixFreeBuffer * free[REMIX_CHUNK_POOL_CLASSES];
+  int nr_free[REMIX_CHUNK_POOL_CLASSES];
+};
+
+static void *
+remix_aligned_alloc (size_t size)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+  void * p;
+
+  if (posix_memalign (&p, REMIX_CHUNK_ALIGNMENT, size) != 0) return NULL;
+  return p;
+#else
+  char * base, * p;
+
+  /* Keep the malloc'd address just below the aligned one */
+  base = (char *) malloc (size + REMIX_CHUNK_ALIGNMENT);
+  if (base == NULL) return NULL;
+  p = base + REMIX_CHUNK_ALIGNMENT - ((size_t)base % REMIX_CHUNK_ALIGNMENT);
+  ((void **)p)[-1] = base;
+  return p;
+#endif
+}
+
+static void
+remix_aligned_free (void * p)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+  free (p);
+#else
+  if (p != NULL) free (((void **)p)[-1]);
+#endif
+}
+
+/*
+ * remix_chunk_pool_class (length)
+ *
+ * Returns the size class for buffers of 'length' samples, or
+ * REMIX_CHUNK_POOL_CLASSES if they are too long to pool.
+ */
+static int
+remix_chunk_pool_class (RemixCount length)
+{
+  int c = 0;
+
+  while (c < REMIX_CHUNK_POOL_CLASSES &&
+	 ((RemixCount)1 << (REMIX_CHUNK_POOL_MIN_SHIFT + c)) < length)
+    c++;
+
+  return c;
+}
+
+static size_t
+remix_chunk_pool_class_size (int c)
+{
+  return ((size_t)1 << (REMIX_CHUNK_POOL_MIN_SHIFT + c)) * sizeof (RemixPCM);
+}
+
+void
+_remix_chunk_pool_init (RemixEnv * env)
+{
+  RemixChunkPool * pool;
+
+  pool = (RemixChunkPool *) remix_malloc (sizeof (struct _RemixChunkPool));
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init (&pool->lock, NULL);
+#endif
+
+  env->world->_chunk_pool = pool;
+}
+
+void
+_remix_chunk_pool_destroy (RemixEnv * env)
+{
+  RemixChunkPool * pool = env->world->_chunk_pool;
+  RemixFreeBuffer * b, * next;
+  int c;
+
+  if (pool == RemixNone) return;
+
+  for (c = 0; c < REMIX_CHUNK_POOL_CLASSES; c++) {
+    for (b = pool->free[c]; b; b = next) {
+      next = b->next;
+      remix_aligned_free (b);
+    }
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy (&pool->lock);
+#endif
+  remix_free (pool);
+
+  env->world->_chunk_pool = RemixNone;
+}
+
+/*
+ * _remix_chunk_pool_alloc (env, length)
+ *
+ * Returns an uninitialised, REMIX_CHUNK_ALIGNMENT aligned buffer of at
+ * least 'length' samples. It must be returned with
+ * _remix_chunk_pool_free() giving the same length.
+ */
+RemixPCM *
+_remix_chunk_pool_alloc (RemixEnv * env, RemixCount length)
+{
+  RemixChunkPool * pool = env->world->_chunk_pool;
+  RemixFreeBuffer * b = NULL;
+  int c = remix_chunk_pool_class (length);
+
+  _remix_alloc_check ();
+
+  if (c == REMIX_CHUNK_POOL_CLASSES)
+    return (RemixPCM *) remix_aligned_alloc (length * sizeof (RemixPCM));
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock (&pool->lock);
+#endif
+  if ((b = pool->free[c]) != NULL) {
+    pool->free[c] = b->next;
+    pool->nr_free[c]--;
+  }
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock (&pool->lock);
+#endif
+
+  if (b == NULL) {
+    b = (RemixFreeBuffer *)
+      remix_aligned_alloc (remix_chunk_pool_class_size (c));
+  }
+
+  return (RemixPCM *)b;
+}
+
+/*
+ * _remix_chunk_pool_free (env, data, length)
+ *
+ * Returns the buffer 'data' of 'length' samples to the pool.
+ */
+void
+_remix_chunk_pool_free (RemixEnv * env, RemixPCM * data, RemixCount length)
+{
+  RemixChunkPool * pool = env->world->_chunk_pool;
+  RemixFreeBuffer * b = (RemixFreeBuffer *)data;
+  int c = remix_chunk_pool_class (length);
+
+  if (data == NULL) return;
+
+  _remix_alloc_check ();
+
+  if (c < REMIX_CHUNK_POOL_CLASSES) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock (&pool->lock);
+#endif
+    if ((pool->nr_free[c] + 1) * remix_chunk_pool_class_size (c) <=
+	REMIX_CHUNK_POOL_RETAIN) {
+      b->next = pool->free[c];
+      pool->free[c] = b;
+      pool->nr_free[c]++;
+      b = NULL;
+    }
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock (&pool->lock);
+#endif
+  }
+
+  if (b != NULL) remix_aligned_free (b);
+}
@@ -51,6 +51,14 @@
 typedef struct _RemixThreadContext RemixThreadContext;
 typedef struct _RemixWorld RemixWorld;
 typedef struct _RemixContext RemixContext;
+typedef struct _RemixThreadPool RemixThreadPool;
+typedef struct _RemixChunkPool RemixChunkPool;
+typedef struct _RemixIOThread RemixIOThread;
+typedef struct _RemixReadAhead RemixReadAhead;
+typedef struct _RemixPageCache RemixPageCache;
+typedef struct _RemixPageFile RemixPageFile;
+typedef struct _RemixPage RemixPage;
+typedef struct _RemixCommandQueue RemixCommandQueue;
 
 typedef RemixThreadContext RemixEnv;
 
@@ -69,6 +77,9 @@ struct _RemixThreadContext {
   RemixError last_error;
   RemixContext * context;
   RemixWorld * world;
+  RemixCommandQueue * _commands; /* posted edits, or NULL */
+  RemixCommandQueue * _retired; /* bases awaiting reclamation, or NULL */
+  int _process_depth; /* nesting of remix_process() calls */
 };
 
 struct _RemixWorld {
@@ -76,6 +87,12 @@ struct _RemixWorld {
   CDList * plugins;
   CDList * bases;
   int purging;
+  RemixThreadPool * _pool; /* deck worker threads, or NULL */
+  RemixChunkPool * _chunk_pool; /* recycled chunk data buffers */
+  RemixCount _read_ahead; /* frames decoded ahead by file readers, or 0 */
+  RemixIOThread * _io; /* decodes for file readers, or NULL */
+  RemixPageCache * _page_cache; /* decoded audio shared by file readers */
+  unsigned int _graph_serial; /* bumped by each edit to any deck's tracks */
 };
 
 struct _RemixContext {
@@ -92,6 +109,11 @@ struct _RemixBase {
   RemixCount offset; /* current position */
   RemixContext context_limit;
   void * instance_data;
+  CDList * _world_item; /* entry in world->bases */
+  /* Set by decks to find bases shared between their tracks */
+  RemixDeck * _reach_deck;
+  unsigned int _reach_serial;
+  int _reach_track;
 };
 
 struct _RemixPoint {
@@ -103,9 +125,18 @@ struct _RemixEnvelope {
   RemixBase base;
   RemixEnvelopeType type;
   RemixTimeType timetype;
-  CDList * points;
-  CDList * _current_point_item;
+  RemixPoint ** points; /* sorted by time */
+  int nr_points;
+  int _max_points;
+  RemixCount * _samples; /* cached sample position of each point */
+  int _samples_valid;
+  RemixSamplerate _samples_samplerate; /* samplerate of _samples */
+  RemixTempo _samples_tempo; /* tempo of _samples */
+  RemixPCM * _coeffs; /* cubic coefficients of each spline segment */
+  int _coeffs_valid;
+  int _current_point; /* index of current point, or -1 */
   RemixCount _current_offset;
+  RemixCount _output_offset; /* output stream offset at _current_offset */
 };
 
 /* XXX: multichannel envelopes ? */
@@ -117,15 +148,31 @@ struct _RemixStream {
 };
 
 struct _RemixChannel {
-  CDList * chunks;
+  RemixChunk ** chunks; /* sorted by start_index; later chunks win overlaps */
+  RemixCount * _valid_lengths; /* visible length of each chunk */
+  int nr_chunks;
+  int _max_chunks;
   RemixCount _current_offset;
-  CDList * _current_chunk;
+  int _current_chunk; /* index of chunk at _current_offset, or -1 */
 };
 
 struct _RemixDeck {
   RemixBase base;
   CDList * tracks;
-  RemixStream * _mixstream;
+  CDList * _mixstreams; /* one per track, in the same order as tracks */
+  RemixPCM * _gains;
+  int _nr_mixstreams;
+  /* Per-block render job, indexed by track */
+  RemixTrack ** _trackv;
+  RemixStream ** _mixstreamv;
+  RemixCount * _counts;
+  RemixError * _errors; /* set by each track's render, or REMIX_ERROR_OK */
+  RemixStream * _input;
+  RemixCount _input_offset;
+  RemixCount _block;
+  unsigned int _reach_serial; /* bumped by each remix_deck_shared() */
+  int _shared; /* last remix_deck_shared() result, or -1 if unknown */
+  unsigned int _shared_serial; /* world _graph_serial when _shared was found */
 };
 
 struct _RemixTrack {
@@ -141,9 +188,11 @@ struct _RemixLayer {
   RemixBase base;
   RemixTrack * track;
   RemixTimeType timetype;
-  CDList * sounds;
+  RemixSound ** sounds; /* sorted by start_time */
+  int nr_sounds;
+  int _max_sounds;
   /*RemixTime _current_time;*/
-  CDList * _current_sound_item;
+  int _current_sound; /* index of current sound, or -1 */
   RemixTempo _current_tempo;
   RemixCount _current_offset;
 };
@@ -151,6 +200,7 @@ struct _RemixLayer {
 struct _RemixSound {
   RemixBase base;
   RemixBase * source;
+  RemixBase * _cursor; /* reads source for this sound; see remix_cursor_new() */
   RemixBase * rate_envelope;
   RemixBase * gain_envelope;
   RemixBase * blend_envelope;
@@ -160,12 +210,23 @@ struct _RemixSound {
   RemixCount cutin;  /* start offset into sound source */
   RemixCount cutlength;
   RemixCount _current_source_offset;
+  int _layer_index; /* position in layer->sounds */
+  RemixResampleQuality rate_quality;
+  double _rate_position; /* source position (from cutin) at _rate_offset */
+  RemixCount _rate_offset; /* sound offset at which _rate_position holds */
+  RemixStream * _rate_srcstream; /* window of source data */
+  RemixCount _rate_src_start; /* source position (from cutin) of window */
+  int * _rate_index; /* per output sample: window index ... */
+  RemixPCM * _rate_frac; /* ... and fractional position */
+  RemixCount _rate_output_offset;
   RemixStream * _rate_envstream;
   RemixStream * _gain_envstream;
   RemixStream * _blend_envstream;
 };
 
 typedef struct _RemixMonitor RemixMonitor;
+typedef struct _RemixPlayback RemixPlayback;
+typedef struct _RemixConverter RemixConverter;
 
 #define REMIX_MONITOR_BUFFERLEN 2048
 
@@ -181,6 +242,7 @@ struct _RemixMonitor {
   int frequency;
   int numfrags;
   int fragsize;
+  RemixConverter * converter;
 };
 
 #define _remix_time_zero(t) (RemixTime)\
@@ -266,12 +328,27 @@ struct _RemixMonitor {
 
 
 /* util */
-#define remix_malloc(x) calloc(1, x)
-#define remix_free free
+#define remix_malloc(x) _remix_malloc(x)
+#define remix_free _remix_free
+
+/* Counters shared between one writing and one reading thread */
+#if defined (__GNUC__)
+#define _remix_load_acquire(p) __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define _remix_store_release(p,v) __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#else
+#define _remix_load_acquire(p) (*(p))
+#define _remix_store_release(p,v) (*(p) = (v))
+#endif
 
 /* debug */
+void remix_debug_init (void);
 void remix_debug_down (void);
 void remix_debug_up (void);
+void _remix_process_enter (void);
+void _remix_process_leave (void);
+void _remix_alloc_check (void);
+void * _remix_malloc (size_t size);
+void _remix_free (void * ptr);
 
 /* RemixEnv, remix_context */
 
@@ -284,11 +361,64 @@ RemixEnv * _remix_unregister_plugin (RemixEnv * env, RemixPlugin * plugin);
 RemixEnv * _remix_register_base (RemixEnv * env, RemixBase * base);
 RemixEnv * _remix_unregister_base (RemixEnv * env, RemixBase * base);
 
+/* remix_thread */
+typedef void (*RemixTaskFunc) (RemixEnv * env, int task, void * data);
+
+int _remix_thread_pool_run (RemixEnv * env, RemixTaskFunc func, void * data,
+			    int nr_tasks);
+void _remix_thread_pool_destroy (RemixEnv * env);
+void _remix_world_lock (RemixEnv * env);
+void _remix_world_unlock (RemixEnv * env);
+
+/* remix_readahead */
+typedef RemixCount (*RemixReadAheadFunc) (void * data, RemixCount frame,
+					  RemixPCM * dest, RemixCount stride,
+					  RemixCount count);
+
+void _remix_io_thread_destroy (RemixEnv * env);
+RemixReadAhead * _remix_read_ahead_new (RemixEnv * env, int nr_channels,
+					RemixReadAheadFunc func, void * data);
+void _remix_read_ahead_destroy (RemixEnv * env, RemixReadAhead * ra);
+void _remix_read_ahead_position (RemixEnv * env, RemixReadAhead * ra,
+				 RemixCount frame);
+RemixCount _remix_read_ahead_read (RemixEnv * env, RemixReadAhead * ra,
+				   int channel, RemixCount frame,
+				   RemixPCM * dest, RemixCount count);
+
+/* remix_pagecache */
+void _remix_page_cache_init (RemixEnv * env);
+void _remix_page_cache_destroy (RemixEnv * env);
+RemixPageFile * _remix_page_file_open (RemixEnv * env, const char * path,
+				       int nr_channels);
+void _remix_page_file_close (RemixEnv * env, RemixPageFile * file);
+RemixCount _remix_page_cache_read (RemixPageCache * cache, RemixPageFile * file,
+				   RemixCount frame, RemixPCM * dest,
+				   RemixCount stride, RemixCount count,
+				   RemixReadAheadFunc func, void * data);
+RemixCount _remix_page_cache_map (RemixPageCache * cache, RemixPageFile * file,
+				  RemixCount frame, RemixPage ** page,
+				  RemixPCM ** channels, RemixReadAheadFunc func,
+				  void * data);
+void _remix_page_cache_unmap (RemixPageCache * cache, RemixPage * page);
+void _remix_page_cache_forget (RemixPageCache * cache, const char * path);
+
+/* remix_command */
+void _remix_commands_init (RemixEnv * env);
+void _remix_commands_destroy (RemixEnv * env);
+
+/* remix_pool */
+void _remix_chunk_pool_init (RemixEnv * env);
+void _remix_chunk_pool_destroy (RemixEnv * env);
+RemixPCM * _remix_chunk_pool_alloc (RemixEnv * env, RemixCount length);
+void _remix_chunk_pool_free (RemixEnv * env, RemixPCM * data,
+			     RemixCount length);
+
 /* remix_plugin */
 void remix_plugin_defaults_initialise (RemixEnv * env);
 void remix_plugin_defaults_unload (RemixEnv * env);
 
 /* remix_deck */
+void _remix_deck_graph_changed (RemixEnv * env);
 RemixTrack * _remix_deck_add_track (RemixEnv * env, RemixDeck * deck,
 				    RemixTrack * track);
 RemixTrack * _remix_deck_remove_track (RemixEnv * env, RemixDeck * deck,
@@ -296,6 +426,8 @@ RemixTrack * _remix_deck_remove_track (RemixEnv * env, RemixDeck * deck,
 
 /* remix_track */
 RemixBase * remix_track_clone (RemixEnv * env, RemixBase * base);
+RemixBase * remix_track_clone_with_deck (RemixEnv * env, RemixBase * base,
+					 RemixDeck * new_deck);
 RemixLayer * _remix_track_add_layer_above (RemixEnv * env, RemixTrack * track,
 				     RemixLayer * layer, RemixLayer * above);
 RemixLayer * _remix_track_remove_layer (RemixEnv * env, RemixTrack * track,
@@ -308,6 +440,8 @@ RemixLayer * _remix_track_get_layer_below (RemixEnv * env, RemixTrack * track,
 /* remix_layer */
 RemixLayer * _remix_remove_layer (RemixEnv * env, RemixLayer * layer);
 RemixBase * remix_layer_clone (RemixEnv * env, RemixBase * base);
+RemixBase * remix_layer_clone_with_track (RemixEnv * env, RemixBase * base,
+					  RemixTrack * new_track);
 RemixSound * _remix_layer_add_sound (RemixEnv * env, RemixLayer * layer,
 				     RemixSound * sound, RemixTime position);
 RemixSound * _remix_layer_remove_sound (RemixEnv * env, RemixLayer * layer,
@@ -320,10 +454,24 @@ RemixSound * _remix_layer_get_sound_next (RemixEnv * env, RemixLayer * layer,
 /* remix_sound */
 RemixBase *  remix_sound_clone_with_layer (RemixEnv * env, RemixBase * base,
 					   RemixLayer * new_layer);
+RemixSound * _remix_sound_new_unplaced (RemixEnv * env, RemixBase * source,
+					RemixLayer * layer,
+					RemixTime start_time,
+					RemixTime duration);
 int remix_sound_later (RemixEnv * env, RemixSound * s1, RemixSound * s2);
 
 /* remix_envelope */
 RemixBase * remix_envelope_clone (RemixEnv * env, RemixBase * base);
+int _remix_is_envelope (RemixEnv * env, RemixBase * base);
+double _remix_envelope_sum (RemixEnv * env, RemixEnvelope * envelope,
+			    RemixCount x1, RemixCount x2);
+void _remix_envelope_prepare (RemixEnv * env, RemixEnvelope * envelope);
+RemixCount _remix_envelope_segment (RemixEnv * env, RemixEnvelope * envelope,
+				    RemixCount pos, RemixCount remaining,
+				    int * current, RemixPCM * c, RemixPCM * s,
+				    RemixPCM * ds);
+void _remix_envelope_advance (RemixEnv * env, RemixEnvelope * envelope,
+			      RemixCount count);
 
 
 /* remix_channel */
@@ -344,6 +492,8 @@ RemixCount remix_channel_write0 (RemixEnv * env, RemixChannel * channel,
 RemixCount _remix_channel_write (RemixEnv * env, RemixChannel * channel,
 				 RemixCount count, RemixChannel * data);
 RemixCount _remix_channel_length (RemixEnv * env, RemixChannel * channel);
+void _remix_channel_view (RemixEnv * env, RemixChannel * view,
+			 RemixChannel * channel);
 RemixCount _remix_channel_seek (RemixEnv * env, RemixChannel * channel,
 				RemixCount offset);
 
@@ -355,9 +505,33 @@ RemixCount remix_channel_deinterleave_2 (RemixEnv * env,
 					 RemixChannel * dest1,
 					 RemixChannel * dest2,
 					 RemixPCM * src, RemixCount count);
+/* Maximum number of channels interleaved by remix_channels_interleave() */
+#define REMIX_INTERLEAVE_MAX 16
+
+RemixCount remix_channels_interleave (RemixEnv * env, RemixChannel ** srcs,
+				      int nr_channels, RemixPCM * dest,
+				      RemixCount count);
+int _remix_channel_is_silent (RemixEnv * env, RemixChannel * channel,
+			      RemixCount offset, RemixCount count);
 RemixCount remix_channel_mix (RemixEnv * env, RemixChannel * src,
 			      RemixChannel * dest, RemixCount count);
+/* Maximum number of sources summed by one remix_channel_mix_gains() */
+#define REMIX_MIX_GROUP 16
+
+RemixCount remix_channel_mix_gains (RemixEnv * env, RemixChannel ** srcs,
+				    RemixPCM * gains, int nr_srcs,
+				    RemixChannel * dest, RemixCount count,
+				    int accumulate);
+
 
+/* remix_stream */
+int _remix_stream_fits (RemixEnv * env, RemixStream * stream,
+			RemixCount length);
+RemixStream * _remix_stream_ensure_contiguous (RemixEnv * env,
+					       RemixStream * stream,
+					       RemixCount length);
+int _remix_stream_is_silent (RemixEnv * env, RemixStream * stream,
+			     RemixCount offset, RemixCount count);
 
 /* remix_channelset */
 void remix_channelset_defaults_initialise (RemixEnv * env);
@@ -372,6 +546,7 @@ RemixChunk * remix_chunk_new_from_buffer (RemixEnv * env,
 					  RemixPCM * buffer);
 RemixChunk * remix_chunk_clone (RemixEnv * env, RemixChunk * chunk);
 void remix_chunk_free (RemixEnv * env, RemixChunk * chunk);
+RemixChunk * _remix_chunk_realise (RemixEnv * env, RemixChunk * chunk);
 RemixCount _remix_chunk_clear_region (RemixEnv * env, RemixChunk * chunk,
 				      RemixCount start, RemixCount length,
 				      int channelname, void * unused);
@@ -423,6 +598,89 @@ RemixCount _remix_chunk_blend_inplace (RemixEnv * env,
 				       RemixCount count,
 				       int channelname, void * unused);
 
+/* remix_pcm */
+
+/*
+ * RemixPCMKernels: one implementation of each of the hot per-sample
+ * loops of remix_pcm.c. The _remix_pcm_* functions dispatch through
+ * the table chosen by remix_pcm_init_kernels().
+ */
+typedef struct _RemixPCMKernels RemixPCMKernels;
+
+struct _RemixPCMKernels {
+  char * name;
+  RemixCount (*set) (RemixPCM * data, RemixPCM value, RemixCount count);
+  RemixCount (*ramp) (RemixPCM * data, RemixPCM value, RemixPCM gradient,
+		      RemixCount count);
+  RemixCount (*cubic) (RemixPCM * data, RemixPCM * coeffs, RemixPCM s,
+		       RemixPCM ds, RemixCount count);
+  RemixCount (*mult_cubic) (RemixPCM * data, RemixPCM * coeffs, RemixPCM s,
+			    RemixPCM ds, RemixCount count);
+  RemixCount (*blend_cubic) (RemixPCM * src, RemixPCM * dest,
+			     RemixPCM * coeffs, RemixPCM s, RemixPCM ds,
+			     RemixCount count);
+  RemixCount (*copy_mult_cubic) (RemixPCM * src, RemixPCM * dest,
+				 RemixPCM * coeffs, RemixPCM s, RemixPCM ds,
+				 RemixCount count);
+  RemixCount (*mult_blend_cubic) (RemixPCM * src, RemixPCM * dest,
+				  RemixPCM * gain, RemixPCM gs, RemixPCM gds,
+				  RemixPCM * blend, RemixPCM bs, RemixPCM bds,
+				  RemixCount count);
+  RemixCount (*gain) (RemixPCM * data, RemixCount count, void * gain);
+  RemixCount (*add) (RemixPCM * src, RemixPCM * dest, RemixCount count,
+		     void * unused);
+  RemixCount (*mult) (RemixPCM * src, RemixPCM * dest, RemixCount count,
+		      void * unused);
+  RemixCount (*fade) (RemixPCM * src, RemixPCM * dest, RemixCount count,
+		      void * unused);
+  RemixCount (*interleave_2) (RemixPCM * src1, RemixPCM * src2,
+			      RemixCount count, void * dest);
+  RemixCount (*deinterleave_2) (RemixPCM * dest1, RemixPCM * dest2,
+				RemixCount count, void * src);
+  RemixCount (*interleave) (RemixPCM ** srcs, int nr_channels,
+			    RemixCount count, RemixPCM * dest);
+  RemixCount (*deinterleave) (RemixPCM ** dests, int nr_channels,
+			      RemixCount count, RemixPCM * src);
+  RemixCount (*blend) (RemixPCM * src, RemixPCM * blend, RemixPCM * dest,
+		       RemixCount count, void * unused);
+  RemixCount (*mix_gains) (RemixPCM ** srcs, RemixPCM * gains, int nr_srcs,
+			   RemixPCM * dest, RemixCount count, int accumulate);
+  RemixCount (*resample_linear) (RemixPCM * src, int * index, RemixPCM * frac,
+				 RemixPCM * dest, RemixCount count);
+  RemixCount (*resample_cubic) (RemixPCM * src, int * index, RemixPCM * frac,
+				RemixPCM * dest, RemixCount count);
+  RemixCount (*resample_sinc) (RemixPCM * src, int * index, RemixPCM * frac,
+			       RemixPCM * dest, RemixCount count);
+  RemixCount (*quantise) (RemixPCM * src, RemixPCM * dither, int * dest,
+			  RemixCount count, RemixPCM scale, RemixPCM max);
+};
+
+/*
+ * Windowed sinc interpolation: REMIX_SINC_TAPS source samples around
+ * each output sample, from (REMIX_SINC_TAPS/2 - 1) before to
+ * REMIX_SINC_TAPS/2 after. The filter is tabulated at REMIX_SINC_PHASES
+ * (+1, for interpolating) fractional positions, stored tap-major: the
+ * coefficient for tap t at phase p is
+ * _remix_pcm_sinc_table[t * (REMIX_SINC_PHASES + 1) + p].
+ */
+#define REMIX_SINC_TAPS 16
+#define REMIX_SINC_PHASES 256
+
+extern RemixPCM _remix_pcm_sinc_table[];
+
+/* Vector variants are built with per-function target attributes */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define REMIX_PCM_X86
+extern RemixPCMKernels _remix_pcm_sse2_kernels;
+extern RemixPCMKernels _remix_pcm_avx2_kernels;
+extern RemixPCMKernels _remix_pcm_avx512_kernels;
+#endif
+
+void remix_pcm_init_kernels (void);
+RemixPCMKernels * remix_pcm_get_kernels (void);
+
 /* XXX: remove these when dynamic! */
 CDList * __gain_init (RemixEnv * env);
 CDList * __sndfile_init (RemixEnv * env);
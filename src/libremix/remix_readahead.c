@@ -0,0 +1,431 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixReadAhead: decoding of file sources ahead of rendering.
+ *
+ * Description
+ * -----------
+ *
+ * When read-ahead is enabled with remix_set_read_ahead(), file readers
+ * created afterwards each register a RemixReadAhead with their world's
+ * I/O thread. The I/O thread decodes each reader's frames, through the
+ * reader's RemixReadAheadFunc, into a planar ring of that many frames
+ * beyond the reader's current position, so that the rendering thread
+ * only copies decoded data and never waits on the disk.
+ *
+ * At the start of each block the rendering thread gives the frame it
+ * is about to read from with _remix_read_ahead_position(). Frames before
+ * it are released for reuse. If it lies outside the decoded region, as
+ * after a seek, the I/O thread is asked to start again from there; until
+ * it has, reads of the reader return nothing and the reader plays
+ * silence.
+ *
+ * Invariants
+ * ----------
+ *
+ * Each RemixReadAhead has one rendering thread at a time. It writes
+ * 'head' and the seek request, and the I/O thread writes 'tail' and
+ * 'seek_done'; neither takes a lock. Frames [head, tail) are decoded and
+ * valid whenever seek_done == seek_request.
+ *
+ * The I/O thread's list of read-aheads is protected by its lock. The
+ * I/O thread holds it only to step through the list, and marks the
+ * read-ahead it is decoding as 'filling' while it decodes without the
+ * lock. A read-ahead is not unlinked while it is being filled, so the
+ * I/O thread can carry on from its 'next' afterwards.
+ */
+
+#include <config.h>
+
+#include <time.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define __REMIX__
+#include "remix.h"
+
+/* Most frames decoded for one read-ahead before moving to the next */
+#define REMIX_READ_AHEAD_BLOCK 4096
+
+/* Time the I/O thread sleeps for when there is nothing to decode, in ns */
+#define REMIX_IO_IDLE 2000000
+
+#ifdef HAVE_PTHREAD
+
+struct _RemixReadAhead {
+  RemixReadAhead * next; /* in the I/O thread's list */
+  RemixReadAheadFunc func;
+  void * data;
+  int nr_channels;
+  RemixCount length; /* frames in the ring */
+  RemixPCM * ring; /* frame f of channel c is ring[c*length + f%length] */
+
+  /* Written by the rendering thread */
+  RemixCount head; /* first frame still needed */
+  RemixCount seek_frame;
+  unsigned int seek_request;
+  int misses;
+
+  /* Written by the I/O thread */
+  RemixCount tail; /* frame after the last one decoded */
+  unsigned int seek_done;
+  int eof;
+};
+
+struct _RemixIOThread {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t filled; /* signalled when 'filling' is cleared */
+  int shutdown;
+  RemixReadAhead * read_aheads;
+  RemixReadAhead * filling; /* decoded by the I/O thread, unlocked */
+};
+
+/*
+ * remix_read_ahead_fill (ra)
+ *
+ * Called by the I/O thread to act on any new seek request of 'ra', and
+ * then to decode up to REMIX_READ_AHEAD_BLOCK frames into its free
+ * space. Returns the number of frames decoded.
+ */
+static RemixCount
+remix_read_ahead_fill (RemixReadAhead * ra)
+{
+  unsigned int request = _remix_load_acquire (&ra->seek_request);
+  RemixCount tail, space, index, n;
+
+  if (request != ra->seek_done) {
+    ra->eof = FALSE;
+    _remix_store_release (&ra->tail, _remix_load_acquire (&ra->seek_frame));
+    _remix_store_release (&ra->seek_done, request);
+  }
+
+  if (ra->eof) return 0;
+
+  tail = ra->tail;
+  space = ra->length - (tail - _remix_load_acquire (&ra->head));
+  if (space <= 0) return 0;
+
+  /* Stop at the end of the ring; the next pass wraps around */
+  index = tail % ra->length;
+  n = MIN (space, REMIX_READ_AHEAD_BLOCK);
+  n = MIN (n, ra->length - index);
+
+  n = ra->func (ra->data, tail, &ra->ring[index], ra->length, n);
+  if (n <= 0) {
+    ra->eof = TRUE;
+    return 0;
+  }
+
+  _remix_store_release (&ra->tail, tail + n);
+
+  return n;
+}
+
+static void *
+remix_io_thread_main (void * arg)
+{
+  RemixIOThread * io = (RemixIOThread *)arg;
+  RemixReadAhead * ra;
+  RemixCount decoded;
+  struct timespec ts;
+
+  pthread_mutex_lock (&io->lock);
+
+  while (!io->shutdown) {
+    decoded = 0;
+    for (ra = io->read_aheads; ra; ra = ra->next) {
+      io->filling = ra;
+      pthread_mutex_unlock (&io->lock);
+
+      decoded += remix_read_ahead_fill (ra);
+
+      pthread_mutex_lock (&io->lock);
+      io->filling = RemixNone;
+      pthread_cond_broadcast (&io->filled);
+      if (io->shutdown) break;
+    }
+
+    if (decoded == 0) {
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_nsec += REMIX_IO_IDLE;
+      if (ts.tv_nsec >= 1000000000) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait (&io->wake, &io->lock, &ts);
+    }
+  }
+
+  pthread_mutex_unlock (&io->lock);
+
+  return NULL;
+}
+
+static RemixIOThread *
+remix_io_thread_new (RemixEnv * env)
+{
+  RemixIOThread * io;
+
+  io = (RemixIOThread *) remix_malloc (sizeof (struct _RemixIOThread));
+  pthread_mutex_init (&io->lock, NULL);
+  pthread_cond_init (&io->wake, NULL);
+  pthread_cond_init (&io->filled, NULL);
+  io->shutdown = FALSE;
+  io->read_aheads = RemixNone;
+  io->filling = RemixNone;
+
+  if (pthread_create (&io->thread, NULL, remix_io_thread_main, io) != 0) {
+    pthread_mutex_destroy (&io->lock);
+    pthread_cond_destroy (&io->wake);
+    pthread_cond_destroy (&io->filled);
+    remix_free (io);
+    return RemixNone;
+  }
+
+  return io;
+}
+
+void
+_remix_io_thread_destroy (RemixEnv * env)
+{
+  RemixIOThread * io = env->world->_io;
+
+  if (io == RemixNone) return;
+
+  pthread_mutex_lock (&io->lock);
+  io->shutdown = TRUE;
+  pthread_cond_signal (&io->wake);
+  pthread_mutex_unlock (&io->lock);
+
+  pthread_join (io->thread, NULL);
+
+  pthread_mutex_destroy (&io->lock);
+  pthread_cond_destroy (&io->wake);
+  pthread_cond_destroy (&io->filled);
+  remix_free (io);
+
+  env->world->_io = RemixNone;
+}
+
+/*
+ * _remix_read_ahead_new (env, nr_channels, func, data)
+ *
+ * Registers a reader of 'nr_channels' channels with the world's I/O
+ * thread, starting it if need be. The I/O thread calls
+ * func (data, frame, dest, stride, count) to decode up to 'count' frames
+ * from 'frame' into 'dest', frame i of channel c at dest[c*stride + i],
+ * which must return the number decoded, or 0 at the end of the file.
+ * Returns RemixNone if read-ahead is disabled or unavailable, in which
+ * case the reader should read synchronously.
+ */
+RemixReadAhead *
+_remix_read_ahead_new (RemixEnv * env, int nr_channels,
+		       RemixReadAheadFunc func, void * data)
+{
+  RemixWorld * world = env->world;
+  RemixReadAhead * ra;
+  RemixIOThread * io;
+
+  if (world->_read_ahead <= 0)
+    return RemixNone;
+
+  if (world->_io == RemixNone) {
+    world->_io = remix_io_thread_new (env);
+    if (world->_io == RemixNone) return RemixNone;
+  }
+  io = world->_io;
+
+  ra = (RemixReadAhead *) remix_malloc (sizeof (struct _RemixReadAhead));
+  ra->func = func;
+  ra->data = data;
+  ra->nr_channels = nr_channels;
+
+  /* Room for a whole block beyond the read-ahead window */
+  ra->length = world->_read_ahead + remix_get_mixlength (env);
+  ra->ring = remix_malloc (nr_channels * ra->length * sizeof (RemixPCM));
+
+  pthread_mutex_lock (&io->lock);
+  ra->next = io->read_aheads;
+  io->read_aheads = ra;
+  pthread_cond_signal (&io->wake);
+  pthread_mutex_unlock (&io->lock);
+
+  return ra;
+}
+
+/*
+ * _remix_read_ahead_destroy (env, ra)
+ *
+ * Unregisters 'ra' from the I/O thread, which will not call its
+ * RemixReadAheadFunc again, and frees it.
+ */
+void
+_remix_read_ahead_destroy (RemixEnv * env, RemixReadAhead * ra)
+{
+  RemixIOThread * io = env->world->_io;
+  RemixReadAhead ** rp;
+
+  if (ra == RemixNone) return;
+
+  if (io != RemixNone) {
+    pthread_mutex_lock (&io->lock);
+    while (io->filling == ra)
+      pthread_cond_wait (&io->filled, &io->lock);
+    for (rp = &io->read_aheads; *rp; rp = &(*rp)->next) {
+      if (*rp == ra) {
+	*rp = ra->next;
+	break;
+      }
+    }
+    pthread_mutex_unlock (&io->lock);
+  }
+
+  remix_dprintf ("[_remix_read_ahead_destroy] %p missed %d blocks\n",
+		 ra, ra->misses);
+
+  remix_free (ra->ring);
+  remix_free (ra);
+}
+
+/*
+ * _remix_read_ahead_position (env, ra, frame)
+ *
+ * Called by the rendering thread before reading a block from 'frame'.
+ * Releases any frames before 'frame' to be decoded over, or asks for
+ * decoding to restart at 'frame' if it has not been decoded.
+ */
+void
+_remix_read_ahead_position (RemixEnv * env, RemixReadAhead * ra,
+			    RemixCount frame)
+{
+  RemixIOThread * io = env->world->_io;
+
+  if (ra->seek_request == _remix_load_acquire (&ra->seek_done)) {
+    if (frame >= ra->head && frame <= _remix_load_acquire (&ra->tail)) {
+      _remix_store_release (&ra->head, frame);
+      return;
+    }
+  } else if (frame == ra->seek_frame) {
+    return; /* already requested */
+  }
+
+  _remix_store_release (&ra->head, frame);
+  _remix_store_release (&ra->seek_frame, frame);
+  _remix_store_release (&ra->seek_request, ra->seek_request + 1);
+
+  /* Signalling does not need the lock, so cannot block here */
+  if (io != RemixNone) pthread_cond_signal (&io->wake);
+}
+
+/*
+ * _remix_read_ahead_read (env, ra, channel, frame, dest, count)
+ *
+ * Copies up to 'count' decoded frames of 'channel' from 'frame', which
+ * must be no earlier than the last position given, to 'dest'. Returns
+ * the number of frames copied, which is less than 'count' if decoding
+ * has not caught up.
+ */
+RemixCount
+_remix_read_ahead_read (RemixEnv * env, RemixReadAhead * ra, int channel,
+			RemixCount frame, RemixPCM * dest, RemixCount count)
+{
+  RemixCount tail, index, n, copied = 0;
+
+  if (ra->seek_request == _remix_load_acquire (&ra->seek_done)) {
+    tail = _remix_load_acquire (&ra->tail);
+
+    while (copied < count && frame < tail) {
+      index = frame % ra->length;
+      n = MIN (count - copied, tail - frame);
+      n = MIN (n, ra->length - index);
+      _remix_pcm_copy (&ra->ring[channel * ra->length + index], &dest[copied],
+		       n, NULL);
+      copied += n;
+      frame += n;
+    }
+  }
+
+  if (copied < count) ra->misses++;
+
+  return copied;
+}
+
+#else /* HAVE_PTHREAD */
+
+void
+_remix_io_thread_destroy (RemixEnv * env)
+{
+}
+
+RemixReadAhead *
+_remix_read_ahead_new (RemixEnv * env, int nr_channels,
+		       RemixReadAheadFunc func, void * data)
+{
+  return RemixNone;
+}
+
+void
+_remix_read_ahead_destroy (RemixEnv * env, RemixReadAhead * ra)
+{
+}
+
+void
+_remix_read_ahead_position (RemixEnv * env, RemixReadAhead * ra,
+			    RemixCount frame)
+{
+}
+
+RemixCount
+_remix_read_ahead_read (RemixEnv * env, RemixReadAhead * ra, int channel,
+			RemixCount frame, RemixPCM * dest, RemixCount count)
+{
+  return 0;
+}
+
+#endif /* HAVE_PTHREAD */
+
+/*
+ * remix_set_read_ahead (env, frames)
+ *
+ * Sets how many frames ahead of the playback position file readers in
+ * env's world decode on a background I/O thread. This applies to readers
+ * created afterwards. A value of 0, the default, makes readers decode
+ * synchronously as they are processed. Returns the previous value.
+ */
+RemixCount
+remix_set_read_ahead (RemixEnv * env, RemixCount frames)
+{
+  RemixCount old = env->world->_read_ahead;
+  env->world->_read_ahead = MAX (frames, 0);
+  return old;
+}
+
+RemixCount
+remix_get_read_ahead (RemixEnv * env)
+{
+  return env->world->_read_ahead;
+}
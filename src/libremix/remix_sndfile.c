@@ -24,57 +24,198 @@
  * RemixSndfile: a libsndfile handler
  *
  * Conrad Parker <conrad@metadecks.org>, August 2001
+ *
+ * The reader decodes CACHE_FRAMES frames of the file at a time,
+ * BLOCK_FRAMES at a time into si->pcm, and deinterleaves them into one
+ * planar buffer per file channel. Each channel's chunks are then copied
+ * from those buffers, in whatever order and sizes they are requested,
+ * so each frame is decoded and deinterleaved once however many channels
+ * are read.
+ *
+ * Decoding goes through the world's RemixPageCache, so readers of the
+ * same path, including clones, share decoded frames. A clone only opens
+ * the file when it first needs to decode a page that is not cached.
+ *
+ * A cursor of a reader, from remix_cursor_new(), holds only its position
+ * and the cache page it is reading, and copies straight from that page.
+ * Pages it misses are decoded through its reader's file, so any number
+ * of cursors share one open file and one set of decoded pages.
+ *
+ * With read-ahead enabled by remix_set_read_ahead(), readers and cursors
+ * instead decode into a RemixReadAhead of their own on the world's I/O
+ * thread, and processing only copies from it.
+ *
+ * Invariants
+ * ----------
+ *
+ * A reader's file is only decoded with its decode lock held, as its
+ * cursors may be processed on several threads at once.
+ *
+ * A cursor does not outlive its reader.
  */
 
+#include <config.h>
+
 #include <stdio.h>
 #include <sndfile.h>
 #include <string.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #define __REMIX__
 #include "remix.h"
 
 #define PATH_KEY 1
+#define FORMAT_KEY 2
 #define BLOCK_FRAMES 4096
+#define CACHE_FRAMES (4 * BLOCK_FRAMES)
+
+#define DEFAULT_FORMAT (SF_FORMAT_WAV | SF_FORMAT_PCM_16)
 
 typedef struct _RemixSndfileInstance RemixSndfileInstance;
 
 struct _RemixSndfileInstance {
   char * path;
   int writing;
-  SNDFILE * file;
+  SNDFILE * file; /* NULL until a reader needs to decode */
   SF_INFO info;
-  float * pcm;
-  sf_count_t pcm_n;
+  float * pcm; /* BLOCK_FRAMES interleaved frames */
+  sf_count_t file_offset; /* frame libsndfile reads or writes next */
+
+  /* Reading */
+  RemixPCM * planes; /* CACHE_FRAMES of each channel, in turn */
+  RemixCount cache_start; /* file frame of planes[c*CACHE_FRAMES] */
+  RemixCount cache_length; /* number of frames in the cache */
+  RemixCount stream_offset; /* file frame minus output stream offset */
+  RemixReadAhead * read_ahead; /* decoding on the I/O thread, or NULL */
+  RemixPageCache * page_cache;
+  RemixPageFile * page_file;
+  RemixPCM ** dests; /* channels being decoded into from 'file' */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t decode_lock; /* held while decoding from 'file' */
+#endif
+
+  /* Writing */
+  RemixConverter * converter; /* writing integer PCM, or NULL */
+  RemixSampleFormat format;
+  void * out; /* converted frames */
+};
+
+
+typedef struct _RemixSndfileCursor RemixSndfileCursor;
+
+struct _RemixSndfileCursor {
+  RemixBase base;
+  RemixBase * sndfile; /* the reader */
+  RemixPage * page; /* pinned page last read from, or NULL */
+  RemixCount stream_offset; /* file frame minus output stream offset */
+  RemixReadAhead * read_ahead; /* decoding on the I/O thread, or NULL */
+  RemixPCM ** channels; /* mapped from 'page' */
 };
 
 
 /* Optimisation dependencies: none */
 static RemixBase * remix_sndfile_optimise (RemixEnv * env, RemixBase * sndfile);
 
+static RemixCount remix_sndfile_decode (void * data, RemixCount frame,
+					RemixPCM * dest, RemixCount stride,
+					RemixCount count);
+
+
+/*
+ * remix_sndfile_create_converter (env, si)
+ *
+ * Integer PCM files are written through our own converter, which
+ * dithers; libsndfile is left to convert to any other encoding.
+ */
+static void
+remix_sndfile_create_converter (RemixEnv * env, RemixSndfileInstance * si)
+{
+  switch (si->info.format & SF_FORMAT_SUBMASK) {
+  case SF_FORMAT_PCM_16:
+    si->format = REMIX_FORMAT_S16;
+    si->out = remix_malloc (BLOCK_FRAMES * si->info.channels * sizeof (short));
+    break;
+  case SF_FORMAT_PCM_24:
+    si->format = REMIX_FORMAT_S24_32;
+    si->out = remix_malloc (BLOCK_FRAMES * si->info.channels * sizeof (int));
+    break;
+  case SF_FORMAT_PCM_32:
+    si->format = REMIX_FORMAT_S32;
+    si->out = remix_malloc (BLOCK_FRAMES * si->info.channels * sizeof (int));
+    break;
+  default:
+    return;
+  }
+
+  si->converter = remix_converter_new (env, si->format, REMIX_DITHER_TPDF,
+				       si->info.channels);
+}
+
+/*
+ * remix_sndfile_create_reader (env, si)
+ *
+ * Allocates the buffers of a reader of the file described by si->info.
+ */
+static void
+remix_sndfile_create_reader (RemixEnv * env, RemixSndfileInstance * si)
+{
+  si->pcm = remix_malloc (BLOCK_FRAMES * si->info.channels * sizeof (float));
+
+  si->planes = remix_malloc (si->info.channels * CACHE_FRAMES *
+			     sizeof (RemixPCM));
+  si->dests = remix_malloc (si->info.channels * sizeof (RemixPCM *));
+
+  si->page_cache = env->world->_page_cache;
+  si->page_file = _remix_page_file_open (env, si->path, si->info.channels);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init (&si->decode_lock, NULL);
+#endif
+  si->read_ahead = _remix_read_ahead_new (env, si->info.channels,
+					  remix_sndfile_decode, si);
+}
 
+/*
+ * remix_sndfile_create (env, sndfile, path, writing, format)
+ *
+ * Opens 'path' for reading, or for writing a file of the given libsndfile
+ * 'format' with one channel for each in the context's channel set, in
+ * order of their names. A 'format' without an encoding is written as
+ * 16 bit PCM.
+ */
 static RemixBase *
 remix_sndfile_create (RemixEnv * env, RemixBase * sndfile,
-		     const char * path, int writing)
+		     const char * path, int writing, int format)
 {
   RemixSndfileInstance * si =
     remix_malloc (sizeof (struct _RemixSndfileInstance));
 
   si->path = strdup (path);
   si->writing = writing;
+  sndfile->instance_data = si;
 
   if (writing) {
+    if ((format & SF_FORMAT_SUBMASK) == 0)
+      format |= SF_FORMAT_PCM_16;
+
     si->info.samplerate = remix_get_samplerate (env);
-    si->info.channels = 1; /* XXX: how many channels, or specify? */
-    si->info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16; /* XXX: assumes WAV */
+    si->info.channels = cd_set_size (env, remix_get_channels (env));
+    si->info.format = format;
+
+    if (!sf_format_check (&si->info)) {
+      remix_set_error (env, REMIX_ERROR_INVALID);
+      remix_destroy (env, (RemixBase *)sndfile);
+      return RemixNone;
+    }
+
+    /* Pages decoded from an earlier file at this path are now wrong */
+    _remix_page_cache_forget (env->world->_page_cache, path);
 
     si->file = sf_open  (path, SFM_WRITE, &si->info);
-    si->pcm = NULL;
-    si->pcm_n = 0;
   } else {
     si->file = sf_open (path, SFM_READ, &si->info);
-    si->pcm = (float *) malloc (BLOCK_FRAMES * si->info.channels *
-				sizeof(float));
-    si->pcm_n = 0;
   }
 
   if (si->file == NULL) {
@@ -85,10 +226,13 @@ remix_sndfile_create (RemixEnv * env, RemixBase * sndfile,
 
   sf_command (si->file, SFC_SET_NORM_FLOAT, NULL, SF_TRUE);
 
-  if (writing)
-    sf_command (si->file, SFC_SET_ADD_DITHER_ON_WRITE, NULL, SF_TRUE);
-
-  sndfile->instance_data = si;
+  if (writing) {
+    si->pcm = remix_malloc (BLOCK_FRAMES * si->info.channels *
+			    sizeof (float));
+    remix_sndfile_create_converter (env, si);
+  } else {
+    remix_sndfile_create_reader (env, si);
+  }
 
   return sndfile;
 }
@@ -100,7 +244,7 @@ remix_sndfile_reader_init (RemixEnv * env, RemixBase * base, CDSet * parameters)
 
   path = (cd_set_find (env, parameters, PATH_KEY)).s_string;
 
-  if (remix_sndfile_create (env, base, path, 0) == RemixNone)
+  if (remix_sndfile_create (env, base, path, 0, 0) == RemixNone)
   	return RemixNone;
 
   remix_sndfile_optimise (env, base);
@@ -111,20 +255,43 @@ static RemixBase *
 remix_sndfile_writer_init (RemixEnv * env, RemixBase * base, CDSet * parameters)
 {
   char * path;
+  int format;
 
   path = (cd_set_find (env, parameters, PATH_KEY)).s_string;
+  format = (cd_set_find (env, parameters, FORMAT_KEY)).s_int;
+  if (format == 0) format = DEFAULT_FORMAT;
+
+  if (remix_sndfile_create (env, base, path, 1, format) == RemixNone)
+    return RemixNone;
 
-  remix_sndfile_create (env, base, path, 1);
   remix_sndfile_optimise (env, base);
   return base;
 }
 
+/*
+ * remix_sndfile_clone (env, base)
+ *
+ * A clone of a reader shares the pages decoded by all readers of its
+ * path, and does not open the file until it misses them.
+ */
 static RemixBase *
 remix_sndfile_clone (RemixEnv * env, RemixBase * base)
 {
   RemixBase * new_sndfile = remix_base_new (env);
   RemixSndfileInstance * si = (RemixSndfileInstance *)base->instance_data;
-  remix_sndfile_create (env, new_sndfile, si->path, si->writing);
+  RemixSndfileInstance * new_si;
+
+  if (si->writing) {
+    remix_sndfile_create (env, new_sndfile, si->path, si->writing,
+			  si->info.format);
+  } else {
+    new_si = remix_malloc (sizeof (struct _RemixSndfileInstance));
+    new_si->path = strdup (si->path);
+    new_si->info = si->info;
+    new_sndfile->instance_data = new_si;
+    remix_sndfile_create_reader (env, new_si);
+  }
+
   remix_sndfile_optimise (env, new_sndfile);
   return new_sndfile;
 }
@@ -133,112 +300,236 @@ static int
 remix_sndfile_destroy (RemixEnv * env, RemixBase * base)
 {
   RemixSndfileInstance * si = (RemixSndfileInstance *)base->instance_data;
+
+  _remix_read_ahead_destroy (env, si->read_ahead);
+  _remix_page_file_close (env, si->page_file);
   if (si->file != NULL) sf_close (si->file);
+  if (si->planes) {
+    remix_free (si->planes);
+    remix_free (si->dests);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy (&si->decode_lock);
+#endif
+  }
+  remix_converter_destroy (env, si->converter);
+  if (si->pcm) remix_free (si->pcm);
+  if (si->out) remix_free (si->out);
+  free (si->path);
   remix_free (si);
   remix_free (base);
   return 0;
 }
 
-/* An RemixChunkFunc for creating sndfile */
+/*
+ * remix_sndfile_decode_locked (si, frame, dest, stride, count)
+ *
+ * Decodes up to 'count' frames of the file from 'frame', BLOCK_FRAMES
+ * at a time, and deinterleaves them into 'dest', frame i of channel c
+ * at dest[c*stride + i], opening the file if need be. Returns the
+ * number of frames decoded, which is less than 'count' only at the end
+ * of the file or on error.
+ * Called with the decode lock held.
+ */
+static RemixCount
+remix_sndfile_decode_locked (RemixSndfileInstance * si, RemixCount frame,
+			     RemixPCM * dest, RemixCount stride,
+			     RemixCount count)
+{
+  SF_INFO info;
+  RemixCount decoded = 0, n;
+  int c, nr_channels = si->info.channels;
+
+  if (si->file == NULL) {
+    memset (&info, 0, sizeof (info));
+    si->file = sf_open (si->path, SFM_READ, &info);
+    if (si->file == NULL) return 0;
+
+    if (info.channels != nr_channels) {
+      sf_close (si->file);
+      si->file = NULL;
+      return 0;
+    }
+
+    sf_command (si->file, SFC_SET_NORM_FLOAT, NULL, SF_TRUE);
+    si->file_offset = 0;
+  }
+
+  if (si->file_offset != frame) {
+    si->file_offset = sf_seek (si->file, frame, SEEK_SET);
+    if (si->file_offset != frame) return 0;
+  }
+
+  while (decoded < count) {
+    n = MIN (BLOCK_FRAMES, count - decoded);
+    n = sf_readf_float (si->file, si->pcm, n);
+    if (n <= 0) break;
+
+    si->file_offset += n;
+
+    for (c = 0; c < nr_channels; c++)
+      si->dests[c] = &dest[c * stride + decoded];
+    _remix_pcm_deinterleave (si->dests, nr_channels, n, si->pcm);
+
+    decoded += n;
+  }
+
+  return decoded;
+}
 
+/*
+ * remix_sndfile_decode_file (si, frame, dest, stride, count)
+ *
+ * Decodes frames of the file as remix_sndfile_decode_locked() does, on
+ * behalf of the reader or any of its cursors.
+ */
 static RemixCount
-remix_sndfile_read_update (RemixEnv * env, RemixBase * sndfile,
-			   RemixCount count)
+remix_sndfile_decode_file (void * data, RemixCount frame, RemixPCM * dest,
+			   RemixCount stride, RemixCount count)
 {
-  RemixSndfileInstance * si = (RemixSndfileInstance *)sndfile->instance_data;
+  RemixSndfileInstance * si = (RemixSndfileInstance *)data;
+  RemixCount decoded;
 
-  si->pcm_n = sf_readf_float (si->file, si->pcm, count);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock (&si->decode_lock);
+#endif
+  decoded = remix_sndfile_decode_locked (si, frame, dest, stride, count);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock (&si->decode_lock);
+#endif
+
+  return decoded;
+}
+
+/*
+ * remix_sndfile_decode (si, frame, dest, stride, count)
+ *
+ * Reads up to 'count' frames of the file from 'frame' into 'dest', frame
+ * i of channel c at dest[c*stride + i], through the page cache. Returns
+ * the number of frames read, which is less than 'count' only at the end
+ * of the file. This is the RemixReadAheadFunc of readers decoding on
+ * the I/O thread.
+ */
+static RemixCount
+remix_sndfile_decode (void * data, RemixCount frame, RemixPCM * dest,
+		      RemixCount stride, RemixCount count)
+{
+  RemixSndfileInstance * si = (RemixSndfileInstance *)data;
 
-  return si->pcm_n;
+  return _remix_page_cache_read (si->page_cache, si->page_file, frame, dest,
+				 stride, count, remix_sndfile_decode_file, si);
 }
 
+/*
+ * remix_sndfile_fill_cache (env, si, frame)
+ *
+ * Makes the cache start at 'frame', keeping any frames from there on
+ * that it already holds, and decodes frames after them until it is full
+ * or the file ends. Returns the number of frames cached.
+ */
+static RemixCount
+remix_sndfile_fill_cache (RemixEnv * env, RemixSndfileInstance * si,
+			  RemixCount frame)
+{
+  RemixPCM * plane;
+  RemixCount cached = 0;
+  int c, nr_channels = si->info.channels;
+
+  if (frame >= si->cache_start &&
+      frame < si->cache_start + si->cache_length) {
+    cached = si->cache_start + si->cache_length - frame;
+    for (c = 0; c < nr_channels; c++) {
+      plane = &si->planes[c * CACHE_FRAMES];
+      memmove (plane, &plane[frame - si->cache_start],
+	       cached * sizeof (RemixPCM));
+    }
+  }
+
+  cached += remix_sndfile_decode (si, frame + cached, &si->planes[cached],
+				  CACHE_FRAMES, CACHE_FRAMES - cached);
+
+  si->cache_start = frame;
+  si->cache_length = cached;
+
+  return cached;
+}
+
+/* A RemixChunkFunc for reading channel 'channelname' of the file */
 static RemixCount
 remix_sndfile_read_into_chunk (RemixEnv * env, RemixChunk * chunk,
 			       RemixCount offset, RemixCount count,
 			       int channelname, void * data)
 {
   RemixBase * sndfile = (RemixBase *)data;
-  RemixPCM * d, * p;
-  RemixCount remaining = count, written = 0, n, i;
   RemixSndfileInstance * si = (RemixSndfileInstance *)sndfile->instance_data;
+  RemixPCM * d;
+  RemixCount remaining = count, frame, n;
+  int c;
 
   remix_dprintf ("[remix_sndfile_read_into_chunk] (%p, +%ld) @ %ld\n",
 		 sndfile, count, remix_tell (env, sndfile));
 
-  d = &chunk->data[offset];
+  d = &chunk->data[offset - chunk->start_index];
+  frame = offset + si->stream_offset;
 
-  n = MIN (remaining, BLOCK_FRAMES);
-  if (channelname == 0)
-    remix_sndfile_read_update (env, sndfile, n);
+  /* Mono files are read into every channel */
+  c = (si->info.channels == 1) ? 0 : channelname;
+  if (c >= si->info.channels)
+    return _remix_pcm_set (d, 0.0, count);
 
-  n = MIN (si->pcm_n, remaining);
-  
-  p = si->pcm;
-  p += channelname;
-  
-  for (i = 0; i < n; i++) {
-    *d++ = *p;
-    p += si->info.channels;
-  }
-    
-  if (n == 0) { /* EOF */
-    n = _remix_pcm_set (d, 0.0, remaining);
+  if (si->read_ahead != RemixNone) {
+    n = MIN (remaining, MAX (si->info.frames - frame, 0));
+    n = _remix_read_ahead_read (env, si->read_ahead, c, frame, d, n);
+    _remix_pcm_set (d + n, 0.0, remaining - n);
+    return count;
   }
-  
-  remaining -= n;
-  written += n;
-  
-#if 0 /* mono only */
-  d = &chunk->data[offset];
 
   while (remaining > 0) {
-    n = MIN (remaining, BLOCK_FRAMES);
-    n = sf_readf_float (si->file, d, n);
-
-    if (n == 0) { /* EOF */
-      n = _remix_pcm_set (d, 0.0, remaining);
+    if (frame < si->cache_start ||
+	frame >= si->cache_start + si->cache_length) {
+      if (frame >= si->info.frames ||
+	  remix_sndfile_fill_cache (env, si, frame) == 0) { /* EOF */
+	_remix_pcm_set (d, 0.0, remaining);
+	break;
+      }
     }
 
-    remaining -= n;
-    written += n;
+    n = MIN (remaining, si->cache_start + si->cache_length - frame);
+    _remix_pcm_copy (&si->planes[c * CACHE_FRAMES + frame - si->cache_start],
+		     d, n, NULL);
 
     d += n;
+    frame += n;
+    remaining -= n;
   }
-#endif
 
-  return written;
+  return count;
 }
 
+/*
+ * remix_sndfile_write_frames (env, si, count)
+ *
+ * Writes 'count' interleaved frames from si->pcm to the file.
+ */
 static RemixCount
-remix_sndfile_write_from_chunk (RemixEnv * env, RemixChunk * chunk,
-			       RemixCount offset, RemixCount count,
-			       int channelname, void * data)
+remix_sndfile_write_frames (RemixEnv * env, RemixSndfileInstance * si,
+			    RemixCount count)
 {
-  RemixBase * sndfile = (RemixBase *)data;
-  RemixPCM * d;
-  RemixCount remaining = count, read = 0, n;
-  RemixSndfileInstance * si = (RemixSndfileInstance *) sndfile->instance_data;
-
-  remix_dprintf ("[remix_sndfile_write_from_chunk] (%p, +%ld) @ %ld\n",
-		 sndfile, count, remix_tell (env, sndfile));
-
-  d = &chunk->data[offset];
+  sf_count_t n;
 
-  while (remaining > 0) {
-    n = MIN (remaining, BLOCK_FRAMES);
-    n = sf_write_float (si->file, d, n);
-
-    if (n == 0) { /* EOF */
-      n = remaining;
-    }
-
-    remaining -= n;
-    read += n;
+  if (si->converter == RemixNone) {
+    n = sf_writef_float (si->file, si->pcm, count);
+  } else {
+    remix_convert_interleaved (env, si->converter, si->pcm, si->out, count);
 
-    d += n;
+    if (si->format == REMIX_FORMAT_S16)
+      n = sf_writef_short (si->file, (short *)si->out, count);
+    else
+      n = sf_writef_int (si->file, (int *)si->out, count);
   }
 
-  return read;
+  if (n > 0) si->file_offset += n;
+
+  return n;
 }
 
 static RemixCount
@@ -246,17 +537,62 @@ remix_sndfile_reader_process (RemixEnv * env, RemixBase * base,
 			      RemixCount count,
 			      RemixStream * input, RemixStream * output)
 {
+  RemixSndfileInstance * si = (RemixSndfileInstance *)base->instance_data;
+  RemixCount start = remix_tell (env, base);
+  RemixCount end = start + MIN (count, CACHE_FRAMES);
+
+  si->stream_offset = start - remix_tell (env, (RemixBase *)output);
+
+  if (si->read_ahead != RemixNone) {
+    _remix_read_ahead_position (env, si->read_ahead, start);
+    return remix_stream_chunkfuncify (env, output, count,
+				      remix_sndfile_read_into_chunk, base);
+  }
+
+  /* Cache the block up front, so that all channels are served from it */
+  end = MIN (end, si->info.frames);
+  if (start < end &&
+      (start < si->cache_start || end > si->cache_start + si->cache_length))
+    remix_sndfile_fill_cache (env, si, start);
+
   return remix_stream_chunkfuncify (env, output, count,
 				    remix_sndfile_read_into_chunk, base);
 }
 
+/*
+ * remix_sndfile_writer_process (env, base, count, input, output)
+ *
+ * Gathers all channels of each block of 'output' into whole interleaved
+ * frames, and writes them with a single call to libsndfile.
+ */
 static RemixCount
 remix_sndfile_writer_process (RemixEnv * env, RemixBase * base,
 			      RemixCount count,
 			      RemixStream * input, RemixStream * output)
 {
-  return remix_stream_chunkfuncify (env, output, count,
-				   remix_sndfile_write_from_chunk, base);
+  RemixSndfileInstance * si = (RemixSndfileInstance *)base->instance_data;
+  RemixCount remaining = count, written = 0, n;
+
+  if (remix_stream_nr_channels (env, output) != si->info.channels) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+
+  remix_dprintf ("[remix_sndfile_writer_process] (%p, +%ld) @ %ld\n",
+		 base, count, remix_tell (env, base));
+
+  while (remaining > 0) {
+    n = MIN (remaining, BLOCK_FRAMES);
+    n = remix_stream_interleave (env, output, si->pcm, n);
+    if (n <= 0) break;
+
+    remix_sndfile_write_frames (env, si, n);
+
+    remaining -= n;
+    written += n;
+  }
+
+  return written;
 }
 
 static RemixCount
@@ -270,7 +606,161 @@ static RemixCount
 remix_sndfile_seek (RemixEnv * env, RemixBase * base, RemixCount offset)
 {
   RemixSndfileInstance * si = (RemixSndfileInstance *)base->instance_data;
-  return sf_seek (si->file, offset, SEEK_SET);
+
+  /* The reader seeks the file when it next fills its cache */
+  if (!si->writing) return offset;
+
+  si->file_offset = sf_seek (si->file, offset, SEEK_SET);
+  return si->file_offset;
+}
+
+/* RemixSndfileCursor */
+
+static RemixBase * remix_sndfile_cursor (RemixEnv * env, RemixBase * base);
+
+static int
+remix_sndfile_cursor_destroy (RemixEnv * env, RemixBase * base)
+{
+  RemixSndfileCursor * cursor = (RemixSndfileCursor *)base;
+  RemixSndfileInstance * si =
+    (RemixSndfileInstance *)cursor->sndfile->instance_data;
+
+  _remix_read_ahead_destroy (env, cursor->read_ahead);
+  _remix_page_cache_unmap (si->page_cache, cursor->page);
+  _remix_page_file_close (env, si->page_file);
+  remix_free (cursor->channels);
+  remix_free (cursor);
+  return 0;
+}
+
+/* A RemixChunkFunc for reading channel 'channelname' through a cursor */
+static RemixCount
+remix_sndfile_cursor_read_into_chunk (RemixEnv * env, RemixChunk * chunk,
+				      RemixCount offset, RemixCount count,
+				      int channelname, void * data)
+{
+  RemixSndfileCursor * cursor = (RemixSndfileCursor *)data;
+  RemixSndfileInstance * si =
+    (RemixSndfileInstance *)cursor->sndfile->instance_data;
+  RemixPCM * d;
+  RemixCount remaining = count, frame, n;
+  int c;
+
+  d = &chunk->data[offset - chunk->start_index];
+  frame = offset + cursor->stream_offset;
+
+  /* Mono files are read into every channel */
+  c = (si->info.channels == 1) ? 0 : channelname;
+  if (c >= si->info.channels)
+    return _remix_pcm_set (d, 0.0, count);
+
+  if (cursor->read_ahead != RemixNone) {
+    n = MIN (remaining, MAX (si->info.frames - frame, 0));
+    n = _remix_read_ahead_read (env, cursor->read_ahead, c, frame, d, n);
+    _remix_pcm_set (d + n, 0.0, remaining - n);
+    return count;
+  }
+
+  while (remaining > 0) {
+    n = 0;
+    if (frame < si->info.frames)
+      n = _remix_page_cache_map (si->page_cache, si->page_file, frame,
+				 &cursor->page, cursor->channels,
+				 remix_sndfile_decode_file, si);
+    if (n <= 0) { /* EOF */
+      _remix_pcm_set (d, 0.0, remaining);
+      break;
+    }
+
+    n = MIN (remaining, n);
+    _remix_pcm_copy (cursor->channels[c], d, n, NULL);
+
+    d += n;
+    frame += n;
+    remaining -= n;
+  }
+
+  return count;
+}
+
+static RemixCount
+remix_sndfile_cursor_process (RemixEnv * env, RemixBase * base,
+			      RemixCount count,
+			      RemixStream * input, RemixStream * output)
+{
+  RemixSndfileCursor * cursor = (RemixSndfileCursor *)base;
+  RemixCount start = remix_tell (env, base);
+
+  remix_dprintf ("[remix_sndfile_cursor_process] (%p, +%ld) @ %ld\n",
+		 base, count, start);
+
+  cursor->stream_offset = start - remix_tell (env, (RemixBase *)output);
+
+  if (cursor->read_ahead != RemixNone)
+    _remix_read_ahead_position (env, cursor->read_ahead, start);
+
+  return remix_stream_chunkfuncify (env, output, count,
+				    remix_sndfile_cursor_read_into_chunk,
+				    cursor);
+}
+
+static RemixCount
+remix_sndfile_cursor_length (RemixEnv * env, RemixBase * base)
+{
+  RemixSndfileCursor * cursor = (RemixSndfileCursor *)base;
+  return remix_length (env, cursor->sndfile);
+}
+
+static RemixCount
+remix_sndfile_cursor_seek (RemixEnv * env, RemixBase * base,
+			   RemixCount offset)
+{
+  return offset;
+}
+
+/* A clone or cursor of a cursor is another cursor of its reader */
+static RemixBase *
+remix_sndfile_cursor_clone (RemixEnv * env, RemixBase * base)
+{
+  RemixSndfileCursor * cursor = (RemixSndfileCursor *)base;
+  return remix_sndfile_cursor (env, cursor->sndfile);
+}
+
+static struct _RemixMethods _remix_sndfile_cursor_methods = {
+  remix_sndfile_cursor_clone,
+  remix_sndfile_cursor_destroy,
+  NULL, /* ready */
+  NULL, /* prepare */
+  remix_sndfile_cursor_process,
+  remix_sndfile_cursor_length,
+  remix_sndfile_cursor_seek,
+  NULL, /* flush */
+  remix_sndfile_cursor_clone,
+};
+
+/*
+ * remix_sndfile_cursor (env, base)
+ *
+ * Returns a cursor of the reader 'base', which reserves its page in the
+ * world's cache and, with read-ahead enabled, a RemixReadAhead of its
+ * own decoding through the reader.
+ */
+static RemixBase *
+remix_sndfile_cursor (RemixEnv * env, RemixBase * base)
+{
+  RemixSndfileInstance * si = (RemixSndfileInstance *)base->instance_data;
+  RemixSndfileCursor * cursor;
+
+  cursor = (RemixSndfileCursor *)
+    remix_base_new_subclass (env, sizeof (struct _RemixSndfileCursor));
+  cursor->sndfile = base;
+  cursor->channels = remix_malloc (si->info.channels * sizeof (RemixPCM *));
+  _remix_page_file_open (env, si->path, si->info.channels);
+  cursor->read_ahead = _remix_read_ahead_new (env, si->info.channels,
+					      remix_sndfile_decode, si);
+  _remix_set_methods (env, cursor, &_remix_sndfile_cursor_methods);
+
+  return (RemixBase *)cursor;
 }
 
 static struct _RemixMethods _remix_sndfile_reader_methods = {
@@ -282,6 +772,7 @@ static struct _RemixMethods _remix_sndfile_reader_methods = {
   remix_sndfile_length,
   remix_sndfile_seek,
   NULL, /* flush */
+  remix_sndfile_cursor,
 };
 
 static struct _RemixMethods _remix_sndfile_writer_methods = {
@@ -410,7 +901,7 @@ __sndfile_init (RemixEnv * env)
   RemixNamedParameter * param;
 
   sndfile_reader_plugin.init_scheme =
-    cd_set_insert (env, sndfile_reader_plugin.init_scheme, PATH_KEY,
+    cd_set_replace (env, sndfile_reader_plugin.init_scheme, PATH_KEY,
 		   CD_POINTER(&path_scheme));
 
   plugins = cd_list_prepend (env, plugins,
@@ -433,8 +924,11 @@ __sndfile_init (RemixEnv * env)
   }
 
   sndfile_writer_plugin.init_scheme =
-    cd_set_insert (env, sndfile_writer_plugin.init_scheme, PATH_KEY,
+    cd_set_replace (env, sndfile_writer_plugin.init_scheme, PATH_KEY,
 		   CD_POINTER(&path_scheme));
+  sndfile_writer_plugin.init_scheme =
+    cd_set_replace (env, sndfile_writer_plugin.init_scheme, FORMAT_KEY,
+		   CD_POINTER(&format_scheme));
 
   plugins = cd_list_prepend (env, plugins,
 			     CD_POINTER(&sndfile_writer_plugin));
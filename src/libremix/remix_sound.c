@@ -29,7 +29,12 @@
  * -----------
  *
  * A sound is contained within a layer. Each sound is a unique entity, but
- * many sounds may have the same source base.
+ * many sounds may have the same source base. Each sound reads its source
+ * through a cursor of its own, so that sounds sharing a source neither
+ * seek it back and forth nor disturb each other when rendered on
+ * different threads. Gain and blend envelopes are applied to the sound's
+ * data directly, and only other kinds of gain or blend source are
+ * rendered into a stream first.
  *
  * Invariants
  * ----------
@@ -38,6 +43,7 @@
  */
 
 #include <string.h>
+#include <math.h>
 
 #define __REMIX__
 #include "remix.h"
@@ -45,30 +51,91 @@
 /* Optimisation dependencies: none */
 static RemixSound * remix_sound_optimise (RemixEnv * env, RemixSound * sound);
 
+/* Length of the window of source data read at once for varispeed, in
+ * units of the mixlength */
+#define REMIX_RATE_WINDOW 4
+
 /*
- * remix_sound_replace_mixstreams (env, sound)
+ * remix_sound_ensure_rate_buffers (env, sound)
  *
- * Replaces mix- (and envelope-) streams of 'sound' with new ones of
- * the env's mixlength.
+ * Makes sure the buffers used for varispeed playback are sized for the
+ * sound's mixlength and the env's channels, replacing them if not.
+ * Sounds without a rate envelope have none.
  */
 static void
-remix_sound_replace_mixstreams (RemixEnv * env, RemixSound * sound)
+remix_sound_ensure_rate_buffers (RemixEnv * env, RemixSound * sound)
 {
   RemixCount mixlength = _remix_base_get_mixlength (env, sound);
+  RemixCount window = REMIX_RATE_WINDOW * mixlength + REMIX_SINC_TAPS;
 
-  if (sound->_rate_envstream != RemixNone)
-    remix_destroy (env, (RemixBase *)sound->_rate_envstream);
-  if (sound->_gain_envstream != RemixNone)
-    remix_destroy (env, (RemixBase *)sound->_gain_envstream);
-  if (sound->_blend_envstream != RemixNone)
-    remix_destroy (env, (RemixBase *)sound->_blend_envstream);
+  /* The index and fraction buffers were sized along with the window */
+  if (sound->rate_envelope != RemixNone &&
+      _remix_stream_fits (env, sound->_rate_srcstream, window))
+    return;
+
+  if (sound->_rate_srcstream != RemixNone)
+    remix_destroy (env, (RemixBase *)sound->_rate_srcstream);
+  if (sound->_rate_index != NULL) remix_free (sound->_rate_index);
+  if (sound->_rate_frac != NULL) remix_free (sound->_rate_frac);
+
+  sound->_rate_srcstream = RemixNone;
+  sound->_rate_index = NULL;
+  sound->_rate_frac = NULL;
+
+  if (sound->rate_envelope == RemixNone) return;
+
+  sound->_rate_srcstream = remix_stream_new_contiguous (env, window);
+  sound->_rate_index = (int *) remix_malloc (mixlength * sizeof (int));
+  sound->_rate_frac = (RemixPCM *) remix_malloc (mixlength * sizeof (RemixPCM));
+
+  /* Invalidate the source window */
+  sound->_rate_src_start = -window;
+}
+
+/*
+ * remix_sound_ensure_envstream (env, stream, envelope, mixlength, direct)
+ *
+ * Returns a stream to render 'envelope' into, fitting 'mixlength' and
+ * the env's channels, in place of 'stream'. Returns RemixNone, having
+ * destroyed 'stream', if there is no envelope or if 'direct' is set and
+ * 'envelope' is a RemixEnvelope, which is applied to the data directly.
+ */
+static RemixStream *
+remix_sound_ensure_envstream (RemixEnv * env, RemixStream * stream,
+                              RemixBase * envelope, RemixCount mixlength,
+                              int direct)
+{
+  if (envelope == RemixNone ||
+      (direct && _remix_is_envelope (env, envelope))) {
+    if (stream != RemixNone) remix_destroy (env, (RemixBase *)stream);
+    return RemixNone;
+  }
+
+  return _remix_stream_ensure_contiguous (env, stream, mixlength);
+}
+
+/*
+ * remix_sound_ensure_mixstreams (env, sound)
+ *
+ * Makes sure the envelope streams of 'sound' fit its mixlength and the
+ * env's channels, replacing them if not. Gain and blend envelopes which
+ * are RemixEnvelopes need no stream; the rate needs one whenever it is
+ * set, as the varispeed reads it sample by sample.
+ */
+static void
+remix_sound_ensure_mixstreams (RemixEnv * env, RemixSound * sound)
+{
+  RemixCount mixlength = _remix_base_get_mixlength (env, sound);
 
   sound->_rate_envstream =
-    remix_stream_new_contiguous (env, mixlength);
+    remix_sound_ensure_envstream (env, sound->_rate_envstream,
+				  sound->rate_envelope, mixlength, FALSE);
   sound->_gain_envstream =
-    remix_stream_new_contiguous (env, mixlength);
+    remix_sound_ensure_envstream (env, sound->_gain_envstream,
+				  sound->gain_envelope, mixlength, TRUE);
   sound->_blend_envstream =
-    remix_stream_new_contiguous (env, mixlength);
+    remix_sound_ensure_envstream (env, sound->_blend_envstream,
+				  sound->blend_envelope, mixlength, TRUE);
 }
 
 static RemixBase *
@@ -80,7 +147,17 @@ remix_sound_init (RemixEnv * env, RemixBase * base)
   sound->cutin = sound->cutlength = 0;
   sound->_rate_envstream = sound->_gain_envstream = sound->_blend_envstream =
     RemixNone;
-  remix_sound_replace_mixstreams (env, sound);
+  sound->rate_quality = REMIX_RESAMPLE_CUBIC;
+  sound->_rate_position = 0.0;
+  sound->_rate_offset = 0;
+  sound->_rate_srcstream = RemixNone;
+  sound->_rate_index = NULL;
+  sound->_rate_frac = NULL;
+  sound->_cursor = RemixNone;
+  if (sound->source != RemixNone)
+    sound->_cursor = remix_cursor_new (env, sound->source);
+  remix_sound_ensure_mixstreams (env, sound);
+  remix_sound_ensure_rate_buffers (env, sound);
   remix_sound_optimise (env, sound);
   return (RemixBase *)sound;
 }
@@ -92,14 +169,50 @@ _remix_sound_new (RemixEnv * env)
     remix_base_new_subclass (env, sizeof (struct _RemixSound));
 }
 
+/*
+ * remix_sound_copy_owned (env, sound)
+ *
+ * Gives 'sound', freshly copied from another sound, its own envelopes
+ * and scratch streams in place of those it shares with the original.
+ * The source is not owned by the sound and remains shared, but is read
+ * through a new cursor.
+ */
+static void
+remix_sound_copy_owned (RemixEnv * env, RemixSound * sound)
+{
+  if (sound->rate_envelope != RemixNone)
+    sound->rate_envelope = remix_clone_subclass (env, sound->rate_envelope);
+  if (sound->gain_envelope != RemixNone)
+    sound->gain_envelope = remix_clone_subclass (env, sound->gain_envelope);
+  if (sound->blend_envelope != RemixNone)
+    sound->blend_envelope = remix_clone_subclass (env, sound->blend_envelope);
+
+  if (sound->source != RemixNone)
+    sound->_cursor = remix_cursor_new (env, sound->source);
+
+  sound->_rate_envstream = sound->_gain_envstream = sound->_blend_envstream =
+    RemixNone;
+  sound->_rate_srcstream = RemixNone;
+  sound->_rate_index = NULL;
+  sound->_rate_frac = NULL;
+
+  remix_sound_ensure_mixstreams (env, sound);
+  remix_sound_ensure_rate_buffers (env, sound);
+}
+
 RemixBase *
 remix_sound_clone_invalid (RemixEnv * env, RemixBase * base)
 {
   RemixSound * sound = (RemixSound *)base;
   RemixSound * new_sound = _remix_sound_new (env);
+  CDList * world_item = new_sound->base._world_item;
 
+  /* Copy everything but the new sound's registration with the world */
   memcpy (new_sound, sound, sizeof (struct _RemixSound));
+  new_sound->base._world_item = world_item;
+  remix_sound_copy_owned (env, new_sound);
   new_sound->layer = RemixNone;
+  new_sound->_layer_index = -1;
 
   return (RemixBase *)new_sound;
 }
@@ -110,8 +223,12 @@ remix_sound_clone_with_layer (RemixEnv * env, RemixBase * base,
 {
   RemixSound * sound = (RemixSound *)base;
   RemixSound * new_sound = _remix_sound_new (env);
+  CDList * world_item = new_sound->base._world_item;
 
+  /* Copy everything but the new sound's registration with the world */
   memcpy (new_sound, sound, sizeof (struct _RemixSound));
+  new_sound->base._world_item = world_item;
+  remix_sound_copy_owned (env, new_sound);
   new_sound->layer = new_layer;
   _remix_layer_add_sound (env, new_layer, new_sound, new_sound->start_time);
 
@@ -134,6 +251,7 @@ remix_sound_destroy (RemixEnv * env, RemixBase * base)
 
   _remix_sound_remove (env, sound);
 
+  remix_cursor_destroy (env, sound->source, sound->_cursor);
   if (sound->rate_envelope)
     remix_destroy (env, sound->rate_envelope);
   if (sound->gain_envelope)
@@ -146,6 +264,10 @@ remix_sound_destroy (RemixEnv * env, RemixBase * base)
     remix_destroy (env, (RemixBase *)sound->_gain_envstream);
   if (sound->_blend_envstream)
     remix_destroy (env, (RemixBase *)sound->_blend_envstream);
+  if (sound->_rate_srcstream)
+    remix_destroy (env, (RemixBase *)sound->_rate_srcstream);
+  if (sound->_rate_index) remix_free (sound->_rate_index);
+  if (sound->_rate_frac) remix_free (sound->_rate_frac);
   remix_free (sound);
 
   return 0;
@@ -157,11 +279,29 @@ remix_sound_ready (RemixEnv * env, RemixBase * base)
   return 0;
 }
 
+/*
+ * remix_sound_prepare (env, base)
+ *
+ * Resizes the sound's scratch streams if need be, and prepares its
+ * source and envelopes.
+ */
 static RemixBase *
 remix_sound_prepare (RemixEnv * env, RemixBase * base)
 {
   RemixSound * sound = (RemixSound *)base;
-  remix_sound_replace_mixstreams (env, sound);
+
+  remix_sound_ensure_mixstreams (env, sound);
+  remix_sound_ensure_rate_buffers (env, sound);
+
+  if (sound->source != RemixNone) remix_prepare (env, sound->source);
+  if (sound->_cursor != sound->source) remix_prepare (env, sound->_cursor);
+  if (sound->rate_envelope != RemixNone)
+    remix_prepare (env, sound->rate_envelope);
+  if (sound->gain_envelope != RemixNone)
+    remix_prepare (env, sound->gain_envelope);
+  if (sound->blend_envelope != RemixNone)
+    remix_prepare (env, sound->blend_envelope);
+
   return base;
 }
 
@@ -169,7 +309,19 @@ RemixBase *
 remix_sound_set_source (RemixEnv * env, RemixSound * sound, RemixBase * source)
 {
   RemixBase * old = sound->source;
+
+  remix_cursor_destroy (env, old, sound->_cursor);
+  sound->_cursor = RemixNone;
+  if (source != RemixNone)
+    sound->_cursor = remix_cursor_new (env, source);
+
+  /* Invalidate the source window */
+  if (sound->_rate_srcstream != RemixNone)
+    sound->_rate_src_start =
+      -remix_length (env, (RemixBase *)sound->_rate_srcstream);
+
   sound->source = source;
+  _remix_deck_graph_changed (env);
   return old;
 }
 
@@ -179,21 +331,38 @@ remix_sound_get_source (RemixEnv * env, RemixSound * sound)
   return sound->source;
 }
 
+/*
+ * _remix_sound_new_unplaced (env, source, layer, start_time, duration)
+ *
+ * Creates a sound belonging to 'layer', without adding it to the
+ * layer's timeline. The caller must do so.
+ */
 RemixSound *
-remix_sound_new (RemixEnv * env, RemixBase * source, RemixLayer * layer,
-		 RemixTime start_time, RemixTime duration)
+_remix_sound_new_unplaced (RemixEnv * env, RemixBase * source,
+			   RemixLayer * layer, RemixTime start_time,
+			   RemixTime duration)
 {
   RemixSound * sound = _remix_sound_new (env);
 
   sound->layer = layer;
   sound->start_time = start_time;
   sound->duration = duration;
-  _remix_layer_add_sound (env, layer, sound, start_time);
   sound->source = source;
   remix_sound_init (env, (RemixBase *)sound);
   return sound;
 }
 
+RemixSound *
+remix_sound_new (RemixEnv * env, RemixBase * source, RemixLayer * layer,
+		 RemixTime start_time, RemixTime duration)
+{
+  RemixSound * sound = _remix_sound_new_unplaced (env, source, layer,
+						  start_time, duration);
+
+  _remix_layer_add_sound (env, layer, sound, start_time);
+  return sound;
+}
+
 RemixLayer *
 remix_sound_get_layer (RemixEnv * env, RemixSound * sound)
 {
@@ -290,6 +459,15 @@ remix_sound_set_rate_envelope (RemixEnv * env, RemixSound * sound,
 {
   RemixBase * old = sound->rate_envelope;
   sound->rate_envelope = rate_envelope;
+  _remix_deck_graph_changed (env);
+
+  /* Source positions must be recalculated from the new envelope */
+  sound->_rate_offset = -1;
+  if ((old == RemixNone) != (rate_envelope == RemixNone)) {
+    remix_sound_ensure_mixstreams (env, sound);
+    remix_sound_ensure_rate_buffers (env, sound);
+  }
+
   return old;
 }
 
@@ -303,6 +481,38 @@ remix_sound_get_rate_envelope (RemixEnv * env, RemixSound * sound)
   return sound->rate_envelope;
 }
 
+/*
+ * remix_sound_set_rate_quality (env, sound, quality)
+ *
+ * Sets the interpolation used to resample the source of 'sound' when it
+ * has a rate envelope.
+ */
+RemixResampleQuality
+remix_sound_set_rate_quality (RemixEnv * env, RemixSound * sound,
+                              RemixResampleQuality quality)
+{
+  RemixResampleQuality old;
+
+  if (sound == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+  old = sound->rate_quality;
+  sound->rate_quality = quality;
+
+  return old;
+}
+
+RemixResampleQuality
+remix_sound_get_rate_quality (RemixEnv * env, RemixSound * sound)
+{
+  if (sound == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_INVALID);
+    return -1;
+  }
+  return sound->rate_quality;
+}
+
 RemixBase *
 remix_sound_set_gain_envelope (RemixEnv * env, RemixSound * sound,
 			    RemixBase * gain_envelope)
@@ -315,6 +525,8 @@ remix_sound_set_gain_envelope (RemixEnv * env, RemixSound * sound,
   }
   old = sound->gain_envelope;
   sound->gain_envelope = gain_envelope;
+  _remix_deck_graph_changed (env);
+  remix_sound_ensure_mixstreams (env, sound);
 
   return old;
 }
@@ -335,6 +547,8 @@ remix_sound_set_blend_envelope (RemixEnv * env, RemixSound * sound,
 {
   RemixBase * old = sound->blend_envelope;
   sound->blend_envelope = blend_envelope;
+  _remix_deck_graph_changed (env);
+  remix_sound_ensure_mixstreams (env, sound);
   return old;
 }
 
@@ -359,6 +573,12 @@ _remix_sound_fade (RemixEnv * env, RemixSound * sound, RemixCount count,
   /* XXX: this wanted to use 'block' not 'count': have we bounds
    * checked the sound ?? */
 
+  if (sound->_blend_envstream == RemixNone) {
+    remix_stream_write (env, output, count, input);
+    remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
+    return remix_envelope_fade (env, sound->blend_envelope, output, count);
+  }
+
   remix_seek (env, (RemixBase *)sound->_blend_envstream, 0, SEEK_SET);
   n = remix_process (env, sound->blend_envelope, count, RemixNone,
 		  sound->_blend_envstream);
@@ -370,6 +590,229 @@ _remix_sound_fade (RemixEnv * env, RemixSound * sound, RemixCount count,
   return n;
 }
 
+/*
+ * remix_sound_envstream_data (stream)
+ *
+ * Returns the data of the first channel of the contiguous envelope
+ * stream 'stream'. Envelopes write the same values to every channel.
+ */
+static RemixPCM *
+remix_sound_envstream_data (RemixEnv * env, RemixStream * stream)
+{
+  RemixChannel * channel = (RemixChannel *)stream->channels->data.s_pointer;
+  return _remix_chunk_realise (env,
+			       remix_channel_get_chunk_at (env, channel, 0))->data;
+}
+
+/*
+ * remix_sound_rate_sum (env, sound, offset)
+ *
+ * Returns the source position (relative to cutin) reached 'offset'
+ * samples into 'sound', ie. the sum of its rate envelope over the
+ * samples before 'offset'.
+ */
+static double
+remix_sound_rate_sum (RemixEnv * env, RemixSound * sound, RemixCount offset)
+{
+  RemixCount mixlength = _remix_base_get_mixlength (env, sound);
+  RemixCount remaining = offset, n, i;
+  RemixPCM * rate;
+  double sum = 0.0;
+
+  if (_remix_is_envelope (env, sound->rate_envelope))
+    return _remix_envelope_sum (env, (RemixEnvelope *)sound->rate_envelope,
+                                0, offset);
+
+  /* Any other rate source must be rendered from the start and summed */
+  remix_seek (env, sound->rate_envelope, 0, SEEK_SET);
+
+  while (remaining > 0) {
+    n = MIN (remaining, mixlength);
+    remix_seek (env, (RemixBase *)sound->_rate_envstream, 0, SEEK_SET);
+    n = remix_process (env, sound->rate_envelope, n, RemixNone,
+                       sound->_rate_envstream);
+    if (n <= 0) break;
+
+    rate = remix_sound_envstream_data (env, sound->_rate_envstream);
+    for (i = 0; i < n; i++)
+      sum += rate[i];
+
+    remaining -= n;
+  }
+
+  return sum;
+}
+
+/*
+ * remix_sound_fill_window (env, sound, lo, hi)
+ *
+ * Makes sure the source window of 'sound' holds source positions 'lo'
+ * to 'hi' inclusive (relative to cutin). A new window is read from the
+ * source in one batch, extending forwards from 'lo', or backwards from
+ * 'hi' when playing in reverse. Positions outside the source or its cut
+ * region read as silence.
+ */
+static void
+remix_sound_fill_window (RemixEnv * env, RemixSound * sound, RemixCount lo,
+                         RemixCount hi)
+{
+  RemixStream * window = sound->_rate_srcstream;
+  RemixCount size = remix_length (env, (RemixBase *)window);
+  RemixCount start, a, b, length;
+
+  if (lo >= sound->_rate_src_start && hi < sound->_rate_src_start + size)
+    return;
+
+  start = (lo < sound->_rate_src_start) ? hi + 1 - size : lo;
+
+  remix_seek (env, (RemixBase *)window, 0, SEEK_SET);
+  remix_stream_write0 (env, window, size);
+
+  a = MAX (start, 0);
+  b = start + size;
+  length = remix_length (env, sound->source);
+  if (length >= 0) b = MIN (b, length - sound->cutin);
+  if (sound->cutlength > 0) b = MIN (b, sound->cutlength);
+
+  if (b > a) {
+    remix_seek (env, sound->_cursor, sound->cutin + a, SEEK_SET);
+    remix_seek (env, (RemixBase *)window, a - start, SEEK_SET);
+    remix_process (env, sound->_cursor, b - a, RemixNone, window);
+  }
+
+  sound->_rate_src_start = start;
+}
+
+/* A RemixChunkFunc interpolating the source window at the positions
+ * calculated by _remix_sound_get_varispeed() */
+static RemixCount
+remix_sound_resample_chunk (RemixEnv * env, RemixChunk * chunk,
+                            RemixCount offset, RemixCount count,
+                            int channelname, void * data)
+{
+  RemixSound * sound = (RemixSound *)data;
+  RemixCount i = offset - sound->_rate_output_offset;
+  RemixChannel * channel;
+  RemixPCM * src, * d;
+
+  count = MIN (count, chunk->start_index + chunk->length - offset);
+
+  channel = remix_stream_find_channel (env, sound->_rate_srcstream,
+                                       channelname);
+  if (channel == RemixNone)
+    return _remix_chunk_clear_region (env, chunk, offset, count, 0, NULL);
+
+  src = _remix_chunk_realise (env,
+			      remix_channel_get_chunk_at (env, channel, 0))->data;
+  d = &chunk->data[offset - chunk->start_index];
+
+  switch (sound->rate_quality) {
+  case REMIX_RESAMPLE_LINEAR:
+    return _remix_pcm_resample_linear (src, &sound->_rate_index[i],
+                                       &sound->_rate_frac[i], d, count);
+  case REMIX_RESAMPLE_SINC:
+    return _remix_pcm_resample_sinc (src, &sound->_rate_index[i],
+                                     &sound->_rate_frac[i], d, count);
+  default:
+    return _remix_pcm_resample_cubic (src, &sound->_rate_index[i],
+                                      &sound->_rate_frac[i], d, count);
+  }
+}
+
+/*
+ * _remix_sound_get_varispeed (env, sound, offset, count, output)
+ *
+ * Get 'count' samples of the source of 'sound', resampled by its rate
+ * envelope: each output sample advances the source position by the
+ * value of the rate envelope at that sample. The source position is
+ * carried from one call to the next, and recalculated after a seek.
+ */
+static RemixCount
+_remix_sound_get_varispeed (RemixEnv * env, RemixSound * sound,
+                            RemixCount offset, RemixCount count,
+                            RemixStream * output)
+{
+  RemixCount mixlength = _remix_base_get_mixlength (env, sound);
+  RemixCount size = remix_length (env, (RemixBase *)sound->_rate_srcstream);
+  RemixCount remaining = count, processed = 0, n, i;
+  RemixCount x, x0, lo, hi, nlo, nhi, before, after, delta;
+  RemixPCM * rate, frac;
+  double pos;
+
+  /* Window margins needed around each position by the interpolator */
+  switch (sound->rate_quality) {
+  case REMIX_RESAMPLE_LINEAR:
+    before = 0; after = 1; break;
+  case REMIX_RESAMPLE_SINC:
+    before = REMIX_SINC_TAPS/2 - 1; after = REMIX_SINC_TAPS/2; break;
+  default:
+    before = 1; after = 2; break;
+  }
+
+  if (offset != sound->_rate_offset) {
+    sound->_rate_position = remix_sound_rate_sum (env, sound, offset);
+    sound->_rate_offset = offset;
+  }
+
+  while (remaining > 0) {
+    n = MIN (remaining, mixlength);
+
+    remix_seek (env, sound->rate_envelope, offset, SEEK_SET);
+    remix_seek (env, (RemixBase *)sound->_rate_envstream, 0, SEEK_SET);
+    n = remix_process (env, sound->rate_envelope, n, RemixNone,
+                       sound->_rate_envstream);
+    if (n <= 0) break;
+
+    rate = remix_sound_envstream_data (env, sound->_rate_envstream);
+
+    /* Find the source position of each output sample, stopping early
+     * if they would not all fit in the source window */
+    pos = sound->_rate_position;
+    x0 = lo = hi = (RemixCount) floor (pos);
+
+    for (i = 0; i < n; i++) {
+      x = (RemixCount) floor (pos);
+      nlo = MIN (lo, x);
+      nhi = MAX (hi, x);
+      if (nhi - nlo + before + after >= size) break;
+      lo = nlo; hi = nhi;
+
+      frac = (RemixPCM)(pos - x);
+      if (frac >= 1.0) frac = 0.99999994; /* rounded up from just below 1 */
+
+      sound->_rate_index[i] = (int)(x - x0);
+      sound->_rate_frac[i] = frac;
+      pos += rate[i];
+    }
+    n = i;
+
+    remix_sound_fill_window (env, sound, lo - before, hi + after);
+
+    delta = x0 - sound->_rate_src_start;
+    for (i = 0; i < n; i++)
+      sound->_rate_index[i] += delta;
+
+    sound->_rate_output_offset = remix_tell (env, (RemixBase *)output);
+    n = remix_stream_chunkfuncify (env, output, n, remix_sound_resample_chunk,
+                                   sound);
+    if (n <= 0) break;
+
+    /* Only as far as was written, if the output was short */
+    for (i = 0; i < n; i++)
+      sound->_rate_position += rate[i];
+
+    offset += n;
+    processed += n;
+    remaining -= n;
+  }
+
+  sound->_rate_offset = offset;
+
+  remix_dprintf ("[_remix_sound_get_varispeed] got %ld samples\n", processed);
+
+  return processed;
+}
+
 /* Do rate conversion, handle offset etc.: get raw sound data */
 static RemixCount
 _remix_sound_get_raw (RemixEnv * env, RemixSound * sound, RemixCount offset,
@@ -381,7 +824,8 @@ _remix_sound_get_raw (RemixEnv * env, RemixSound * sound, RemixCount offset,
   remix_dprintf ("[_remix_sound_get_raw] (%p, +%ld, %p -> %p) @ %ld\n",
 	      sound, count, input, output, offset);
 
-  /* XXX: deal with rate conversion!! */
+  if (sound->rate_envelope != RemixNone)
+    return _remix_sound_get_varispeed (env, sound, offset, count, output);
 
   if (sound->cutlength > 0) {
     if (offset > sound->cutlength) {
@@ -396,8 +840,8 @@ _remix_sound_get_raw (RemixEnv * env, RemixSound * sound, RemixCount offset,
   remix_dprintf ("[_remix_sound_get_raw] block +%ld (cutin: %ld, cutlength: %ld)\n",
 	      block, sound->cutin, sound->cutlength);
 
-  remix_seek (env, sound->source, sound->cutin + offset, SEEK_SET);
-  n = remix_process (env, sound->source, block, input, output);
+  remix_seek (env, sound->_cursor, sound->cutin + offset, SEEK_SET);
+  n = remix_process (env, sound->_cursor, block, input, output);
 
   if (n == -1) {
     remix_dprintf ("error getting source data: %s\n",
@@ -423,6 +867,12 @@ _remix_sound_apply_gain (RemixEnv * env, RemixSound * sound,
   remix_dprintf ("in _remix_sound_apply_gain (%p, +%ld)\n", sound, count);
 
   remix_seek (env, sound->gain_envelope, offset, SEEK_SET);
+
+  if (sound->_gain_envstream == RemixNone) {
+    remix_seek (env, (RemixBase *)data, data_offset, SEEK_SET);
+    return remix_envelope_mult (env, sound->gain_envelope, data, count);
+  }
+
   remix_seek (env, (RemixBase *)sound->_gain_envstream, 0, SEEK_SET);
   n = remix_process (env, sound->gain_envelope, count,
 		  RemixNone, sound->_gain_envstream);
@@ -446,6 +896,10 @@ _remix_sound_blend (RemixEnv * env, RemixSound * sound, RemixCount count,
   /* XXX: this wanted to use 'block' not 'count': have we bounds
    * checked the sound ?? */
 
+  if (sound->_blend_envstream == RemixNone)
+    return remix_envelope_blend (env, sound->blend_envelope, input, output,
+				 count);
+
   remix_seek (env, (RemixBase * )sound->_blend_envstream, 0, SEEK_SET);
   n = remix_process (env, sound->blend_envelope, count, RemixNone,
 		    sound->_blend_envstream);
@@ -456,6 +910,40 @@ _remix_sound_blend (RemixEnv * env, RemixSound * sound, RemixCount count,
   return n;
 }
 
+/*
+ * _remix_sound_apply_envelopes (env, sound, offset, count, gain, input,
+ *                               output)
+ *
+ * Multiplies 'count' samples of 'output' by the gain envelope of 'sound'
+ * from 'offset' (if 'gain' is set), and blends 'input' back into them by
+ * its blend envelope, in one pass. Returns -1, having done nothing, if
+ * the envelopes cannot be evaluated together, as when either is not a
+ * RemixEnvelope.
+ */
+static RemixCount
+_remix_sound_apply_envelopes (RemixEnv * env, RemixSound * sound,
+			      RemixCount offset, RemixCount count, int gain,
+			      RemixStream * input, RemixStream * output)
+{
+  RemixStreamExpr expr;
+
+  if ((gain && sound->_gain_envstream != RemixNone) ||
+      sound->_blend_envstream != RemixNone)
+    return -1;
+
+  remix_stream_expr_init (env, &expr, input);
+  if (gain &&
+      remix_stream_expr_mult (env, &expr, sound->gain_envelope) == -1)
+    return -1;
+  if (sound->blend_envelope != RemixNone &&
+      remix_stream_expr_blend (env, &expr, sound->blend_envelope) == -1)
+    return -1;
+
+  if (gain) remix_seek (env, sound->gain_envelope, offset, SEEK_SET);
+
+  return remix_stream_expr_evaluate (env, &expr, output, count);
+}
+
 static RemixCount
 remix_sound_process (RemixEnv * env, RemixBase * base, RemixCount count,
                      RemixStream * input, RemixStream * output)
@@ -464,6 +952,7 @@ remix_sound_process (RemixEnv * env, RemixBase * base, RemixCount count,
   RemixCount remaining = count, processed = 0, block, m, n;
   RemixCount offset, input_offset, output_offset;
   RemixCount mixlength = _remix_base_get_mixlength (env, sound);
+  int gain;
 
   offset = remix_tell (env, (RemixBase *)sound);
 
@@ -473,7 +962,8 @@ remix_sound_process (RemixEnv * env, RemixBase * base, RemixCount count,
   /* if we're beyond the source's actual length, then
    * just fade the input to the output using the sound's blend
    * envelope */
-  if (offset > remix_length (env, sound->source)) {
+  if (sound->rate_envelope == RemixNone &&
+      offset > remix_length (env, sound->source)) {
     remix_dprintf ("## offset %ld > length %ld\n", offset,
 	    remix_length (env, sound->source));
 
@@ -501,23 +991,45 @@ remix_sound_process (RemixEnv * env, RemixBase * base, RemixCount count,
       n = m;
     }
 
-    /* Apply gain envelope */
-    if (sound->gain_envelope != RemixNone) {
-      m = _remix_sound_apply_gain (env, sound, offset, n, output, output_offset);
-      if (m == -1) {
-	remix_dprintf ("error applying gain!\n");
-      } else {
-	n = m;
-      }
-    }
-    
-    /* Blend input back in */
-    if (sound->blend_envelope != RemixNone) {
+    /* Apply gain envelope, unless the raw data is silent anyway */
+    gain = (sound->gain_envelope != RemixNone &&
+	    !_remix_stream_is_silent (env, output, output_offset, n));
+
+    /* Apply gain and blend the input back in together where we can */
+    m = -1;
+    if (gain || sound->blend_envelope != RemixNone) {
       remix_seek (env, (RemixBase *)input, input_offset, SEEK_SET);
       remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
-      n = _remix_sound_blend (env, sound, n, input, output);
+      m = _remix_sound_apply_envelopes (env, sound, offset, n, gain,
+					input, output);
     }
-    
+
+    if (m != -1) {
+      n = m;
+    } else {
+      if (gain) {
+	m = _remix_sound_apply_gain (env, sound, offset, n, output,
+				     output_offset);
+	if (m == -1) {
+	  remix_dprintf ("error applying gain!\n");
+	} else {
+	  n = m;
+	}
+      }
+
+      /* Blend input back in */
+      if (sound->blend_envelope != RemixNone) {
+	remix_seek (env, (RemixBase *)input, input_offset, SEEK_SET);
+	remix_seek (env, (RemixBase *)output, output_offset, SEEK_SET);
+	n = _remix_sound_blend (env, sound, n, input, output);
+      }
+    }
+
+    if (n <= 0) {
+      remix_dprintf ("error applying envelopes\n");
+      break;
+    }
+
     offset += n;
     processed += n;
     remaining -= n;
@@ -546,7 +1058,7 @@ remix_sound_seek (RemixEnv * env, RemixBase * base, RemixCount offset)
   if (sound->cutlength > 0 && offset > sound->cutlength) {
     offset = sound->cutlength;
   }
-  remix_seek (env, sound->source, sound->cutin + offset, SEEK_SET);
+  remix_seek (env, sound->_cursor, sound->cutin + offset, SEEK_SET);
   return offset;
 }
 
@@ -554,7 +1066,7 @@ static int
 remix_sound_flush (RemixEnv * env, RemixBase * base)
 {
   RemixSound * sound = (RemixSound *)base;
-  return remix_flush (env, sound->source);
+  return remix_flush (env, sound->_cursor);
 }
 
 static struct _RemixMethods _remix_sound_methods = {
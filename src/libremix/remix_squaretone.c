@@ -53,7 +53,7 @@ remix_squaretone_replace_channels (RemixEnv * env, RemixSquareTone * squaretone)
   CDSet * s, * channels = remix_get_channels (env);
   RemixCount offset = remix_tell (env, (RemixBase *)squaretone);
 
-  cd_set_free_all (env, squaretone->channels);
+  squaretone->channels = cd_set_free_all (env, squaretone->channels);
 
   for (s = channels; s; s = s->next) {
     remix_dprintf ("[remix_squaretone_replace_channels] %p replacing channel %d\n",
@@ -105,15 +105,24 @@ static int
 remix_squaretone_destroy (RemixEnv * env, RemixBase * base)
 {
   RemixSquareTone * squaretone = (RemixSquareTone *)base;
+  cd_set_free_all (env, squaretone->channels);
   remix_free (squaretone);
   return 0;
 }
 
+/* Ready if there is a channel built for each in the context */
 static int
 remix_squaretone_ready (RemixEnv * env, RemixBase * base)
 {
-  return (remix_base_has_samplerate (env, base) &&
-	  remix_base_encompasses_channels (env, base));
+  RemixSquareTone * squaretone = (RemixSquareTone *)base;
+  CDSet * s;
+
+  if (!remix_base_has_samplerate (env, base)) return 0;
+
+  for (s = remix_get_channels (env); s; s = s->next)
+    if (!cd_set_contains (env, squaretone->channels, s->key)) return 0;
+
+  return 1;
 }
 
 static RemixBase *
@@ -30,10 +30,17 @@
  *
  * A stream consists of multiple channels of PCM data.
  *
+ * A cursor of a stream, from remix_cursor_new(), is a stream whose
+ * channels are views of the source's channels, sharing their chunks but
+ * with positions of their own. The views are pointed at the source's
+ * current chunks whenever the cursor is seeked or processed.
+ *
  * Invariants
  * ----------
  *
  * A stream is an independent entity.
+ *
+ * A cursor is only read from, and does not outlive its source.
  */
 
 #define __REMIX__
@@ -45,6 +52,15 @@
 static RemixStream * remix_stream_optimise (RemixEnv * env,
 					    RemixStream * stream);
 
+static RemixBase * remix_stream_cursor (RemixEnv * env, RemixBase * base);
+
+typedef struct _RemixStreamCursor RemixStreamCursor;
+
+struct _RemixStreamCursor {
+  RemixStream stream; /* channels are views of the source's */
+  RemixStream * source;
+};
+
 RemixBase *
 remix_stream_init (RemixEnv * env, RemixBase * base)
 {
@@ -155,7 +171,8 @@ remix_stream_destroy (RemixEnv * env, RemixBase * base)
     return -1;
   }
 
-  cd_set_destroy_with (env, stream->channels, (CDDestroyFunc)remix_destroy);
+  cd_set_destroy_with (env, stream->channels,
+                       (CDDestroyFunc)remix_channel_destroy);
 
   remix_free (stream);
   return 0;
@@ -246,6 +263,71 @@ remix_stream_write0 (RemixEnv * env, RemixStream * stream, RemixCount count)
   return count;
 }
 
+/*
+ * _remix_stream_fits (env, stream, length)
+ *
+ * Returns TRUE if 'stream' has at least 'length' samples from offset 0
+ * in each of the env's channels.
+ */
+int
+_remix_stream_fits (RemixEnv * env, RemixStream * stream, RemixCount length)
+{
+  CDSet * s, * channels = remix_get_channels (env);
+  RemixChannel * channel;
+
+  if (stream == RemixNone) return FALSE;
+
+  for (s = channels; s; s = s->next) {
+    channel = remix_stream_find_channel (env, stream, s->key);
+    if (channel == RemixNone || _remix_channel_length (env, channel) < length)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * _remix_stream_ensure_contiguous (env, stream, length)
+ *
+ * Returns 'stream' if it fits 'length' samples of the env's channels.
+ * Otherwise destroys it, if it is not RemixNone, and returns a new
+ * contiguous stream of 'length'.
+ */
+RemixStream *
+_remix_stream_ensure_contiguous (RemixEnv * env, RemixStream * stream,
+				 RemixCount length)
+{
+  if (_remix_stream_fits (env, stream, length)) return stream;
+
+  if (stream != RemixNone) remix_destroy (env, (RemixBase *)stream);
+
+  return remix_stream_new_contiguous (env, length);
+}
+
+/*
+ * _remix_stream_is_silent (env, stream, offset, count)
+ *
+ * Returns TRUE if 'count' samples from 'offset' of each of the env's
+ * channels in 'stream' are known to be silent.
+ */
+int
+_remix_stream_is_silent (RemixEnv * env, RemixStream * stream,
+			 RemixCount offset, RemixCount count)
+{
+  CDSet * s, * channels = remix_get_channels (env);
+  RemixChannel * channel;
+
+  for (s = stream->channels; s; s = s->next) {
+    if (cd_set_contains (env, channels, s->key)) {
+      channel = (RemixChannel *)s->data.s_pointer;
+      if (!_remix_channel_is_silent (env, channel, offset, count))
+	return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 /*
  * remix_stream_process (env, stream, count, input, output)
  *
@@ -305,8 +387,119 @@ static struct _RemixMethods _remix_stream_methods = {
   remix_stream_process,
   remix_stream_length,
   remix_stream_seek,
+  NULL, /* flush */
+  remix_stream_cursor,
+};
+
+/*
+ * remix_stream_cursor_refresh (env, cursor, offset)
+ *
+ * Points the channel views of 'cursor' at the current chunks of its
+ * source, at 'offset', first rebuilding them if the source's channels
+ * have changed.
+ */
+static void
+remix_stream_cursor_refresh (RemixEnv * env, RemixStreamCursor * cursor,
+			     RemixCount offset)
+{
+  RemixStream * stream = &cursor->stream;
+  RemixChannel * view;
+  CDSet * s;
+  int rebuild;
+
+  rebuild = (cd_set_size (env, stream->channels) !=
+	     cd_set_size (env, cursor->source->channels));
+  for (s = cursor->source->channels; s && !rebuild; s = s->next)
+    rebuild = !cd_set_contains (env, stream->channels, s->key);
+
+  if (rebuild) {
+    stream->channels = cd_set_free_all (env, stream->channels);
+    for (s = cursor->source->channels; s; s = s->next)
+      remix_stream_add_channel_unchecked (env, stream, s->key,
+					  remix_channel_new (env));
+  }
+
+  for (s = cursor->source->channels; s; s = s->next) {
+    view = (RemixChannel *)
+      (cd_set_find (env, stream->channels, s->key)).s_pointer;
+    view->_current_offset = offset;
+    _remix_channel_view (env, view, (RemixChannel *)s->data.s_pointer);
+  }
+}
+
+static int
+remix_stream_cursor_destroy (RemixEnv * env, RemixBase * base)
+{
+  RemixStreamCursor * cursor = (RemixStreamCursor *)base;
+
+  /* The views do not own their chunks */
+  cd_set_free_all (env, cursor->stream.channels);
+  remix_free (cursor);
+  return 0;
+}
+
+static RemixCount
+remix_stream_cursor_process (RemixEnv * env, RemixBase * base,
+			     RemixCount count, RemixStream * input,
+			     RemixStream * output)
+{
+  RemixStreamCursor * cursor = (RemixStreamCursor *)base;
+
+  remix_stream_cursor_refresh (env, cursor, remix_tell (env, base));
+  return remix_stream_write (env, output, count, &cursor->stream);
+}
+
+static RemixCount
+remix_stream_cursor_length (RemixEnv * env, RemixBase * base)
+{
+  RemixStreamCursor * cursor = (RemixStreamCursor *)base;
+  return remix_length (env, (RemixBase *)cursor->source);
+}
+
+static RemixCount
+remix_stream_cursor_seek (RemixEnv * env, RemixBase * base, RemixCount offset)
+{
+  RemixStreamCursor * cursor = (RemixStreamCursor *)base;
+
+  remix_stream_cursor_refresh (env, cursor, offset);
+  return offset;
+}
+
+/* A clone or cursor of a cursor is another cursor of its source */
+static RemixBase *
+remix_stream_cursor_clone (RemixEnv * env, RemixBase * base)
+{
+  RemixStreamCursor * cursor = (RemixStreamCursor *)base;
+  return remix_stream_cursor (env, (RemixBase *)cursor->source);
+}
+
+static struct _RemixMethods _remix_stream_cursor_methods = {
+  remix_stream_cursor_clone,
+  remix_stream_cursor_destroy,
+  NULL, /* ready */
+  NULL, /* prepare */
+  remix_stream_cursor_process,
+  remix_stream_cursor_length,
+  remix_stream_cursor_seek,
+  NULL, /* flush */
+  remix_stream_cursor_clone,
 };
 
+static RemixBase *
+remix_stream_cursor (RemixEnv * env, RemixBase * base)
+{
+  RemixStreamCursor * cursor;
+
+  cursor = (RemixStreamCursor *)
+    remix_base_new_subclass (env, sizeof (struct _RemixStreamCursor));
+  cursor->source = (RemixStream *)base;
+  cursor->stream.channels = cd_set_new (env);
+  remix_stream_cursor_refresh (env, cursor, 0);
+  _remix_set_methods (env, cursor, &_remix_stream_cursor_methods);
+
+  return (RemixBase *)cursor;
+}
+
 static RemixStream *
 remix_stream_optimise (RemixEnv * env, RemixStream * stream)
 {
@@ -588,6 +781,67 @@ remix_streams_mix (RemixEnv * env, CDList * streams, RemixStream * dest,
   return count;
 }
 
+/*
+ * remix_streams_mix_gains (env, streams, gains, dest, count)
+ *
+ * Mix 'count' samples from all streams in list 'streams', each scaled by
+ * the corresponding value in the array 'gains', into 'dest', replacing
+ * the previous contents of 'dest'. Sources are summed REMIX_MIX_GROUP at
+ * a time, so each group costs one pass over 'dest' rather than a gain
+ * pass and a mix pass per stream.
+ */
+RemixCount
+remix_streams_mix_gains (RemixEnv * env, CDList * streams, RemixPCM * gains,
+                         RemixStream * dest, RemixCount count)
+{
+  RemixChannel * srcs[REMIX_MIX_GROUP];
+  CDList * sl, * group;
+  CDSet * s;
+  RemixChannel * dch;
+  RemixStream * stream;
+  RemixCount dest_start = remix_tell (env, (RemixBase *)dest);
+  RemixCount n, mixed = count;
+  int k, g;
+
+  if (dest == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_NOENTITY);
+    return -1;
+  }
+
+  for (s = dest->channels; s; s = s->next) {
+    dch = (RemixChannel *)s->data.s_pointer;
+    g = 0;
+    group = streams;
+
+    do {
+      for (k = 0, sl = group; sl && k < REMIX_MIX_GROUP; sl = sl->next, k++) {
+        stream = (RemixStream *)sl->data.s_pointer;
+        srcs[k] = remix_stream_find_channel (env, stream, s->key);
+        if (srcs[k] != RemixNone)
+          _remix_channel_seek (env, srcs[k],
+                               remix_tell (env, (RemixBase *)stream));
+      }
+
+      _remix_channel_seek (env, dch, dest_start);
+      n = remix_channel_mix_gains (env, srcs, &gains[g], k, dch, count,
+                                   g > 0);
+      mixed = MIN (mixed, n);
+
+      g += k;
+      group = sl;
+    } while (group != NULL);
+  }
+
+  for (sl = streams; sl; sl = sl->next) {
+    stream = (RemixStream *)sl->data.s_pointer;
+    remix_seek (env, (RemixBase *)stream, mixed, SEEK_CUR);
+  }
+
+  remix_seek (env, (RemixBase *)dest, dest_start + mixed, SEEK_SET);
+
+  return mixed;
+}
+
 /*
  * remix_stream_interleave_2 (env, stream, name1, name2, dest, count)
  *
@@ -617,6 +871,45 @@ remix_stream_interleave_2 (RemixEnv * env, RemixStream * stream,
   return n;
 }
 
+/*
+ * remix_stream_interleave (env, stream, dest, count)
+ *
+ * Interleave 'count' frames of all the channels of 'stream', in order of
+ * their names, placing the resulting PCM data in the memory region
+ * pointed to by 'dest'.
+ */
+RemixCount
+remix_stream_interleave (RemixEnv * env, RemixStream * stream,
+                         RemixPCM * dest, RemixCount count)
+{
+  RemixChannel * channels[REMIX_INTERLEAVE_MAX];
+  int names[REMIX_INTERLEAVE_MAX];
+  CDSet * s;
+  RemixCount n;
+  int nr_channels = 0, k;
+
+  /* Insertion sort the channels by name */
+  for (s = stream->channels; s; s = s->next) {
+    if (nr_channels == REMIX_INTERLEAVE_MAX) {
+      remix_set_error (env, REMIX_ERROR_INVALID);
+      return -1;
+    }
+    for (k = nr_channels; k > 0 && names[k-1] > s->key; k--) {
+      names[k] = names[k-1];
+      channels[k] = channels[k-1];
+    }
+    names[k] = s->key;
+    channels[k] = (RemixChannel *)s->data.s_pointer;
+    nr_channels++;
+  }
+
+  n = remix_channels_interleave (env, channels, nr_channels, dest, count);
+
+  if (n > 0) remix_seek (env, (RemixBase *)stream, n, SEEK_CUR);
+
+  return n;
+}
+
 /*
  * remix_stream_deinterleave_stereo (env, stream, name1, name2, src, count)
  *
@@ -0,0 +1,351 @@
+/*
+ * libremix -- An audio mixing and sequencing library.
+ *
+ * Copyright (C) 2001 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * RemixThreadPool: persistent worker threads for parallel rendering.
+ *
+ * Description
+ * -----------
+ *
+ * A world may own a pool of worker threads, set up with
+ * remix_set_threads(). Decks use it to render their tracks concurrently.
+ *
+ * Each worker has its own RemixEnv sharing the world and context of the
+ * env which created the pool, so that error state is per thread. The
+ * calling thread takes part in running the tasks of a job.
+ *
+ * Invariants
+ * ----------
+ *
+ * The pool runs one job at a time. A job submitted while another is in
+ * progress -- eg. by a nested deck rendering inside a worker -- is run
+ * serially on the calling thread, so workers never wait on the pool.
+ *
+ * The context must not be modified while a job is running.
+ */
+
+#include <config.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define __REMIX__
+#include "remix.h"
+
+#ifdef HAVE_PTHREAD
+
+typedef struct _RemixWorker RemixWorker;
+
+struct _RemixWorker {
+  RemixThreadPool * pool;
+  RemixEnv * env;
+  pthread_t thread;
+};
+
+struct _RemixThreadPool {
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  pthread_mutex_t world_lock; /* protects world->bases */
+  int nr_workers;
+  RemixWorker * workers;
+  int shutdown;
+  int busy;
+
+  /* Current job */
+  RemixTaskFunc func;
+  void * data;
+  int nr_tasks;
+  int next_task;
+  int nr_pending;
+};
+
+static void *
+remix_thread_pool_worker (void * arg)
+{
+  RemixWorker * worker = (RemixWorker *)arg;
+  RemixThreadPool * pool = worker->pool;
+  int task;
+
+  pthread_mutex_lock (&pool->lock);
+
+  for (;;) {
+    while (!pool->shutdown && pool->next_task >= pool->nr_tasks)
+      pthread_cond_wait (&pool->work_cond, &pool->lock);
+
+    if (pool->shutdown) break;
+
+    task = pool->next_task++;
+    pthread_mutex_unlock (&pool->lock);
+
+    pool->func (worker->env, task, pool->data);
+
+    pthread_mutex_lock (&pool->lock);
+    if (--pool->nr_pending == 0)
+      pthread_cond_signal (&pool->done_cond);
+  }
+
+  pthread_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+/*
+ * remix_thread_pool_new (env, nr_workers)
+ *
+ * Starts 'nr_workers' worker threads. Returns RemixNone if any thread
+ * could not be started.
+ */
+static RemixThreadPool *
+remix_thread_pool_new (RemixEnv * env, int nr_workers)
+{
+  RemixThreadPool * pool;
+  RemixWorker * worker;
+  int i;
+
+  pool = (RemixThreadPool *) remix_malloc (sizeof (struct _RemixThreadPool));
+  pool->workers = (RemixWorker *) remix_malloc (nr_workers *
+						sizeof (struct _RemixWorker));
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->work_cond, NULL);
+  pthread_cond_init (&pool->done_cond, NULL);
+  pthread_mutex_init (&pool->world_lock, NULL);
+  pool->shutdown = FALSE;
+  pool->busy = FALSE;
+  pool->nr_tasks = 0;
+  pool->next_task = 0;
+  pool->nr_pending = 0;
+
+  for (i = 0; i < nr_workers; i++) {
+    worker = &pool->workers[i];
+    worker->pool = pool;
+
+    /* Worker envs share the world but are not counted as its users */
+    worker->env = remix_malloc (sizeof (struct _RemixThreadContext));
+    worker->env->context = env->context;
+    worker->env->world = env->world;
+
+    if (pthread_create (&worker->thread, NULL, remix_thread_pool_worker,
+			worker) != 0) {
+      remix_free (worker->env);
+      break;
+    }
+  }
+
+  pool->nr_workers = i;
+
+  if (i < nr_workers) {
+    env->world->_pool = pool;
+    _remix_thread_pool_destroy (env);
+    return RemixNone;
+  }
+
+  return pool;
+}
+
+void
+_remix_thread_pool_destroy (RemixEnv * env)
+{
+  RemixThreadPool * pool = env->world->_pool;
+  int i;
+
+  if (pool == RemixNone) return;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->shutdown = TRUE;
+  pthread_cond_broadcast (&pool->work_cond);
+  pthread_mutex_unlock (&pool->lock);
+
+  for (i = 0; i < pool->nr_workers; i++) {
+    pthread_join (pool->workers[i].thread, NULL);
+    remix_free (pool->workers[i].env);
+  }
+
+  pthread_mutex_destroy (&pool->lock);
+  pthread_cond_destroy (&pool->work_cond);
+  pthread_cond_destroy (&pool->done_cond);
+  pthread_mutex_destroy (&pool->world_lock);
+
+  remix_free (pool->workers);
+  remix_free (pool);
+
+  env->world->_pool = RemixNone;
+}
+
+/*
+ * _remix_thread_pool_run (env, func, data, nr_tasks)
+ *
+ * Calls func (task_env, i, data) for each 'i' from 0 to nr_tasks-1,
+ * spread across the world's worker threads and the calling thread, and
+ * waits for all of them to complete. The tasks are run serially on the
+ * calling thread if there is no pool or it is busy with another job.
+ * Any error a task sets is left in its task_env, for the task to pass
+ * back through 'data'. Returns the number of tasks run.
+ */
+int
+_remix_thread_pool_run (RemixEnv * env, RemixTaskFunc func, void * data,
+			int nr_tasks)
+{
+  RemixThreadPool * pool = env->world->_pool;
+  int task;
+
+  if (pool == RemixNone || nr_tasks < 2) goto serial;
+
+  pthread_mutex_lock (&pool->lock);
+
+  if (pool->busy) {
+    pthread_mutex_unlock (&pool->lock);
+    goto serial;
+  }
+
+  pool->busy = TRUE;
+  pool->func = func;
+  pool->data = data;
+  pool->nr_tasks = nr_tasks;
+  pool->next_task = 0;
+  pool->nr_pending = nr_tasks;
+  pthread_cond_broadcast (&pool->work_cond);
+
+  while (pool->next_task < pool->nr_tasks) {
+    task = pool->next_task++;
+    pthread_mutex_unlock (&pool->lock);
+
+    func (env, task, data);
+
+    pthread_mutex_lock (&pool->lock);
+    pool->nr_pending--;
+  }
+
+  while (pool->nr_pending > 0)
+    pthread_cond_wait (&pool->done_cond, &pool->lock);
+
+  pool->nr_tasks = 0;
+  pool->next_task = 0;
+  pool->busy = FALSE;
+
+  pthread_mutex_unlock (&pool->lock);
+
+  return nr_tasks;
+
+ serial:
+  for (task = 0; task < nr_tasks; task++) {
+    func (env, task, data);
+  }
+
+  return nr_tasks;
+}
+
+void
+_remix_world_lock (RemixEnv * env)
+{
+  RemixThreadPool * pool = env->world->_pool;
+  if (pool != RemixNone) pthread_mutex_lock (&pool->world_lock);
+}
+
+void
+_remix_world_unlock (RemixEnv * env)
+{
+  RemixThreadPool * pool = env->world->_pool;
+  if (pool != RemixNone) pthread_mutex_unlock (&pool->world_lock);
+}
+
+#else /* HAVE_PTHREAD */
+
+void
+_remix_thread_pool_destroy (RemixEnv * env)
+{
+}
+
+int
+_remix_thread_pool_run (RemixEnv * env, RemixTaskFunc func, void * data,
+			int nr_tasks)
+{
+  int task;
+
+  for (task = 0; task < nr_tasks; task++) {
+    func (env, task, data);
+  }
+
+  return nr_tasks;
+}
+
+void
+_remix_world_lock (RemixEnv * env)
+{
+}
+
+void
+_remix_world_unlock (RemixEnv * env)
+{
+}
+
+#endif /* HAVE_PTHREAD */
+
+/*
+ * remix_set_threads (env, nr_threads)
+ *
+ * Sets the number of threads used to render decks in env's world,
+ * including the calling thread. A value of 1 or less disables threaded
+ * rendering, which is the default. Must not be called while processing.
+ * Returns the previous number of threads, or -1 if the threads could
+ * not be started.
+ */
+int
+remix_set_threads (RemixEnv * env, int nr_threads)
+{
+  int old = remix_get_threads (env);
+
+  if (nr_threads == old) return old;
+
+  _remix_thread_pool_destroy (env);
+
+  if (nr_threads <= 1) return old;
+
+#ifdef HAVE_PTHREAD
+  env->world->_pool = remix_thread_pool_new (env, nr_threads - 1);
+  if (env->world->_pool == RemixNone) {
+    remix_set_error (env, REMIX_ERROR_SYSTEM);
+    return -1;
+  }
+  return old;
+#else
+  remix_set_error (env, REMIX_ERROR_INVALID);
+  return -1;
+#endif
+}
+
+/*
+ * remix_get_threads (env)
+ *
+ * Returns the number of threads used to render decks in env's world.
+ */
+int
+remix_get_threads (RemixEnv * env)
+{
+#ifdef HAVE_PTHREAD
+  RemixThreadPool * pool = env->world->_pool;
+  if (pool != RemixNone) return pool->nr_workers + 1;
+#endif
+  return 1;
+}
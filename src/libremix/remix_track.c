@@ -43,18 +43,21 @@
 /* Optimisation dependencies: optimise on change of nr. layers */
 static RemixTrack * remix_track_optimise (RemixEnv * env, RemixTrack * track);
 
+/*
+ * remix_track_ensure_mixstreams (env, track)
+ *
+ * Makes sure the track's two scratch streams fit its mixlength and the
+ * env's channels, replacing them if not.
+ */
 static void
-remix_track_replace_mixstreams (RemixEnv * env, RemixTrack * track)
+remix_track_ensure_mixstreams (RemixEnv * env, RemixTrack * track)
 {
   RemixCount mixlength = _remix_base_get_mixlength (env, track);
 
-  if (track->_mixstream_a != RemixNone)
-    remix_destroy (env, (RemixBase *)track->_mixstream_a);
-  if (track->_mixstream_b != RemixNone)
-    remix_destroy (env, (RemixBase *)track->_mixstream_b);
-
-  track->_mixstream_a = remix_stream_new_contiguous (env, mixlength);
-  track->_mixstream_b = remix_stream_new_contiguous (env, mixlength);
+  track->_mixstream_a =
+    _remix_stream_ensure_contiguous (env, track->_mixstream_a, mixlength);
+  track->_mixstream_b =
+    _remix_stream_ensure_contiguous (env, track->_mixstream_b, mixlength);
 }
 
 static RemixBase *
@@ -64,7 +67,7 @@ remix_track_init (RemixEnv * env, RemixBase * base)
   track->gain = 1.0;
   track->layers = cd_list_new (env);
   track->_mixstream_a = track->_mixstream_b = RemixNone;
-  remix_track_replace_mixstreams (env, track);
+  remix_track_ensure_mixstreams (env, track);
   remix_track_optimise (env, track);
   return (RemixBase *)track;
 }
@@ -76,16 +79,40 @@ _remix_track_new (RemixEnv * env)
     remix_base_new_subclass (env, sizeof (struct _RemixTrack));
 }
 
+/*
+ * remix_track_clone_with_deck (env, base, new_deck)
+ *
+ * Clones the track 'base' and its layers for 'new_deck'. The new track
+ * is not added to the deck's list of tracks.
+ */
 RemixBase *
-remix_track_clone (RemixEnv * env, RemixBase * base)
+remix_track_clone_with_deck (RemixEnv * env, RemixBase * base,
+			     RemixDeck * new_deck)
 {
   RemixTrack * track = (RemixTrack *)base;
   RemixTrack * new_track = _remix_track_new (env);
 
+  new_track->deck = new_deck;
+  remix_track_init (env, (RemixBase *)new_track);
   new_track->gain = track->gain;
-  new_track->layers = cd_list_clone (env, track->layers,
-				     (CDCloneFunc)remix_layer_clone);
-  remix_track_optimise (env, track);
+  new_track->layers =
+    cd_list_clone_with (env, track->layers,
+			(CDCloneWithFunc)remix_layer_clone_with_track,
+			new_track);
+  remix_track_optimise (env, new_track);
+
+  return (RemixBase *)new_track;
+}
+
+RemixBase *
+remix_track_clone (RemixEnv * env, RemixBase * base)
+{
+  RemixTrack * track = (RemixTrack *)base;
+  RemixTrack * new_track = (RemixTrack *)
+    remix_track_clone_with_deck (env, base, track->deck);
+
+  if (track->deck)
+    _remix_deck_add_track (env, track->deck, new_track);
 
   return (RemixBase *)new_track;
 }
@@ -95,22 +122,29 @@ remix_track_destroy (RemixEnv * env, RemixBase * base)
 {
   RemixTrack * track = (RemixTrack *)base;
   remix_destroy_list (env, track->layers);
+  remix_destroy (env, (RemixBase *)track->_mixstream_a);
+  remix_destroy (env, (RemixBase *)track->_mixstream_b);
   remix_free (track);
   return 0;
 }
 
-static int
-remix_track_ready (RemixEnv * env, RemixBase * base)
-{
-  return (remix_base_encompasses_mixlength (env, base) &&
-	  remix_base_encompasses_channels (env, base));
-}
-
+/*
+ * remix_track_prepare (env, base)
+ *
+ * Resizes the track's scratch streams if need be, and prepares its
+ * layers. Like decks, tracks are always prepared.
+ */
 static RemixBase *
 remix_track_prepare (RemixEnv * env, RemixBase * base)
 {
   RemixTrack * track = (RemixTrack *)base;
-  remix_track_replace_mixstreams (env, track);
+  CDList * l;
+
+  remix_track_ensure_mixstreams (env, track);
+
+  for (l = track->layers; l; l = l->next)
+    remix_prepare (env, (RemixBase *)l->data.s_pointer);
+
   return base;
 }
 
@@ -191,6 +225,7 @@ _remix_track_add_layer_above (RemixEnv * env, RemixTrack * track,
       (cd_list_last (env, track->layers, CD_TYPE_POINTER)).s_pointer;
   track->layers = cd_list_add_after (env, track->layers, CD_TYPE_POINTER,
 				     CD_POINTER(layer), CD_POINTER(above));
+  _remix_deck_graph_changed (env);
   remix_track_optimise (env, track);
   return layer;
 }
@@ -201,6 +236,7 @@ _remix_track_remove_layer (RemixEnv * env, RemixTrack * track,
 {
   track->layers = cd_list_remove (env, track->layers, CD_TYPE_POINTER,
 				  CD_POINTER(layer));
+  _remix_deck_graph_changed (env);
   remix_track_optimise (env, track);
   return layer;
 }
@@ -417,7 +453,7 @@ remix_track_flush (RemixEnv * env, RemixBase * base)
 static struct _RemixMethods _remix_track_empty_methods = {
   remix_track_clone,   /* clone */
   remix_track_destroy, /* destroy */
-  remix_track_ready,   /* ready */
+  NULL,                /* ready */
   remix_track_prepare, /* prepare */
   remix_null_process,  /* process */
   remix_null_length,   /* length */
@@ -428,7 +464,7 @@ static struct _RemixMethods _remix_track_empty_methods = {
 static struct _RemixMethods _remix_track_methods = {
   remix_track_clone,   /* clone */
   remix_track_destroy, /* destroy */
-  remix_track_ready,   /* ready */
+  NULL,                /* ready */
   remix_track_prepare, /* prepare */
   remix_track_process, /* process */
   remix_track_length,  /* length */
@@ -439,7 +475,7 @@ static struct _RemixMethods _remix_track_methods = {
 static struct _RemixMethods _remix_track_onelayer_methods = {
   remix_track_clone,            /* clone */
   remix_track_destroy,          /* destroy */
-  remix_track_ready,            /* ready */
+  NULL,                         /* ready */
   remix_track_prepare,          /* prepare */
   remix_track_onelayer_process, /* process */
   remix_track_length,           /* length */
@@ -450,7 +486,7 @@ static struct _RemixMethods _remix_track_onelayer_methods = {
 static struct _RemixMethods _remix_track_twolayer_methods = {
   remix_track_clone,            /* clone */
   remix_track_destroy,          /* destroy */
-  remix_track_ready,            /* ready */
+  NULL,                         /* ready */
   remix_track_prepare,          /* prepare */
   remix_track_twolayer_process, /* process */
   remix_track_length,           /* length */
@@ -0,0 +1,1511 @@
+/*
+ * decktest.c
+ *
+ * Copyright (C) 2006 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+/* For access to chunk data */
+#define __REMIX_PLUGIN__
+#include <remix/remix.h>
+
+#include "tests.h"
+
+/* Longer than one mixlength, and not a multiple of it */
+#define SOURCE_LENGTH 5000
+#define SOUND_START 100
+#define SOUND_LENGTH 3000
+#define RENDER_LENGTH 4321
+
+#define EPSILON 1e-4
+
+static RemixPCM buf[2*RENDER_LENGTH];
+
+static RemixStream *
+constant_stream (RemixEnv * env, RemixCount length, RemixPCM value)
+{
+  RemixStream * stream = remix_stream_new_contiguous (env, length);
+  RemixCount i;
+
+  for (i = 0; i < 2*length && i < 2*RENDER_LENGTH; i++)
+    buf[i] = value;
+
+  remix_stream_deinterleave_2 (env, stream, REMIX_CHANNEL_LEFT,
+			       REMIX_CHANNEL_RIGHT, buf,
+			       MIN (length, RENDER_LENGTH));
+  remix_seek (env, (RemixBase *)stream, 0, SEEK_SET);
+
+  return stream;
+}
+
+static RemixStream *
+ramp_stream (RemixEnv * env, RemixCount length)
+{
+  RemixStream * stream = remix_stream_new_contiguous (env, length);
+  RemixCount i;
+
+  for (i = 0; i < 2*length && i < 2*RENDER_LENGTH; i++)
+    buf[i] = (i/2) * 1e-4;
+
+  remix_stream_deinterleave_2 (env, stream, REMIX_CHANNEL_LEFT,
+			       REMIX_CHANNEL_RIGHT, buf,
+			       MIN (length, RENDER_LENGTH));
+  remix_seek (env, (RemixBase *)stream, 0, SEEK_SET);
+
+  return stream;
+}
+
+/*
+ * Render a deck of 'nr_tracks' tracks, each playing a constant source
+ * with its own gain, using 'nr_threads' threads, and check the sum.
+ */
+static void
+test_deck (int nr_tracks, int nr_threads)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixStream * source, * output;
+  RemixPCM expected = 0.0, value, gain;
+  RemixCount n;
+  char msg[128];
+  int i;
+
+  snprintf (msg, sizeof (msg), "+ Rendering a deck of %d tracks, %d threads",
+	    nr_tracks, nr_threads);
+  INFO (msg);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+  if (remix_set_threads (env, nr_threads) == -1)
+    FAIL ("Could not start threads");
+
+  deck = remix_deck_new (env);
+
+  for (i = 0; i < nr_tracks; i++) {
+    value = 0.01 * (i + 1);
+    gain = 1.0 - 0.03 * i;
+    expected += value * gain;
+
+    source = constant_stream (env, SOURCE_LENGTH, value);
+    track = remix_track_new (env, deck);
+    remix_track_set_gain (env, track, gain);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    remix_sound_new (env, (RemixBase *)source, layer,
+		     REMIX_SAMPLES(SOUND_START), REMIX_SAMPLES(SOUND_LENGTH));
+  }
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Deck render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    value = (i/2 >= SOUND_START && i/2 < SOUND_START + SOUND_LENGTH) ?
+      expected : 0.0;
+    if (fabs (buf[i] - value) > EPSILON) {
+      printf ("frame %d is %f, expected %f\n", i/2, buf[i], value);
+      FAIL ("Deck output mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/* A source which fails as if it could not be read */
+static RemixCount
+failing_process (RemixEnv * env, RemixBase * base, RemixCount count,
+		 RemixStream * input, RemixStream * output)
+{
+  remix_set_error (env, REMIX_ERROR_SYSTEM);
+  return -1;
+}
+
+static RemixCount
+failing_length (RemixEnv * env, RemixBase * base)
+{
+  return SOURCE_LENGTH;
+}
+
+static int
+failing_destroy (RemixEnv * env, RemixBase * base)
+{
+  free (base);
+  return 0;
+}
+
+static struct _RemixMethods failing_methods = {
+  NULL,                      /* clone */
+  failing_destroy,           /* destroy */
+  NULL,                      /* ready */
+  NULL,                      /* prepare */
+  failing_process,           /* process */
+  failing_length,            /* length */
+  NULL,                      /* seek */
+  NULL,                      /* flush */
+};
+
+/*
+ * Render a deck of 'nr_tracks' tracks using 'nr_threads' threads, where
+ * the last track plays a source that fails, and check that the render
+ * stops with the source's error, wherever the track was rendered.
+ */
+static void
+test_track_error (int nr_tracks, int nr_threads)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixBase * source;
+  RemixBase * sources[20];
+  RemixStream * output;
+  RemixCount n;
+  char msg[128];
+  int i;
+
+  snprintf (msg, sizeof (msg),
+	    "+ Failing the last of %d tracks, %d threads", nr_tracks,
+	    nr_threads);
+  INFO (msg);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+  if (remix_set_threads (env, nr_threads) == -1)
+    FAIL ("Could not start threads");
+
+  deck = remix_deck_new (env);
+
+  for (i = 0; i < nr_tracks; i++) {
+    if (i < nr_tracks - 1) {
+      source = (RemixBase *)constant_stream (env, SOURCE_LENGTH, 0.1);
+    } else {
+      source = remix_base_new (env);
+      remix_base_set_methods (env, source, &failing_methods);
+    }
+    sources[i] = source;
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    remix_sound_new (env, source, layer, REMIX_SAMPLES(0),
+		     REMIX_SAMPLES(SOUND_LENGTH));
+  }
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  remix_set_error (env, REMIX_ERROR_OK);
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n > 0) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Deck with a failing track rendered");
+  }
+  if (remix_last_error (env) != REMIX_ERROR_SYSTEM) {
+    printf ("error is %d, expected %d\n", remix_last_error (env),
+	    REMIX_ERROR_SYSTEM);
+    FAIL ("Failing track's error was lost");
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  for (i = 0; i < nr_tracks; i++)
+    remix_destroy (env, sources[i]);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/*
+ * Render a deck of 'nr_tracks' tracks, each playing the same ramp source
+ * from a different start time, using 'nr_threads' threads, and check
+ * that every sound read the source from its own position.
+ */
+static void
+test_shared_source (int nr_tracks, int nr_threads)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixStream * source, * output;
+  RemixCount n, start, t;
+  RemixPCM expected;
+  char msg[128];
+  int i, j;
+
+  snprintf (msg, sizeof (msg),
+	    "+ Sharing a source between %d tracks, %d threads",
+	    nr_tracks, nr_threads);
+  INFO (msg);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+  if (remix_set_threads (env, nr_threads) == -1)
+    FAIL ("Could not start threads");
+
+  deck = remix_deck_new (env);
+  source = ramp_stream (env, SOURCE_LENGTH);
+
+  for (j = 0; j < nr_tracks; j++) {
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    remix_sound_new (env, (RemixBase *)source, layer,
+		     REMIX_SAMPLES(SOUND_START + 37 * j),
+		     REMIX_SAMPLES(SOUND_LENGTH));
+  }
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Deck render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    t = i/2;
+    expected = 0.0;
+    for (j = 0; j < nr_tracks; j++) {
+      start = SOUND_START + 37 * j;
+      if (t >= start && t < start + SOUND_LENGTH)
+	expected += (t - start) * 1e-4;
+    }
+    if (fabs (buf[i] - expected) > EPSILON) {
+      printf ("frame %ld is %f, expected %f\n", t, buf[i], expected);
+      FAIL ("Shared source output mismatch");
+    }
+  }
+
+  if (remix_tell (env, (RemixBase *)source) != 0)
+    FAIL ("Source was seeked by its sounds");
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, (RemixBase *)source);
+  remix_purge (env);
+}
+
+/*
+ * Render a squaretone, which has no cursor, shared by 'nr_tracks' tracks
+ * at different offsets into it, with 'nr_threads' threads, into 'dest'.
+ */
+static void
+render_shared_squaretone (int nr_tracks, int nr_threads, RemixPCM * dest)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixBase * square;
+  RemixStream * output;
+  RemixCount n;
+  int j;
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+  if (remix_set_threads (env, nr_threads) == -1)
+    FAIL ("Could not start threads");
+
+  deck = remix_deck_new (env);
+  square = remix_squaretone_new (env, 441.0);
+
+  for (j = 0; j < nr_tracks; j++) {
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    remix_sound_new (env, square, layer,
+		     REMIX_SAMPLES(SOUND_START + 37 * j),
+		     REMIX_SAMPLES(SOUND_LENGTH));
+  }
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Deck render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, dest, RENDER_LENGTH);
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, square);
+  remix_purge (env);
+}
+
+/*
+ * Check that tracks sharing a source without a cursor render the same
+ * with threads as without, as the deck must not render them at once.
+ */
+static void
+test_shared_squaretone (int nr_tracks, int nr_threads)
+{
+  static RemixPCM serial[2*RENDER_LENGTH];
+  char msg[128];
+  int i, k;
+
+  snprintf (msg, sizeof (msg),
+	    "+ Sharing a squaretone between %d tracks, %d threads",
+	    nr_tracks, nr_threads);
+  INFO (msg);
+
+  render_shared_squaretone (nr_tracks, 1, serial);
+
+  for (k = 0; k < 20; k++) {
+    render_shared_squaretone (nr_tracks, nr_threads, buf);
+    for (i = 0; i < 2*RENDER_LENGTH; i++) {
+      if (fabs (buf[i] - serial[i]) > EPSILON) {
+	printf ("frame %d is %f, expected %f\n", i/2, buf[i], serial[i]);
+	FAIL ("Shared squaretone output mismatch");
+      }
+    }
+  }
+}
+
+/*
+ * Render two tracks of 'nr_sounds' sounds each, and check that the deck
+ * only walks their sounds to find shared sources when it has worker
+ * threads, and then only once until the tracks are edited.
+ */
+static void
+test_shared_walks (int nr_sounds)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixStream * source, * output;
+  RemixBase ** sources;
+  RemixTime * starts, * durations;
+  char msg[128];
+  int i, t;
+
+  snprintf (msg, sizeof (msg), "+ Finding shared sources among %d sounds",
+	    2 * nr_sounds);
+  INFO (msg);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  source = constant_stream (env, SOURCE_LENGTH, 0.1);
+
+  sources = (RemixBase **) malloc (nr_sounds * sizeof (RemixBase *));
+  starts = (RemixTime *) malloc (nr_sounds * sizeof (RemixTime));
+  durations = (RemixTime *) malloc (nr_sounds * sizeof (RemixTime));
+
+  for (i = 0; i < nr_sounds; i++) {
+    sources[i] = (RemixBase *)source;
+    starts[i] = REMIX_SAMPLES(i * 1000);
+    durations[i] = REMIX_SAMPLES(500);
+  }
+
+  deck = remix_deck_new (env);
+  for (t = 0; t < 2; t++) {
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    if (remix_layer_add_sounds (env, layer, sources, starts, durations,
+				nr_sounds) != nr_sounds)
+      FAIL ("Could not add sounds");
+  }
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  for (i = 0; i < 3; i++) {
+    remix_seek (env, (RemixBase *)deck, 0, SEEK_SET);
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone, output);
+  }
+  if (_remix_deck_nr_shared_walks (env, deck) != 0)
+    FAIL ("Single-threaded deck walked its sounds");
+
+  if (remix_set_threads (env, 4) == -1)
+    FAIL ("Could not start threads");
+
+  for (i = 0; i < 3; i++) {
+    remix_seek (env, (RemixBase *)deck, 0, SEEK_SET);
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone, output);
+  }
+  if (_remix_deck_nr_shared_walks (env, deck) != 1)
+    FAIL ("Threaded deck did not keep which sources are shared");
+
+  remix_sound_new (env, (RemixBase *)source, layer,
+		   REMIX_SAMPLES(nr_sounds * 1000), REMIX_SAMPLES(500));
+
+  remix_seek (env, (RemixBase *)deck, 0, SEEK_SET);
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone, output);
+  if (_remix_deck_nr_shared_walks (env, deck) != 2)
+    FAIL ("Threaded deck did not notice an edit");
+
+  free (sources);
+  free (starts);
+  free (durations);
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, (RemixBase *)source);
+  remix_purge (env);
+}
+
+/*
+ * Render a ramp through a rate envelope going linearly from 'r0' to
+ * 'r1', in two parts with a seek between them, and check the output
+ * follows the ramp at the integrated source positions.
+ */
+static void
+test_varispeed (RemixResampleQuality quality, RemixPCM r0, RemixPCM r1)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixSound * sound;
+  RemixEnvelope * rate;
+  RemixStream * source, * output;
+  RemixPCM value;
+  RemixCount n, half = RENDER_LENGTH/2;
+  double pos, slope = (r1 - r0) / RENDER_LENGTH;
+  char msg[128];
+  int i;
+
+  snprintf (msg, sizeof (msg), "+ Varispeed quality %d, rate %.2f to %.2f",
+	    quality, r0, r1);
+  INFO (msg);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  deck = remix_deck_new (env);
+  source = ramp_stream (env, RENDER_LENGTH);
+  track = remix_track_new (env, deck);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  sound = remix_sound_new (env, (RemixBase *)source, layer,
+			   REMIX_SAMPLES(0), REMIX_SAMPLES(RENDER_LENGTH));
+
+  rate = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  remix_envelope_add_point (env, rate, REMIX_SAMPLES(0), r0);
+  remix_envelope_add_point (env, rate, REMIX_SAMPLES(RENDER_LENGTH), r1);
+  remix_sound_set_rate_envelope (env, sound, (RemixBase *)rate);
+  remix_sound_set_rate_quality (env, sound, quality);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  /* Render the second half first, so that the first half follows a seek */
+  remix_seek (env, (RemixBase *)deck, half, SEEK_SET);
+  remix_seek (env, (RemixBase *)output, half, SEEK_SET);
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH - half, RemixNone,
+		     output);
+  remix_seek (env, (RemixBase *)deck, 0, SEEK_SET);
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  n += remix_process (env, (RemixBase *)deck, half, RemixNone, output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Varispeed render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  /* Skip the edges, where the interpolators see the silence around the
+   * source, and allow for the passband ripple of the sinc filter */
+  for (i = 2*16; i < 2*RENDER_LENGTH; i++) {
+    pos = r0 * (i/2) + slope * (i/2) * (i/2 - 1) / 2.0;
+    if (pos >= RENDER_LENGTH - 16) break;
+    value = pos * 1e-4;
+    if (fabs (buf[i] - value) > 1e-5) {
+      printf ("frame %d is %f, expected %f\n", i/2, buf[i], value);
+      FAIL ("Varispeed output mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/*
+ * Add 'nr_sounds' sounds to a layer in one batch, in scrambled order,
+ * each playing its own constant source, and check the render.
+ */
+static void
+test_add_sounds (int nr_sounds)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixSound * sound;
+  RemixStream * output;
+  RemixBase * sources[RENDER_LENGTH];
+  RemixTime starts[RENDER_LENGTH], durations[RENDER_LENGTH];
+  RemixCount n, slot = RENDER_LENGTH / nr_sounds;
+  RemixPCM value;
+  char msg[128];
+  int i, j;
+
+  snprintf (msg, sizeof (msg), "+ Adding %d sounds to a layer at once",
+	    nr_sounds);
+  INFO (msg);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  deck = remix_deck_new (env);
+  track = remix_track_new (env, deck);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+
+  /* Sound j fills slot j; list them in a scrambled order */
+  for (i = 0; i < nr_sounds; i++) {
+    j = (i * 7) % nr_sounds;
+    sources[i] = (RemixBase *)constant_stream (env, slot, 0.001 * (j + 1));
+    starts[i] = REMIX_SAMPLES(j * slot);
+    durations[i] = REMIX_SAMPLES(slot);
+  }
+
+  if (remix_layer_add_sounds (env, layer, sources, starts, durations,
+			      nr_sounds) != nr_sounds)
+    FAIL ("Could not add sounds");
+
+  sound = remix_layer_get_sound_after (env, layer, REMIX_SAMPLES(0));
+  for (i = 0; i < nr_sounds; i++) {
+    if (sound == RemixNone ||
+	remix_sound_get_start_time (env, sound).samples != i * slot)
+      FAIL ("Layer sounds out of order");
+    sound = remix_sound_get_next (env, sound);
+  }
+  if (sound != RemixNone)
+    FAIL ("Layer has extra sounds");
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Layer render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    value = (i/2 < nr_sounds * slot) ? 0.001 * (i/2 / slot + 1) : 0.0;
+    if (fabs (buf[i] - value) > EPSILON) {
+      printf ("frame %d is %f, expected %f\n", i/2, buf[i], value);
+      FAIL ("Layer output mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/*
+ * Render a deck and a clone of it, check they agree, then overwrite a
+ * clone of the deck's source and check the original is unchanged.
+ */
+static void
+test_clone (void)
+{
+  RemixEnv * env;
+  RemixDeck * deck, * new_deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixStream * source, * new_source, * output;
+  RemixPCM value;
+  RemixCount n;
+  int i, pass;
+
+  INFO ("+ Cloning a deck and its source");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  deck = remix_deck_new (env);
+  track = remix_track_new (env, deck);
+  remix_track_set_gain (env, track, 0.5);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  source = constant_stream (env, SOURCE_LENGTH, 0.25);
+  remix_sound_new (env, (RemixBase *)source, layer,
+		   REMIX_SAMPLES(SOUND_START), REMIX_SAMPLES(SOUND_LENGTH));
+
+  new_deck = (RemixDeck *)remix_clone_subclass (env, (RemixBase *)deck);
+  new_source = (RemixStream *)remix_clone_subclass (env, (RemixBase *)source);
+
+  /* Writing to the cloned source must not show through the original */
+  remix_seek (env, (RemixBase *)new_source, 0, SEEK_SET);
+  remix_stream_write0 (env, new_source, SOURCE_LENGTH);
+  remix_destroy (env, (RemixBase *)new_source);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  for (pass = 0; pass < 2; pass++) {
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    remix_seek (env, pass ? (RemixBase *)new_deck : (RemixBase *)deck, 0,
+		SEEK_SET);
+    n = remix_process (env, pass ? (RemixBase *)new_deck : (RemixBase *)deck,
+		       RENDER_LENGTH, RemixNone, output);
+    if (n != RENDER_LENGTH) {
+      printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+      FAIL ("Clone render was short");
+    }
+
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			       REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+    for (i = 0; i < 2*RENDER_LENGTH; i++) {
+      value = (i/2 >= SOUND_START && i/2 < SOUND_START + SOUND_LENGTH) ?
+	0.125 : 0.0;
+      if (fabs (buf[i] - value) > EPSILON) {
+	printf ("%s frame %d is %f, expected %f\n", pass ? "clone" : "original",
+		i/2, buf[i], value);
+	FAIL ("Clone output mismatch");
+      }
+    }
+
+    /* The clone must still play once the original deck is gone */
+    if (pass == 0) remix_destroy (env, (RemixBase *)deck);
+  }
+
+  remix_destroy (env, (RemixBase *)new_deck);
+  remix_destroy (env, (RemixBase *)source);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/*
+ * Render a sparse deck, whose tracks each play a short sound at a
+ * different time, in blocks reusing one output stream so that its
+ * chunk alternates between silence and sound.
+ */
+static void
+test_sparse (void)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixStream * source, * output;
+  RemixPCM value, expected;
+  RemixCount n, offset, block = 500;
+  int i, t;
+
+  INFO ("+ Rendering a sparse deck");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  deck = remix_deck_new (env);
+
+  for (t = 0; t < 3; t++) {
+    source = constant_stream (env, SOURCE_LENGTH, 0.1 * (t + 1));
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    remix_sound_new (env, (RemixBase *)source, layer,
+		     REMIX_SAMPLES(1000 * (t + 1)), REMIX_SAMPLES(700));
+  }
+
+  output = remix_stream_new_contiguous (env, block);
+
+  for (offset = 0; offset < RENDER_LENGTH; offset += block) {
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    n = remix_process (env, (RemixBase *)deck, block, RemixNone, output);
+    if (n != block) {
+      printf ("processed %ld of %ld\n", n, block);
+      FAIL ("Sparse render was short");
+    }
+
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			       REMIX_CHANNEL_RIGHT, buf, block);
+
+    for (i = 0; i < 2*block; i++) {
+      t = (offset + i/2) / 1000 - 1;
+      expected = (t >= 0 && t < 3 && (offset + i/2) % 1000 < 700) ?
+	0.1 * (t + 1) : 0.0;
+      value = buf[i];
+      if (fabs (value - expected) > EPSILON) {
+	printf ("frame %ld is %f, expected %f\n", offset + i/2, value,
+		expected);
+	FAIL ("Sparse output mismatch");
+      }
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/*
+ * Render a deck playing a squaretone into 'dest'. If 'mono_first', the
+ * deck is built for mono, and prepared twice for stereo before
+ * rendering.
+ */
+static void
+render_prepared_squaretone (int mono_first, RemixPCM * dest)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixBase * square;
+  RemixStream * output;
+  RemixCount n;
+
+  env = remix_init ();
+  remix_set_channels (env, mono_first ? REMIX_MONO : REMIX_STEREO);
+
+  deck = remix_deck_new (env);
+  square = remix_squaretone_new (env, 441.0);
+  track = remix_track_new (env, deck);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  remix_sound_new (env, square, layer, REMIX_SAMPLES(SOUND_START),
+		   REMIX_SAMPLES(SOUND_LENGTH));
+
+  if (mono_first) {
+    remix_set_channels (env, REMIX_STEREO);
+    remix_prepare (env, (RemixBase *)deck);
+    remix_prepare (env, (RemixBase *)deck);
+  }
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Squaretone render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, dest, RENDER_LENGTH);
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, square);
+  remix_purge (env);
+}
+
+/*
+ * Prepare a mono deck with a squaretone source for stereo, and check it
+ * renders both channels as a deck built for stereo does. Preparing
+ * reaches the squaretone, which must rebuild its channels once and
+ * then be ready.
+ */
+static void
+test_prepare_squaretone (void)
+{
+  static RemixPCM stereo[2*RENDER_LENGTH];
+  int i;
+
+  INFO ("+ Preparing a deck with a squaretone source");
+
+  render_prepared_squaretone (FALSE, stereo);
+  render_prepared_squaretone (TRUE, buf);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    if (fabs (buf[i] - stereo[i]) > EPSILON) {
+      printf ("frame %d is %f, expected %f\n", i/2, buf[i], stereo[i]);
+      FAIL ("Prepared squaretone output mismatch");
+    }
+  }
+
+  if (fabs (buf[2*SOUND_START + 1]) < EPSILON)
+    FAIL ("Prepared squaretone right channel is silent");
+}
+
+/*
+ * Build a mono varispeed deck of stereo sources, then prepare it for
+ * stereo and a longer mixlength, and check that both channels render in
+ * a single block. Processing runs with the allocation trap set (see
+ * main), so this also checks that nothing is allocated once prepared.
+ */
+static void
+test_prepare (void)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixSound * sound;
+  RemixEnvelope * rate;
+  RemixStream * sources[2], * output;
+  RemixPCM value, expected;
+  RemixCount n;
+  int i, t;
+
+  INFO ("+ Rendering after preparing for new channels and mixlength");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  for (t = 0; t < 2; t++)
+    sources[t] = constant_stream (env, SOURCE_LENGTH, 0.25);
+
+  remix_set_channels (env, REMIX_MONO);
+
+  deck = remix_deck_new (env);
+
+  for (t = 0; t < 2; t++) {
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    sound = remix_sound_new (env, (RemixBase *)sources[t], layer,
+			     REMIX_SAMPLES(SOUND_START),
+			     REMIX_SAMPLES(SOUND_LENGTH));
+
+    rate = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+    remix_envelope_add_point (env, rate, REMIX_SAMPLES(0), 1.0);
+    remix_sound_set_rate_envelope (env, sound, (RemixBase *)rate);
+  }
+
+  remix_set_channels (env, REMIX_STEREO);
+  remix_set_mixlength (env, RENDER_LENGTH);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  remix_prepare (env, (RemixBase *)deck);
+
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Prepared render was short");
+  }
+
+  /* Preparing again in the same context keeps the same buffers */
+  remix_prepare (env, (RemixBase *)deck);
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    expected = (i/2 >= SOUND_START && i/2 < SOUND_START + SOUND_LENGTH) ?
+      0.5 : 0.0;
+    value = buf[i];
+    if (fabs (value - expected) > EPSILON) {
+      printf ("frame %d is %f, expected %f\n", i/2, value, expected);
+      FAIL ("Prepared output mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+typedef struct {
+  RemixTrack * track;
+  RemixSound * sound;
+  RemixBase * source;
+} LiveEdit;
+
+static void
+live_set_gain (RemixEnv * env, void * data)
+{
+  LiveEdit * edit = (LiveEdit *)data;
+  remix_track_set_gain (env, edit->track, 0.5);
+}
+
+static void
+live_set_source (RemixEnv * env, void * data)
+{
+  LiveEdit * edit = (LiveEdit *)data;
+  RemixBase * old;
+
+  old = remix_sound_set_source (env, edit->sound, edit->source);
+  remix_retire (env, old);
+}
+
+static void
+check_block (RemixEnv * env, RemixStream * output, RemixCount block,
+	     RemixPCM expected)
+{
+  RemixCount i;
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, block);
+
+  for (i = 0; i < 2*block; i++) {
+    if (fabs (buf[i] - expected) > EPSILON) {
+      printf ("sample %ld is %f, expected %f\n", i, buf[i], expected);
+      FAIL ("Live edit output mismatch");
+    }
+  }
+}
+
+/*
+ * Post edits from a second env while rendering, and check that each
+ * applies from the next block on, and that a replaced source is only
+ * destroyed when reclaimed.
+ */
+static void
+test_live_edits (void)
+{
+  RemixEnv * env, * ui_env;
+  RemixDeck * deck;
+  RemixLayer * layer;
+  RemixStream * output;
+  LiveEdit edit;
+  RemixCount block = 500;
+  int i;
+
+  INFO ("+ Posting live edits while rendering");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+  remix_set_mixlength (env, block);
+  ui_env = remix_init_clone (env);
+
+  deck = remix_deck_new (env);
+  edit.track = remix_track_new (env, deck);
+  layer = remix_layer_new_ontop (env, edit.track, REMIX_TIME_SAMPLES);
+  edit.sound = remix_sound_new (env,
+				(RemixBase *)constant_stream (env, SOURCE_LENGTH,
+							      0.25),
+				layer, REMIX_SAMPLES(0),
+				REMIX_SAMPLES(SOURCE_LENGTH));
+  edit.source = (RemixBase *)constant_stream (env, SOURCE_LENGTH, 1.0);
+
+  output = remix_stream_new_contiguous (env, block);
+  remix_prepare (env, (RemixBase *)deck);
+
+  remix_process (env, (RemixBase *)deck, block, RemixNone, output);
+  check_block (env, output, block, 0.25);
+
+  remix_post (ui_env, env, live_set_gain, &edit);
+  remix_post (ui_env, env, live_set_source, &edit);
+
+  /* Nothing is applied or retired until the next block */
+  if (remix_reclaim (ui_env, env) != 0)
+    FAIL ("Source was retired before the next block");
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_process (env, (RemixBase *)deck, block, RemixNone, output);
+  check_block (env, output, block, 0.5);
+
+  if (remix_reclaim (ui_env, env) != 1)
+    FAIL ("Replaced source was not reclaimed");
+
+  /* A full queue refuses further edits */
+  for (i = 0; remix_post (ui_env, env, live_set_gain, &edit) == 0; i++);
+  if (i == 0 || remix_last_error (ui_env) != REMIX_ERROR_FULL)
+    FAIL ("Full command queue was not reported");
+  if (remix_drain (env) != i)
+    FAIL ("Queued edits were not all drained");
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, edit.source);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (ui_env);
+  remix_purge (env);
+}
+
+static RemixPCM *
+stream_data (RemixEnv * env, RemixStream * stream, int name)
+{
+  RemixChannel * channel = remix_stream_find_channel (env, stream, name);
+  return remix_channel_get_chunk_at (env, channel, 0)->data;
+}
+
+/*
+ * Check that chunk data is aligned, and that the buffers of a destroyed
+ * stream are reused for a new one.
+ */
+static void
+test_chunk_pool (void)
+{
+  RemixEnv * env;
+  RemixStream * stream;
+  RemixPCM * left, * right, * data;
+  int name, reused = 0;
+
+  INFO ("+ Reusing pooled chunk data");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  stream = constant_stream (env, SOURCE_LENGTH, 0.5);
+  left = stream_data (env, stream, REMIX_CHANNEL_LEFT);
+  right = stream_data (env, stream, REMIX_CHANNEL_RIGHT);
+  remix_destroy (env, (RemixBase *)stream);
+
+  stream = remix_stream_new_contiguous (env, SOURCE_LENGTH - 1);
+  for (name = REMIX_CHANNEL_LEFT; name <= REMIX_CHANNEL_RIGHT; name++) {
+    data = stream_data (env, stream, name);
+    if ((size_t)data % REMIX_CHUNK_ALIGNMENT != 0)
+      FAIL ("Chunk data is not aligned");
+    if (data[0] != 0.0 || data[SOURCE_LENGTH - 2] != 0.0)
+      FAIL ("Reused chunk data was not cleared");
+    if (data == left || data == right) reused++;
+  }
+
+  if (reused != 2)
+    FAIL ("Chunk data was not reused");
+
+  remix_destroy (env, (RemixBase *)stream);
+  remix_purge (env);
+}
+
+/*
+ * Build a linear envelope of 'nr_points' points at every beat24, added in
+ * a scrambled order, and check it renders at 'tempo' from 'offset'.
+ */
+static void
+check_envelope_points (RemixEnv * env, RemixEnvelope * envelope,
+		       int nr_points, RemixTempo tempo, RemixCount offset)
+{
+  RemixStream * output;
+  RemixCount n, x, x1, x2;
+  RemixPCM y1, y2, value;
+  int i, k;
+
+  remix_set_tempo (env, tempo);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+  remix_seek (env, (RemixBase *)envelope, offset, SEEK_SET);
+  n = remix_process (env, (RemixBase *)envelope, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Envelope render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0, k = 0; i < 2*RENDER_LENGTH; i++) {
+    x = offset + i/2;
+    while (k < nr_points - 2 &&
+	   remix_time_convert (env, REMIX_BEAT24S(k+1), REMIX_TIME_BEAT24S,
+			       REMIX_TIME_SAMPLES).samples <= x)
+      k++;
+    x1 = remix_time_convert (env, REMIX_BEAT24S(k), REMIX_TIME_BEAT24S,
+			     REMIX_TIME_SAMPLES).samples;
+    x2 = remix_time_convert (env, REMIX_BEAT24S(k+1), REMIX_TIME_BEAT24S,
+			     REMIX_TIME_SAMPLES).samples;
+    y1 = 0.01 * (k % 7);
+    y2 = 0.01 * ((k+1) % 7);
+    value = y1 + (RemixPCM)(x - x1) * (y2 - y1) / (x2 - x1);
+    if (fabs (buf[i] - value) > EPSILON) {
+      printf ("frame %ld is %f, expected %f\n", x, buf[i], value);
+      FAIL ("Envelope output mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)output);
+}
+
+static void
+test_envelope_points (int nr_points)
+{
+  RemixEnv * env;
+  RemixEnvelope * envelope;
+  RemixPoint * extra = RemixNone;
+  char msg[128];
+  int i, j;
+
+  snprintf (msg, sizeof (msg), "+ Rendering an envelope of %d points",
+	    nr_points);
+  INFO (msg);
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  envelope = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  remix_envelope_set_timetype (env, envelope, REMIX_TIME_BEAT24S);
+
+  for (i = 0; i < nr_points; i++) {
+    j = (i * 7) % nr_points;
+    remix_envelope_add_point (env, envelope, REMIX_BEAT24S(j),
+			      0.01 * (j % 7));
+    if (i == nr_points / 2)
+      extra = remix_envelope_add_point (env, envelope, REMIX_BEAT24S(j), 1.0);
+  }
+  remix_envelope_remove_point (env, envelope, extra);
+
+  if (remix_envelope_get_duration (env, envelope).beat24s != nr_points - 1)
+    FAIL ("Envelope has the wrong duration");
+
+  /* Point positions must follow tempo changes */
+  check_envelope_points (env, envelope, nr_points, 6000.0, 0);
+  check_envelope_points (env, envelope, nr_points, 3000.0, 1234);
+  check_envelope_points (env, envelope, nr_points, 6000.0, 2000);
+
+  remix_destroy (env, (RemixBase *)envelope);
+  remix_purge (env);
+}
+
+/*
+ * Render a spline envelope and check that it passes through its points
+ * without overshooting them, and that its integral matches the render.
+ */
+static void
+test_spline_envelope (void)
+{
+  RemixEnv * env;
+  RemixEnvelope * envelope;
+  RemixStream * output;
+  RemixCount x[] = { 200, 1000, 1500, 1600, 3000, 4000 };
+  RemixPCM y[] = { 0.0, 1.0, 1.0, 0.8, 0.2, 0.9 }, lo, hi;
+  double sum = 0.0, integral;
+  int i, k, nr_points = sizeof (x) / sizeof (x[0]);
+
+  INFO ("+ Rendering a spline envelope");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  envelope = remix_envelope_new (env, REMIX_ENVELOPE_SPLINE);
+  for (k = nr_points - 1; k >= 0; k--)
+    remix_envelope_add_point (env, envelope, REMIX_SAMPLES(x[k]), y[k]);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+  if (remix_process (env, (RemixBase *)envelope, RENDER_LENGTH, RemixNone,
+		     output) != RENDER_LENGTH)
+    FAIL ("Spline render was short");
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0, k = -1; i < RENDER_LENGTH; i++) {
+    while (k + 1 < nr_points && x[k+1] <= i) k++;
+    if (k < 0) {
+      lo = hi = y[0];
+    } else if (k == nr_points - 1) {
+      lo = hi = y[k];
+    } else {
+      lo = MIN (y[k], y[k+1]);
+      hi = MAX (y[k], y[k+1]);
+    }
+    if (k >= 0 && x[k] == i) lo = hi = y[k];
+    if (buf[2*i] < lo - EPSILON || buf[2*i] > hi + EPSILON) {
+      printf ("frame %d is %f, expected within [%f, %f]\n", i, buf[2*i],
+	      lo, hi);
+      FAIL ("Spline overshoots its points");
+    }
+    sum += buf[2*i];
+  }
+
+  integral = remix_envelope_get_integral (env, envelope, REMIX_SAMPLES(0),
+					  REMIX_SAMPLES(RENDER_LENGTH));
+  if (fabs (integral - sum) > 1e-2) {
+    printf ("integral %f, rendered sum %f\n", integral, sum);
+    FAIL ("Spline integral mismatch");
+  }
+
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, (RemixBase *)envelope);
+  remix_purge (env);
+}
+
+/*
+ * Render a sound of a constant source through a rising gain, given as a
+ * linear envelope if 'direct' and otherwise as a ramp stream, in two
+ * parts with a seek between them, and check the output follows the gain.
+ */
+static void
+test_gain_source (int direct)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixSound * sound;
+  RemixEnvelope * envelope;
+  RemixBase * gain;
+  RemixStream * source, * output;
+  RemixCount n, half = RENDER_LENGTH/2;
+  RemixPCM value;
+  int i;
+
+  INFO (direct ? "+ Applying a gain envelope directly" :
+	"+ Applying a gain stream");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  if (direct) {
+    envelope = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+    remix_envelope_add_point (env, envelope, REMIX_SAMPLES(0), 0.0);
+    remix_envelope_add_point (env, envelope, REMIX_SAMPLES(RENDER_LENGTH),
+			      RENDER_LENGTH * 1e-4);
+    gain = (RemixBase *)envelope;
+  } else {
+    gain = (RemixBase *)ramp_stream (env, RENDER_LENGTH);
+  }
+
+  deck = remix_deck_new (env);
+  source = constant_stream (env, RENDER_LENGTH, 0.5);
+  track = remix_track_new (env, deck);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  sound = remix_sound_new (env, (RemixBase *)source, layer,
+			   REMIX_SAMPLES(0), REMIX_SAMPLES(RENDER_LENGTH));
+  remix_sound_set_gain_envelope (env, sound, gain);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+
+  remix_seek (env, (RemixBase *)deck, half, SEEK_SET);
+  remix_seek (env, (RemixBase *)output, half, SEEK_SET);
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH - half, RemixNone,
+		     output);
+  remix_seek (env, (RemixBase *)deck, 0, SEEK_SET);
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  n += remix_process (env, (RemixBase *)deck, half, RemixNone, output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Gain render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    value = 0.5 * (i/2) * 1e-4;
+    if (fabs (buf[i] - value) > 1e-5) {
+      printf ("frame %d is %f, expected %f\n", i/2, buf[i], value);
+      FAIL ("Gain output mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)source);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/*
+ * Render a sound with both a gain and a blend envelope over a layer of a
+ * constant sound, so that both are applied in one pass, and check that
+ * the output is the gained sound blended with the layer beneath.
+ */
+static void
+test_gain_and_blend (void)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixSound * sound;
+  RemixEnvelope * gain, * blend;
+  RemixStream * under, * source, * output;
+  RemixPCM g, b, value;
+  RemixCount n;
+  int i;
+
+  INFO ("+ Applying a gain and a blend envelope together");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  deck = remix_deck_new (env);
+  track = remix_track_new (env, deck);
+
+  under = constant_stream (env, RENDER_LENGTH, 0.25);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  remix_sound_new (env, (RemixBase *)under, layer, REMIX_SAMPLES(0),
+		   REMIX_SAMPLES(RENDER_LENGTH));
+
+  source = constant_stream (env, RENDER_LENGTH, 0.5);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  sound = remix_sound_new (env, (RemixBase *)source, layer,
+			   REMIX_SAMPLES(0), REMIX_SAMPLES(RENDER_LENGTH));
+
+  gain = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  remix_envelope_add_point (env, gain, REMIX_SAMPLES(0), 0.0);
+  remix_envelope_add_point (env, gain, REMIX_SAMPLES(RENDER_LENGTH),
+			    RENDER_LENGTH * 1e-4);
+  remix_sound_set_gain_envelope (env, sound, (RemixBase *)gain);
+
+  blend = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  remix_envelope_add_point (env, blend, REMIX_SAMPLES(0), 1.0);
+  remix_envelope_add_point (env, blend, REMIX_SAMPLES(RENDER_LENGTH), 0.0);
+  remix_sound_set_blend_envelope (env, sound, (RemixBase *)blend);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Blended render was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    g = (i/2) * 1e-4;
+    b = 1.0 - (RemixPCM)(i/2) / RENDER_LENGTH;
+    value = 0.5 * g * b + 0.25 * (1.0 - b);
+    if (fabs (buf[i] - value) > 1e-5) {
+      printf ("frame %d is %f, expected %f\n", i/2, buf[i], value);
+      FAIL ("Blended output mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)under);
+  remix_destroy (env, (RemixBase *)source);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+/*
+ * Render a sound with a blend envelope on the only layer of a deck, so
+ * that there is no input beneath it to blend in, and check that it
+ * blends in silence.
+ */
+static void
+test_blend_silence (void)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixSound * sound;
+  RemixEnvelope * blend;
+  RemixStream * source, * output;
+  RemixPCM b, value;
+  RemixCount n;
+  int i;
+
+  INFO ("+ Blending a sound over silence");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  deck = remix_deck_new (env);
+  track = remix_track_new (env, deck);
+
+  source = constant_stream (env, RENDER_LENGTH, 0.5);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  sound = remix_sound_new (env, (RemixBase *)source, layer,
+			   REMIX_SAMPLES(0), REMIX_SAMPLES(RENDER_LENGTH));
+
+  blend = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  remix_envelope_add_point (env, blend, REMIX_SAMPLES(0), 1.0);
+  remix_envelope_add_point (env, blend, REMIX_SAMPLES(RENDER_LENGTH), 0.0);
+  remix_sound_set_blend_envelope (env, sound, (RemixBase *)blend);
+
+  output = remix_stream_new_contiguous (env, RENDER_LENGTH);
+  n = remix_process (env, (RemixBase *)deck, RENDER_LENGTH, RemixNone,
+		     output);
+  if (n != RENDER_LENGTH) {
+    printf ("processed %ld of %d\n", n, RENDER_LENGTH);
+    FAIL ("Blend over silence was short");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave_2 (env, output, REMIX_CHANNEL_LEFT,
+			     REMIX_CHANNEL_RIGHT, buf, RENDER_LENGTH);
+
+  for (i = 0; i < 2*RENDER_LENGTH; i++) {
+    b = 1.0 - (RemixPCM)(i/2) / RENDER_LENGTH;
+    value = 0.5 * b;
+    if (fabs (buf[i] - value) > 1e-5) {
+      printf ("frame %d is %f, expected %f\n", i/2, buf[i], value);
+      FAIL ("Blend over silence mismatch");
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)source);
+  remix_destroy (env, (RemixBase *)output);
+  remix_purge (env);
+}
+
+int
+main (int argc, char ** argv)
+{
+  /* Abort on any allocation within remix_process () */
+  setenv ("REMIX_DEBUG_ALLOC", "1", 1);
+
+  test_deck (1, 1);
+  test_deck (2, 1);
+  test_deck (5, 1);
+  test_deck (20, 1);
+  test_deck (20, 4);
+
+  test_track_error (1, 1);
+  test_track_error (8, 1);
+  test_track_error (8, 4);
+
+  test_shared_source (2, 1);
+  test_shared_source (8, 4);
+
+  test_shared_squaretone (64, 4);
+
+  test_shared_walks (100000);
+
+  test_varispeed (REMIX_RESAMPLE_LINEAR, 0.5, 0.5);
+  test_varispeed (REMIX_RESAMPLE_CUBIC, 0.5, 1.5);
+  test_varispeed (REMIX_RESAMPLE_SINC, 0.75, 0.25);
+
+  test_add_sounds (1);
+  test_add_sounds (100);
+
+  test_clone ();
+
+  test_sparse ();
+
+  test_prepare ();
+  test_prepare_squaretone ();
+
+  test_chunk_pool ();
+
+  test_live_edits ();
+
+  test_envelope_points (100);
+  test_envelope_points (1000);
+
+  test_spline_envelope ();
+
+  test_gain_source (TRUE);
+  test_gain_source (FALSE);
+
+  test_gain_and_blend ();
+  test_blend_silence ();
+
+  return 0;
+}
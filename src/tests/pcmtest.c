@@ -0,0 +1,511 @@
+/*
+ * pcmtest.c
+ *
+ * Copyright (C) 2006 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+/* For stream expressions */
+#define __REMIX_PLUGIN__
+#include <remix/remix.h>
+
+#include "tests.h"
+
+/* Odd, so that every kernel also runs its scalar tail */
+#define N 1003
+
+#define EPSILON 1e-6
+
+static RemixPCM a[2*N], b[2*N], c[2*N], out[2*N];
+
+/* Frames left untouched at the start of each stream */
+static RemixCount skip;
+
+static RemixStream *
+load_stream (RemixEnv * env, RemixPCM * data)
+{
+  RemixStream * stream = remix_stream_new_contiguous (env, N);
+
+  if (remix_stream_deinterleave_2 (env, stream, REMIX_CHANNEL_LEFT,
+				   REMIX_CHANNEL_RIGHT, data, N) != N)
+    FAIL ("Deinterleave failed");
+  remix_seek (env, (RemixBase *)stream, skip, SEEK_SET);
+
+  return stream;
+}
+
+static RemixPCM exp_copy (int i) { return a[i]; }
+
+static void
+check_stream (RemixEnv * env, RemixStream * stream, char * op,
+	      RemixPCM (*expected) (int i))
+{
+  RemixPCM e;
+  int i;
+
+  remix_seek (env, (RemixBase *)stream, 0, SEEK_SET);
+  if (remix_stream_interleave_2 (env, stream, REMIX_CHANNEL_LEFT,
+				 REMIX_CHANNEL_RIGHT, out, N) != N)
+    FAIL ("Interleave failed");
+
+  for (i = 0; i < 2*N; i++) {
+    e = (i < 2*skip) ? exp_copy (i) : expected (i);
+    if (fabs (out[i] - e) > EPSILON) {
+      printf ("%s: sample %d is %f, expected %f\n", op, i, out[i], e);
+      FAIL ("Kernel output mismatch");
+    }
+  }
+}
+
+static RemixPCM exp_gain (int i) { return a[i] * 0.5; }
+static RemixPCM exp_mix (int i) { return a[i] + b[i]; }
+static RemixPCM exp_mult (int i) { return a[i] * b[i]; }
+static RemixPCM exp_fade (int i) { return a[i] * (1.0 - c[i]); }
+static RemixPCM exp_blend (int i) { return a[i] * c[i] + b[i] * (1.0 - c[i]); }
+
+/* Envelope breakpoints, with segments shorter than a vector */
+#define NR_RAMP_POINTS 6
+static RemixCount ramp_x[NR_RAMP_POINTS] = { 0, 5, 300, 307, 316, N - 1 };
+static RemixPCM ramp_y[NR_RAMP_POINTS] = { -1.0, 0.5, -0.25, 1.0, 0.0, 0.75 };
+
+static RemixPCM
+exp_ramp (int i)
+{
+  RemixCount x = i/2;
+  int k;
+
+  for (k = 0; k < NR_RAMP_POINTS - 2 && ramp_x[k+1] <= x; k++);
+  return ramp_y[k] + (x - ramp_x[k]) *
+    (ramp_y[k+1] - ramp_y[k]) / (ramp_x[k+1] - ramp_x[k]);
+}
+
+/* The spline envelope evaluates itself without the kernels */
+static RemixEnv * spline_env;
+static RemixEnvelope * spline;
+
+static RemixPCM
+exp_spline (int i)
+{
+  return remix_envelope_get_value (spline_env, spline, REMIX_SAMPLES(i/2));
+}
+
+static RemixPCM exp_mult_ramp (int i) { return a[i] * exp_ramp (i); }
+static RemixPCM exp_mult_cubic (int i) { return a[i] * exp_spline (i); }
+
+static RemixPCM
+exp_blend_cubic (int i)
+{
+  return a[i] * exp_spline (i) + b[i] * (1.0 - exp_spline (i));
+}
+
+static RemixPCM exp_copy_mult_cubic (int i) { return b[i] * exp_spline (i); }
+
+static RemixPCM
+exp_mult_blend_cubic (int i)
+{
+  return a[i] * exp_spline (i) * exp_ramp (i) + b[i] * (1.0 - exp_ramp (i));
+}
+
+/* Not fused: copy b, fade by the spline, blend b back in by the ramp */
+static RemixPCM
+exp_unfused (int i)
+{
+  return b[i] * (1.0 - exp_spline (i)) * exp_ramp (i) +
+    b[i] * (1.0 - exp_ramp (i));
+}
+
+/*
+ * Evaluate an expression over a with source b, of the spline envelope
+ * and (if 'ramp' is given) the linear one, and check the result.
+ */
+static void
+check_expr (RemixEnv * env, RemixEnvelope * spline, RemixEnvelope * ramp,
+	    char * op, RemixPCM (*expected) (int i))
+{
+  RemixStream * sa, * sb;
+  RemixStreamExpr expr;
+
+  sa = load_stream (env, a);
+  sb = load_stream (env, b);
+  remix_seek (env, (RemixBase *)spline, skip, SEEK_SET);
+  if (ramp != RemixNone) remix_seek (env, (RemixBase *)ramp, skip, SEEK_SET);
+
+  remix_stream_expr_init (env, &expr, sb);
+  if (expected == exp_copy_mult_cubic) {
+    remix_stream_expr_copy (env, &expr);
+    remix_stream_expr_mult (env, &expr, (RemixBase *)spline);
+  } else if (expected == exp_mult_blend_cubic) {
+    remix_stream_expr_mult (env, &expr, (RemixBase *)spline);
+    remix_stream_expr_blend (env, &expr, (RemixBase *)ramp);
+  } else {
+    remix_stream_expr_copy (env, &expr);
+    remix_stream_expr_fade (env, &expr, (RemixBase *)spline);
+    remix_stream_expr_blend (env, &expr, (RemixBase *)ramp);
+  }
+
+  if (remix_stream_expr_evaluate (env, &expr, sa, N - skip) != N - skip)
+    FAIL ("Expression evaluation was short");
+  check_stream (env, sa, op, expected);
+
+  remix_destroy (env, (RemixBase *)sa);
+  remix_destroy (env, (RemixBase *)sb);
+}
+
+/*
+ * Switch to the 'name' kernel set, returning whether the CPU supports it.
+ */
+static int
+use_kernels (char * name)
+{
+  char buf[64];
+
+  if (_remix_pcm_set_kernels (name) == -1) {
+    snprintf (buf, sizeof (buf), "%s PCM kernels unsupported, skipping",
+	      name);
+    WARN (buf);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Test the 'name' kernel set on all but the first 'skip_frames' frames
+ * of each stream, so that the kernels start at that offset into the
+ * chunk data.
+ */
+static void
+test_kernels (char * name, RemixCount skip_frames)
+{
+  RemixEnv * env;
+  RemixStream * sa, * sb, * sc;
+  RemixEnvelope * envelope, * ramp;
+  RemixCount n = N - skip_frames;
+  char buf[64];
+  int k;
+
+  snprintf (buf, sizeof (buf), "+ Testing %s PCM kernels from frame %ld",
+	    name, skip_frames);
+  INFO (buf);
+
+  skip = skip_frames;
+
+  if (!use_kernels (name)) return;
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+
+  sa = load_stream (env, a);
+  check_stream (env, sa, "copy", exp_copy);
+
+  remix_seek (env, (RemixBase *)sa, skip, SEEK_SET);
+  remix_stream_gain (env, sa, n, 0.5);
+  check_stream (env, sa, "gain", exp_gain);
+  remix_destroy (env, (RemixBase *)sa);
+
+  sa = load_stream (env, a);
+  sb = load_stream (env, b);
+  remix_stream_mix (env, sb, sa, n);
+  check_stream (env, sa, "mix", exp_mix);
+  remix_destroy (env, (RemixBase *)sa);
+
+  sa = load_stream (env, a);
+  remix_seek (env, (RemixBase *)sb, skip, SEEK_SET);
+  remix_stream_mult (env, sb, sa, n);
+  check_stream (env, sa, "mult", exp_mult);
+  remix_destroy (env, (RemixBase *)sa);
+
+  sa = load_stream (env, a);
+  sc = load_stream (env, c);
+  remix_stream_fade (env, sc, sa, n);
+  check_stream (env, sa, "fade", exp_fade);
+  remix_destroy (env, (RemixBase *)sa);
+
+  /* blend b into a by c */
+  sa = load_stream (env, a);
+  remix_seek (env, (RemixBase *)sb, skip, SEEK_SET);
+  remix_seek (env, (RemixBase *)sc, skip, SEEK_SET);
+  remix_stream_blend (env, sb, sc, sa, n);
+  check_stream (env, sa, "blend", exp_blend);
+
+  remix_destroy (env, (RemixBase *)sa);
+  remix_destroy (env, (RemixBase *)sb);
+  remix_destroy (env, (RemixBase *)sc);
+
+  /* ramp: render a linear envelope over a */
+  envelope = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  for (k = 0; k < NR_RAMP_POINTS; k++)
+    remix_envelope_add_point (env, envelope, REMIX_SAMPLES(ramp_x[k]),
+			      ramp_y[k]);
+  sa = load_stream (env, a);
+  remix_seek (env, (RemixBase *)envelope, skip, SEEK_SET);
+  remix_process (env, (RemixBase *)envelope, n, RemixNone, sa);
+  check_stream (env, sa, "ramp", exp_ramp);
+  remix_destroy (env, (RemixBase *)sa);
+
+  /* mult_cubic: apply the linear envelope to a in place */
+  sa = load_stream (env, a);
+  remix_seek (env, (RemixBase *)envelope, skip, SEEK_SET);
+  remix_envelope_mult (env, (RemixBase *)envelope, sa, n);
+  check_stream (env, sa, "mult_ramp", exp_mult_ramp);
+  remix_destroy (env, (RemixBase *)sa);
+
+  /* cubic: the same points as a spline */
+  remix_envelope_set_type (env, envelope, REMIX_ENVELOPE_SPLINE);
+  spline_env = env;
+  spline = envelope;
+  sa = load_stream (env, a);
+  remix_seek (env, (RemixBase *)envelope, skip, SEEK_SET);
+  remix_process (env, (RemixBase *)envelope, n, RemixNone, sa);
+  check_stream (env, sa, "cubic", exp_spline);
+  remix_destroy (env, (RemixBase *)sa);
+
+  sa = load_stream (env, a);
+  remix_seek (env, (RemixBase *)envelope, skip, SEEK_SET);
+  remix_envelope_mult (env, (RemixBase *)envelope, sa, n);
+  check_stream (env, sa, "mult_cubic", exp_mult_cubic);
+  remix_destroy (env, (RemixBase *)sa);
+
+  /* blend_cubic: blend b into a by the spline */
+  sa = load_stream (env, a);
+  sb = load_stream (env, b);
+  remix_seek (env, (RemixBase *)envelope, skip, SEEK_SET);
+  remix_envelope_blend (env, (RemixBase *)envelope, sb, sa, n);
+  check_stream (env, sa, "blend_cubic", exp_blend_cubic);
+  remix_destroy (env, (RemixBase *)sa);
+  remix_destroy (env, (RemixBase *)sb);
+
+  /* Expressions of the spline and a linear envelope of the same points */
+  ramp = remix_envelope_new (env, REMIX_ENVELOPE_LINEAR);
+  for (k = 0; k < NR_RAMP_POINTS; k++)
+    remix_envelope_add_point (env, ramp, REMIX_SAMPLES(ramp_x[k]), ramp_y[k]);
+  check_expr (env, envelope, RemixNone, "copy_mult_cubic",
+	      exp_copy_mult_cubic);
+  check_expr (env, envelope, ramp, "mult_blend_cubic", exp_mult_blend_cubic);
+  check_expr (env, envelope, ramp, "unfused", exp_unfused);
+  remix_destroy (env, (RemixBase *)ramp);
+  remix_destroy (env, (RemixBase *)envelope);
+
+  remix_purge (env);
+}
+
+/*
+ * Interleave a 5.1 stream, whose centre and rear channels are silent
+ * for the first 'skip' frames, with the 'name' kernel set.
+ */
+static void
+test_interleave (char * name, RemixCount skip_frames)
+{
+  RemixEnv * env;
+  RemixStream * stream;
+  CDSet * channels = NULL;
+  CDScalar none;
+  static RemixPCM out6[6*N];
+  RemixPCM e;
+  int i, k;
+  char buf[64];
+
+  snprintf (buf, sizeof (buf), "+ Testing %s 5.1 interleave", name);
+  INFO (buf);
+
+  if (!use_kernels (name)) return;
+  env = remix_init ();
+  none.s_pointer = NULL;
+  for (k = REMIX_CHANNEL_LEFT; k <= REMIX_CHANNEL_REAR_RIGHT; k++)
+    channels = cd_set_insert (env, channels, k, none);
+  remix_set_channels (env, channels);
+  cd_set_free (env, channels);
+
+  stream = remix_stream_new_contiguous (env, N);
+  remix_stream_deinterleave_2 (env, stream, REMIX_CHANNEL_LEFT,
+			       REMIX_CHANNEL_RIGHT, a, N);
+  remix_seek (env, (RemixBase *)stream, skip_frames, SEEK_SET);
+  remix_stream_deinterleave_2 (env, stream, REMIX_CHANNEL_CENTRE,
+			       REMIX_CHANNEL_REAR, &b[2*skip_frames],
+			       N - skip_frames);
+  remix_seek (env, (RemixBase *)stream, skip_frames, SEEK_SET);
+  remix_stream_deinterleave_2 (env, stream, REMIX_CHANNEL_REAR_LEFT,
+			       REMIX_CHANNEL_REAR_RIGHT, &c[2*skip_frames],
+			       N - skip_frames);
+
+  remix_seek (env, (RemixBase *)stream, 0, SEEK_SET);
+  if (remix_stream_interleave (env, stream, out6, N) != N)
+    FAIL ("Interleave failed");
+
+  for (i = 0; i < N; i++) {
+    for (k = 0; k < 6; k++) {
+      if (k < 2) e = a[2*i + k];
+      else if (i < skip_frames) e = 0.0;
+      else if (k < 4) e = b[2*i + k - 2];
+      else e = c[2*i + k - 4];
+      if (out6[6*i + k] != e) {
+	printf ("frame %d channel %d is %f, expected %f\n", i, k,
+		out6[6*i + k], e);
+	FAIL ("Interleave mismatch");
+      }
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)stream);
+  remix_purge (env);
+}
+
+/* The nearest integer to 'x' LSBs, saturated to 'scale' */
+static long
+quantise (RemixPCM x, RemixPCM scale, RemixPCM max)
+{
+  RemixPCM v = x * scale;
+
+  if (v > max) v = max;
+  else if (v < -scale) v = -scale;
+
+  return lrintf (v);
+}
+
+/*
+ * Convert the sound 'a', at up to 1.25 full scale, to each format
+ * undithered and check it exactly; then with each dither, and check
+ * that it stays within the dither's range of the input.
+ */
+static void
+test_convert (char * name)
+{
+  RemixEnv * env;
+  RemixConverter * conv;
+  RemixPCM * planes[2], left[N], right[N], x;
+  static RemixPCM loud[2*N];
+  static short s16[2*N];
+  static unsigned char s24[3*2*N];
+  static int s32[2*N];
+  long e, v;
+  int i, one = 1, big_endian = (*(char *)&one == 0);
+  char buf[64];
+
+  snprintf (buf, sizeof (buf), "+ Testing %s output conversion", name);
+  INFO (buf);
+
+  if (!use_kernels (name)) return;
+  env = remix_init ();
+
+  for (i = 0; i < 2*N; i++)
+    loud[i] = a[i] * 1.25;
+
+  conv = remix_converter_new (env, REMIX_FORMAT_S16, REMIX_DITHER_NONE, 2);
+  remix_convert_interleaved (env, conv, loud, s16, N);
+  for (i = 0; i < 2*N; i++) {
+    if (s16[i] != quantise (loud[i], 32768.0, 32767.0)) {
+      printf ("S16: sample %d of %f is %d\n", i, loud[i], s16[i]);
+      FAIL ("S16 conversion mismatch");
+    }
+  }
+  remix_converter_destroy (env, conv);
+
+  conv = remix_converter_new (env, REMIX_FORMAT_S24, REMIX_DITHER_NONE, 2);
+  remix_convert_interleaved (env, conv, loud, s24, N);
+  for (i = 0; i < 2*N; i++) {
+    if (big_endian)
+      v = (s24[3*i] << 16) | (s24[3*i+1] << 8) | s24[3*i+2];
+    else
+      v = s24[3*i] | (s24[3*i+1] << 8) | (s24[3*i+2] << 16);
+    if (v & 0x800000) v -= 0x1000000;
+    if (v != quantise (loud[i], 8388608.0, 8388607.0)) {
+      printf ("S24: sample %d of %f is %ld\n", i, loud[i], v);
+      FAIL ("S24 conversion mismatch");
+    }
+  }
+  remix_converter_destroy (env, conv);
+
+  /* Planar, with a silent right channel */
+  for (i = 0; i < N; i++)
+    left[i] = loud[2*i];
+  planes[0] = left; planes[1] = NULL;
+  conv = remix_converter_new (env, REMIX_FORMAT_S32, REMIX_DITHER_NONE, 2);
+  remix_convert_planar (env, conv, planes, s32, N);
+  for (i = 0; i < 2*N; i++) {
+    e = (i % 2) ? 0 : quantise (loud[i], 2147483648.0, 2147483520.0);
+    if (s32[i] != e) {
+      printf ("S32: sample %d of %f is %d\n", i, loud[i], s32[i]);
+      FAIL ("S32 conversion mismatch");
+    }
+  }
+  remix_converter_destroy (env, conv);
+
+  /* TPDF dither is within 1 LSB; shaped, the error feedback
+   * adds up to 2.7 times the 1.5 LSB error of each sample */
+  for (i = 0; i < N; i++) {
+    left[i] = a[2*i] * 0.9;
+    right[i] = a[2*i+1] * 0.9;
+  }
+  planes[0] = left; planes[1] = right;
+
+  conv = remix_converter_new (env, REMIX_FORMAT_S16, REMIX_DITHER_TPDF, 2);
+  remix_convert_planar (env, conv, planes, s16, N);
+  for (i = 0; i < 2*N; i++) {
+    x = planes[i % 2][i / 2] * 32768.0;
+    if (fabs (s16[i] - x) > 1.5) {
+      printf ("TPDF: sample %d of %f is %d\n", i, x, s16[i]);
+      FAIL ("Dithered conversion out of range");
+    }
+  }
+  remix_converter_destroy (env, conv);
+
+  conv = remix_converter_new (env, REMIX_FORMAT_S16, REMIX_DITHER_SHAPED, 2);
+  remix_convert_planar (env, conv, planes, s16, N);
+  for (i = 0; i < 2*N; i++) {
+    x = planes[i % 2][i / 2] * 32768.0;
+    if (fabs (s16[i] - x) > 6.0) {
+      printf ("Shaped: sample %d of %f is %d\n", i, x, s16[i]);
+      FAIL ("Noise shaped conversion out of range");
+    }
+  }
+  remix_converter_destroy (env, conv);
+
+  remix_purge (env);
+}
+
+int
+main (int argc, char ** argv)
+{
+  int i;
+
+  for (i = 0; i < 2*N; i++) {
+    a[i] = (RemixPCM)((i * 37) % 101) / 50.0 - 1.0;
+    b[i] = (RemixPCM)((i * 53) % 97) / 48.0 - 1.0;
+    c[i] = (RemixPCM)((i * 11) % 89) / 88.0;
+  }
+
+  /* Kernel sets the CPU does not support are skipped */
+  test_kernels ("scalar", 0);
+  test_kernels ("sse2", 0);
+  test_kernels ("avx2", 0);
+  test_kernels ("avx512", 0);
+
+  /* Starting off a vector boundary, the kernels first align the output */
+  test_kernels ("sse2", 3);
+  test_kernels ("avx2", 5);
+  test_kernels ("avx512", 13);
+
+  test_interleave ("scalar", 0);
+  test_interleave ("sse2", 7);
+  test_interleave ("avx2", 0);
+  test_interleave ("avx512", 19);
+
+  test_convert ("scalar");
+  test_convert ("sse2");
+  test_convert ("avx2");
+  test_convert ("avx512");
+
+  return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * playbacktest.c
+ *
+ * Copyright (C) 2006 Commonwealth Scientific and Industrial Research
+ * Organisation (CSIRO), Australia.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* For slow_source */
+#define __REMIX_PLUGIN__
+#include <remix/remix.h>
+
+#include "tests.h"
+
+#define MIXLENGTH 1024
+#define SOUND_LENGTH 20000
+
+static short frames[2*MIXLENGTH];
+static RemixPCM buf[2*SOUND_LENGTH];
+
+static void
+wait_for_end (RemixEnv * env, RemixPlayback * playback)
+{
+  int i;
+
+  for (i = 0; remix_playback_is_playing (env, playback); i++) {
+    if (i > 500) FAIL ("Playback did not finish");
+    usleep (10000);
+  }
+}
+
+/*
+ * Play a deck of a constant sound to a temporary file at the samplerate,
+ * and check what the simulated device was given.
+ */
+static void
+test_file_device (void)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixStream * source;
+  RemixPlayback * playback;
+  FILE * f;
+  RemixCount n, total = 0, expected_total;
+  short expected;
+  int i;
+
+  INFO ("+ Playing a deck to a file device");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+  remix_set_mixlength (env, MIXLENGTH);
+
+  for (i = 0; i < 2*SOUND_LENGTH; i++)
+    buf[i] = 0.5;
+  source = remix_stream_new_contiguous (env, SOUND_LENGTH);
+  remix_stream_deinterleave_2 (env, source, REMIX_CHANNEL_LEFT,
+			       REMIX_CHANNEL_RIGHT, buf, SOUND_LENGTH);
+  remix_seek (env, (RemixBase *)source, 0, SEEK_SET);
+
+  deck = remix_deck_new (env);
+  track = remix_track_new (env, deck);
+  layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+  remix_sound_new (env, (RemixBase *)source, layer, REMIX_SAMPLES(0),
+		   REMIX_SAMPLES(SOUND_LENGTH));
+
+  f = tmpfile ();
+  playback = remix_playback_new_file (env, (RemixBase *)deck, fileno (f),
+				      1.0);
+  /* Undithered, so that the output is exact */
+  if (remix_playback_set_dither (env, playback, REMIX_DITHER_NONE) !=
+      REMIX_DITHER_TPDF)
+    FAIL ("Playback is not dithered by default");
+  if (remix_playback_start (env, playback) == -1)
+    FAIL ("Could not start playback");
+
+  if (remix_playback_get_env (env, playback) == RemixNone)
+    FAIL ("Playback has no render env");
+
+  wait_for_end (env, playback);
+  remix_playback_stop (env, playback);
+
+  if (remix_playback_get_xruns (env, playback) != 0)
+    WARN ("Playback had xruns");
+  if (remix_playback_get_played (env, playback) != SOUND_LENGTH)
+    FAIL ("Not all frames were played");
+  if (remix_playback_get_fill (env, playback) != 0)
+    FAIL ("Frames were left in the ring");
+  if (remix_playback_get_latency (env, playback) < MIXLENGTH)
+    FAIL ("Latency was not measured");
+
+  /* Whole periods of the sound, then silence to the end of the period */
+  expected_total = (SOUND_LENGTH + MIXLENGTH - 1) / MIXLENGTH * MIXLENGTH;
+  rewind (f);
+  while ((n = fread (frames, 2 * sizeof (short), MIXLENGTH, f)) > 0) {
+    for (i = 0; i < 2*n; i++) {
+      expected = (total + i/2 < SOUND_LENGTH) ? 16384 : 0;
+      if (frames[i] != expected) {
+	printf ("frame %ld is %d, expected %d\n", total + i/2, frames[i],
+		expected);
+	FAIL ("Played output mismatch");
+      }
+    }
+    total += n;
+  }
+
+  if (total != expected_total) {
+    printf ("device got %ld frames, expected %ld\n", total, expected_total);
+    FAIL ("Device was given the wrong number of frames");
+  }
+
+  fclose (f);
+  remix_destroy (env, (RemixBase *)playback);
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)source);
+  remix_purge (env);
+}
+
+static RemixCount
+slow_process (RemixEnv * env, RemixBase * base, RemixCount count,
+	      RemixStream * input, RemixStream * output)
+{
+  usleep (20000);
+  return remix_stream_write0 (env, output, count);
+}
+
+static RemixCount
+slow_length (RemixEnv * env, RemixBase * base)
+{
+  return REMIX_COUNT_INFINITE;
+}
+
+static int
+slow_destroy (RemixEnv * env, RemixBase * base)
+{
+  free (base);
+  return 0;
+}
+
+static struct _RemixMethods slow_methods = {
+  NULL,                      /* clone */
+  slow_destroy,              /* destroy */
+  NULL,                      /* ready */
+  NULL,                      /* prepare */
+  slow_process,              /* process */
+  slow_length,               /* length */
+  NULL,                      /* seek */
+  NULL,                      /* flush */
+};
+
+/*
+ * Play a source that renders slower than real time, and check that the
+ * device underruns rather than waiting for it.
+ */
+static void
+test_xruns (void)
+{
+  RemixEnv * env;
+  RemixBase * source;
+  RemixPlayback * playback;
+  FILE * f;
+
+  INFO ("+ Counting xruns of a slow source");
+
+  env = remix_init ();
+  remix_set_channels (env, REMIX_STEREO);
+  remix_set_mixlength (env, 256);
+
+  source = remix_base_new (env);
+  remix_base_set_methods (env, source, &slow_methods);
+
+  f = tmpfile ();
+  playback = remix_playback_new_file (env, source, fileno (f), 1.0);
+  remix_playback_start (env, playback);
+
+  usleep (300000);
+
+  if (!remix_playback_is_playing (env, playback))
+    FAIL ("Playback of an endless source finished");
+  if (remix_playback_get_xruns (env, playback) == 0)
+    FAIL ("Underruns were not counted");
+
+  remix_playback_stop (env, playback);
+  if (remix_playback_is_playing (env, playback))
+    FAIL ("Playback did not stop");
+
+  fclose (f);
+  remix_destroy (env, (RemixBase *)playback);
+  remix_destroy (env, source);
+  remix_purge (env);
+}
+
+int
+main (int argc, char ** argv)
+{
+  /* Abort on any allocation within remix_process () */
+  setenv ("REMIX_DEBUG_ALLOC", "1", 1);
+
+  test_file_device ();
+
+  test_xruns ();
+
+  return 0;
+}
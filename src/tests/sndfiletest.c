@@ -16,11 +16,42 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <sndfile.h>
 
 #include <remix/remix.h>
 
 #include "tests.h"
 
+#define NR_CHANNELS 6
+
+/* More channels than the interleave kernels take at once */
+#define WIDE_CHANNELS 20
+
+/* Several pages of the page cache, and blocks of the reader */
+#define FILE_FRAMES 50000
+
+/* Longer than the reader's cache of decoded frames */
+#define BIG_READ 20000
+
+#define NR_CLONES 16
+
+/* Sounds of one reader in a deck, and the frames between their starts */
+#define NR_SOUNDS 16
+#define SOUND_SPACING 1237
+#define NR_THREADS 4
+
+/* Frames played at a time with read-ahead */
+#define READ_AHEAD_BLOCK 1024
+
+/* Files are written as 16 bit PCM, with dither */
+#define EPSILON (3.0 / 32768)
+
+static char path[64];
+static RemixPCM frames[NR_CHANNELS * FILE_FRAMES];
+
 static void non_existant_file (void);
 
 static void
@@ -34,7 +65,7 @@ non_existant_file (void)
   CDScalar name;
 
   INFO ("Attempting to read non existant file") ;
-  
+
   env = remix_init ();
   remix_set_tempo (env, 120);
   remix_set_channels (env, REMIX_STEREO);
@@ -49,12 +80,566 @@ non_existant_file (void)
   }
 
   sf1 = remix_new (env, sf_plugin, sf_parms);
+  if (sf1 != RemixNone) {
+    FAIL ("Opened a non existant file");
+  }
+}
+
+/* The value written to channel 'c' of frame 'frame' of the test file */
+static RemixPCM
+file_value (RemixCount frame, int c)
+{
+  return (RemixPCM)((frame * 7 + c * 1013) % 2001 - 1000) / 2048.0;
+}
+
+/* A different value, written over the test file */
+static RemixPCM
+other_value (RemixCount frame, int c)
+{
+  return -file_value (frame, c) / 2;
+}
+
+/*
+ * Returns a new environment with channels 0 to nr_channels-1.
+ */
+static RemixEnv *
+new_env (int nr_channels)
+{
+  RemixEnv * env = remix_init ();
+  CDSet * channels = cd_set_new (env);
+  CDScalar none;
+  int c;
+
+  none.s_pointer = NULL;
+
+  /* Sets are prepended to, so that these end up in order */
+  for (c = nr_channels - 1; c >= 0; c--)
+    channels = cd_set_insert (env, channels, c, none);
+  remix_set_channels (env, channels);
+
+  return env;
+}
+
+static RemixBase *
+open_file (RemixEnv * env, char * identifier)
+{
+  RemixPlugin * sf_plugin;
+  CDSet * sf_parms;
+  RemixBase * sf;
+  CDScalar name;
+
+  sf_plugin = remix_find_plugin (env, identifier);
+  if (sf_plugin == NULL)
+    FAIL ("Could not find sndfile plugin");
+
+  sf_parms = cd_set_new (env);
+  name.s_string = path;
+  sf_parms = cd_set_insert (env, sf_parms,
+			    remix_get_init_parameter_key (env, sf_plugin,
+							  "path"),
+			    name);
+
+  sf = remix_new (env, sf_plugin, sf_parms);
+  if (sf == RemixNone)
+    FAIL ("Could not open test file");
+
+  return sf;
+}
+
+/*
+ * Writes the test file, of NR_CHANNELS channels with the values of
+ * 'value', in blocks of 'block' frames.
+ */
+static void
+write_file (RemixPCM (*value) (RemixCount, int), RemixCount block)
+{
+  RemixEnv * env = new_env (NR_CHANNELS);
+  RemixBase * writer;
+  RemixStream * data;
+  RemixPCM * buffers[NR_CHANNELS];
+  RemixCount offset, n;
+  int c;
+
+  /* The stream takes the buffers, in the order of the channel set */
+  for (c = 0; c < NR_CHANNELS; c++) {
+    buffers[c] = malloc (FILE_FRAMES * sizeof (RemixPCM));
+    for (offset = 0; offset < FILE_FRAMES; offset++)
+      buffers[c][offset] = value (offset, c);
+  }
+
+  data = remix_stream_new_from_buffers (env, FILE_FRAMES, buffers);
+  writer = open_file (env, "builtin::sndfile_writer");
+
+  for (offset = 0; offset < FILE_FRAMES; offset += n) {
+    n = MIN (block, FILE_FRAMES - offset);
+    remix_seek (env, (RemixBase *)data, offset, SEEK_SET);
+    if (remix_process (env, writer, n, RemixNone, data) != n)
+      FAIL ("Short write");
+  }
+
+  remix_destroy (env, writer);
+  remix_destroy (env, (RemixBase *)data);
+  remix_purge (env);
+}
+
+/*
+ * Reads 'count' frames from 'offset' of 'reader' into 'output', whose
+ * channels are the 'nr_names' channels 'names' in increasing order, and
+ * checks them against the test file.
+ */
+static void
+check_read (RemixEnv * env, RemixBase * reader, RemixStream * output,
+	    int * names, int nr_names, RemixCount offset, RemixCount count)
+{
+  RemixCount i, n;
+  int k;
+
+  remix_seek (env, reader, offset, SEEK_SET);
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  n = remix_process (env, reader, count, RemixNone, output);
+  if (n != count) {
+    printf ("read %ld of %ld\n", n, count);
+    FAIL ("Short read");
+  }
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave (env, output, frames, count);
+
+  for (i = 0; i < count; i++) {
+    for (k = 0; k < nr_names; k++) {
+      if (fabs (frames[i * nr_names + k] -
+		file_value (offset + i, names[k])) > EPSILON) {
+	printf ("frame %ld channel %d is %f, expected %f\n", offset + i,
+		names[k], frames[i * nr_names + k],
+		file_value (offset + i, names[k]));
+	FAIL ("Read back wrong data");
+      }
+    }
+  }
+}
+
+/*
+ * Write a multichannel file in blocks of 'block' frames, and read it all
+ * back at once.
+ */
+static void
+test_write_read (RemixCount block)
+{
+  RemixEnv * env;
+  RemixBase * reader;
+  RemixStream * output;
+  int names[NR_CHANNELS], c;
+  char msg[128];
+
+  snprintf (msg, sizeof (msg),
+	    "+ Writing %d channels in blocks of %ld frames, and reading back",
+	    NR_CHANNELS, block);
+  INFO (msg);
+
+  write_file (file_value, block);
+
+  env = new_env (NR_CHANNELS);
+  reader = open_file (env, "builtin::sndfile_reader");
+  if (remix_length (env, reader) != FILE_FRAMES)
+    FAIL ("Read back wrong length");
+
+  for (c = 0; c < NR_CHANNELS; c++)
+    names[c] = c;
+
+  output = remix_stream_new_contiguous (env, FILE_FRAMES);
+  check_read (env, reader, output, names, NR_CHANNELS, 0, FILE_FRAMES);
+
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, reader);
+  remix_purge (env);
+}
+
+/*
+ * Read the file one channel at a time, in a scrambled order, at offsets
+ * that are not block aligned and in chunks longer than the reader's
+ * cache of decoded frames, which must serve every channel regardless.
+ */
+static void
+test_channel_order (void)
+{
+  RemixEnv * env;
+  RemixBase * reader;
+  RemixStream * output;
+  CDSet * channel;
+  CDScalar none;
+  int order[NR_CHANNELS] = {4, 1, 5, 0, 3, 2};
+  RemixCount offsets[] = {0, 12345, 7, FILE_FRAMES - BIG_READ};
+  int k, o;
+
+  INFO ("+ Reading channels out of order in long chunks");
+
+  write_file (file_value, FILE_FRAMES);
+
+  env = new_env (NR_CHANNELS);
+  reader = open_file (env, "builtin::sndfile_reader");
+
+  none.s_pointer = NULL;
+
+  for (o = 0; o < sizeof (offsets) / sizeof (offsets[0]); o++) {
+    for (k = 0; k < NR_CHANNELS; k++) {
+      channel = cd_set_insert (env, cd_set_new (env), order[k], none);
+      remix_set_channels (env, channel);
+      output = remix_stream_new_contiguous (env, BIG_READ);
+      check_read (env, reader, output, &order[k], 1, offsets[o], BIG_READ);
+      remix_destroy (env, (RemixBase *)output);
+    }
+  }
+
+  remix_destroy (env, reader);
+  remix_purge (env);
+}
+
+/*
+ * Reads 'count' frames from 'offset' of 'reader', which decodes on the
+ * I/O thread, into 'output', whose channels are the 'nr_names' channels
+ * 'names' in increasing order. Frames the I/O thread has not decoded yet
+ * are silent; any others must match the test file. Returns TRUE once
+ * every frame has been read.
+ */
+static int
+read_ahead_block (RemixEnv * env, RemixBase * reader, RemixStream * output,
+		  int * names, int nr_names, RemixCount offset,
+		  RemixCount count)
+{
+  RemixPCM v, e;
+  RemixCount i;
+  int k, complete = TRUE;
+
+  remix_seek (env, reader, offset, SEEK_SET);
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  if (remix_process (env, reader, count, RemixNone, output) != count)
+    FAIL ("Short read");
+
+  remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+  remix_stream_interleave (env, output, frames, count);
+
+  for (i = 0; i < count; i++) {
+    for (k = 0; k < nr_names; k++) {
+      v = frames[i * nr_names + k];
+      e = file_value (offset + i, names[k]);
+      if (fabs (v - e) <= EPSILON) continue;
+      if (v != 0.0) {
+	printf ("frame %ld channel %d is %f, expected %f\n", offset + i,
+		names[k], v, e);
+	FAIL ("Read ahead wrong data");
+      }
+      complete = FALSE;
+    }
+  }
+
+  return complete;
+}
+
+/*
+ * Play blocks of the file from a series of offsets with read-ahead
+ * enabled, seeking between them, and check that each block is played
+ * once the I/O thread has caught up, and that nothing else ever is.
+ */
+static void
+test_read_ahead_seek (void)
+{
+  RemixEnv * env;
+  RemixBase * reader;
+  RemixStream * output;
+  RemixCount offsets[] = {0, 30000, 1000, FILE_FRAMES - 3 * READ_AHEAD_BLOCK,
+			  12345};
+  RemixCount offset;
+  int names[NR_CHANNELS], c, o, b, tries;
+
+  INFO ("+ Seeking with read-ahead");
+
+  write_file (file_value, FILE_FRAMES);
+
+  env = new_env (NR_CHANNELS);
+  remix_set_read_ahead (env, 4 * READ_AHEAD_BLOCK);
+  reader = open_file (env, "builtin::sndfile_reader");
+  output = remix_stream_new_contiguous (env, READ_AHEAD_BLOCK);
+
+  for (c = 0; c < NR_CHANNELS; c++)
+    names[c] = c;
+
+  for (o = 0; o < sizeof (offsets) / sizeof (offsets[0]); o++) {
+    for (b = 0; b < 3; b++) {
+      offset = offsets[o] + b * READ_AHEAD_BLOCK;
+      for (tries = 0; !read_ahead_block (env, reader, output, names,
+					 NR_CHANNELS, offset,
+					 READ_AHEAD_BLOCK); tries++) {
+	if (tries > 1000) FAIL ("Read-ahead did not catch up");
+	usleep (1000);
+      }
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, reader);
+  remix_purge (env);
+}
+
+/*
+ * Read the whole file through each of 16 clones of a reader, rewriting it
+ * from another world after the first. The other clones must be served
+ * from the pages the first decoded, and not decode them again.
+ */
+static void
+test_clones (void)
+{
+  RemixEnv * env;
+  RemixBase * reader, * clones[NR_CLONES];
+  RemixStream * output;
+  int names[NR_CHANNELS], c, k;
+
+  INFO ("+ Reading 16 clones of a reader");
+
+  write_file (file_value, FILE_FRAMES);
+
+  env = new_env (NR_CHANNELS);
+  reader = open_file (env, "builtin::sndfile_reader");
+  for (k = 0; k < NR_CLONES; k++)
+    clones[k] = remix_clone_subclass (env, reader);
+
+  for (c = 0; c < NR_CHANNELS; c++)
+    names[c] = c;
+
+  output = remix_stream_new_contiguous (env, FILE_FRAMES);
+  check_read (env, clones[0], output, names, NR_CHANNELS, 0, FILE_FRAMES);
+
+  write_file (other_value, FILE_FRAMES);
+
+  for (k = 1; k < NR_CLONES; k++)
+    check_read (env, clones[k], output, names, NR_CHANNELS, 0, FILE_FRAMES);
+
+  for (k = 0; k < NR_CLONES; k++)
+    remix_destroy (env, clones[k]);
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, reader);
+  remix_purge (env);
+}
+
+/*
+ * Read the file through clones of a reader at different offsets, block
+ * by block, with a cache of only a few pages that they must keep
+ * recycling between them.
+ */
+static void
+test_small_cache (void)
+{
+  RemixEnv * env;
+  RemixBase * reader, * clones[NR_CLONES];
+  RemixStream * output;
+  RemixCount offset;
+  int names[NR_CHANNELS], c, k;
+
+  INFO ("+ Reading clones of a reader through a small cache");
+
+  write_file (file_value, FILE_FRAMES);
+
+  env = new_env (NR_CHANNELS);
+  remix_set_cache_size (env, 4 * 16384 * sizeof (RemixPCM));
+  reader = open_file (env, "builtin::sndfile_reader");
+  for (k = 0; k < NR_CLONES; k++)
+    clones[k] = remix_clone_subclass (env, reader);
+
+  for (c = 0; c < NR_CHANNELS; c++)
+    names[c] = c;
+
+  output = remix_stream_new_contiguous (env, READ_AHEAD_BLOCK);
+
+  for (offset = 0; offset < FILE_FRAMES / 2; offset += READ_AHEAD_BLOCK) {
+    for (k = 0; k < NR_CLONES; k++)
+      check_read (env, clones[k], output, names, NR_CHANNELS,
+		  offset + k * (FILE_FRAMES / 2 / NR_CLONES), READ_AHEAD_BLOCK);
+  }
+
+  for (k = 0; k < NR_CLONES; k++)
+    remix_destroy (env, clones[k]);
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, reader);
+  remix_purge (env);
+}
+
+/*
+ * Play the file from 16 sounds of one reader, on tracks of a deck
+ * rendering with 4 threads, each starting a little after the last. The
+ * sounds read through cursors of the reader at once, and the output must
+ * be the sum of the file at each of their positions. Without the cache,
+ * 'cached' FALSE, every cursor decodes its own pages from the reader.
+ */
+static void
+test_deck_cursors (int cached)
+{
+  RemixEnv * env;
+  RemixDeck * deck;
+  RemixTrack * track;
+  RemixLayer * layer;
+  RemixBase * reader;
+  RemixStream * output;
+  RemixPCM expected;
+  RemixCount i, n, length = FILE_FRAMES + NR_SOUNDS * SOUND_SPACING;
+  char msg[128];
+  int c, j, k;
+
+  snprintf (msg, sizeof (msg),
+	    "+ Playing %d sounds of a reader in a deck, %d threads%s",
+	    NR_SOUNDS, NR_THREADS, cached ? "" : ", no cache");
+  INFO (msg);
+
+  write_file (file_value, FILE_FRAMES);
+
+  env = new_env (NR_CHANNELS);
+  if (!cached) remix_set_cache_size (env, 0);
+  if (remix_set_threads (env, NR_THREADS) == -1)
+    FAIL ("Could not start threads");
+
+  reader = open_file (env, "builtin::sndfile_reader");
+  deck = remix_deck_new (env);
+
+  for (j = 0; j < NR_SOUNDS; j++) {
+    track = remix_track_new (env, deck);
+    layer = remix_layer_new_ontop (env, track, REMIX_TIME_SAMPLES);
+    remix_sound_new (env, reader, layer, REMIX_SAMPLES(j * SOUND_SPACING),
+		     REMIX_SAMPLES(FILE_FRAMES));
+  }
+
+  output = remix_stream_new_contiguous (env, length);
+
+  for (k = 0; k < 3; k++) {
+    remix_seek (env, (RemixBase *)deck, 0, SEEK_SET);
+    remix_seek (env, (RemixBase *)output, 0, SEEK_SET);
+    n = remix_process (env, (RemixBase *)deck, length, RemixNone, output);
+    if (n != length) {
+      printf ("processed %ld of %ld\n", n, length);
+      FAIL ("Deck render was short");
+    }
+
+    for (i = 0; i < length; i += BIG_READ) {
+      n = MIN (BIG_READ, length - i);
+      remix_seek (env, (RemixBase *)output, i, SEEK_SET);
+      remix_stream_interleave (env, output, frames, n);
+
+      for (n--; n >= 0; n--) {
+	for (c = 0; c < NR_CHANNELS; c++) {
+	  expected = 0.0;
+	  for (j = 0; j < NR_SOUNDS; j++) {
+	    if (i + n >= j * SOUND_SPACING &&
+		i + n < j * SOUND_SPACING + FILE_FRAMES)
+	      expected += file_value (i + n - j * SOUND_SPACING, c);
+	  }
+	  if (fabs (frames[n * NR_CHANNELS + c] - expected) >
+	      NR_SOUNDS * EPSILON) {
+	    printf ("frame %ld channel %d is %f, expected %f\n", i + n, c,
+		    frames[n * NR_CHANNELS + c], expected);
+	    FAIL ("Deck played wrong data");
+	  }
+	}
+      }
+    }
+  }
+
+  remix_destroy (env, (RemixBase *)deck);
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, reader);
+  remix_purge (env);
+}
+
+/*
+ * Write a file of WIDE_CHANNELS channels directly with libsndfile, and
+ * read a few of them back, with and without read-ahead. Every channel
+ * is decoded, however few are read.
+ */
+static void
+test_wide_file (int read_ahead)
+{
+  RemixEnv * env;
+  RemixBase * reader;
+  RemixStream * output;
+  CDSet * channels;
+  CDScalar none;
+  SNDFILE * file;
+  SF_INFO info;
+  static float wide[WIDE_CHANNELS * READ_AHEAD_BLOCK];
+  int names[] = {0, 9, 17, WIDE_CHANNELS - 1};
+  int nr_names = sizeof (names) / sizeof (names[0]);
+  RemixCount offset, i;
+  int c, k, tries;
+  char msg[128];
+
+  snprintf (msg, sizeof (msg), "+ Reading a file of %d channels%s",
+	    WIDE_CHANNELS, read_ahead ? ", with read-ahead" : "");
+  INFO (msg);
+
+  info.samplerate = 44100;
+  info.channels = WIDE_CHANNELS;
+  info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+  if ((file = sf_open (path, SFM_WRITE, &info)) == NULL)
+    FAIL ("Could not write wide test file");
+
+  for (offset = 0; offset < FILE_FRAMES; offset += READ_AHEAD_BLOCK) {
+    for (i = 0; i < READ_AHEAD_BLOCK; i++)
+      for (c = 0; c < WIDE_CHANNELS; c++)
+	wide[i * WIDE_CHANNELS + c] = file_value (offset + i, c);
+    sf_writef_float (file, wide, MIN (READ_AHEAD_BLOCK, FILE_FRAMES - offset));
+  }
+  sf_close (file);
+
+  env = remix_init ();
+  channels = cd_set_new (env);
+  none.s_pointer = NULL;
+  for (k = nr_names - 1; k >= 0; k--)
+    channels = cd_set_insert (env, channels, names[k], none);
+  remix_set_channels (env, channels);
+
+  if (read_ahead) remix_set_read_ahead (env, 4 * READ_AHEAD_BLOCK);
+  reader = open_file (env, "builtin::sndfile_reader");
+
+  if (read_ahead) {
+    output = remix_stream_new_contiguous (env, READ_AHEAD_BLOCK);
+    for (tries = 0; !read_ahead_block (env, reader, output, names, nr_names,
+				       0, READ_AHEAD_BLOCK); tries++) {
+      if (tries > 1000) FAIL ("Read-ahead did not catch up");
+      usleep (1000);
+    }
+  } else {
+    output = remix_stream_new_contiguous (env, FILE_FRAMES);
+    check_read (env, reader, output, names, nr_names, 0, FILE_FRAMES);
+  }
+
+  remix_destroy (env, (RemixBase *)output);
+  remix_destroy (env, reader);
+  remix_purge (env);
 }
 
 int
 main (int argc, char ** argv)
 {
+  /* Abort on any allocation within remix_process () */
+  setenv ("REMIX_DEBUG_ALLOC", "1", 1);
+
+  snprintf (path, sizeof (path), "sndfiletest-%d.wav", (int)getpid ());
+
   non_existant_file () ;
 
+  test_write_read (1000);
+  test_write_read (FILE_FRAMES);
+
+  test_channel_order ();
+
+  test_read_ahead_seek ();
+
+  test_clones ();
+  test_small_cache ();
+
+  test_deck_cursors (TRUE);
+  test_deck_cursors (FALSE);
+
+  test_wide_file (FALSE);
+  test_wide_file (TRUE);
+
+  unlink (path);
+
   return 0;
 }